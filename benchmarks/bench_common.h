@@ -0,0 +1,217 @@
+/**
+ * Created by jraynor on 8/3/2024.
+ */
+#pragma once
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "clib/defines.h"
+#include "clib/time_lib.h"
+
+#if defined(CL_PLATFORM_WINDOWS)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(CL_PLATFORM_APPLE)
+#include <mach/mach.h>
+#endif
+
+#ifndef CLIB_VERSION
+#define CLIB_VERSION "unknown"
+#endif
+
+#define BENCH_QUICK_DIVISOR 10
+
+typedef enum bench_format
+{
+    BENCH_FORMAT_TABLE,
+    BENCH_FORMAT_CSV,
+    BENCH_FORMAT_JSON,
+} bench_format_t;
+
+typedef struct bench_options
+{
+    const char *name; // Benchmark target, reported in the JSON header
+    const char *subject_label; // Column naming what is measured, e.g. "allocator"
+    const char *size_label; // Column naming the size parameter, e.g. "size" or "entries"
+    bench_format_t format;
+    u64 divisor; // Every iteration count is divided by this
+    const char *filter; // Only runs whose pattern or subject contains this
+    u64 max_size; // Largest size parameter to run, 0 for the benchmark's default
+    u32 results; // Rows printed so far
+} bench_options_t;
+
+typedef struct bench_result
+{
+    const char *pattern;
+    const char *subject;
+    u64 size;
+    u32 threads;
+    u64 ops;
+    f64 ns_per_op;
+    u64 rss_kb; // Resident set with the workload's data still live
+    u64 peak_kb; // High-water mark of the resident set since the run started
+} bench_result_t;
+
+static inline u64 bench_now_ns(void)
+{
+    cl_time_t now;
+    cl_time_get_current(&now);
+    return (u64)now.seconds * 1000000000ull + (u64)now.nanoseconds;
+}
+
+static inline u32 bench_random(u32 *state)
+{
+    u32 x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static inline u64 bench_random_size(u32 *state, u64 min_size, u64 max_size)
+{
+    return min_size + bench_random(state) % (max_size - min_size + 1);
+}
+
+// Starts a new high-water mark where the OS allows it (Linux); elsewhere the peak covers the whole process
+static inline void bench_reset_peak(void)
+{
+#if defined(CL_PLATFORM_LINUX)
+    FILE *file = fopen("/proc/self/clear_refs", "w");
+    if (file != null)
+    {
+        fputs("5", file);
+        fclose(file);
+    }
+#endif
+}
+
+static inline void bench_memory_usage(u64 *rss_kb, u64 *peak_kb)
+{
+    *rss_kb = 0;
+    *peak_kb = 0;
+#if defined(CL_PLATFORM_LINUX)
+    FILE *file = fopen("/proc/self/status", "r");
+    if (file == null)
+        return;
+    char line[256];
+    while (fgets(line, sizeof(line), file))
+    {
+        unsigned long long value;
+        if (sscanf(line, "VmRSS: %llu", &value) == 1)
+            *rss_kb = value;
+        else if (sscanf(line, "VmHWM: %llu", &value) == 1)
+            *peak_kb = value;
+    }
+    fclose(file);
+#elif defined(CL_PLATFORM_APPLE)
+    mach_task_basic_info_data_t info;
+    mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+    if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO, (task_info_t)&info, &count) == KERN_SUCCESS)
+    {
+        *rss_kb = info.resident_size / 1024;
+        *peak_kb = info.resident_size_max / 1024;
+    }
+#elif defined(CL_PLATFORM_WINDOWS)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        *rss_kb = counters.WorkingSetSize / 1024;
+        *peak_kb = counters.PeakWorkingSetSize / 1024;
+    }
+#endif
+}
+
+static inline bool bench_selected(const bench_options_t *options, const char *pattern, const char *subject)
+{
+    return options->filter == null || strstr(pattern, options->filter) || strstr(subject, options->filter);
+}
+
+// Parses the options every benchmark shares; returns false after printing usage for anything else
+static inline bool bench_parse_options(bench_options_t *options, int argc, char **argv, int *exit_code)
+{
+    options->format = BENCH_FORMAT_TABLE;
+    options->divisor = 1;
+    options->filter = null;
+    options->max_size = 0;
+    options->results = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--format=table") == 0)
+            options->format = BENCH_FORMAT_TABLE;
+        else if (strcmp(argv[i], "--format=csv") == 0)
+            options->format = BENCH_FORMAT_CSV;
+        else if (strcmp(argv[i], "--format=json") == 0)
+            options->format = BENCH_FORMAT_JSON;
+        else if (strcmp(argv[i], "--quick") == 0)
+            options->divisor = BENCH_QUICK_DIVISOR;
+        else if (strncmp(argv[i], "--filter=", 9) == 0)
+            options->filter = argv[i] + 9;
+        else if (strncmp(argv[i], "--max-size=", 11) == 0)
+            options->max_size = strtoull(argv[i] + 11, null, 10);
+        else
+        {
+            printf("Usage: %s [--format=table|csv|json] [--quick] [--filter=<name>] [--max-size=<n>]\n"
+                   "  --format    table by default; csv and json are meant for tracking results between releases\n"
+                   "  --quick     divide every iteration count by %d\n"
+                   "  --filter    only run patterns or %ss whose name contains <name>\n"
+                   "  --max-size  largest %s to run, where the benchmark sweeps over it\n",
+                   argv[0], BENCH_QUICK_DIVISOR, options->subject_label, options->size_label);
+            *exit_code = strcmp(argv[i], "--help") == 0 ? 0 : 1;
+            return false;
+        }
+    }
+    return true;
+}
+
+static inline void bench_begin(const bench_options_t *options, const char *details)
+{
+    if (options->format == BENCH_FORMAT_JSON)
+        printf("{\n  \"benchmark\": \"%s\",\n  \"version\": \"%s\",\n  %s,\n  \"results\": [", options->name,
+               CLIB_VERSION, details);
+    else if (options->format == BENCH_FORMAT_TABLE)
+        printf("clib %s %s (%s)\n\n", CLIB_VERSION, options->name, details);
+}
+
+static inline int bench_end(const bench_options_t *options, int failures)
+{
+    if (options->format == BENCH_FORMAT_JSON)
+        printf("\n  ],\n  \"failures\": %d\n}\n", failures);
+    else if (failures > 0)
+        fprintf(stderr, "%d benchmark runs failed\n", failures);
+    return failures > 0 ? 1 : 0;
+}
+
+static inline void bench_report(bench_options_t *options, const bench_result_t *result)
+{
+    switch (options->format)
+    {
+        case BENCH_FORMAT_TABLE:
+            if (options->results == 0)
+                printf("%-18s %-20s %10s %7s %11s %10s %10s %10s\n", "pattern", options->subject_label,
+                       options->size_label, "threads", "ops", "ns/op", "rss_kb", "peak_kb");
+            printf("%-18s %-20s %10llu %7u %11llu %10.2f %10llu %10llu\n", result->pattern, result->subject,
+                   (unsigned long long)result->size, result->threads, (unsigned long long)result->ops,
+                   result->ns_per_op, (unsigned long long)result->rss_kb, (unsigned long long)result->peak_kb);
+            break;
+        case BENCH_FORMAT_CSV:
+            if (options->results == 0)
+                printf("pattern,%s,%s,threads,ops,ns_per_op,rss_kb,peak_kb\n", options->subject_label,
+                       options->size_label);
+            printf("%s,%s,%llu,%u,%llu,%.3f,%llu,%llu\n", result->pattern, result->subject,
+                   (unsigned long long)result->size, result->threads, (unsigned long long)result->ops,
+                   result->ns_per_op, (unsigned long long)result->rss_kb, (unsigned long long)result->peak_kb);
+            break;
+        case BENCH_FORMAT_JSON:
+            printf("%s\n    {\"pattern\": \"%s\", \"%s\": \"%s\", \"%s\": %llu, \"threads\": %u, \"ops\": %llu, "
+                   "\"ns_per_op\": %.3f, \"rss_kb\": %llu, \"peak_kb\": %llu}",
+                   options->results == 0 ? "" : ",", result->pattern, options->subject_label, result->subject,
+                   options->size_label, (unsigned long long)result->size, result->threads,
+                   (unsigned long long)result->ops, result->ns_per_op, (unsigned long long)result->rss_kb,
+                   (unsigned long long)result->peak_kb);
+            break;
+    }
+    fflush(stdout);
+    options->results++;
+}
@@ -0,0 +1,222 @@
+/**
+ * Created by jraynor on 8/6/2024.
+ */
+#include <stdatomic.h>
+#include <stdlib.h>
+#include "bench_common.h"
+#include "clib/containers_lib.h"
+#include "clib/thread_lib.h"
+
+#define BENCH_CHT_KEYS 1000000 // Key space shared by every thread; half of it is present when a run starts
+#define BENCH_CHT_OPS 4000000 // Operations per run, split between the threads
+#define BENCH_CHT_MAX_THREADS 64
+
+typedef struct bench_mix
+{
+    const char *name;
+    u32 get_percent; // The remaining operations are split evenly between put and remove
+} bench_mix_t;
+
+static const bench_mix_t bench_mixes[] = {
+    {"read_only", 100},
+    {"read_heavy", 90},
+    {"write_heavy", 10},
+};
+
+// The baseline is what callers do today: one cl_ht whose own mutex wraps every operation
+typedef enum bench_subject
+{
+    BENCH_SUBJECT_HT_MUTEX,
+    BENCH_SUBJECT_CHT,
+    BENCH_SUBJECT_RMHT,
+} bench_subject_t;
+
+static const char *bench_subject_names[] = {"ht_mutex", "cht", "rmht"};
+
+typedef struct bench_table
+{
+    bench_subject_t subject;
+    cl_ht_t *ht;
+    cl_cht_t *cht;
+    cl_rmht_t *rmht;
+} bench_table_t;
+
+static bool bench_table_get(bench_table_t *table, const u64 *key)
+{
+    if (table->subject == BENCH_SUBJECT_CHT)
+        return cl_cht_exists(table->cht, key, sizeof(u64));
+    if (table->subject == BENCH_SUBJECT_RMHT)
+        return cl_rmht_exists(table->rmht, key, sizeof(u64));
+    cl_ht_lock(table->ht);
+    const bool found = cl_ht_exists(table->ht, key, sizeof(u64));
+    cl_ht_unlock(table->ht);
+    return found;
+}
+
+static bool bench_table_put(bench_table_t *table, const u64 *key)
+{
+    if (table->subject == BENCH_SUBJECT_CHT)
+        return cl_cht_put(table->cht, key, sizeof(u64), (void *)key, sizeof(u64), null);
+    if (table->subject == BENCH_SUBJECT_RMHT)
+        return cl_rmht_put(table->rmht, key, sizeof(u64), (void *)key, sizeof(u64), null);
+    cl_ht_lock(table->ht);
+    const bool ok = cl_ht_put(table->ht, key, sizeof(u64), (void *)key, sizeof(u64), null);
+    cl_ht_unlock(table->ht);
+    return ok;
+}
+
+static void bench_table_remove(bench_table_t *table, const u64 *key)
+{
+    if (table->subject == BENCH_SUBJECT_CHT)
+    {
+        cl_cht_remove(table->cht, key, sizeof(u64));
+        return;
+    }
+    if (table->subject == BENCH_SUBJECT_RMHT)
+    {
+        cl_rmht_remove(table->rmht, key, sizeof(u64));
+        return;
+    }
+    cl_ht_lock(table->ht);
+    cl_ht_remove(table->ht, key, sizeof(u64));
+    cl_ht_unlock(table->ht);
+}
+
+typedef struct bench_worker
+{
+    bench_table_t *table;
+    const u64 *keys;
+    u64 key_count;
+    u64 ops;
+    u32 get_percent;
+    u32 seed;
+    atomic_uint *ready; // Workers check in here, then wait for start
+    atomic_bool *start;
+    bool failed;
+} bench_worker_t;
+
+static void *bench_worker(void *arg)
+{
+    bench_worker_t *worker = (bench_worker_t *)arg;
+    u32 seed = worker->seed;
+    atomic_fetch_add(worker->ready, 1);
+    while (!atomic_load_explicit(worker->start, memory_order_acquire))
+        cl_thread_yield();
+
+    for (u64 i = 0; i < worker->ops; i++)
+    {
+        const u32 roll = bench_random(&seed) % 100;
+        const u64 *key = &worker->keys[bench_random(&seed) % worker->key_count];
+        if (roll < worker->get_percent)
+            bench_table_get(worker->table, key);
+        else if ((roll - worker->get_percent) % 2 == 0)
+            worker->failed |= !bench_table_put(worker->table, key);
+        else
+            bench_table_remove(worker->table, key);
+    }
+    return null;
+}
+
+static bool bench_run(bench_subject_t subject, const bench_mix_t *mix, u32 threads, const u64 *keys, u64 key_count,
+                      u64 ops, bench_result_t *result)
+{
+    // Every table copies its keys, as the read-mostly table always does, and the baseline uses the shards' layout
+    const cl_ht_flags_t flags = CL_HT_FLAG_GROUP_PROBING;
+    bench_table_t table = {.subject = subject};
+    if (subject == BENCH_SUBJECT_CHT)
+        table.cht = cl_cht_create(null, 0, flags);
+    else if (subject == BENCH_SUBJECT_RMHT)
+        table.rmht = cl_rmht_create(null);
+    else
+        table.ht = cl_ht_create_with_flags(null, flags);
+    if (table.ht == null && table.cht == null && table.rmht == null)
+        return false;
+
+    bench_reset_peak();
+    bool ok = true;
+    for (u64 i = 0; i < key_count; i += 2)
+        ok &= bench_table_put(&table, &keys[i]);
+
+    atomic_uint ready;
+    atomic_bool start;
+    atomic_init(&ready, 0);
+    atomic_init(&start, false);
+    bench_worker_t workers[BENCH_CHT_MAX_THREADS];
+    cl_thread_t *handles[BENCH_CHT_MAX_THREADS];
+    u32 started = 0;
+    for (u32 i = 0; i < threads && ok; i++, started++)
+    {
+        workers[i] = (bench_worker_t){.table = &table, .keys = keys, .key_count = key_count, .ops = ops / threads,
+                                      .get_percent = mix->get_percent, .seed = 0x9E3779B9u * (i + 1),
+                                      .ready = &ready, .start = &start};
+        handles[i] = cl_thread_create(bench_worker, &workers[i], CL_THREAD_FLAG_NONE);
+        ok = handles[i] != null;
+    }
+
+    // Time from the moment every worker is waiting, so thread creation stays out of the measurement
+    while (ok && atomic_load(&ready) < threads)
+        cl_thread_yield();
+    const u64 begin = bench_now_ns();
+    atomic_store_explicit(&start, true, memory_order_release);
+    for (u32 i = 0; i < started; i++)
+    {
+        if (handles[i] == null)
+            continue;
+        cl_thread_join(handles[i], null);
+        cl_thread_destroy(handles[i]);
+        ok &= !workers[i].failed;
+    }
+    const u64 elapsed = bench_now_ns() - begin;
+
+    const u64 total = ops / threads * threads;
+    *result = (bench_result_t){.pattern = mix->name, .subject = bench_subject_names[subject], .size = key_count,
+                               .threads = threads, .ops = total, .ns_per_op = (f64)elapsed / (f64)total};
+    bench_memory_usage(&result->rss_kb, &result->peak_kb);
+
+    cl_cht_destroy(table.cht);
+    cl_rmht_destroy(table.rmht);
+    cl_ht_destroy(table.ht);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    bench_options_t options = {.name = "clib_bench_cht", .subject_label = "table", .size_label = "keys"};
+    int exit_code;
+    if (!bench_parse_options(&options, argc, argv, &exit_code))
+        return exit_code;
+
+    const u64 key_count = options.max_size > 0 ? options.max_size : BENCH_CHT_KEYS / options.divisor;
+    const u64 ops = BENCH_CHT_OPS / options.divisor;
+    u64 *keys = malloc(key_count * sizeof(u64));
+    if (keys == null)
+    {
+        fprintf(stderr, "Failed to allocate %llu keys\n", (unsigned long long)key_count);
+        return 1;
+    }
+    for (u64 i = 0; i < key_count; i++)
+        keys[i] = i * 0x9E3779B97F4A7C15ull;
+
+    // ns/op is wall time over every thread's operations, so a table that scales shows it falling as threads rise
+    bench_begin(&options, "\"keys\": \"u64\", \"ns_per_op\": \"wall time / total ops\"");
+    int failures = 0;
+    for (u32 m = 0; m < sizeof(bench_mixes) / sizeof(bench_mixes[0]); m++)
+    {
+        for (u32 s = 0; s < sizeof(bench_subject_names) / sizeof(bench_subject_names[0]); s++)
+        {
+            if (!bench_selected(&options, bench_mixes[m].name, bench_subject_names[s]))
+                continue;
+            for (u32 threads = 1; threads <= BENCH_CHT_MAX_THREADS; threads *= 2)
+            {
+                bench_result_t result;
+                if (bench_run((bench_subject_t)s, &bench_mixes[m], threads, keys, key_count, ops, &result))
+                    bench_report(&options, &result);
+                else
+                    failures++;
+            }
+        }
+    }
+
+    free(keys);
+    return bench_end(&options, failures);
+}
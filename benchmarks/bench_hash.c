@@ -0,0 +1,253 @@
+/**
+ * Created by jraynor on 8/6/2024.
+ */
+#include <stdlib.h>
+#include "bench_common.h"
+#include "clib/containers_lib.h"
+
+#define BENCH_HASH_BUFFER (1 << 16) // Speed runs start their keys anywhere in this much random data, kept in cache
+#define BENCH_HASH_MAX_LENGTH 65536
+#define BENCH_HASH_BYTES (1ull << 30) // Bytes hashed per speed run
+#define BENCH_HASH_MAX_OPS 50000000 // Hashes per speed run for the shortest keys
+#define BENCH_HASH_COLLISION_BITS 20 // Counter keys hashed for the collision counts, and the buckets they go into
+#define BENCH_HASH_COLLISION_BYTES (1ull << 28) // Fewer counter keys for long lengths
+#define BENCH_HASH_AVALANCHE_TRIALS 2000 // Random keys per flipped input bit
+#define BENCH_HASH_AVALANCHE_BITS 512 // Input bits flipped, spread over the key
+
+typedef struct bench_hash
+{
+    const char *name;
+    u64 (*hash)(const void *data, u64 length, u64 seed);
+    u64 only_length; // 0 for any length
+} bench_hash_t;
+
+static u64 bench_mix64(const void *data, u64 length, u64 seed)
+{
+    (void)length;
+    u64 key;
+    memcpy(&key, data, sizeof(key));
+    return cl_hash_u64(key ^ seed);
+}
+
+// xxh64 with seed 0 is the hash cl_ht used before cl_hash_wy
+static const bench_hash_t bench_hashes[] = {
+    {"wy", cl_hash_wy, 0},
+    {"xxh64", cl_hash_xxh64, 0},
+    {"mix64", bench_mix64, 8},
+};
+
+static const u64 bench_lengths[] = {4, 8, 16, 32, 64, 256, 1024, BENCH_HASH_MAX_LENGTH};
+
+typedef struct bench_hash_row
+{
+    const char *hash;
+    u64 key_bytes;
+    f64 ns_per_hash;
+    f64 gb_per_s;
+    u64 collisions; // Full 64-bit collisions between counter keys
+    f64 low_ratio; // Low-bit bucket collisions over the number a random function gives; 1.0 is ideal
+    f64 high_ratio; // The same for the top bits
+    f64 avalanche_mean; // Mean |2 * P(output bit flips) - 1| over input/output bit pairs; 0 is ideal
+    f64 avalanche_max;
+} bench_hash_row_t;
+
+static void bench_hash_report(bench_options_t *options, const bench_hash_row_t *row)
+{
+    switch (options->format)
+    {
+        case BENCH_FORMAT_TABLE:
+            if (options->results == 0)
+                printf("%-8s %9s %11s %9s %10s %9s %10s %8s %8s\n", "hash", "key_bytes", "ns_per_hash", "gb_per_s",
+                       "collisions", "low_ratio", "high_ratio", "aval_avg", "aval_max");
+            printf("%-8s %9llu %11.2f %9.2f %10llu %9.3f %10.3f %8.4f %8.4f\n", row->hash,
+                   (unsigned long long)row->key_bytes, row->ns_per_hash, row->gb_per_s,
+                   (unsigned long long)row->collisions, row->low_ratio, row->high_ratio, row->avalanche_mean,
+                   row->avalanche_max);
+            break;
+        case BENCH_FORMAT_CSV:
+            if (options->results == 0)
+                printf("hash,key_bytes,ns_per_hash,gb_per_s,collisions,low_ratio,high_ratio,aval_avg,aval_max\n");
+            printf("%s,%llu,%.3f,%.3f,%llu,%.4f,%.4f,%.5f,%.5f\n", row->hash, (unsigned long long)row->key_bytes,
+                   row->ns_per_hash, row->gb_per_s, (unsigned long long)row->collisions, row->low_ratio,
+                   row->high_ratio, row->avalanche_mean, row->avalanche_max);
+            break;
+        case BENCH_FORMAT_JSON:
+            printf("%s\n    {\"hash\": \"%s\", \"key_bytes\": %llu, \"ns_per_hash\": %.3f, \"gb_per_s\": %.3f, "
+                   "\"collisions\": %llu, \"low_ratio\": %.4f, \"high_ratio\": %.4f, \"aval_avg\": %.5f, "
+                   "\"aval_max\": %.5f}",
+                   options->results == 0 ? "" : ",", row->hash, (unsigned long long)row->key_bytes,
+                   row->ns_per_hash, row->gb_per_s, (unsigned long long)row->collisions, row->low_ratio,
+                   row->high_ratio, row->avalanche_mean, row->avalanche_max);
+            break;
+    }
+    fflush(stdout);
+    options->results++;
+}
+
+static void bench_hash_speed(const bench_hash_t *hash, const u8 *buffer, u64 length, u64 divisor,
+                             bench_hash_row_t *row)
+{
+    u64 ops = BENCH_HASH_BYTES / length;
+    ops = (ops < BENCH_HASH_MAX_OPS ? ops : BENCH_HASH_MAX_OPS) / divisor;
+    // Each key starts where the previous hash points, so the hashes cannot overlap and every one is timed in full
+    u64 sink = 0;
+    const u64 start = bench_now_ns();
+    for (u64 i = 0; i < ops; i++)
+        sink = hash->hash(buffer + ((sink + i * 64) & (BENCH_HASH_BUFFER - 1)), length, 0);
+    const u64 elapsed = bench_now_ns() - start;
+    row->ns_per_hash = (f64)elapsed / (f64)ops;
+    row->gb_per_s = (f64)(ops * length) / (f64)elapsed;
+    if (sink == 1)
+        printf(" ");
+}
+
+static int bench_compare_u64(const void *a, const void *b)
+{
+    const u64 x = *(const u64 *)a, y = *(const u64 *)b;
+    return x < y ? -1 : x > y;
+}
+
+// Extra hashes in the same bucket, when count hashes go into buckets by their bits at shift
+static u64 bench_bucket_collisions(const u64 *hashes, u64 count, u32 bits, u32 shift, u8 *buckets)
+{
+    const u64 mask = (1ull << bits) - 1;
+    memset(buckets, 0, (size_t)1 << bits);
+    u64 collisions = 0;
+    for (u64 i = 0; i < count; i++)
+    {
+        const u64 bucket = (hashes[i] >> shift) & mask;
+        collisions += buckets[bucket];
+        buckets[bucket] = 1;
+    }
+    return collisions;
+}
+
+// Keys are little-endian counters padded with zeros, the kind of structured input a weak hash clusters
+static void bench_hash_collisions(const bench_hash_t *hash, u64 length, u64 divisor, u64 *hashes, u8 *buckets,
+                                  bench_hash_row_t *row)
+{
+    u64 count = 1ull << BENCH_HASH_COLLISION_BITS;
+    if (count * length > BENCH_HASH_COLLISION_BYTES)
+        count = BENCH_HASH_COLLISION_BYTES / length;
+    count /= divisor;
+    u8 *key = calloc(length, 1);
+    if (key == null)
+        return;
+    for (u64 i = 0; i < count; i++)
+    {
+        memcpy(key, &i, length < sizeof(i) ? length : sizeof(i));
+        hashes[i] = hash->hash(key, length, 0);
+    }
+    free(key);
+
+    // About as many buckets as keys, so there are enough collisions to compare at every length
+    u32 bits = 1;
+    while (bits < BENCH_HASH_COLLISION_BITS && (2ull << bits) <= count)
+        bits++;
+    const f64 buckets_count = (f64)(1ull << bits);
+    // A random function leaves each bucket empty with probability (1 - 1/buckets)^count
+    f64 empty = 1.0;
+    for (u64 i = 0; i < count; i++)
+        empty *= 1.0 - 1.0 / buckets_count;
+    const f64 expected = (f64)count - buckets_count * (1.0 - empty);
+    row->low_ratio = (f64)bench_bucket_collisions(hashes, count, bits, 0, buckets) / expected;
+    row->high_ratio = (f64)bench_bucket_collisions(hashes, count, bits, 64 - bits, buckets) / expected;
+
+    qsort(hashes, count, sizeof(u64), bench_compare_u64);
+    row->collisions = 0;
+    for (u64 i = 1; i < count; i++)
+        row->collisions += hashes[i] == hashes[i - 1];
+}
+
+static void bench_hash_avalanche(const bench_hash_t *hash, u64 length, u64 divisor, bench_hash_row_t *row)
+{
+    const u64 input_bits = length * 8;
+    const u64 step = input_bits > BENCH_HASH_AVALANCHE_BITS ? input_bits / BENCH_HASH_AVALANCHE_BITS : 1;
+    const u64 flipped = input_bits / step;
+    const u64 trials = BENCH_HASH_AVALANCHE_TRIALS / divisor;
+    u32 *flips = calloc(flipped * 64, sizeof(u32));
+    u8 *key = malloc(length);
+    if (flips == null || key == null)
+    {
+        free(flips);
+        free(key);
+        return;
+    }
+
+    u32 seed = 0x2545F491u;
+    for (u64 t = 0; t < trials; t++)
+    {
+        for (u64 i = 0; i < length; i++)
+            key[i] = (u8)bench_random(&seed);
+        const u64 base = hash->hash(key, length, 0);
+        for (u64 f = 0; f < flipped; f++)
+        {
+            const u64 bit = f * step;
+            key[bit / 8] ^= (u8)(1u << (bit % 8));
+            const u64 diff = base ^ hash->hash(key, length, 0);
+            key[bit / 8] ^= (u8)(1u << (bit % 8));
+            for (u32 o = 0; o < 64; o++)
+                flips[f * 64 + o] += (diff >> o) & 1;
+        }
+    }
+
+    f64 sum = 0.0;
+    row->avalanche_max = 0.0;
+    for (u64 i = 0; i < flipped * 64; i++)
+    {
+        const f64 signed_bias = 2.0 * (f64)flips[i] / (f64)trials - 1.0;
+        const f64 bias = signed_bias < 0 ? -signed_bias : signed_bias;
+        sum += bias;
+        row->avalanche_max = bias > row->avalanche_max ? bias : row->avalanche_max;
+    }
+    row->avalanche_mean = sum / (f64)(flipped * 64);
+    free(flips);
+    free(key);
+}
+
+int main(int argc, char **argv)
+{
+    bench_options_t options = {.name = "clib_bench_hash", .subject_label = "hash", .size_label = "key_bytes"};
+    int exit_code;
+    if (!bench_parse_options(&options, argc, argv, &exit_code))
+        return exit_code;
+
+    u8 *buffer = malloc(BENCH_HASH_BUFFER + BENCH_HASH_MAX_LENGTH);
+    u64 *hashes = malloc(sizeof(u64) << BENCH_HASH_COLLISION_BITS);
+    u8 *buckets = malloc((size_t)1 << BENCH_HASH_COLLISION_BITS);
+    if (buffer == null || hashes == null || buckets == null)
+    {
+        fprintf(stderr, "Failed to allocate benchmark buffers\n");
+        free(buffer);
+        free(hashes);
+        free(buckets);
+        return 1;
+    }
+    u32 seed = 0x9E3779B9u;
+    for (u64 i = 0; i < BENCH_HASH_BUFFER + BENCH_HASH_MAX_LENGTH; i++)
+        buffer[i] = (u8)bench_random(&seed);
+
+    // Avalanche noise shrinks with the trial count: with 2000 trials a perfect hash still shows about 0.018 on average
+    bench_begin(&options, "\"gb_per_s\": \"bytes hashed / ns\", \"ratios\": \"bucket collisions / random\"");
+    for (u32 l = 0; l < sizeof(bench_lengths) / sizeof(bench_lengths[0]); l++)
+    {
+        const u64 length = options.max_size > 0 && bench_lengths[l] > options.max_size ? 0 : bench_lengths[l];
+        for (u32 h = 0; h < sizeof(bench_hashes) / sizeof(bench_hashes[0]) && length > 0; h++)
+        {
+            const bench_hash_t *hash = &bench_hashes[h];
+            if ((hash->only_length != 0 && hash->only_length != length) ||
+                !bench_selected(&options, "hash", hash->name))
+                continue;
+            bench_hash_row_t row = {.hash = hash->name, .key_bytes = length};
+            bench_hash_speed(hash, buffer, length, options.divisor, &row);
+            bench_hash_collisions(hash, length, options.divisor, hashes, buckets, &row);
+            bench_hash_avalanche(hash, length, options.divisor, &row);
+            bench_hash_report(&options, &row);
+        }
+    }
+
+    free(buffer);
+    free(hashes);
+    free(buckets);
+    return bench_end(&options, 0);
+}
@@ -0,0 +1,273 @@
+/**
+ * Created by jraynor on 8/6/2024.
+ */
+#include <stdlib.h>
+#include "bench_common.h"
+#include "clib/containers_lib.h"
+
+#define BENCH_HT_MIN_ENTRIES 1000
+#define BENCH_HT_MAX_ENTRIES 10000000 // Default top of the sweep; --max-size=100000000 runs 100M with enough memory
+#define BENCH_HT_MIN_OPS 1000000 // Small tables repeat their work until at least this many operations ran
+#define BENCH_HT_BATCH 64 // Keys per cl_ht_get_batch call in lookup_batch
+
+typedef struct bench_table
+{
+    const char *name;
+    cl_ht_flags_t flags;
+    bool perfect; // Frozen with cl_ht_freeze_perfect once built; its inserts include the freeze
+} bench_table_t;
+
+// Keys are u64s owned by the benchmark, so most tables skip their per-key copies and only the probing is measured; the
+// _copy and _arena tables copy every key, one allocation each or into the table's key arena
+static const bench_table_t bench_tables[] = {
+    {"robin_hood", CL_HT_FLAG_NOCOPY_KEYS | CL_HT_FLAG_NO_LOCKING, false},
+    {"group", CL_HT_FLAG_NOCOPY_KEYS | CL_HT_FLAG_NO_LOCKING | CL_HT_FLAG_GROUP_PROBING, false},
+    {"robin_hood_incr", CL_HT_FLAG_NOCOPY_KEYS | CL_HT_FLAG_NO_LOCKING | CL_HT_FLAG_INCREMENTAL_RESIZE, false},
+    {"group_incr",
+     CL_HT_FLAG_NOCOPY_KEYS | CL_HT_FLAG_NO_LOCKING | CL_HT_FLAG_GROUP_PROBING | CL_HT_FLAG_INCREMENTAL_RESIZE, false},
+    {"group_copy", CL_HT_FLAG_NO_LOCKING | CL_HT_FLAG_GROUP_PROBING, false},
+    {"group_arena", CL_HT_FLAG_NO_LOCKING | CL_HT_FLAG_GROUP_PROBING | CL_HT_FLAG_KEY_ARENA, false},
+    {"perfect", CL_HT_FLAG_NOCOPY_KEYS | CL_HT_FLAG_NO_LOCKING | CL_HT_FLAG_GROUP_PROBING, true},
+};
+
+static inline u64 bench_key(u64 i)
+{
+    // splitmix64: distinct inputs give distinct, well spread keys
+    u64 z = i + 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static cl_ht_t *bench_build(const bench_table_t *table, const u64 *keys, u64 entries)
+{
+    cl_ht_t *ht = cl_ht_create_with_flags(null, table->flags);
+    if (ht == null)
+        return null;
+    for (u64 i = 0; i < entries; i++)
+    {
+        if (!cl_ht_put(ht, &keys[i], sizeof(u64), (void *)&keys[i], sizeof(u64), null))
+        {
+            cl_ht_destroy(ht);
+            return null;
+        }
+    }
+    if (table->perfect && !cl_ht_freeze_perfect(ht))
+    {
+        cl_ht_destroy(ht);
+        return null;
+    }
+    return ht;
+}
+
+static bool bench_insert(const bench_table_t *table, const u64 *keys, u64 entries, u64 min_ops, bench_result_t *result)
+{
+    const u64 rounds = entries < min_ops ? min_ops / entries : 1;
+    bench_reset_peak();
+    u64 elapsed = 0;
+    for (u64 round = 0; round < rounds; round++)
+    {
+        const u64 start = bench_now_ns();
+        cl_ht_t *ht = bench_build(table, keys, entries);
+        elapsed += bench_now_ns() - start;
+        if (ht == null)
+            return false;
+        if (round == rounds - 1)
+            bench_memory_usage(&result->rss_kb, &result->peak_kb);
+        cl_ht_destroy(ht);
+    }
+
+    result->pattern = "insert";
+    result->ops = rounds * entries;
+    result->ns_per_op = (f64)elapsed / (f64)result->ops;
+    return true;
+}
+
+// Slowest single put while the table grows to its final size; this is where a resize lands in one caller's latency
+static bool bench_insert_max(const bench_table_t *table, const u64 *keys, u64 entries, bench_result_t *result)
+{
+    cl_ht_t *ht = cl_ht_create_with_flags(null, table->flags);
+    if (ht == null)
+        return false;
+
+    bench_reset_peak();
+    bool ok = true;
+    u64 slowest = 0;
+    for (u64 i = 0; i < entries && ok; i++)
+    {
+        const u64 start = bench_now_ns();
+        ok = cl_ht_put(ht, &keys[i], sizeof(u64), (void *)&keys[i], sizeof(u64), null);
+        const u64 elapsed = bench_now_ns() - start;
+        slowest = elapsed > slowest ? elapsed : slowest;
+    }
+    if (ok && table->perfect)
+    {
+        const u64 start = bench_now_ns();
+        ok = cl_ht_freeze_perfect(ht);
+        const u64 elapsed = bench_now_ns() - start;
+        slowest = elapsed > slowest ? elapsed : slowest;
+    }
+    bench_memory_usage(&result->rss_kb, &result->peak_kb);
+    cl_ht_destroy(ht);
+
+    result->pattern = "insert_max";
+    result->ops = entries;
+    result->ns_per_op = (f64)slowest;
+    return ok;
+}
+
+// Hits look up keys in insertion order, which is random with respect to their slots; misses use keys never inserted
+static bool bench_lookup(const bench_table_t *table, const u64 *keys, u64 entries, u64 min_ops, bool hit,
+                         bench_result_t *result)
+{
+    cl_ht_t *ht = bench_build(table, keys, entries);
+    if (ht == null)
+        return false;
+
+    const u64 ops = entries < min_ops ? min_ops : entries;
+    u64 found = 0;
+    const u64 start = bench_now_ns();
+    for (u64 i = 0, k = 0; i < ops; i++, k = k + 1 == entries ? 0 : k + 1)
+    {
+        const u64 miss = hit ? 0 : bench_key(entries + k);
+        found += cl_ht_exists(ht, hit ? &keys[k] : &miss, sizeof(u64));
+    }
+    const u64 elapsed = bench_now_ns() - start;
+    bench_memory_usage(&result->rss_kb, &result->peak_kb);
+    cl_ht_destroy(ht);
+
+    result->pattern = hit ? "lookup_hit" : "lookup_miss";
+    result->ops = ops;
+    result->ns_per_op = (f64)elapsed / (f64)ops;
+    return found == (hit ? ops : 0);
+}
+
+// The lookup_hit workload through cl_ht_get_batch, so the cache misses of a batch overlap
+static bool bench_lookup_batch(const bench_table_t *table, const u64 *keys, u64 entries, u64 min_ops,
+                               bench_result_t *result)
+{
+    cl_ht_t *ht = bench_build(table, keys, entries);
+    if (ht == null)
+        return false;
+
+    const void *batch[BENCH_HT_BATCH];
+    u64 sizes[BENCH_HT_BATCH];
+    for (u32 i = 0; i < BENCH_HT_BATCH; i++)
+        sizes[i] = sizeof(u64);
+    const u64 ops = entries < min_ops ? min_ops : entries;
+    u64 found = 0;
+    u64 done = 0;
+    const u64 start = bench_now_ns();
+    for (u64 k = 0; done < ops;)
+    {
+        const u64 count = ops - done < BENCH_HT_BATCH ? ops - done : BENCH_HT_BATCH;
+        for (u64 i = 0; i < count; i++, k = k + 1 == entries ? 0 : k + 1)
+            batch[i] = &keys[k];
+        found += cl_ht_get_batch(ht, batch, sizes, count, null, null);
+        done += count;
+    }
+    const u64 elapsed = bench_now_ns() - start;
+    bench_memory_usage(&result->rss_kb, &result->peak_kb);
+    cl_ht_destroy(ht);
+
+    result->pattern = "lookup_batch";
+    result->ops = ops;
+    result->ns_per_op = (f64)elapsed / (f64)ops;
+    return found == ops;
+}
+
+// One full pass over the entries, either through cl_ht_keys with its per-key copies or cl_ht_scan's views in place
+static bool bench_iterate(const bench_table_t *table, const u64 *keys, u64 entries, u64 min_ops, bool scan,
+                          bench_result_t *result)
+{
+    cl_ht_t *ht = bench_build(table, keys, entries);
+    if (ht == null)
+        return false;
+
+    const u64 rounds = entries < min_ops ? min_ops / entries : 1;
+    cl_ht_entry_view_t views[BENCH_HT_BATCH];
+    u64 seen = 0;
+    bench_reset_peak();
+    const u64 start = bench_now_ns();
+    for (u64 round = 0; round < rounds; round++)
+    {
+        if (scan)
+        {
+            u64 cursor = 0;
+            do
+                seen += cl_ht_scan(ht, &cursor, views, BENCH_HT_BATCH);
+            while (cursor != 0);
+            continue;
+        }
+        u64 count = 0;
+        void **copies = cl_ht_keys(ht, &count, null, false);
+        for (u64 i = 0; i < count && copies != null; i++)
+            cl_mem_free(null, copies[i]);
+        cl_mem_free(null, copies);
+        seen += copies != null ? count : 0;
+    }
+    const u64 elapsed = bench_now_ns() - start;
+    bench_memory_usage(&result->rss_kb, &result->peak_kb);
+    cl_ht_destroy(ht);
+
+    result->pattern = scan ? "scan" : "keys";
+    result->ops = rounds * entries;
+    result->ns_per_op = (f64)elapsed / (f64)result->ops;
+    return seen == result->ops;
+}
+
+int main(int argc, char **argv)
+{
+    bench_options_t options = {.name = "clib_bench_ht", .subject_label = "table", .size_label = "entries"};
+    int exit_code;
+    if (!bench_parse_options(&options, argc, argv, &exit_code))
+        return exit_code;
+
+    const u64 max_entries = options.max_size > 0 ? options.max_size : BENCH_HT_MAX_ENTRIES / options.divisor;
+    const u64 min_ops = BENCH_HT_MIN_OPS / options.divisor;
+    u64 *keys = malloc(max_entries * sizeof(u64));
+    if (keys == null)
+    {
+        fprintf(stderr, "Failed to allocate %llu keys\n", (unsigned long long)max_entries);
+        return 1;
+    }
+    for (u64 i = 0; i < max_entries; i++)
+        keys[i] = bench_key(i);
+
+    bench_begin(&options, "\"keys\": \"u64\", \"insert_max\": \"ns of the slowest single put or freeze\"");
+    int failures = 0;
+    for (u64 entries = BENCH_HT_MIN_ENTRIES; entries <= max_entries; entries *= 10)
+    {
+        for (u32 i = 0; i < sizeof(bench_tables) / sizeof(bench_tables[0]); i++)
+        {
+            const bench_table_t *table = &bench_tables[i];
+            const char *patterns[] = {"insert", "insert_max", "lookup_hit", "lookup_miss", "lookup_batch", "keys",
+                                      "scan"};
+            for (u32 p = 0; p < sizeof(patterns) / sizeof(patterns[0]); p++)
+            {
+                if (!bench_selected(&options, patterns[p], table->name))
+                    continue;
+                bench_result_t result = {.subject = table->name, .size = entries, .threads = 1};
+                bool ok;
+                if (p == 0)
+                    ok = bench_insert(table, keys, entries, min_ops, &result);
+                else if (p == 1)
+                    ok = bench_insert_max(table, keys, entries, &result);
+                else if (p == 4)
+                    ok = bench_lookup_batch(table, keys, entries, min_ops, &result);
+                else if (p >= 5)
+                    ok = bench_iterate(table, keys, entries, min_ops, p == 6, &result);
+                else
+                    ok = bench_lookup(table, keys, entries, min_ops, p == 2, &result);
+                // A lookup that lost keys still reports its timing, the failure count flags it
+                if (result.ops > 0)
+                    bench_report(&options, &result);
+                if (!ok)
+                    failures++;
+            }
+        }
+    }
+
+    free(keys);
+    return bench_end(&options, failures);
+}
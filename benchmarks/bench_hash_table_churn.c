@@ -0,0 +1,195 @@
+/**
+ * Created by jraynor on 8/6/2024.
+ */
+#include <stdlib.h>
+#include "bench_common.h"
+#include "clib/containers_lib.h"
+
+#define BENCH_CHURN_ENTRIES 1000000 // Live entries the churn hovers around; the key space is twice that
+#define BENCH_CHURN_OPS 100000000 // Mixed operations per table
+#define BENCH_CHURN_CHECKPOINTS 10 // Probe lengths and lookup time are sampled this many times during the run
+#define BENCH_CHURN_LOOKUPS 1000000 // Timed lookups per checkpoint, half of them hits
+#define BENCH_CHURN_PROBE_BUCKETS 64
+
+typedef struct bench_table
+{
+    const char *name;
+    cl_ht_flags_t flags;
+} bench_table_t;
+
+static const bench_table_t bench_tables[] = {
+    {"robin_hood", CL_HT_FLAG_NOCOPY_KEYS | CL_HT_FLAG_NO_LOCKING},
+    {"group", CL_HT_FLAG_NOCOPY_KEYS | CL_HT_FLAG_NO_LOCKING | CL_HT_FLAG_GROUP_PROBING},
+};
+
+typedef struct bench_checkpoint
+{
+    const char *subject;
+    u64 entries;
+    u64 ops; // Mixed operations run so far
+    f64 mix_ns; // Mean ns per mixed operation since the previous checkpoint
+    f64 lookup_ns;
+    f64 mean_probe;
+    u64 p99_probe;
+    u64 max_probe;
+} bench_checkpoint_t;
+
+static inline u64 bench_key(u64 i)
+{
+    // splitmix64: distinct inputs give distinct, well spread keys
+    u64 z = i + 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static void bench_checkpoint_report(bench_options_t *options, const bench_checkpoint_t *row)
+{
+    switch (options->format)
+    {
+        case BENCH_FORMAT_TABLE:
+            if (options->results == 0)
+                printf("%-12s %10s %11s %9s %10s %10s %9s %9s\n", "table", "entries", "ops", "mix_ns", "lookup_ns",
+                       "mean_probe", "p99_probe", "max_probe");
+            printf("%-12s %10llu %11llu %9.2f %10.2f %10.3f %9llu %9llu\n", row->subject,
+                   (unsigned long long)row->entries, (unsigned long long)row->ops, row->mix_ns, row->lookup_ns,
+                   row->mean_probe, (unsigned long long)row->p99_probe, (unsigned long long)row->max_probe);
+            break;
+        case BENCH_FORMAT_CSV:
+            if (options->results == 0)
+                printf("table,entries,ops,mix_ns,lookup_ns,mean_probe,p99_probe,max_probe\n");
+            printf("%s,%llu,%llu,%.3f,%.3f,%.4f,%llu,%llu\n", row->subject, (unsigned long long)row->entries,
+                   (unsigned long long)row->ops, row->mix_ns, row->lookup_ns, row->mean_probe,
+                   (unsigned long long)row->p99_probe, (unsigned long long)row->max_probe);
+            break;
+        case BENCH_FORMAT_JSON:
+            printf("%s\n    {\"table\": \"%s\", \"entries\": %llu, \"ops\": %llu, \"mix_ns\": %.3f, "
+                   "\"lookup_ns\": %.3f, \"mean_probe\": %.4f, \"p99_probe\": %llu, \"max_probe\": %llu}",
+                   options->results == 0 ? "" : ",", row->subject, (unsigned long long)row->entries,
+                   (unsigned long long)row->ops, row->mix_ns, row->lookup_ns, row->mean_probe,
+                   (unsigned long long)row->p99_probe, (unsigned long long)row->max_probe);
+            break;
+    }
+    fflush(stdout);
+    options->results++;
+}
+
+static void bench_probe_stats(cl_ht_t *ht, bench_checkpoint_t *row)
+{
+    u64 counts[BENCH_CHURN_PROBE_BUCKETS];
+    row->max_probe = cl_ht_probe_lengths(ht, counts, BENCH_CHURN_PROBE_BUCKETS);
+    const u64 total = cl_ht_size(ht);
+    u64 sum = 0;
+    u64 seen = 0;
+    row->p99_probe = 0;
+    for (u64 i = 0; i < BENCH_CHURN_PROBE_BUCKETS; i++)
+    {
+        sum += i * counts[i];
+        if (seen < total - total / 100)
+            row->p99_probe = i;
+        seen += counts[i];
+    }
+    row->mean_probe = total > 0 ? (f64)sum / (f64)total : 0.0;
+}
+
+// Random keys from the whole key space, so about half of the lookups miss
+static bool bench_timed_lookups(cl_ht_t *ht, const u64 *keys, const bool *present, u64 key_space, u64 lookups,
+                                u32 *seed, f64 *ns_per_op)
+{
+    bool ok = true;
+    const u64 start = bench_now_ns();
+    for (u64 i = 0; i < lookups; i++)
+    {
+        const u64 k = bench_random(seed) % key_space;
+        ok &= cl_ht_exists(ht, &keys[k], sizeof(u64)) == present[k];
+    }
+    *ns_per_op = (f64)(bench_now_ns() - start) / (f64)lookups;
+    return ok;
+}
+
+// Half of the operations are lookups and half flip a random key in or out, so the table stays near its starting size
+// while every slot sees a steady stream of inserts and removes
+static bool bench_churn(bench_options_t *options, const bench_table_t *table, const u64 *keys, bool *present,
+                        u64 entries, u64 ops, u64 lookups)
+{
+    const u64 key_space = entries * 2;
+    cl_ht_t *ht = cl_ht_create_with_flags(null, table->flags);
+    if (ht == null)
+        return false;
+
+    bool ok = true;
+    for (u64 i = 0; i < key_space; i++)
+    {
+        present[i] = i < entries;
+        if (present[i])
+            ok &= cl_ht_put(ht, &keys[i], sizeof(u64), (void *)&keys[i], sizeof(u64), null);
+    }
+
+    u32 seed = 0x2545F491u;
+    u64 done = 0;
+    for (u32 c = 1; c <= BENCH_CHURN_CHECKPOINTS && ok; c++)
+    {
+        const u64 until = ops / BENCH_CHURN_CHECKPOINTS * c;
+        const u64 start = bench_now_ns();
+        for (; done < until; done++)
+        {
+            const u32 roll = bench_random(&seed);
+            const u64 k = bench_random(&seed) % key_space;
+            if (roll & 1)
+                ok &= cl_ht_exists(ht, &keys[k], sizeof(u64)) == present[k];
+            else if (present[k])
+                ok &= cl_ht_remove(ht, &keys[k], sizeof(u64)) == &keys[k];
+            else
+                ok &= cl_ht_put(ht, &keys[k], sizeof(u64), (void *)&keys[k], sizeof(u64), null);
+            if (!(roll & 1))
+                present[k] = !present[k];
+        }
+
+        bench_checkpoint_t row = {.subject = table->name, .entries = cl_ht_size(ht), .ops = done};
+        row.mix_ns = (f64)(bench_now_ns() - start) / (f64)(ops / BENCH_CHURN_CHECKPOINTS);
+        ok &= bench_timed_lookups(ht, keys, present, key_space, lookups, &seed, &row.lookup_ns);
+        bench_probe_stats(ht, &row);
+        bench_checkpoint_report(options, &row);
+    }
+
+    cl_ht_destroy(ht);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    bench_options_t options = {.name = "clib_bench_ht_churn", .subject_label = "table", .size_label = "entries"};
+    int exit_code;
+    if (!bench_parse_options(&options, argc, argv, &exit_code))
+        return exit_code;
+
+    const u64 entries = options.max_size > 0 ? options.max_size : BENCH_CHURN_ENTRIES;
+    const u64 ops = BENCH_CHURN_OPS / options.divisor;
+    const u64 lookups = BENCH_CHURN_LOOKUPS / options.divisor;
+    u64 *keys = malloc(entries * 2 * sizeof(u64));
+    bool *present = malloc(entries * 2 * sizeof(bool));
+    if (keys == null || present == null)
+    {
+        fprintf(stderr, "Failed to allocate %llu keys\n", (unsigned long long)entries * 2);
+        free(keys);
+        free(present);
+        return 1;
+    }
+    for (u64 i = 0; i < entries * 2; i++)
+        keys[i] = bench_key(i);
+
+    // Probe lengths count slots for robin_hood and 16-slot groups for group, as cl_ht_probe_lengths reports them
+    bench_begin(&options, "\"keys\": \"u64\", \"probe\": \"slots (robin_hood) or groups (group) past home\"");
+    int failures = 0;
+    for (u32 i = 0; i < sizeof(bench_tables) / sizeof(bench_tables[0]); i++)
+    {
+        if (!bench_selected(&options, "churn", bench_tables[i].name))
+            continue;
+        if (!bench_churn(&options, &bench_tables[i], keys, present, entries, ops, lookups))
+            failures++;
+    }
+
+    free(keys);
+    free(present);
+    return bench_end(&options, failures);
+}
@@ -0,0 +1,158 @@
+/**
+ * Created by jraynor on 8/6/2024.
+ */
+#include <stdlib.h>
+#include "bench_common.h"
+#include "clib/containers_lib.h"
+
+#define BENCH_SNAPSHOT_MIN_ENTRIES 1000
+#define BENCH_SNAPSHOT_MAX_ENTRIES 10000000
+#define BENCH_SNAPSHOT_MIN_OPS 1000000 // Lookups run at least this many times on small tables
+#define BENCH_SNAPSHOT_FILE "clib_bench_ht_snapshot.bin" // Written to the working directory and removed at the end
+
+static inline u64 bench_key(u64 i)
+{
+    // splitmix64: distinct inputs give distinct, well spread keys
+    u64 z = i + 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// What a service rebuilds on restart: copied u64 keys with u64 values. The keys go into the key arena, since freeing a
+// million single-key allocations leaves glibc to merge them on the next large malloc, inside whatever runs next.
+static cl_ht_t *bench_build(const u64 *keys, u64 entries)
+{
+    cl_ht_t *ht =
+        cl_ht_create_with_flags(null, CL_HT_FLAG_NO_LOCKING | CL_HT_FLAG_GROUP_PROBING | CL_HT_FLAG_KEY_ARENA);
+    for (u64 i = 0; i < entries && ht != null; i++)
+    {
+        if (!cl_ht_put(ht, &keys[i], sizeof(u64), (void *)&keys[i], sizeof(u64), null))
+        {
+            cl_ht_destroy(ht);
+            ht = null;
+        }
+    }
+    return ht;
+}
+
+static void bench_finish(bench_result_t *result, u64 elapsed)
+{
+    result->ns_per_op = (f64)elapsed / (f64)result->ops;
+    bench_memory_usage(&result->rss_kb, &result->peak_kb);
+}
+
+// Startup is reported per entry for both: building the table, or mapping its snapshot
+static bool bench_startup(cl_fs_t *fs, const u64 *keys, u64 entries, bool snapshot, bench_result_t *result)
+{
+    bench_reset_peak();
+    result->ops = entries;
+    const u64 start = bench_now_ns();
+    if (snapshot)
+    {
+        cl_ht_snapshot_t *s = cl_ht_snapshot_open(null, fs, BENCH_SNAPSHOT_FILE);
+        bench_finish(result, bench_now_ns() - start);
+        const bool ok = s != null && cl_ht_snapshot_size(s) == entries;
+        cl_ht_snapshot_close(s);
+        return ok;
+    }
+    cl_ht_t *ht = bench_build(keys, entries);
+    bench_finish(result, bench_now_ns() - start);
+    const bool ok = ht != null;
+    cl_ht_destroy(ht);
+    return ok;
+}
+
+static bool bench_lookup(cl_fs_t *fs, const u64 *keys, u64 entries, u64 min_ops, bool snapshot, bool hit,
+                         bench_result_t *result)
+{
+    cl_ht_t *ht = snapshot ? null : bench_build(keys, entries);
+    cl_ht_snapshot_t *s = snapshot ? cl_ht_snapshot_open(null, fs, BENCH_SNAPSHOT_FILE) : null;
+    if (ht == null && s == null)
+        return false;
+
+    bench_reset_peak();
+    result->ops = entries < min_ops ? min_ops : entries;
+    u64 found = 0;
+    const u64 start = bench_now_ns();
+    for (u64 i = 0, k = 0; i < result->ops; i++, k = k + 1 == entries ? 0 : k + 1)
+    {
+        const u64 key = hit ? keys[k] : bench_key(entries + k);
+        found += s ? cl_ht_snapshot_get(s, &key, sizeof(key), null, null) : cl_ht_exists(ht, &key, sizeof(key));
+    }
+    bench_finish(result, bench_now_ns() - start);
+    cl_ht_destroy(ht);
+    cl_ht_snapshot_close(s);
+    return found == (hit ? result->ops : 0);
+}
+
+int main(int argc, char **argv)
+{
+    bench_options_t options = {.name = "clib_bench_ht_snapshot", .subject_label = "table", .size_label = "entries"};
+    int exit_code;
+    if (!bench_parse_options(&options, argc, argv, &exit_code))
+        return exit_code;
+
+    const u64 max_entries = options.max_size > 0 ? options.max_size : BENCH_SNAPSHOT_MAX_ENTRIES / options.divisor;
+    const u64 min_ops = BENCH_SNAPSHOT_MIN_OPS / options.divisor;
+    cl_allocator_t *allocator = cl_allocator_create(&(cl_allocator_config_t){.type = CL_ALLOCATOR_TYPE_PLATFORM});
+    cl_fs_t *fs = allocator ? cl_fs_init(allocator, &(cl_fs_config_t){.type = CL_FS_TYPE_LOCAL, .root_path = "."})
+                            : null;
+    u64 *keys = malloc(max_entries * sizeof(u64));
+    if (fs == null || keys == null)
+    {
+        fprintf(stderr, "Failed to set up %llu keys\n", (unsigned long long)max_entries);
+        free(keys);
+        cl_fs_destroy(fs);
+        cl_allocator_destroy(allocator);
+        return 1;
+    }
+    for (u64 i = 0; i < max_entries; i++)
+        keys[i] = bench_key(i);
+
+    bench_begin(&options, "\"keys\": \"u64\", \"startup\": \"ns per entry to build the table or map its snapshot\"");
+    const char *patterns[] = {"write", "startup", "lookup_hit", "lookup_miss"};
+    const char *subjects[] = {"ht", "snapshot"};
+    int failures = 0;
+    for (u64 entries = BENCH_SNAPSHOT_MIN_ENTRIES; entries <= max_entries; entries *= 10)
+    {
+        // Every snapshot run maps the file written here, which the page cache still holds
+        cl_ht_t *ht = bench_build(keys, entries);
+        bench_result_t written = {.pattern = patterns[0], .subject = subjects[1], .size = entries, .threads = 1,
+                                  .ops = entries};
+        const u64 start = bench_now_ns();
+        if (ht == null || !cl_ht_snapshot_write(ht, fs, BENCH_SNAPSHOT_FILE))
+        {
+            cl_ht_destroy(ht);
+            failures++;
+            break;
+        }
+        bench_finish(&written, bench_now_ns() - start);
+        cl_ht_destroy(ht);
+        if (bench_selected(&options, patterns[0], subjects[1]))
+            bench_report(&options, &written);
+
+        for (u32 p = 1; p < sizeof(patterns) / sizeof(patterns[0]); p++)
+        {
+            for (u32 s = 0; s < sizeof(subjects) / sizeof(subjects[0]); s++)
+            {
+                if (!bench_selected(&options, patterns[p], subjects[s]))
+                    continue;
+                bench_result_t result = {.pattern = patterns[p], .subject = subjects[s], .size = entries,
+                                         .threads = 1};
+                const bool ok = p == 1 ? bench_startup(fs, keys, entries, s == 1, &result)
+                                       : bench_lookup(fs, keys, entries, min_ops, s == 1, p == 2, &result);
+                if (result.ops > 0)
+                    bench_report(&options, &result);
+                if (!ok)
+                    failures++;
+            }
+        }
+    }
+
+    cl_fs_remove_file(fs, BENCH_SNAPSHOT_FILE);
+    free(keys);
+    cl_fs_destroy(fs);
+    cl_allocator_destroy(allocator);
+    return bench_end(&options, failures);
+}
@@ -0,0 +1,548 @@
+/**
+ * Created by jraynor on 8/3/2024.
+ */
+#include <stdatomic.h>
+#include <stdlib.h>
+#include "bench_common.h"
+#include "clib/memory_lib.h"
+#include "clib/thread_lib.h"
+
+#define BENCH_CHURN_ITERATIONS 1000000 // Free/alloc pairs per size class
+#define BENCH_CHURN_LIVE 1024 // Blocks held while churning, replaced at random
+#define BENCH_XFER_PAIRS 4 // Producer/consumer thread pairs
+#define BENCH_XFER_ITEMS 250000 // Blocks each producer hands to its consumer
+#define BENCH_XFER_MIN_SIZE 16
+#define BENCH_XFER_MAX_SIZE 256
+#define BENCH_RING_SIZE 1024 // Power of two
+#define BENCH_SCALE_MAX_THREADS 64 // Thread scaling doubles from 1 up to this
+#define BENCH_SCALE_ITEMS 200000 // Free/alloc pairs per thread
+#define BENCH_SCALE_LIVE 256 // Blocks each thread holds, replaced at random
+#define BENCH_BUILD_OBJECTS 100000 // Objects per build round
+#define BENCH_BUILD_ROUNDS 20
+#define BENCH_BUILD_MIN_SIZE 16 // Room for the link to the previous object
+#define BENCH_BUILD_MAX_SIZE 128
+#define BENCH_REGION_SIZE (256ull * 1024 * 1024) // Free list, linear and stack regions; touched lazily
+#define BENCH_MEM_OPS_MAX_SIZE (64ull * 1024 * 1024) // Largest set/copy/compare, grown by 4x from 1 byte
+#define BENCH_MEM_OPS_MAX_ITERATIONS 200000
+#define BENCH_MEM_OPS_BYTE_BUDGET (256ull * 1024 * 1024) // Bytes each size moves, so large sizes run fewer times
+
+static const u64 bench_size_classes[] = {16, 64, 256, 1024, 4096};
+
+typedef enum bench_caps
+{
+    BENCH_CAP_FREE = 1 << 0, // Blocks can be freed one at a time in any order
+    BENCH_CAP_THREADS = 1 << 1, // Any thread may allocate and free
+    BENCH_CAP_RESET = 1 << 2, // Everything is released at once (arena reset, rollback to a zeroed marker)
+} bench_caps_t;
+
+typedef struct bench_allocator
+{
+    const char *name;
+    cl_allocator_t *(*create)(u64 max_size); // max_size is the largest request the run will make
+    u32 caps;
+} bench_allocator_t;
+
+// Allocators under test
+
+static cl_allocator_t *bench_create_platform(u64 max_size)
+{
+    (void)max_size;
+    return cl_allocator_new(CL_ALLOCATOR_TYPE_PLATFORM);
+}
+
+static cl_allocator_t *bench_create_pool(u64 max_size)
+{
+    return cl_allocator_new(CL_ALLOCATOR_TYPE_POOL, .flags = CL_ALLOCATOR_FLAG_GROWABLE,
+                            .config.pool = {.block_size = max_size, .block_count = 4096});
+}
+
+static cl_allocator_t *bench_create_concurrent_pool(u64 max_size)
+{
+    return cl_allocator_new(CL_ALLOCATOR_TYPE_POOL, .flags = CL_ALLOCATOR_FLAG_CONCURRENT | CL_ALLOCATOR_FLAG_GROWABLE,
+                            .config.pool = {.block_size = max_size, .block_count = 4096});
+}
+
+static cl_allocator_t *bench_create_free_list(u64 max_size)
+{
+    (void)max_size;
+    return cl_allocator_new(CL_ALLOCATOR_TYPE_FREE_LIST, .config.free_list = {.size = BENCH_REGION_SIZE});
+}
+
+static cl_allocator_t *bench_create_arena(u64 max_size)
+{
+    (void)max_size;
+    return cl_allocator_new(CL_ALLOCATOR_TYPE_ARENA, .config.arena = {.size = 1024 * 1024});
+}
+
+static cl_allocator_t *bench_create_arena_reserved(u64 max_size)
+{
+    (void)max_size;
+    return cl_allocator_new(CL_ALLOCATOR_TYPE_ARENA, .config.arena = {.size = 1024 * 1024, .reserve = 1ull << 30});
+}
+
+static cl_allocator_t *bench_create_linear(u64 max_size)
+{
+    (void)max_size;
+    return cl_allocator_new(CL_ALLOCATOR_TYPE_LINEAR, .config.linear = {.size = BENCH_REGION_SIZE});
+}
+
+static cl_allocator_t *bench_create_stack(u64 max_size)
+{
+    (void)max_size;
+    return cl_allocator_new(CL_ALLOCATOR_TYPE_STACK, .config.stack = {.size = BENCH_REGION_SIZE});
+}
+
+static cl_allocator_t *bench_create_thread_cache(u64 max_size)
+{
+    (void)max_size;
+    return cl_allocator_new(CL_ALLOCATOR_TYPE_PROXY, .config.proxy = {.mode = CL_PROXY_MODE_THREAD_CACHE});
+}
+
+static cl_allocator_t *bench_create_tracking(u64 max_size)
+{
+    (void)max_size;
+    return cl_allocator_new(CL_ALLOCATOR_TYPE_PROXY, .config.proxy = {.mode = CL_PROXY_MODE_TRACKING});
+}
+
+static cl_allocator_t *bench_create_guard(u64 max_size)
+{
+    (void)max_size;
+    return cl_allocator_new(CL_ALLOCATOR_TYPE_GUARD, .config.guard = {.sample_rate = 1024});
+}
+
+static const bench_allocator_t bench_allocators[] = {
+    {"platform", bench_create_platform, BENCH_CAP_FREE | BENCH_CAP_THREADS},
+    {"pool", bench_create_pool, BENCH_CAP_FREE},
+    {"concurrent_pool", bench_create_concurrent_pool, BENCH_CAP_FREE | BENCH_CAP_THREADS},
+    {"free_list", bench_create_free_list, BENCH_CAP_FREE},
+    {"arena", bench_create_arena, BENCH_CAP_RESET},
+    {"arena_reserved", bench_create_arena_reserved, BENCH_CAP_RESET},
+    {"linear", bench_create_linear, BENCH_CAP_RESET},
+    {"stack", bench_create_stack, BENCH_CAP_RESET},
+    {"proxy_thread_cache", bench_create_thread_cache, BENCH_CAP_FREE | BENCH_CAP_THREADS},
+    {"proxy_tracking", bench_create_tracking, BENCH_CAP_FREE | BENCH_CAP_THREADS},
+    {"guard", bench_create_guard, BENCH_CAP_FREE | BENCH_CAP_THREADS},
+};
+
+// Churn: a window of live blocks of one size class, replaced at random so frees arrive in no particular order
+
+static bool bench_churn(const bench_allocator_t *entry, u64 size_class, u64 iterations, bench_result_t *result)
+{
+    cl_allocator_t *allocator = entry->create(size_class);
+    void **live = calloc(BENCH_CHURN_LIVE, sizeof(void *));
+    if (allocator == null || live == null)
+    {
+        cl_allocator_destroy(allocator);
+        free(live);
+        return false;
+    }
+
+    bench_reset_peak();
+    u32 seed = 0x9E3779B9u ^ (u32)size_class;
+    bool ok = true;
+    for (u32 i = 0; i < BENCH_CHURN_LIVE && ok; i++)
+        ok = (live[i] = cl_mem_alloc(allocator, bench_random_size(&seed, size_class / 2, size_class))) != null;
+
+    const u64 start = bench_now_ns();
+    for (u64 i = 0; i < iterations && ok; i++)
+    {
+        const u32 slot = bench_random(&seed) % BENCH_CHURN_LIVE;
+        cl_mem_free(allocator, live[slot]);
+        u8 *block = cl_mem_alloc(allocator, bench_random_size(&seed, size_class / 2, size_class));
+        if (block == null)
+        {
+            ok = false;
+            break;
+        }
+        block[0] = (u8)i;
+        live[slot] = block;
+    }
+    const u64 elapsed = bench_now_ns() - start;
+
+    *result = (bench_result_t){.pattern = "churn", .subject = entry->name, .size = size_class, .threads = 1,
+                               .ops = iterations * 2, .ns_per_op = (f64)elapsed / (f64)(iterations * 2)};
+    bench_memory_usage(&result->rss_kb, &result->peak_kb);
+
+    for (u32 i = 0; i < BENCH_CHURN_LIVE; i++)
+        cl_mem_free(allocator, live[i]);
+    free(live);
+    cl_allocator_destroy(allocator);
+    return ok;
+}
+
+// Producer/consumer: each producer allocates and hands its blocks over a ring to a consumer that frees them, so
+// every block is released by a thread other than the one that allocated it
+
+typedef struct bench_ring
+{
+    _Alignas(64) atomic_uint_fast64_t head; // Next slot the consumer reads
+    _Alignas(64) atomic_uint_fast64_t tail; // Next slot the producer writes
+    _Alignas(64) void *slots[BENCH_RING_SIZE];
+} bench_ring_t;
+
+typedef struct bench_pair
+{
+    const cl_allocator_t *allocator;
+    bench_ring_t *ring;
+    u64 items;
+    u32 seed;
+    atomic_bool failed;
+} bench_pair_t;
+
+static void *bench_producer(void *arg)
+{
+    bench_pair_t *pair = (bench_pair_t *)arg;
+    bench_ring_t *ring = pair->ring;
+    u32 seed = pair->seed;
+
+    for (u64 i = 0; i < pair->items; i++)
+    {
+        // A failed allocation still goes through as null so the consumer sees every item
+        u8 *block = cl_mem_alloc(pair->allocator, bench_random_size(&seed, BENCH_XFER_MIN_SIZE, BENCH_XFER_MAX_SIZE));
+        if (block != null)
+            block[0] = (u8)i;
+        else
+            atomic_store(&pair->failed, true);
+
+        const u64 tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+        while (tail - atomic_load_explicit(&ring->head, memory_order_acquire) == BENCH_RING_SIZE)
+            cl_thread_yield();
+        ring->slots[tail & (BENCH_RING_SIZE - 1)] = block;
+        atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+    }
+    cl_proxy_flush_thread_cache(pair->allocator);
+    return null;
+}
+
+static void *bench_consumer(void *arg)
+{
+    bench_pair_t *pair = (bench_pair_t *)arg;
+    bench_ring_t *ring = pair->ring;
+
+    for (u64 i = 0; i < pair->items; i++)
+    {
+        const u64 head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+        while (atomic_load_explicit(&ring->tail, memory_order_acquire) == head)
+            cl_thread_yield();
+        cl_mem_free(pair->allocator, ring->slots[head & (BENCH_RING_SIZE - 1)]);
+        atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+    }
+    cl_proxy_flush_thread_cache(pair->allocator);
+    return null;
+}
+
+static bool bench_producer_consumer(const bench_allocator_t *entry, u64 items, bench_result_t *result)
+{
+    cl_allocator_t *allocator = entry->create(BENCH_XFER_MAX_SIZE);
+    bench_ring_t *rings = cl_mem_aligned_alloc(null, 64, BENCH_XFER_PAIRS * sizeof(bench_ring_t));
+    if (allocator == null || rings == null)
+    {
+        cl_allocator_destroy(allocator);
+        cl_mem_aligned_free(null, rings);
+        return false;
+    }
+
+    bench_pair_t pairs[BENCH_XFER_PAIRS];
+    cl_thread_t *threads[BENCH_XFER_PAIRS * 2];
+    bench_reset_peak();
+    const u64 start = bench_now_ns();
+    for (u32 i = 0; i < BENCH_XFER_PAIRS; i++)
+    {
+        atomic_init(&rings[i].head, 0);
+        atomic_init(&rings[i].tail, 0);
+        pairs[i] = (bench_pair_t){.allocator = allocator, .ring = &rings[i], .items = items, .seed = 0x2545F491u + i};
+        atomic_init(&pairs[i].failed, false);
+        threads[i * 2] = cl_thread_create(bench_consumer, &pairs[i], CL_THREAD_FLAG_NONE);
+        threads[i * 2 + 1] = cl_thread_create(bench_producer, &pairs[i], CL_THREAD_FLAG_NONE);
+    }
+    for (u32 i = 0; i < BENCH_XFER_PAIRS * 2; i++)
+    {
+        cl_thread_join(threads[i], null);
+        cl_thread_destroy(threads[i]);
+    }
+    const u64 elapsed = bench_now_ns() - start;
+
+    const u64 ops = BENCH_XFER_PAIRS * items * 2;
+    *result = (bench_result_t){.pattern = "producer_consumer", .subject = entry->name, .size = BENCH_XFER_MAX_SIZE,
+                               .threads = BENCH_XFER_PAIRS * 2, .ops = ops, .ns_per_op = (f64)elapsed / (f64)ops};
+    bench_memory_usage(&result->rss_kb, &result->peak_kb);
+
+    bool ok = true;
+    for (u32 i = 0; i < BENCH_XFER_PAIRS; i++)
+        ok &= !atomic_load(&pairs[i].failed);
+    cl_mem_aligned_free(null, rings);
+    cl_allocator_destroy(allocator);
+    return ok;
+}
+
+// Thread scaling: every thread churns its own window of live blocks, so the only sharing is whatever the allocator
+// does internally; ns/op is wall time over every thread's operations and falls as threads rise when it scales
+
+typedef struct bench_scaler
+{
+    const cl_allocator_t *allocator;
+    u64 items;
+    u32 seed;
+    bool failed;
+} bench_scaler_t;
+
+static void *bench_scale_worker(void *arg)
+{
+    bench_scaler_t *scaler = (bench_scaler_t *)arg;
+    u8 *live[BENCH_SCALE_LIVE] = {0};
+    u32 seed = scaler->seed;
+
+    for (u64 i = 0; i < scaler->items; i++)
+    {
+        const u32 slot = bench_random(&seed) % BENCH_SCALE_LIVE;
+        cl_mem_free(scaler->allocator, live[slot]);
+        const u64 size = bench_random_size(&seed, BENCH_XFER_MIN_SIZE, BENCH_XFER_MAX_SIZE);
+        live[slot] = cl_mem_alloc(scaler->allocator, size);
+        if (live[slot] != null)
+            live[slot][0] = (u8)i;
+        else
+            scaler->failed = true;
+    }
+    for (u32 i = 0; i < BENCH_SCALE_LIVE; i++)
+        cl_mem_free(scaler->allocator, live[i]);
+    cl_proxy_flush_thread_cache(scaler->allocator);
+    return null;
+}
+
+static bool bench_thread_scaling(const bench_allocator_t *entry, u32 thread_count, u64 items, bench_result_t *result)
+{
+    cl_allocator_t *allocator = entry->create(BENCH_XFER_MAX_SIZE);
+    if (allocator == null)
+        return false;
+
+    bench_scaler_t scalers[BENCH_SCALE_MAX_THREADS];
+    cl_thread_t *threads[BENCH_SCALE_MAX_THREADS];
+    bench_reset_peak();
+    const u64 start = bench_now_ns();
+    for (u32 i = 0; i < thread_count; i++)
+    {
+        scalers[i] = (bench_scaler_t){.allocator = allocator, .items = items, .seed = 0x27D4EB2Fu * (i + 1)};
+        threads[i] = cl_thread_create(bench_scale_worker, &scalers[i], CL_THREAD_FLAG_NONE);
+    }
+    bool ok = true;
+    for (u32 i = 0; i < thread_count; i++)
+    {
+        ok &= threads[i] != null;
+        cl_thread_join(threads[i], null);
+        cl_thread_destroy(threads[i]);
+    }
+    const u64 elapsed = bench_now_ns() - start;
+
+    const u64 ops = thread_count * items * 2;
+    *result = (bench_result_t){.pattern = "thread_scaling", .subject = entry->name, .size = BENCH_XFER_MAX_SIZE,
+                               .threads = thread_count, .ops = ops, .ns_per_op = (f64)elapsed / (f64)ops};
+    bench_memory_usage(&result->rss_kb, &result->peak_kb);
+
+    for (u32 i = 0; i < thread_count; i++)
+        ok &= !scalers[i].failed;
+    cl_allocator_destroy(allocator);
+    return ok;
+}
+
+// Bulk build then reset: many small objects linked into a list, then all released at once; allocators without a
+// reset free every object instead, which is the cost an arena saves
+
+static bool bench_bulk_build(const bench_allocator_t *entry, u64 objects, u64 rounds, bench_result_t *result)
+{
+    cl_allocator_t *allocator = entry->create(BENCH_BUILD_MAX_SIZE);
+    if (allocator == null)
+        return false;
+
+    bench_reset_peak();
+    u32 seed = 0x85EBCA6Bu;
+    bool ok = true;
+    const u64 start = bench_now_ns();
+    for (u64 round = 0; round < rounds && ok; round++)
+    {
+        void *last = null;
+        for (u64 i = 0; i < objects; i++)
+        {
+            const u64 size = bench_random_size(&seed, BENCH_BUILD_MIN_SIZE, BENCH_BUILD_MAX_SIZE);
+            void **object = cl_mem_alloc(allocator, size);
+            if (object == null)
+            {
+                ok = false;
+                break;
+            }
+            *object = last;
+            last = object;
+        }
+
+        // Sample the resident set while the last round is still built
+        if (round == rounds - 1)
+            bench_memory_usage(&result->rss_kb, &result->peak_kb);
+
+        if (entry->caps & BENCH_CAP_RESET)
+        {
+            if (allocator->type == CL_ALLOCATOR_TYPE_ARENA)
+                ok &= cl_arena_reset(allocator, UINT64_MAX);
+            else
+                ok &= cl_mem_rollback(allocator, (cl_mem_marker_t){0});
+        }
+        else
+        {
+            while (last != null)
+            {
+                void *previous = *(void **)last;
+                cl_mem_free(allocator, last);
+                last = previous;
+            }
+        }
+    }
+    const u64 elapsed = bench_now_ns() - start;
+
+    const u64 ops = objects * rounds * (entry->caps & BENCH_CAP_RESET ? 1 : 2);
+    result->pattern = "bulk_build";
+    result->subject = entry->name;
+    result->size = BENCH_BUILD_MAX_SIZE;
+    result->threads = 1;
+    result->ops = ops;
+    result->ns_per_op = (f64)elapsed / (f64)ops;
+
+    cl_allocator_destroy(allocator);
+    return ok;
+}
+
+// Memory operations: cl_mem_set/copy/compare against libc; both are called through volatile pointers so neither side
+// gets inlined or folded away
+
+static void bench_libc_set(void *ptr, int value, u64 num) { memset(ptr, value, num); }
+
+static void bench_libc_copy(void *dest, const void *src, u64 num) { memcpy(dest, src, num); }
+
+static int bench_libc_compare(const void *ptr1, const void *ptr2, u64 num) { return memcmp(ptr1, ptr2, num); }
+
+static bool bench_mem_ops(bench_options_t *options, u8 *src, u8 *dest, u64 max_size)
+{
+    void (*volatile set[2])(void *, int, u64) = {bench_libc_set, cl_mem_set};
+    void (*volatile copy[2])(void *, const void *, u64) = {bench_libc_copy, cl_mem_copy};
+    int (*volatile compare[2])(const void *, const void *, u64) = {bench_libc_compare, cl_mem_compare};
+    const char *subjects[2] = {"libc", "cl_mem"};
+    const char *patterns[3] = {"mem_set", "mem_copy", "mem_compare"};
+
+    u64 mismatches = 0;
+    for (u64 size = 1; size <= max_size; size *= 4)
+    {
+        u64 iterations = BENCH_MEM_OPS_BYTE_BUDGET / size;
+        if (iterations > BENCH_MEM_OPS_MAX_ITERATIONS)
+            iterations = BENCH_MEM_OPS_MAX_ITERATIONS;
+        iterations = iterations / options->divisor > 0 ? iterations / options->divisor : 1;
+
+        for (u32 p = 0; p < 3; p++)
+        {
+            for (u32 k = 0; k < 2; k++)
+            {
+                if (!bench_selected(options, patterns[p], subjects[k]))
+                    continue;
+                const u64 start = bench_now_ns();
+                for (u64 i = 0; i < iterations; i++)
+                {
+                    if (p == 0)
+                        set[k](dest, 0x11, size);
+                    else if (p == 1)
+                        copy[k](dest, src, size);
+                    else
+                        mismatches += compare[k](dest, src, size) != 0;
+                }
+                const u64 elapsed = bench_now_ns() - start;
+                bench_result_t result = {.pattern = patterns[p], .subject = subjects[k], .size = size, .threads = 1,
+                                         .ops = iterations, .ns_per_op = (f64)elapsed / (f64)iterations};
+                bench_memory_usage(&result.rss_kb, &result.peak_kb);
+                bench_report(options, &result);
+            }
+        }
+    }
+    return mismatches == 0;
+}
+
+int main(int argc, char **argv)
+{
+    bench_options_t options = {.name = "clib_bench_memory", .subject_label = "allocator", .size_label = "size"};
+    int exit_code;
+    if (!bench_parse_options(&options, argc, argv, &exit_code))
+        return exit_code;
+
+    char details[64];
+    snprintf(details, sizeof(details), "\"mem_ops\": \"%s\"", cl_mem_ops_name());
+    bench_begin(&options, details);
+
+    int failures = 0;
+    const u32 allocator_count = sizeof(bench_allocators) / sizeof(bench_allocators[0]);
+    bench_result_t result;
+
+    for (u32 i = 0; i < allocator_count; i++)
+    {
+        const bench_allocator_t *entry = &bench_allocators[i];
+        if (!(entry->caps & BENCH_CAP_FREE) || !bench_selected(&options, "churn", entry->name))
+            continue;
+        for (u32 j = 0; j < sizeof(bench_size_classes) / sizeof(bench_size_classes[0]); j++)
+        {
+            if (bench_churn(entry, bench_size_classes[j], BENCH_CHURN_ITERATIONS / options.divisor, &result))
+                bench_report(&options, &result);
+            else
+                failures++;
+        }
+    }
+
+    for (u32 i = 0; i < allocator_count; i++)
+    {
+        const bench_allocator_t *entry = &bench_allocators[i];
+        if (!(entry->caps & BENCH_CAP_THREADS) || !bench_selected(&options, "producer_consumer", entry->name))
+            continue;
+        if (bench_producer_consumer(entry, BENCH_XFER_ITEMS / options.divisor, &result))
+            bench_report(&options, &result);
+        else
+            failures++;
+    }
+
+    for (u32 i = 0; i < allocator_count; i++)
+    {
+        const bench_allocator_t *entry = &bench_allocators[i];
+        if (!(entry->caps & BENCH_CAP_THREADS) || !bench_selected(&options, "thread_scaling", entry->name))
+            continue;
+        for (u32 threads = 1; threads <= BENCH_SCALE_MAX_THREADS; threads *= 2)
+        {
+            if (bench_thread_scaling(entry, threads, BENCH_SCALE_ITEMS / options.divisor, &result))
+                bench_report(&options, &result);
+            else
+                failures++;
+        }
+    }
+
+    for (u32 i = 0; i < allocator_count; i++)
+    {
+        const bench_allocator_t *entry = &bench_allocators[i];
+        if (!bench_selected(&options, "bulk_build", entry->name))
+            continue;
+        if (bench_bulk_build(entry, BENCH_BUILD_OBJECTS / options.divisor, BENCH_BUILD_ROUNDS, &result))
+            bench_report(&options, &result);
+        else
+            failures++;
+    }
+
+    // Both buffers hold the same bytes throughout, so every compare runs to the end
+    u64 mem_ops_max = BENCH_MEM_OPS_MAX_SIZE;
+    if (options.max_size > 0 && options.max_size < mem_ops_max)
+        mem_ops_max = options.max_size;
+    u8 *src = malloc(mem_ops_max);
+    u8 *dest = malloc(mem_ops_max);
+    if (src != null && dest != null)
+    {
+        memset(src, 0x11, mem_ops_max);
+        memset(dest, 0x11, mem_ops_max);
+        failures += !bench_mem_ops(&options, src, dest, mem_ops_max);
+    }
+    else
+    {
+        failures++;
+    }
+    free(src);
+    free(dest);
+
+    return bench_end(&options, failures);
+}
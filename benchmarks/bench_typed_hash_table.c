@@ -0,0 +1,242 @@
+/**
+ * Created by jraynor on 8/6/2024.
+ */
+#include <stdlib.h>
+#include "bench_common.h"
+#include "clib/containers_lib.h"
+#include "clib/ht_define.h"
+
+#define BENCH_TYPED_MIN_ENTRIES 1000
+#define BENCH_TYPED_MAX_ENTRIES 10000000
+#define BENCH_TYPED_MIN_OPS 1000000 // Small tables repeat their work until at least this many operations ran
+
+typedef enum bench_pattern
+{
+    BENCH_PATTERN_INSERT,
+    BENCH_PATTERN_LOOKUP_HIT,
+    BENCH_PATTERN_LOOKUP_MISS,
+} bench_pattern_t;
+
+static const char *bench_pattern_names[] = {"insert", "lookup_hit", "lookup_miss"};
+
+typedef enum bench_key_type
+{
+    BENCH_KEY_U32,
+    BENCH_KEY_U64,
+    BENCH_KEY_PTR,
+} bench_key_type_t;
+
+typedef struct bench_subject
+{
+    const char *name;
+    bench_key_type_t type;
+    bool typed; // CL_HT_DEFINE map rather than cl_ht
+} bench_subject_t;
+
+// The cl_ht tables use the group-probing layout without key copies or locking, its fastest configuration
+static const bench_subject_t bench_subjects[] = {
+    {"ht_u32", BENCH_KEY_U32, false},  {"typed_u32", BENCH_KEY_U32, true}, {"ht_u64", BENCH_KEY_U64, false},
+    {"typed_u64", BENCH_KEY_U64, true}, {"ht_ptr", BENCH_KEY_PTR, false},  {"typed_ptr", BENCH_KEY_PTR, true},
+};
+
+CL_HT_DEFINE(u32_map, u32, u64, cl_ht_hash_u32, cl_ht_eq)
+CL_HT_DEFINE(u64_map, u64, u64, cl_ht_hash_u64, cl_ht_eq)
+CL_HT_DEFINE(ptr_map, const void *, u64, cl_ht_hash_ptr, cl_ht_eq)
+
+static inline u64 bench_key(u64 i)
+{
+    // splitmix64: distinct inputs give distinct, well spread keys
+    u64 z = i + 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+static inline u64 bench_ops(u64 entries, u64 min_ops) { return entries < min_ops ? min_ops : entries; }
+
+// Keys past entries are never inserted and serve the misses; every table stores the key's index as its value
+static cl_ht_t *bench_ht_build(const u8 *keys, u64 key_size, u64 entries)
+{
+    cl_ht_t *ht =
+        cl_ht_create_with_flags(null, CL_HT_FLAG_NOCOPY_KEYS | CL_HT_FLAG_NO_LOCKING | CL_HT_FLAG_GROUP_PROBING);
+    for (u64 i = 0; i < entries && ht != null; i++)
+    {
+        if (!cl_ht_put(ht, keys + i * key_size, key_size, (void *)(uintptr_t)i, sizeof(u64), null))
+        {
+            cl_ht_destroy(ht);
+            ht = null;
+        }
+    }
+    return ht;
+}
+
+static bool bench_ht_run(bench_pattern_t pattern, const u8 *keys, u64 key_size, u64 entries, u64 min_ops,
+                         bench_result_t *result)
+{
+    bench_reset_peak();
+    u64 elapsed = 0;
+    u64 found = 0;
+    if (pattern == BENCH_PATTERN_INSERT)
+    {
+        const u64 rounds = entries < min_ops ? min_ops / entries : 1;
+        for (u64 round = 0; round < rounds; round++)
+        {
+            const u64 start = bench_now_ns();
+            cl_ht_t *ht = bench_ht_build(keys, key_size, entries);
+            elapsed += bench_now_ns() - start;
+            if (ht == null)
+                return false;
+            found += cl_ht_size(ht);
+            if (round == rounds - 1)
+                bench_memory_usage(&result->rss_kb, &result->peak_kb);
+            cl_ht_destroy(ht);
+        }
+        result->ops = rounds * entries;
+    }
+    else
+    {
+        cl_ht_t *ht = bench_ht_build(keys, key_size, entries);
+        if (ht == null)
+            return false;
+        const u8 *probe = pattern == BENCH_PATTERN_LOOKUP_HIT ? keys : keys + entries * key_size;
+        result->ops = bench_ops(entries, min_ops);
+        const u64 start = bench_now_ns();
+        for (u64 i = 0, k = 0; i < result->ops; i++, k = k + 1 == entries ? 0 : k + 1)
+            found += cl_ht_exists(ht, probe + k * key_size, key_size);
+        elapsed = bench_now_ns() - start;
+        bench_memory_usage(&result->rss_kb, &result->peak_kb);
+        cl_ht_destroy(ht);
+    }
+    result->ns_per_op = (f64)elapsed / (f64)result->ops;
+    return found == (pattern == BENCH_PATTERN_LOOKUP_MISS ? 0 : result->ops);
+}
+
+// The same workload against one CL_HT_DEFINE map type
+#define BENCH_TYPED_RUN(map, key_t)                                                                                    \
+    static map##_t *bench_##map##_build(const key_t *keys, u64 entries)                                                \
+    {                                                                                                                  \
+        map##_t *m = map##_create(null);                                                                               \
+        for (u64 i = 0; i < entries && m != null; i++)                                                                 \
+        {                                                                                                              \
+            if (!map##_put(m, keys[i], i, null))                                                                       \
+            {                                                                                                          \
+                map##_destroy(m);                                                                                      \
+                m = null;                                                                                              \
+            }                                                                                                          \
+        }                                                                                                              \
+        return m;                                                                                                      \
+    }                                                                                                                  \
+                                                                                                                       \
+    static bool bench_##map##_run(bench_pattern_t pattern, const key_t *keys, u64 entries, u64 min_ops,                \
+                                  bench_result_t *result)                                                              \
+    {                                                                                                                  \
+        bench_reset_peak();                                                                                            \
+        u64 elapsed = 0;                                                                                               \
+        u64 found = 0;                                                                                                 \
+        if (pattern == BENCH_PATTERN_INSERT)                                                                           \
+        {                                                                                                              \
+            const u64 rounds = entries < min_ops ? min_ops / entries : 1;                                              \
+            for (u64 round = 0; round < rounds; round++)                                                               \
+            {                                                                                                          \
+                const u64 start = bench_now_ns();                                                                      \
+                map##_t *m = bench_##map##_build(keys, entries);                                                       \
+                elapsed += bench_now_ns() - start;                                                                     \
+                if (m == null)                                                                                         \
+                    return false;                                                                                      \
+                found += map##_size(m);                                                                                \
+                if (round == rounds - 1)                                                                               \
+                    bench_memory_usage(&result->rss_kb, &result->peak_kb);                                             \
+                map##_destroy(m);                                                                                      \
+            }                                                                                                          \
+            result->ops = rounds * entries;                                                                            \
+        }                                                                                                              \
+        else                                                                                                           \
+        {                                                                                                              \
+            map##_t *m = bench_##map##_build(keys, entries);                                                           \
+            if (m == null)                                                                                             \
+                return false;                                                                                          \
+            const key_t *probe = pattern == BENCH_PATTERN_LOOKUP_HIT ? keys : keys + entries;                          \
+            result->ops = bench_ops(entries, min_ops);                                                                 \
+            const u64 start = bench_now_ns();                                                                          \
+            for (u64 i = 0, k = 0; i < result->ops; i++, k = k + 1 == entries ? 0 : k + 1)                             \
+                found += map##_exists(m, probe[k]);                                                                    \
+            elapsed = bench_now_ns() - start;                                                                          \
+            bench_memory_usage(&result->rss_kb, &result->peak_kb);                                                     \
+            map##_destroy(m);                                                                                          \
+        }                                                                                                              \
+        result->ns_per_op = (f64)elapsed / (f64)result->ops;                                                           \
+        return found == (pattern == BENCH_PATTERN_LOOKUP_MISS ? 0 : result->ops);                                      \
+    }
+
+BENCH_TYPED_RUN(u32_map, u32)
+BENCH_TYPED_RUN(u64_map, u64)
+BENCH_TYPED_RUN(ptr_map, const void *)
+
+int main(int argc, char **argv)
+{
+    bench_options_t options = {.name = "clib_bench_ht_typed", .subject_label = "table", .size_label = "entries"};
+    int exit_code;
+    if (!bench_parse_options(&options, argc, argv, &exit_code))
+        return exit_code;
+
+    const u64 max_entries = options.max_size > 0 ? options.max_size : BENCH_TYPED_MAX_ENTRIES / options.divisor;
+    const u64 min_ops = BENCH_TYPED_MIN_OPS / options.divisor;
+    // Twice the entries, so the misses have keys of their own; pointer keys are the addresses of the u64 keys
+    u32 *keys32 = malloc(max_entries * 2 * sizeof(u32));
+    u64 *keys64 = malloc(max_entries * 2 * sizeof(u64));
+    const void **ptrs = malloc(max_entries * 2 * sizeof(void *));
+    if (keys32 == null || keys64 == null || ptrs == null)
+    {
+        fprintf(stderr, "Failed to allocate %llu keys\n", (unsigned long long)max_entries * 2);
+        free(keys32);
+        free(keys64);
+        free(ptrs);
+        return 1;
+    }
+    for (u64 i = 0; i < max_entries * 2; i++)
+    {
+        keys32[i] = (u32)i * 0x9E3779B9u; // An odd multiplier keeps 32-bit keys distinct
+        keys64[i] = bench_key(i);
+        ptrs[i] = &keys64[i];
+    }
+
+    bench_begin(&options, "\"keys\": \"u32, u64 and pointers\", \"values\": \"u64\"");
+    int failures = 0;
+    for (u64 entries = BENCH_TYPED_MIN_ENTRIES; entries <= max_entries; entries *= 10)
+    {
+        for (u32 p = 0; p < sizeof(bench_pattern_names) / sizeof(bench_pattern_names[0]); p++)
+        {
+            for (u32 s = 0; s < sizeof(bench_subjects) / sizeof(bench_subjects[0]); s++)
+            {
+                const bench_subject_t *subject = &bench_subjects[s];
+                if (!bench_selected(&options, bench_pattern_names[p], subject->name))
+                    continue;
+                bench_result_t result = {.pattern = bench_pattern_names[p], .subject = subject->name,
+                                         .size = entries, .threads = 1};
+                const bench_pattern_t pattern = (bench_pattern_t)p;
+                bool ok;
+                if (subject->type == BENCH_KEY_U32)
+                    ok = subject->typed ? bench_u32_map_run(pattern, keys32, entries, min_ops, &result)
+                                        : bench_ht_run(pattern, (const u8 *)keys32, sizeof(u32), entries, min_ops,
+                                                       &result);
+                else if (subject->type == BENCH_KEY_U64)
+                    ok = subject->typed ? bench_u64_map_run(pattern, keys64, entries, min_ops, &result)
+                                        : bench_ht_run(pattern, (const u8 *)keys64, sizeof(u64), entries, min_ops,
+                                                       &result);
+                else
+                    ok = subject->typed ? bench_ptr_map_run(pattern, ptrs, entries, min_ops, &result)
+                                        : bench_ht_run(pattern, (const u8 *)ptrs, sizeof(void *), entries, min_ops,
+                                                       &result);
+                if (result.ops > 0)
+                    bench_report(&options, &result);
+                if (!ok)
+                    failures++;
+            }
+        }
+    }
+
+    free(keys32);
+    free(keys64);
+    free(ptrs);
+    return bench_end(&options, failures);
+}
@@ -15,10 +15,30 @@
 #pragma once
 
 #include "defines.h"
+#include "filesystem_lib.h"
 #include "memory_lib.h"
 #include "string_lib.h"
 #include "thread_lib.h"
 
+// Hashing
+// 64-bit hashes of any bytes at any alignment. cl_hash_wy is the wyhash construction, cl_ht's default; cl_hash_xxh64
+// is xxHash64. A secret seed keeps callers who control the keys from choosing ones that collide.
+u64 cl_hash_wy(const void *data, u64 length, u64 seed);
+u64 cl_hash_xxh64(const void *data, u64 length, u64 seed);
+// Differs on every call and between runs; meant against hash flooding, not as a cryptographic secret
+u64 cl_hash_random_seed(void);
+
+// Mixes every bit of an integer key into every bit of the result (the MurmurHash3 finalizer), for tables that index
+// by the low bits
+static inline u64 cl_hash_u64(u64 x)
+{
+    x ^= x >> 33;
+    x *= 0xFF51AFD7ED558CCDull;
+    x ^= x >> 33;
+    x *= 0xC4CEB9FE1A85EC53ull;
+    return x ^ (x >> 33);
+}
+
 // Hash table structure
 typedef struct cl_ht cl_ht_t;
 
@@ -43,7 +63,17 @@ typedef enum cl_ht_flags
     CL_HT_FLAG_FROZEN = 1 << 2,
     CL_HT_FLAG_FROZEN_UNTIL_GROWS = 1 << 3,
     CL_HT_FLAG_FREE_DATA = 1 << 4,
-    CL_HT_FLAG_IGNORE_CASE = 1 << 5
+    CL_HT_FLAG_IGNORE_CASE = 1 << 5,
+    CL_HT_FLAG_GROUP_PROBING = 1 << 6, // Swiss-table layout: SIMD probing of 7-bit hash tags; fixed at creation
+    // A resize allocates the new array and moves a bounded number of slots per later operation instead of all at
+    // once; lookups check both arrays until it is done
+    CL_HT_FLAG_INCREMENTAL_RESIZE = 1 << 7,
+    // Copied keys of up to 32 bytes go to table-owned pools instead of one allocation each, and are all freed at once
+    // by clear and destroy; fixed at creation
+    CL_HT_FLAG_KEY_ARENA = 1 << 8,
+    // The default hash takes a seed from cl_hash_random_seed, so key placement cannot be predicted from outside; fixed
+    // at creation
+    CL_HT_FLAG_RANDOM_SEED = 1 << 9
 } cl_ht_flags_t;
 
 // Hash table functions
@@ -68,16 +98,79 @@ bool cl_ht_put(cl_ht_t *ht, const void *key, u64 key_size, void *data, u64 data_
 void cl_ht_clear(cl_ht_t *ht);
 void *cl_ht_remove(cl_ht_t *ht, const void *key, u64 key_size);
 
+// Batched forms for bulk work: each chunk of keys is hashed and has its home slots prefetched before any of them is
+// probed, so the cache misses overlap. Keys must not be null. cl_ht_get_batch fills out_data and out_found per key
+// when given and returns how many keys were found. cl_ht_put_batch grows the table once up front, takes null data or
+// data_sizes as all null / 0, and returns how many keys it stored before the first failure.
+u64 cl_ht_get_batch(cl_ht_t *ht, const void *const *keys, const u64 *key_sizes, u64 n, void **out_data,
+                    bool *out_found);
+u64 cl_ht_put_batch(cl_ht_t *ht, const void *const *keys, const u64 *key_sizes, void *const *data,
+                    const u64 *data_sizes, u64 n);
+
 void **cl_ht_keys(cl_ht_t *ht, u64 *num_keys, u64 **key_sizes, bool fast);
+// Keeps one position for every table in the process; prefer cl_ht_iterator_t or cl_ht_scan
 bool cl_ht_iter_init(cl_ht_t *ht, void **key, u64 *key_size, void **data, u64 *data_size);
 bool cl_ht_iter_next(cl_ht_t *ht, void **key, u64 *key_size, void **data, u64 *data_size);
 
+// An entry as it sits in the table, without copies. The key stays valid until the entry is removed.
+typedef struct cl_ht_entry_view
+{
+    const void *key;
+    u64 key_size;
+    void *data;
+    u64 data_size;
+} cl_ht_entry_view_t;
+
+// Iteration state kept by the caller, usually on the stack, so any number of iterations can run over one table. A
+// put that resizes the table, or a remove in the Robin Hood layout (which shifts later entries back), can make the
+// rest of an iteration repeat or skip entries; removing the returned entries is safe in the group-probing layout.
+// Iterating never moves entries of a pending incremental resize, but other operations made meanwhile do, and an
+// entry they move after the iteration has returned it can be returned again.
+typedef struct cl_ht_iterator
+{
+    cl_ht_t *ht;
+    u64 index; // Next slot to look at, in the old array first while an incremental resize is in progress
+} cl_ht_iterator_t;
+
+void cl_ht_iterator_init(cl_ht_t *ht, cl_ht_iterator_t *it);
+bool cl_ht_iterator_next(cl_ht_iterator_t *it, cl_ht_entry_view_t *entry);
+// Fills up to count views from the slot cursor, which starts at 0, and returns how many it filled. The cursor is set
+// back to 0 once the scan reaches the end of the table, so callers can spread a pass over many calls and do other
+// work in between; the same rules as for cl_ht_iterator_t apply to changes made meanwhile.
+u64 cl_ht_scan(cl_ht_t *ht, u64 *cursor, cl_ht_entry_view_t *views, u64 count);
+
 u64 cl_ht_foreach_remove(cl_ht_t *ht, cl_ht_remove_func_t r_fn, cl_ht_free_func_t ff, void *arg);
 u64 cl_ht_foreach(cl_ht_t *ht, cl_ht_foreach_func_t fe_fn, void *arg);
 
 bool cl_ht_rehash(cl_ht_t *ht);
 u64 cl_ht_size(cl_ht_t *ht);
 bool cl_ht_is_empty(cl_ht_t *ht);
+// Counts entries by probe length, the slots (groups, in the group-probing layout) a lookup steps past before reaching
+// them; the last count also takes every longer probe. Returns the longest probe length.
+u64 cl_ht_probe_lengths(cl_ht_t *ht, u64 *counts, u32 count);
+// Rebuilds a table whose keys are final into a minimal perfect hash: one slot per entry plus a 4-byte seed per three
+// entries, and every lookup reads exactly one slot. Values of existing keys can still be replaced through put; new
+// keys and removals fail until cl_ht_clear, after which the next put returns the table to its probing layout. Fails
+// and leaves the table as it was when it is empty, memory runs out, or two keys share a full 64-bit hash.
+bool cl_ht_freeze_perfect(cl_ht_t *ht);
+
+// Snapshots: a table written to a file that later processes map read-only instead of rebuilding the table. The file
+// holds hashes, keys and values but no pointers, so it serves lookups from wherever it is mapped, and processes mapping
+// the same file share its pages. Values are written as the data_size bytes data points at; a value stored with
+// data_size 0 keeps its pointer bits instead. Tables with their own hash function cannot be written.
+typedef struct cl_ht_snapshot cl_ht_snapshot_t;
+// Writes to path with a ".tmp" suffix first and renames it over path, so readers never map a partial file
+bool cl_ht_snapshot_write(cl_ht_t *ht, cl_fs_t *fs, const char *path);
+// Null when the file is missing or not a snapshot of this version and byte order
+cl_ht_snapshot_t *cl_ht_snapshot_open(const cl_allocator_t *allocator, cl_fs_t *fs, const char *path);
+void cl_ht_snapshot_close(cl_ht_snapshot_t *snapshot);
+u64 cl_ht_snapshot_size(const cl_ht_snapshot_t *snapshot);
+// Data points into the mapping, 8-byte aligned, and stays valid until the snapshot is closed
+bool cl_ht_snapshot_get(const cl_ht_snapshot_t *snapshot, const void *key, u64 key_size, const void **data,
+                        u64 *data_size);
+// Walks every entry from a cursor that starts at 0; data and data_size may be null
+bool cl_ht_snapshot_next(const cl_ht_snapshot_t *snapshot, u64 *cursor, const void **key, u64 *key_size,
+                         const void **data, u64 *data_size);
 
 
 bool cl_ht_lock(cl_ht_t *ht);
@@ -90,6 +183,70 @@ void *cl_ht_put_str(cl_ht_t *ht, const char *key, void *data);
 void *cl_ht_remove_str(cl_ht_t *ht, const char *key);
 bool cl_ht_iter_init_str(cl_ht_t *ht, char **key, void **data);
 bool cl_ht_iter_next_str(cl_ht_t *ht, char **key, void **data);
+
+// Concurrent hash table
+// Sharded on the top bits of the remixed hash into independently locked cl_ht tables, so operations on different
+// shards never contend. Every call synchronizes internally; data pointers handed back stay valid only as long as the
+// caller's own protocol keeps other threads from removing or freeing them.
+typedef struct cl_cht cl_cht_t;
+
+// shards is rounded up to a power of two, 0 picks a default; flags apply to every shard, which always uses the
+// group-probing layout and no locking of its own
+cl_cht_t *cl_cht_create(const cl_allocator_t *allocator, u32 shards, cl_ht_flags_t flags);
+void cl_cht_destroy(cl_cht_t *cht);
+
+// Only allowed while the table is empty
+bool cl_cht_set_hash_function(cl_cht_t *cht, cl_ht_hash_func_t hf);
+bool cl_cht_set_free_function(cl_cht_t *cht, cl_ht_free_func_t ff);
+
+bool cl_cht_get(cl_cht_t *cht, const void *key, u64 key_size, void **data, u64 *data_size);
+bool cl_cht_exists(cl_cht_t *cht, const void *key, u64 key_size);
+bool cl_cht_put(cl_cht_t *cht, const void *key, u64 key_size, void *data, u64 data_size, void **old_data);
+void *cl_cht_remove(cl_cht_t *cht, const void *key, u64 key_size);
+void cl_cht_clear(cl_cht_t *cht);
+
+// Visits one shard at a time with that shard locked; the callback must not call back into the same table
+u64 cl_cht_foreach(cl_cht_t *cht, cl_ht_foreach_func_t fe_fn, void *arg);
+
+u64 cl_cht_size(cl_cht_t *cht);
+u32 cl_cht_shard_count(const cl_cht_t *cht);
+// Entries in one shard, for checking how evenly a hash function spreads keys; 0 for an out of range shard
+u64 cl_cht_shard_size(cl_cht_t *cht, u32 shard);
+
+// Read-mostly hash table
+// Lookups take no locks: a reader only marks itself in a striped counter while it probes. Writers serialize on a
+// mutex, publish entries and resized slot arrays with atomic stores, and free what they replaced once every reader
+// that could still see it has left. Keys are always copied.
+typedef struct cl_rmht cl_rmht_t;
+
+cl_rmht_t *cl_rmht_create(const cl_allocator_t *allocator);
+// No reader or writer may still be using the table
+void cl_rmht_destroy(cl_rmht_t *rmht);
+
+// Only allowed while the table is empty
+bool cl_rmht_set_hash_function(cl_rmht_t *rmht, cl_ht_hash_func_t hf);
+// Applied to data a put replaces and to data cleared or destroyed, once no reader can still return it
+bool cl_rmht_set_free_function(cl_rmht_t *rmht, cl_ht_free_func_t ff);
+
+// Lock-free
+bool cl_rmht_get(cl_rmht_t *rmht, const void *key, u64 key_size, void **data, u64 *data_size);
+bool cl_rmht_exists(cl_rmht_t *rmht, const void *key, u64 key_size);
+u64 cl_rmht_size(cl_rmht_t *rmht);
+// Visits a snapshot inside a read section; the callback must not write to the same table
+u64 cl_rmht_foreach(cl_rmht_t *rmht, cl_ht_foreach_func_t fe_fn, void *arg);
+
+// Serialized between writers
+bool cl_rmht_put(cl_rmht_t *rmht, const void *key, u64 key_size, void *data, u64 data_size, void **old_data);
+void *cl_rmht_remove(cl_rmht_t *rmht, const void *key, u64 key_size);
+void cl_rmht_clear(cl_rmht_t *rmht);
+
+// A read section keeps data returned by gets inside it from being reclaimed; sections may nest, and a thread must not
+// write to the table from inside one. cl_rmht_synchronize waits for every section that started before it, after
+// which data removed earlier is unreachable and may be freed.
+u32 cl_rmht_read_lock(cl_rmht_t *rmht);
+void cl_rmht_read_unlock(cl_rmht_t *rmht, u32 token);
+void cl_rmht_synchronize(cl_rmht_t *rmht);
+
 // Dynamic array
 typedef struct cl_da cl_da_t;
 
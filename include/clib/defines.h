@@ -38,6 +38,13 @@ typedef double f64;
 #error "Unsupported compiler"
 #endif
 
+// Thread-local storage for a static or global
+#if defined(CL_COMPILER_MSVC)
+#define CL_THREAD_LOCAL __declspec(thread)
+#else
+#define CL_THREAD_LOCAL _Thread_local
+#endif
+
 // Platform detection
 #if defined(_WIN32) || defined(_WIN64)
 #define CL_PLATFORM_WINDOWS
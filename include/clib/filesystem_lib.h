@@ -77,6 +77,10 @@ u64 cl_fs_read_file(cl_file_t *file, void *buffer, u64 size);
 u64 cl_fs_write_file(cl_file_t *file, const void *buffer, u64 size);
 bool cl_fs_seek_file(cl_file_t *file, i64 offset, i32 origin);
 i64 cl_fs_tell_file(cl_file_t *file);
+// Maps the whole file read-only and shared, so processes mapping the same file share its pages. The mapping outlives
+// the file handle and is released with cl_fs_unmap_file. Returns null for an empty file.
+const void *cl_fs_map_file(cl_file_t *file, u64 *size);
+void cl_fs_unmap_file(const void *data, u64 size);
 
 // Directory operations
 bool cl_fs_create_directory(cl_fs_t *fs, const char *path);
@@ -0,0 +1,273 @@
+/**
+ * Created by jraynor on 8/6/2024.
+ */
+#pragma once
+
+#include "containers_lib.h"
+#include "defines.h"
+#include "memory_lib.h"
+
+// Type-specialized hash maps generated at compile time. CL_HT_DEFINE(name, key_t, val_t, hash, eq) emits name_t and
+// static inline name_* functions for an open-addressing Robin Hood map that stores keys and values inline, with
+// hash(key) returning a u64 and eq(a, b) comparing two keys, both expanded in place rather than called through
+// pointers. Keys are held by value; anything they point to is the caller's. Not synchronized.
+//
+//     CL_HT_DEFINE(id_map, u64, entity_t, cl_ht_hash_u64, cl_ht_eq)
+//     id_map_t *map = id_map_create(null);
+//     id_map_put(map, id, entity, null);
+//     entity_t *found = id_map_find(map, id);
+
+#define CL_HT_DEFINE_INITIAL_SIZE 16
+#define CL_HT_DEFINE_MAX_PROBE 255 // Probe distances are stored in a byte
+
+// Hashes for the generated maps; the map indexes slots by the low bits, so every input bit has to reach them
+static inline u64 cl_ht_hash_u64(u64 key) { return cl_hash_u64(key); }
+
+static inline u64 cl_ht_hash_u32(u32 key) { return cl_ht_hash_u64(key); }
+
+static inline u64 cl_ht_hash_ptr(const void *key) { return cl_ht_hash_u64((u64)(uintptr_t)key); }
+
+#define cl_ht_eq(a, b) ((a) == (b))
+
+// dist holds one byte per slot: 0 when empty, otherwise one more than how far the entry sits from its home slot.
+// Entries along a run stay ordered by home slot, so a lookup stops at the first slot closer to home than the probe.
+#define CL_HT_DEFINE(name, key_t, val_t, hash, eq)                                                                     \
+    typedef struct name##_entry                                                                                        \
+    {                                                                                                                  \
+        key_t key;                                                                                                     \
+        val_t value;                                                                                                   \
+    } name##_entry_t;                                                                                                  \
+                                                                                                                       \
+    typedef struct name                                                                                                \
+    {                                                                                                                  \
+        name##_entry_t *entries;                                                                                       \
+        u8 *dist; /* Stored right after the entries */                                                                 \
+        u64 capacity;                                                                                                  \
+        u64 mask;                                                                                                      \
+        u64 size;                                                                                                      \
+        const cl_allocator_t *allocator;                                                                               \
+    } name##_t;                                                                                                        \
+                                                                                                                       \
+    static inline bool name##_alloc_slots(name##_t *map, u64 capacity)                                                 \
+    {                                                                                                                  \
+        name##_entry_t *entries =                                                                                      \
+            (name##_entry_t *)cl_mem_alloc(map->allocator, capacity * (sizeof(name##_entry_t) + 1));                   \
+        if (entries == null)                                                                                           \
+            return false;                                                                                              \
+        map->entries = entries;                                                                                        \
+        map->dist = (u8 *)(entries + capacity);                                                                        \
+        cl_mem_set(map->dist, 0, capacity);                                                                            \
+        map->capacity = capacity;                                                                                      \
+        map->mask = capacity - 1;                                                                                      \
+        return true;                                                                                                   \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline name##_t *name##_create_with_size(const cl_allocator_t *allocator, u64 size)                         \
+    {                                                                                                                  \
+        name##_t *map = (name##_t *)cl_mem_alloc(allocator, sizeof(name##_t));                                         \
+        if (map == null)                                                                                               \
+            return null;                                                                                               \
+        map->allocator = allocator;                                                                                    \
+        map->size = 0;                                                                                                 \
+        u64 capacity = CL_HT_DEFINE_INITIAL_SIZE;                                                                      \
+        while (capacity < (1ULL << 62) && size * 4 > capacity * 3)                                                     \
+            capacity <<= 1;                                                                                            \
+        if (!name##_alloc_slots(map, capacity))                                                                        \
+        {                                                                                                              \
+            cl_mem_free(allocator, map);                                                                               \
+            return null;                                                                                               \
+        }                                                                                                              \
+        return map;                                                                                                    \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline name##_t *name##_create(const cl_allocator_t *allocator)                                             \
+    {                                                                                                                  \
+        return name##_create_with_size(allocator, 0);                                                                  \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline void name##_destroy(name##_t *map)                                                                   \
+    {                                                                                                                  \
+        if (map == null)                                                                                               \
+            return;                                                                                                    \
+        cl_mem_free(map->allocator, map->entries);                                                                     \
+        cl_mem_free(map->allocator, map);                                                                              \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline u64 name##_size(const name##_t *map) { return map ? map->size : 0; }                                 \
+                                                                                                                       \
+    static inline void name##_clear(name##_t *map)                                                                     \
+    {                                                                                                                  \
+        if (map == null)                                                                                               \
+            return;                                                                                                    \
+        cl_mem_set(map->dist, 0, map->capacity);                                                                       \
+        map->size = 0;                                                                                                 \
+    }                                                                                                                  \
+                                                                                                                       \
+    /* Slot holding key, or capacity when it is absent */                                                              \
+    static inline u64 name##_index(const name##_t *map, key_t key)                                                     \
+    {                                                                                                                  \
+        u64 i = (u64)(hash(key)) & map->mask;                                                                          \
+        for (u32 d = 1; map->dist[i] >= d; i = (i + 1) & map->mask, d++)                                               \
+        {                                                                                                              \
+            if (map->dist[i] == d && eq(map->entries[i].key, key))                                                     \
+                return i;                                                                                              \
+        }                                                                                                              \
+        return map->capacity;                                                                                          \
+    }                                                                                                                  \
+                                                                                                                       \
+    /* Stores key in slot i, d - 1 slots from its home, where a probe for it stopped; false when a probe distance      \
+     * would not fit, leaving the map untouched */                                                                     \
+    static inline bool name##_place_at(name##_t *map, u64 i, u32 d, key_t key, val_t value)                            \
+    {                                                                                                                  \
+        /* Everything from i up to the next empty slot moves one slot further from home */                             \
+        u64 end = i;                                                                                                   \
+        u32 longest = d;                                                                                               \
+        for (; map->dist[end] != 0; end = (end + 1) & map->mask)                                                       \
+            longest = map->dist[end] + 1u > longest ? map->dist[end] + 1u : longest;                                   \
+        if (longest > CL_HT_DEFINE_MAX_PROBE)                                                                          \
+            return false;                                                                                              \
+        for (u64 j = end; j != i; j = (j - 1) & map->mask)                                                             \
+        {                                                                                                              \
+            const u64 prev = (j - 1) & map->mask;                                                                      \
+            map->entries[j] = map->entries[prev];                                                                      \
+            map->dist[j] = map->dist[prev] + 1;                                                                        \
+        }                                                                                                              \
+        map->entries[i].key = key;                                                                                     \
+        map->entries[i].value = value;                                                                                 \
+        map->dist[i] = (u8)d;                                                                                          \
+        map->size++;                                                                                                   \
+        return true;                                                                                                   \
+    }                                                                                                                  \
+                                                                                                                       \
+    /* Inserts a key known to be absent */                                                                             \
+    static inline bool name##_place(name##_t *map, key_t key, val_t value)                                             \
+    {                                                                                                                  \
+        u64 i = (u64)(hash(key)) & map->mask;                                                                          \
+        u32 d = 1;                                                                                                     \
+        for (; map->dist[i] >= d; i = (i + 1) & map->mask, d++)                                                        \
+        {                                                                                                              \
+        }                                                                                                              \
+        return name##_place_at(map, i, d, key, value);                                                                 \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline bool name##_resize(name##_t *map, u64 capacity)                                                      \
+    {                                                                                                                  \
+        name##_t old = *map;                                                                                           \
+        if (!name##_alloc_slots(map, capacity))                                                                        \
+            return false;                                                                                              \
+        map->size = 0;                                                                                                 \
+        for (u64 i = 0; i < old.capacity; i++)                                                                         \
+        {                                                                                                              \
+            if (old.dist[i] != 0 && !name##_place(map, old.entries[i].key, old.entries[i].value))                      \
+            {                                                                                                          \
+                cl_mem_free(map->allocator, map->entries);                                                             \
+                *map = old;                                                                                            \
+                return false;                                                                                          \
+            }                                                                                                          \
+        }                                                                                                              \
+        cl_mem_free(map->allocator, old.entries);                                                                      \
+        return true;                                                                                                   \
+    }                                                                                                                  \
+                                                                                                                       \
+    /* Grows once so entries fit without another resize */                                                             \
+    static inline bool name##_reserve(name##_t *map, u64 entries)                                                      \
+    {                                                                                                                  \
+        if (map == null)                                                                                               \
+            return false;                                                                                              \
+        u64 capacity = map->capacity;                                                                                  \
+        while (capacity < (1ULL << 62) && entries * 4 > capacity * 3)                                                  \
+            capacity <<= 1;                                                                                            \
+        return capacity == map->capacity || name##_resize(map, capacity);                                              \
+    }                                                                                                                  \
+                                                                                                                       \
+    /* Pointer to the value stored inline for key, valid until the next put or remove; null when absent */             \
+    static inline val_t *name##_find(name##_t *map, key_t key)                                                         \
+    {                                                                                                                  \
+        if (map == null)                                                                                               \
+            return null;                                                                                               \
+        const u64 i = name##_index(map, key);                                                                          \
+        return i < map->capacity ? &map->entries[i].value : null;                                                      \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline bool name##_get(name##_t *map, key_t key, val_t *value)                                              \
+    {                                                                                                                  \
+        val_t *found = name##_find(map, key);                                                                          \
+        if (found == null)                                                                                             \
+            return false;                                                                                              \
+        if (value)                                                                                                     \
+            *value = *found;                                                                                           \
+        return true;                                                                                                   \
+    }                                                                                                                  \
+                                                                                                                       \
+    static inline bool name##_exists(name##_t *map, key_t key) { return name##_find(map, key) != null; }               \
+                                                                                                                       \
+    /* Inserts or replaces; old_value, when given, receives a replaced value. Fails on allocation failure, or when so  \
+     * many keys share a hash that growing would not shorten their probes. */                                          \
+    static inline bool name##_put(name##_t *map, key_t key, val_t value, val_t *old_value)                             \
+    {                                                                                                                  \
+        if (map == null)                                                                                               \
+            return false;                                                                                              \
+        if ((map->size + 1) * 4 > map->capacity * 3 && !name##_resize(map, map->capacity * 2))                         \
+            return false;                                                                                              \
+        /* One probe finds either the key or the slot it belongs in */                                                 \
+        u64 i = (u64)(hash(key)) & map->mask;                                                                          \
+        u32 d = 1;                                                                                                     \
+        for (; map->dist[i] >= d; i = (i + 1) & map->mask, d++)                                                        \
+        {                                                                                                              \
+            if (map->dist[i] == d && eq(map->entries[i].key, key))                                                     \
+            {                                                                                                          \
+                if (old_value)                                                                                         \
+                    *old_value = map->entries[i].value;                                                                \
+                map->entries[i].value = value;                                                                         \
+                return true;                                                                                           \
+            }                                                                                                          \
+        }                                                                                                              \
+        if (name##_place_at(map, i, d, key, value))                                                                    \
+            return true;                                                                                               \
+        do                                                                                                             \
+        {                                                                                                              \
+            if (map->size * 8 < map->capacity || !name##_resize(map, map->capacity * 2))                               \
+                return false;                                                                                          \
+        } while (!name##_place(map, key, value));                                                                      \
+        return true;                                                                                                   \
+    }                                                                                                                  \
+                                                                                                                       \
+    /* Backward-shift deletion: the entries after the removed one step back towards home, so no tombstones build up */ \
+    static inline bool name##_remove(name##_t *map, key_t key, val_t *value)                                           \
+    {                                                                                                                  \
+        if (map == null)                                                                                               \
+            return false;                                                                                              \
+        u64 i = name##_index(map, key);                                                                                \
+        if (i == map->capacity)                                                                                        \
+            return false;                                                                                              \
+        if (value)                                                                                                     \
+            *value = map->entries[i].value;                                                                            \
+        for (u64 next = (i + 1) & map->mask; map->dist[next] > 1; i = next, next = (next + 1) & map->mask)             \
+        {                                                                                                              \
+            map->entries[i] = map->entries[next];                                                                      \
+            map->dist[i] = map->dist[next] - 1;                                                                        \
+        }                                                                                                              \
+        map->dist[i] = 0;                                                                                              \
+        map->size--;                                                                                                   \
+        return true;                                                                                                   \
+    }                                                                                                                  \
+                                                                                                                       \
+    /* Iterates from *cursor, which starts at 0; entries must not be put or removed in between */                      \
+    static inline bool name##_next(name##_t *map, u64 *cursor, key_t *key, val_t **value)                              \
+    {                                                                                                                  \
+        if (map == null)                                                                                               \
+            return false;                                                                                              \
+        for (u64 i = *cursor; i < map->capacity; i++)                                                                  \
+        {                                                                                                              \
+            if (map->dist[i] == 0)                                                                                     \
+                continue;                                                                                              \
+            if (key)                                                                                                   \
+                *key = map->entries[i].key;                                                                            \
+            if (value)                                                                                                 \
+                *value = &map->entries[i].value;                                                                       \
+            *cursor = i + 1;                                                                                           \
+            return true;                                                                                               \
+        }                                                                                                              \
+        *cursor = map->capacity;                                                                                       \
+        return false;                                                                                                  \
+    }
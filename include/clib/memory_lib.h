@@ -15,6 +15,9 @@ typedef struct cl_allocator cl_allocator_t;
 typedef void *(*cl_alloc_func)(u64 size, void *user_data);
 typedef void *(*cl_realloc_func)(void *ptr, u64 new_size, void *user_data);
 typedef void (*cl_free_func)(void *ptr, void *user_data);
+typedef void *(*cl_aligned_alloc_func)(u64 size, u64 alignment, void *user_data);
+typedef u64 (*cl_alloc_batch_func)(u64 size, u64 count, void **out_ptrs, void *user_data);
+typedef void (*cl_free_batch_func)(void **ptrs, u64 count, void *user_data);
 
 // Allocator structure
 typedef enum cl_allocator_type
@@ -25,7 +28,8 @@ typedef enum cl_allocator_type
     CL_ALLOCATOR_TYPE_LINEAR, // linear allocator
     CL_ALLOCATOR_TYPE_STACK, // stack allocator
     CL_ALLOCATOR_TYPE_FREE_LIST, // free list allocator
-    CL_ALLOCATOR_TYPE_PROXY, // proxy allocator
+    CL_ALLOCATOR_TYPE_PROXY, // proxy allocator (thread cache or tracking front-end for another allocator)
+    CL_ALLOCATOR_TYPE_GUARD, // debug allocator putting sampled allocations against an inaccessible guard page
     CL_ALLOCATOR_TYPE_COUNT
 } cl_allocator_type_t;
 
@@ -33,20 +37,31 @@ typedef enum cl_allocator_flags
 {
     CL_ALLOCATOR_FLAG_NONE = 0,
     CL_ALLOCATOR_FLAG_CLEAR = 1 << 0, // clear memory to zero
-    CL_ALLOCATOR_FLAG_ALIGN = 1 << 1, // align memory to a specific boundary
+    CL_ALLOCATOR_FLAG_ALIGN = 1 << 1, // align every allocation to config.alignment
+    CL_ALLOCATOR_FLAG_GROWABLE = 1 << 2, // allow fixed-capacity allocators (pool) to grow by whole slabs
+    CL_ALLOCATOR_FLAG_HUGE_PAGES = 1 << 3, // hint that reserved address space should be backed by huge pages
+    CL_ALLOCATOR_FLAG_CONCURRENT = 1 << 4, // lock-free pool that any thread may allocate from and free to
     CL_ALLOCATOR_FLAG_COUNT
 } cl_allocator_flags_t;
 
+typedef enum cl_proxy_mode
+{
+    CL_PROXY_MODE_THREAD_CACHE, // per-thread size-class caches in front of the backing allocator
+    CL_PROXY_MODE_TRACKING, // counts every allocation, per call site when the caller passes one
+} cl_proxy_mode_t;
+
 typedef struct cl_allocator_config
 {
     cl_allocator_type_t type;
     cl_allocator_flags_t flags;
+    u64 alignment; // power of two honoured with CL_ALLOCATOR_FLAG_ALIGN, 64 bytes (a cache line) when zero
     union
     {
         struct
         {
             u64 block_size;
             u64 block_count;
+            const cl_allocator_t *allocator; // backs the slabs of non-concurrent pools, platform malloc when null
         } pool;
         struct
         {
@@ -64,18 +79,25 @@ typedef struct cl_allocator_config
         } stack;
         struct
         {
-            u64 block_size;
-            u64 block_count;
-            void *free_list;
+            u64 size;
+            void *start; // optional caller-provided region, reserved internally when null
         } free_list;
         struct
         {
-            u64 size;
+            u64 size; // block size, or commit granularity when reserving
+            u64 reserve; // when non-zero, reserve this much address space and grow contiguously inside it
         } arena;
         struct
         {
-            cl_allocator_t *allocator;
+            cl_allocator_t *allocator; // backing allocator, platform malloc when null
+            cl_proxy_mode_t mode;
+            u64 cache_size; // blocks each thread may hold per size class before flushing half back
         } proxy;
+        struct
+        {
+            cl_allocator_t *allocator; // serves the unsampled allocations, platform malloc when null
+            u32 sample_rate; // guard one in this many allocations, every allocation when 0 or 1
+        } guard;
     } config;
     void *user_data;
 } cl_allocator_config_t;
@@ -88,9 +110,19 @@ struct cl_allocator
     cl_alloc_func alloc;
     cl_realloc_func realloc;
     cl_free_func free;
+    cl_aligned_alloc_func aligned_alloc; // optional; results are released with free
+    cl_alloc_batch_func alloc_batch; // optional; returns how many leading out_ptrs were filled
+    cl_free_batch_func free_batch; // optional; ptrs holds no nulls
     void *user_data;
 };
 
+// Position in a linear or stack allocator, captured with cl_mem_mark and restored with cl_mem_rollback
+typedef struct cl_mem_marker
+{
+    u64 position;
+    u64 last;
+} cl_mem_marker_t;
+
 // Memory system initialization
 
 // Allocator management
@@ -102,14 +134,93 @@ void cl_allocator_destroy(cl_allocator_t *allocator);
 void *cl_mem_alloc(const cl_allocator_t *allocator, u64 size);
 void *cl_mem_realloc(const cl_allocator_t *allocator, void *ptr, u64 new_size);
 void cl_mem_free(const cl_allocator_t *allocator, void *ptr);
-void *cl_mem_aligned_alloc(cl_allocator_t *allocator, u64 alignment, u64 size);
+// Alignment must be a power of two; release with cl_mem_aligned_free, or cl_mem_free when the allocator has a native
+// aligned_alloc (every built-in allocator except the platform one on Windows). realloc does not keep the alignment.
+void *cl_mem_aligned_alloc(const cl_allocator_t *allocator, u64 alignment, u64 size);
 void cl_mem_aligned_free(const cl_allocator_t *allocator, void *ptr);
+// Allocates count blocks of size bytes in one call, all or nothing; each block may later be freed on its own
+bool cl_mem_alloc_batch(const cl_allocator_t *allocator, u64 size, u64 count, void **out_ptrs);
+// Frees count blocks in one call, skipping nulls
+void cl_mem_free_batch(const cl_allocator_t *allocator, void **ptrs, u64 count);
+
+// Arena allocator; reset releases every allocation but keeps up to keep_blocks blocks for reuse
+bool cl_arena_reset(const cl_allocator_t *allocator, u64 keep_blocks);
+
+// Markers (linear and stack allocators); rolling back to a zeroed marker resets the allocator
+cl_mem_marker_t cl_mem_mark(const cl_allocator_t *allocator);
+bool cl_mem_rollback(const cl_allocator_t *allocator, cl_mem_marker_t marker);
+
+// Free list allocator
+typedef struct cl_freelist_stats
+{
+    u64 total_size; // bytes managed by the allocator
+    u64 used_size; // bytes held by live allocations, including block headers
+    u64 free_size; // bytes available to callers across all free blocks
+    u64 largest_free_block; // largest single request that can currently succeed
+    u64 free_block_count;
+    u64 allocation_count;
+    f64 fragmentation; // 0 when all free memory is one block, approaching 1 as it splinters
+} cl_freelist_stats_t;
+
+bool cl_freelist_get_stats(const cl_allocator_t *allocator, cl_freelist_stats_t *stats);
+
+// Proxy allocator; a thread can return its cached blocks to the backing allocator, e.g. before it exits
+bool cl_proxy_flush_thread_cache(const cl_allocator_t *allocator);
+
+// Tracking proxy; statistics cover every allocation made through it since it was created
+#define CL_MEM_HISTOGRAM_BUCKETS 32
+
+typedef struct cl_mem_stats
+{
+    u64 live_bytes;
+    u64 peak_bytes;
+    u64 live_count;
+    u64 total_allocations;
+    u64 total_reallocations;
+    u64 total_frees;
+    u64 total_bytes; // sum of every requested size
+    // bucket i counts requests of up to 2^i bytes, the last one anything larger
+    u64 histogram[CL_MEM_HISTOGRAM_BUCKETS];
+} cl_mem_stats_t;
+
+typedef struct cl_mem_site_stats
+{
+    const char *file; // null for allocations made without a call site
+    i32 line;
+    u64 allocations;
+    u64 total_bytes;
+    u64 live_bytes;
+    u64 live_count;
+} cl_mem_site_stats_t;
+
+bool cl_tracking_get_stats(const cl_allocator_t *allocator, cl_mem_stats_t *stats);
+// Copies up to capacity call sites, most frequently allocating first, and returns how many were written
+u64 cl_tracking_get_sites(const cl_allocator_t *allocator, cl_mem_site_stats_t *sites, u64 capacity);
+// Logs the totals, the size histogram and the max_sites hottest call sites
+void cl_tracking_dump(const cl_allocator_t *allocator, u64 max_sites);
+
+// Whether ptr is a live sampled allocation of a guard allocator, sitting right before its guard page
+bool cl_guard_contains(const cl_allocator_t *allocator, const void *ptr);
+
+// Call-site aware variants; defining CL_MEM_TRACK_CALL_SITES routes cl_mem_alloc and cl_mem_realloc through them
+void *cl_mem_alloc_at(const cl_allocator_t *allocator, u64 size, const char *file, i32 line);
+void *cl_mem_realloc_at(const cl_allocator_t *allocator, void *ptr, u64 new_size, const char *file, i32 line);
+
+#ifdef CL_MEM_TRACK_CALL_SITES
+#define cl_mem_alloc(allocator, size) cl_mem_alloc_at(allocator, size, __FILE__, __LINE__)
+#define cl_mem_realloc(allocator, ptr, new_size) cl_mem_realloc_at(allocator, ptr, new_size, __FILE__, __LINE__)
+#endif
 
-// Utility functions
+// Utility functions. They call libc, except copies of 32 MB and up, which use an AVX2 streaming kernel when the CPU
+// has one; the SSE2/AVX2 kernels for every op can be forced with cl_mem_ops_select
 void cl_mem_set(void *ptr, int value, u64 num);
 void cl_mem_copy(void *dest, const void *src, u64 num);
 void cl_mem_move(void *dest, const void *src, u64 num);
 int cl_mem_compare(const void *ptr1, const void *ptr2, u64 num);
+// Name of the active kernel set: "libc+avx2" or "libc" by default, "avx2" or "sse2" when forced
+const char *cl_mem_ops_name(void);
+// Forces a kernel set by name ("auto" re-runs detection); fails if the CPU does not support it
+bool cl_mem_ops_select(const char *name);
 
 #ifdef __cplusplus
 }
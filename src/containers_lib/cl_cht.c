@@ -0,0 +1,241 @@
+/**
+ * Created by jraynor on 8/6/2024.
+ */
+#include "cl_ht_internal.h"
+#include "clib/containers_lib.h"
+#include "clib/log_lib.h"
+#define CL_CHT_DEFAULT_SHARDS 64
+#define CL_CHT_MAX_SHARDS 65536 // Shards are picked from the top 16 bits of the remixed hash
+#define CL_CHT_SHARD_SHIFT 48
+// Shards lock externally, and group probing keeps a remove to one tombstone write instead of shifting a run of
+// entries while the lock is held
+#define CL_CHT_SHARD_FLAGS (CL_HT_FLAG_NO_LOCKING | CL_HT_FLAG_GROUP_PROBING)
+
+// Each shard is an unlocked cl_ht behind its own mutex. The tables place entries by the low hash bits, and the shard
+// comes from the top bits of the hash run once more through the integer finalizer. A caller's hash function that only
+// fills the low 32 bits would otherwise send every key to shard 0, and the remix keeps the shard independent of the
+// slot bits so the entries of a shard still spread over its table.
+typedef struct cl_cht_shard
+{
+    cl_mutex_t *mutex;
+    cl_ht_t *ht;
+} cl_cht_shard_t;
+
+struct cl_cht
+{
+    cl_cht_shard_t *shards;
+    u32 shard_count;
+    u32 shard_mask;
+    const cl_allocator_t *allocator;
+};
+
+static inline cl_cht_shard_t *cl_cht_shard(const cl_cht_t *cht, u64 hash)
+{
+    return &cht->shards[(cl_hash_u64(hash) >> CL_CHT_SHARD_SHIFT) & cht->shard_mask];
+}
+
+static void cl_cht_destroy_shards(cl_cht_t *cht, u32 count)
+{
+    for (u32 i = 0; i < count; i++)
+    {
+        cl_ht_destroy(cht->shards[i].ht);
+        cl_mutex_destroy(cht->shards[i].mutex);
+    }
+}
+
+cl_cht_t *cl_cht_create(const cl_allocator_t *allocator, u32 shards, cl_ht_flags_t flags)
+{
+    if (shards == 0)
+        shards = CL_CHT_DEFAULT_SHARDS;
+    if (shards > CL_CHT_MAX_SHARDS)
+        shards = CL_CHT_MAX_SHARDS;
+    // Ensure the shard count is a power of 2
+    shards = shards > 1 ? 1u << (32 - __builtin_clz(shards - 1)) : 1;
+
+    cl_cht_t *cht = cl_mem_alloc(allocator, sizeof(cl_cht_t));
+    if (!cht)
+        return null;
+
+    cht->shards = cl_mem_alloc(allocator, shards * sizeof(cl_cht_shard_t));
+    if (!cht->shards)
+    {
+        cl_mem_free(allocator, cht);
+        return null;
+    }
+    cht->shard_count = shards;
+    cht->shard_mask = shards - 1;
+    cht->allocator = allocator;
+
+    for (u32 i = 0; i < shards; i++)
+    {
+        cht->shards[i].mutex = cl_mutex_create();
+        cht->shards[i].ht = cl_ht_create_with_flags(allocator, flags | CL_CHT_SHARD_FLAGS);
+        if (!cht->shards[i].mutex || !cht->shards[i].ht)
+        {
+            cl_log_warn("Failed to create shard %u of concurrent hash table", i);
+            cl_cht_destroy_shards(cht, i + 1);
+            cl_mem_free(allocator, cht->shards);
+            cl_mem_free(allocator, cht);
+            return null;
+        }
+    }
+
+    return cht;
+}
+
+void cl_cht_destroy(cl_cht_t *cht)
+{
+    if (!cht)
+        return;
+    cl_cht_destroy_shards(cht, cht->shard_count);
+    cl_mem_free(cht->allocator, cht->shards);
+    cl_mem_free(cht->allocator, cht);
+}
+
+bool cl_cht_set_hash_function(cl_cht_t *cht, cl_ht_hash_func_t hf)
+{
+    if (!cht || !hf)
+        return false;
+    // Entries already placed by the old function would land in the wrong shard, so every shard stays locked from the
+    // emptiness check until the function is swapped; a put racing in between would otherwise be stranded. Locks are
+    // always taken in shard order, and no other path holds more than one.
+    for (u32 i = 0; i < cht->shard_count; i++)
+        cl_mutex_lock(cht->shards[i].mutex);
+    bool empty = true;
+    for (u32 i = 0; i < cht->shard_count && empty; i++)
+        empty = cl_ht_size(cht->shards[i].ht) == 0;
+    for (u32 i = 0; i < cht->shard_count && empty; i++)
+        cl_ht_set_hash_function(cht->shards[i].ht, hf);
+    for (u32 i = cht->shard_count; i > 0; i--)
+        cl_mutex_unlock(cht->shards[i - 1].mutex);
+    return empty;
+}
+
+bool cl_cht_set_free_function(cl_cht_t *cht, cl_ht_free_func_t ff)
+{
+    if (!cht)
+        return false;
+    for (u32 i = 0; i < cht->shard_count; i++)
+    {
+        cl_mutex_lock(cht->shards[i].mutex);
+        cl_ht_set_free_function(cht->shards[i].ht, ff);
+        cl_mutex_unlock(cht->shards[i].mutex);
+    }
+    return true;
+}
+
+bool cl_cht_get(cl_cht_t *cht, const void *key, u64 key_size, void **data, u64 *data_size)
+{
+    if (!cht || !key)
+        return false;
+
+    // Every shard shares the hash function, so any of them can compute the hash before a lock is taken
+    const u64 hash = cl_ht_hash(cht->shards[0].ht, key, key_size);
+    cl_cht_shard_t *shard = cl_cht_shard(cht, hash);
+    cl_mutex_lock(shard->mutex);
+    const bool found = cl_ht_get_hashed(shard->ht, hash, key, key_size, data, data_size);
+    cl_mutex_unlock(shard->mutex);
+    return found;
+}
+
+bool cl_cht_exists(cl_cht_t *cht, const void *key, u64 key_size)
+{
+    return cl_cht_get(cht, key, key_size, null, null);
+}
+
+bool cl_cht_put(cl_cht_t *cht, const void *key, u64 key_size, void *data, u64 data_size, void **old_data)
+{
+    if (!cht || !key)
+        return false;
+
+    const u64 hash = cl_ht_hash(cht->shards[0].ht, key, key_size);
+    cl_cht_shard_t *shard = cl_cht_shard(cht, hash);
+    cl_mutex_lock(shard->mutex);
+    const bool ok = cl_ht_put_hashed(shard->ht, hash, key, key_size, data, data_size, old_data);
+    cl_mutex_unlock(shard->mutex);
+    return ok;
+}
+
+void *cl_cht_remove(cl_cht_t *cht, const void *key, u64 key_size)
+{
+    if (!cht || !key)
+        return null;
+
+    const u64 hash = cl_ht_hash(cht->shards[0].ht, key, key_size);
+    cl_cht_shard_t *shard = cl_cht_shard(cht, hash);
+    cl_mutex_lock(shard->mutex);
+    void *data = cl_ht_remove_hashed(shard->ht, hash, key, key_size);
+    cl_mutex_unlock(shard->mutex);
+    return data;
+}
+
+void cl_cht_clear(cl_cht_t *cht)
+{
+    if (!cht)
+        return;
+    for (u32 i = 0; i < cht->shard_count; i++)
+    {
+        cl_mutex_lock(cht->shards[i].mutex);
+        cl_ht_clear(cht->shards[i].ht);
+        cl_mutex_unlock(cht->shards[i].mutex);
+    }
+}
+
+typedef struct cl_cht_foreach_state
+{
+    cl_ht_foreach_func_t fe_fn;
+    void *arg;
+    bool stopped;
+} cl_cht_foreach_state_t;
+
+static bool cl_cht_foreach_wrapper(void *key, u64 key_size, void *data, u64 data_size, void *arg)
+{
+    cl_cht_foreach_state_t *state = (cl_cht_foreach_state_t *)arg;
+    state->stopped = !state->fe_fn(key, key_size, data, data_size, state->arg);
+    return !state->stopped;
+}
+
+u64 cl_cht_foreach(cl_cht_t *cht, cl_ht_foreach_func_t fe_fn, void *arg)
+{
+    if (!cht || !fe_fn)
+        return 0;
+
+    cl_cht_foreach_state_t state = {fe_fn, arg, false};
+    u64 count = 0;
+    for (u32 i = 0; i < cht->shard_count && !state.stopped; i++)
+    {
+        cl_mutex_lock(cht->shards[i].mutex);
+        count += cl_ht_foreach(cht->shards[i].ht, cl_cht_foreach_wrapper, &state);
+        cl_mutex_unlock(cht->shards[i].mutex);
+    }
+    return count;
+}
+
+// Each shard is counted under its own lock, so the total is exact only while no other thread writes
+u64 cl_cht_size(cl_cht_t *cht)
+{
+    if (!cht)
+        return 0;
+
+    u64 size = 0;
+    for (u32 i = 0; i < cht->shard_count; i++)
+    {
+        cl_mutex_lock(cht->shards[i].mutex);
+        size += cl_ht_size(cht->shards[i].ht);
+        cl_mutex_unlock(cht->shards[i].mutex);
+    }
+    return size;
+}
+
+u32 cl_cht_shard_count(const cl_cht_t *cht) { return cht ? cht->shard_count : 0; }
+
+u64 cl_cht_shard_size(cl_cht_t *cht, u32 shard)
+{
+    if (!cht || shard >= cht->shard_count)
+        return 0;
+
+    cl_mutex_lock(cht->shards[shard].mutex);
+    const u64 size = cl_ht_size(cht->shards[shard].ht);
+    cl_mutex_unlock(cht->shards[shard].mutex);
+    return size;
+}
@@ -0,0 +1,210 @@
+/**
+ * Created by jraynor on 8/6/2024.
+ */
+#include <stdatomic.h>
+#include <string.h>
+#include <time.h>
+#include "clib/containers_lib.h"
+
+#if defined(CL_COMPILER_MSVC) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+#define CL_HASH_XXH_PRIME_1 11400714785074694791ULL
+#define CL_HASH_XXH_PRIME_2 14029467366897019727ULL
+#define CL_HASH_XXH_PRIME_3 1609587929392839161ULL
+#define CL_HASH_XXH_PRIME_4 9650029242287828579ULL
+#define CL_HASH_XXH_PRIME_5 2870177450012600261ULL
+
+static const u64 cl_hash_wy_secret[4] = {0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull,
+                                         0x4d5a2da51de1aa47ull};
+
+// Unaligned loads; the compilers turn these into plain moves
+static inline u64 cl_hash_read64(const u8 *p)
+{
+    u64 value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline u64 cl_hash_read32(const u8 *p)
+{
+    u32 value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static inline u64 cl_hash_rotl(u64 x, u32 r) { return (x << r) | (x >> (64 - r)); }
+
+// Full 64x64->128 bit product, low half into *a and high half into *b
+static inline void cl_hash_mum(u64 *a, u64 *b)
+{
+#if defined(__SIZEOF_INT128__)
+    const __uint128_t r = (__uint128_t)*a * *b;
+    *a = (u64)r;
+    *b = (u64)(r >> 64);
+#elif defined(CL_COMPILER_MSVC) && defined(_M_X64)
+    *a = _umul128(*a, *b, b);
+#else
+    const u64 ha = *a >> 32, hb = *b >> 32, la = (u32)*a, lb = (u32)*b;
+    const u64 rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    const u64 t = rl + (rm0 << 32);
+    const u64 lo = t + (rm1 << 32);
+    const u64 hi = rh + (rm0 >> 32) + (rm1 >> 32) + (t < rl) + (lo < t);
+    *a = lo;
+    *b = hi;
+#endif
+}
+
+static inline u64 cl_hash_mix(u64 a, u64 b)
+{
+    cl_hash_mum(&a, &b);
+    return a ^ b;
+}
+
+u64 cl_hash_wy(const void *data, u64 length, u64 seed)
+{
+    const u64 *secret = cl_hash_wy_secret;
+    const u8 *p = (const u8 *)data;
+    seed ^= cl_hash_mix(seed ^ secret[0], secret[1]);
+    u64 a;
+    u64 b;
+    if (length <= 16)
+    {
+        if (length >= 4)
+        {
+            // Two overlapping pairs of 4-byte reads cover every length from 4 to 16 without a loop
+            const u64 step = (length >> 3) << 2;
+            a = (cl_hash_read32(p) << 32) | cl_hash_read32(p + step);
+            b = (cl_hash_read32(p + length - 4) << 32) | cl_hash_read32(p + length - 4 - step);
+        }
+        else if (length > 0)
+        {
+            a = ((u64)p[0] << 16) | ((u64)p[length >> 1] << 8) | p[length - 1];
+            b = 0;
+        }
+        else
+        {
+            a = 0;
+            b = 0;
+        }
+    }
+    else
+    {
+        u64 i = length;
+        if (i >= 48)
+        {
+            // Three independent lanes keep the multipliers busy on long keys
+            u64 see1 = seed;
+            u64 see2 = seed;
+            do
+            {
+                seed = cl_hash_mix(cl_hash_read64(p) ^ secret[1], cl_hash_read64(p + 8) ^ seed);
+                see1 = cl_hash_mix(cl_hash_read64(p + 16) ^ secret[2], cl_hash_read64(p + 24) ^ see1);
+                see2 = cl_hash_mix(cl_hash_read64(p + 32) ^ secret[3], cl_hash_read64(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            }
+            while (i >= 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16)
+        {
+            seed = cl_hash_mix(cl_hash_read64(p) ^ secret[1], cl_hash_read64(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = cl_hash_read64(p + i - 16);
+        b = cl_hash_read64(p + i - 8);
+    }
+    a ^= secret[1];
+    b ^= seed;
+    cl_hash_mum(&a, &b);
+    return cl_hash_mix(a ^ secret[0] ^ length, b ^ secret[1]);
+}
+
+static inline u64 cl_hash_xxh_round(u64 acc, u64 input)
+{
+    acc += input * CL_HASH_XXH_PRIME_2;
+    return cl_hash_rotl(acc, 31) * CL_HASH_XXH_PRIME_1;
+}
+
+static inline u64 cl_hash_xxh_merge(u64 h64, u64 acc)
+{
+    h64 ^= cl_hash_xxh_round(0, acc);
+    return h64 * CL_HASH_XXH_PRIME_1 + CL_HASH_XXH_PRIME_4;
+}
+
+u64 cl_hash_xxh64(const void *data, u64 length, u64 seed)
+{
+    const u8 *p = (const u8 *)data;
+    const u8 *end = p + length;
+    u64 h64;
+
+    if (length >= 32)
+    {
+        const u8 *limit = end - 32;
+        u64 v1 = seed + CL_HASH_XXH_PRIME_1 + CL_HASH_XXH_PRIME_2;
+        u64 v2 = seed + CL_HASH_XXH_PRIME_2;
+        u64 v3 = seed;
+        u64 v4 = seed - CL_HASH_XXH_PRIME_1;
+        do
+        {
+            v1 = cl_hash_xxh_round(v1, cl_hash_read64(p));
+            v2 = cl_hash_xxh_round(v2, cl_hash_read64(p + 8));
+            v3 = cl_hash_xxh_round(v3, cl_hash_read64(p + 16));
+            v4 = cl_hash_xxh_round(v4, cl_hash_read64(p + 24));
+            p += 32;
+        }
+        while (p <= limit);
+
+        h64 = cl_hash_rotl(v1, 1) + cl_hash_rotl(v2, 7) + cl_hash_rotl(v3, 12) + cl_hash_rotl(v4, 18);
+        h64 = cl_hash_xxh_merge(h64, v1);
+        h64 = cl_hash_xxh_merge(h64, v2);
+        h64 = cl_hash_xxh_merge(h64, v3);
+        h64 = cl_hash_xxh_merge(h64, v4);
+    }
+    else
+    {
+        h64 = seed + CL_HASH_XXH_PRIME_5;
+    }
+
+    h64 += length;
+
+    for (; p + 8 <= end; p += 8)
+    {
+        h64 ^= cl_hash_xxh_round(0, cl_hash_read64(p));
+        h64 = cl_hash_rotl(h64, 27) * CL_HASH_XXH_PRIME_1 + CL_HASH_XXH_PRIME_4;
+    }
+
+    if (p + 4 <= end)
+    {
+        h64 ^= cl_hash_read32(p) * CL_HASH_XXH_PRIME_1;
+        h64 = cl_hash_rotl(h64, 23) * CL_HASH_XXH_PRIME_2 + CL_HASH_XXH_PRIME_3;
+        p += 4;
+    }
+
+    for (; p < end; p++)
+    {
+        h64 ^= (*p) * CL_HASH_XXH_PRIME_5;
+        h64 = cl_hash_rotl(h64, 11) * CL_HASH_XXH_PRIME_1;
+    }
+
+    h64 ^= h64 >> 33;
+    h64 *= CL_HASH_XXH_PRIME_2;
+    h64 ^= h64 >> 29;
+    h64 *= CL_HASH_XXH_PRIME_3;
+    h64 ^= h64 >> 32;
+    return h64;
+}
+
+u64 cl_hash_random_seed(void)
+{
+    // The clock, where this process's code and stack were mapped, and a call counter, so every call differs
+    static atomic_ullong counter;
+    struct timespec now = {0};
+    timespec_get(&now, TIME_UTC);
+    u64 seed = cl_hash_u64((u64)now.tv_sec * 1000000000ull + (u64)now.tv_nsec);
+    seed = cl_hash_u64(seed ^ (u64)(uintptr_t)&now ^ ((u64)(uintptr_t)&counter << 17));
+    return cl_hash_u64(seed + atomic_fetch_add(&counter, 1) * 0x9E3779B97F4A7C15ull);
+}
@@ -1,13 +1,32 @@
 // table_lib.c
 
 #include <string.h>
+#include "cl_ht_internal.h"
 #include "clib/containers_lib.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CL_HT_GROUP_SSE2
+#endif
+
 #define CL_HT_INITIAL_SIZE 16
 #define CL_HT_LOAD_FACTOR_LOW 0.25f
 #define CL_HT_LOAD_FACTOR_HIGH 0.75f
 #define CL_HT_INITIAL_SIZE 16
 #define CL_HT_LOAD_FACTOR 0.75f
+#define CL_HT_GROUP_WIDTH 16 // Control bytes compared at once in the group-probing layout
+#define CL_HT_CTRL_EMPTY ((u8)0x80)
+#define CL_HT_CTRL_DELETED ((u8)0xFE)
+#define CL_HT_MIGRATE_SLOTS 64 // Old slots each operation moves while an incremental resize is in progress
+#define CL_HT_KEY_CLASS_SIZE 8 // Key arena size classes are multiples of this
+#define CL_HT_KEY_CLASSES 4
+#define CL_HT_KEY_ARENA_MAX (CL_HT_KEY_CLASS_SIZE * CL_HT_KEY_CLASSES) // Longer keys get their own allocation
+#define CL_HT_KEY_ARENA_BLOCKS 1024 // Keys per pool slab
+#define CL_HT_BATCH_SIZE 16 // Keys hashed and prefetched together by the batch operations
+#define CL_HT_PERFECT_BUCKET_KEYS 3 // Mean keys per seed bucket of a perfect table
+#define CL_HT_PERFECT_DIRECT 0x80000000u // Bucket seed that holds the slot of its single key instead of a seed
+#define CL_HT_PERFECT_MAX_SEED (1u << 24) // Seeds tried for one bucket before freezing gives up
+#define CL_HT_CREATION_FLAGS (CL_HT_FLAG_GROUP_PROBING | CL_HT_FLAG_KEY_ARENA | CL_HT_FLAG_RANDOM_SEED)
 
 typedef struct cl_ht_entry
 {
@@ -25,127 +44,201 @@ struct cl_ht
     u64 size;
     u64 mask; // For fast modulo operation
     cl_ht_flags_t flags;
-    cl_ht_hash_func_t hash_func;
+    cl_ht_hash_func_t hash_func; // null for the built-in hash, which mixes in seed
+    u64 seed;
     cl_ht_free_func_t free_func;
     cl_mutex_t *mutex;
     const cl_allocator_t *allocator;
+    u8 *ctrl; // Group-probing layout only, stored right after the entries; null for Robin Hood probing
+    u64 growth_left; // Group-probing layout: inserts into empty slots left before the next resize
+    // Incremental resize: the previous slot array while its entries are still being moved, null otherwise. Slots
+    // before migrate_index are done; a moved or removed old entry is marked so probes still step over it.
+    cl_ht_entry_t *old_entries;
+    u8 *old_ctrl;
+    u64 old_capacity;
+    u64 migrate_index;
+    cl_allocator_t *key_pools[CL_HT_KEY_CLASSES]; // Key arena, one growable pool per size class, created on first use
+    // Minimal perfect hash, set by cl_ht_freeze_perfect: entries holds exactly capacity full slots, and the seed of a
+    // key's bucket picks its slot. Null for the probing layouts.
+    u32 *perfect_seeds;
+    u64 perfect_buckets;
 };
 
-static inline u64 cl_ht_default_hash(const void *input, u64 length)
+// Key of a Robin Hood entry that left the old array; the hash stays so probe distances along the run still hold
+static char cl_ht_moved_key;
+#define CL_HT_MOVED_KEY ((void *)&cl_ht_moved_key)
+
+u64 cl_ht_default_hash(const void *input, u64 length) { return cl_hash_wy(input, length, 0); }
+
+static inline u64 cl_ht_hash_key(const cl_ht_t *ht, const void *key, u64 key_size)
 {
-    const u64 PRIME64_1 = 11400714785074694791ULL;
-    const u64 PRIME64_2 = 14029467366897019727ULL;
-    const u64 PRIME64_3 = 1609587929392839161ULL;
-    const u64 PRIME64_4 = 9650029242287828579ULL;
-    const u64 PRIME64_5 = 2870177450012600261ULL;
+    return ht->hash_func ? ht->hash_func(key, key_size) : cl_hash_wy(key, key_size, ht->seed);
+}
 
-    const u8 *p = (const u8 *)input;
-    const u8 *end = p + length;
-    u64 h64;
+static inline u64 cl_ht_probe_distance(u64 mask, u64 hash, u64 slot_index)
+{
+    return (slot_index - (hash & mask)) & mask;
+}
 
-    if (length >= 32)
-    {
-        const u8 *limit = end - 32;
-        u64 v1 = PRIME64_1 + PRIME64_2;
-        u64 v2 = PRIME64_2;
-        u64 v3 = 0;
-        u64 v4 = -PRIME64_1;
+// Group-probing layout: ctrl holds one byte per slot, the low 7 hash bits of a full slot or an EMPTY/DELETED marker,
+// followed by a copy of the first group so a group load never wraps. A lookup compares a whole group of tags at once
+// and only reads the entries whose tag matches, and a group with an empty slot ends the probe.
 
-        do
-        {
-            v1 += (*(u64 *)p) * PRIME64_2;
-            v1 = (v1 << 31) | (v1 >> 33);
-            v1 *= PRIME64_1;
-            p += 8;
-
-            v2 += (*(u64 *)p) * PRIME64_2;
-            v2 = (v2 << 31) | (v2 >> 33);
-            v2 *= PRIME64_1;
-            p += 8;
-
-            v3 += (*(u64 *)p) * PRIME64_2;
-            v3 = (v3 << 31) | (v3 >> 33);
-            v3 *= PRIME64_1;
-            p += 8;
-
-            v4 += (*(u64 *)p) * PRIME64_2;
-            v4 = (v4 << 31) | (v4 >> 33);
-            v4 *= PRIME64_1;
-            p += 8;
-        }
-        while (p <= limit);
-
-        h64 =
-            ((v1 << 1) | (v1 >> 63)) + ((v2 << 7) | (v2 >> 57)) + ((v3 << 12) | (v3 >> 52)) + ((v4 << 18) | (v4 >> 46));
-
-        v1 *= PRIME64_2;
-        v1 = (v1 << 31) | (v1 >> 33);
-        v1 *= PRIME64_1;
-        h64 ^= v1;
-        h64 = h64 * PRIME64_1 + PRIME64_4;
-
-        v2 *= PRIME64_2;
-        v2 = (v2 << 31) | (v2 >> 33);
-        v2 *= PRIME64_1;
-        h64 ^= v2;
-        h64 = h64 * PRIME64_1 + PRIME64_4;
-
-        v3 *= PRIME64_2;
-        v3 = (v3 << 31) | (v3 >> 33);
-        v3 *= PRIME64_1;
-        h64 ^= v3;
-        h64 = h64 * PRIME64_1 + PRIME64_4;
-
-        v4 *= PRIME64_2;
-        v4 = (v4 << 31) | (v4 >> 33);
-        v4 *= PRIME64_1;
-        h64 ^= v4;
-        h64 = h64 * PRIME64_1 + PRIME64_4;
-    }
-    else
-    {
-        h64 = PRIME64_5;
-    }
+static inline u8 cl_ht_tag(u64 hash) { return (u8)(hash & 0x7F); }
 
-    h64 += (u64)length;
+static inline u32 cl_ht_group_match(const u8 *group, u8 tag)
+{
+#ifdef CL_HT_GROUP_SSE2
+    const __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+    return (u32)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8((char)tag)));
+#else
+    u32 match = 0;
+    for (u32 i = 0; i < CL_HT_GROUP_WIDTH; i++)
+        match |= (u32)(group[i] == tag) << i;
+    return match;
+#endif
+}
 
-    while (p + 8 <= end)
+// Empty and deleted slots are the control bytes with the top bit set
+static inline u32 cl_ht_group_match_free(const u8 *group)
+{
+#ifdef CL_HT_GROUP_SSE2
+    return (u32)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)group));
+#else
+    u32 match = 0;
+    for (u32 i = 0; i < CL_HT_GROUP_WIDTH; i++)
+        match |= (u32)(group[i] >> 7) << i;
+    return match;
+#endif
+}
+
+static inline void cl_ht_set_ctrl_in(u8 *ctrl, u64 mask, u64 index, u8 value)
+{
+    ctrl[index] = value;
+    // Slots of the first group are mirrored past the end, every other slot maps onto itself
+    ctrl[((index - (CL_HT_GROUP_WIDTH - 1)) & mask) + (CL_HT_GROUP_WIDTH - 1)] = value;
+}
+
+static inline void cl_ht_set_ctrl(cl_ht_t *ht, u64 index, u8 value)
+{
+    cl_ht_set_ctrl_in(ht->ctrl, ht->mask, index, value);
+}
+
+static inline u64 cl_ht_group_growth(u64 capacity) { return (u64)(capacity * CL_HT_LOAD_FACTOR); }
+
+// First empty or deleted slot on the key's probe sequence
+static u64 cl_ht_group_find_free(const cl_ht_t *ht, u64 hash)
+{
+    u64 pos = (hash >> 7) & ht->mask;
+    u64 step = 0;
+    while (true)
     {
-        u64 k1 = *(u64 *)p;
-        k1 *= PRIME64_2;
-        k1 = (k1 << 31) | (k1 >> 33);
-        k1 *= PRIME64_1;
-        h64 ^= k1;
-        h64 = ((h64 << 27) | (h64 >> 37)) * PRIME64_1 + PRIME64_4;
-        p += 8;
+        const u32 free = cl_ht_group_match_free(ht->ctrl + pos);
+        if (free)
+            return (pos + __builtin_ctz(free)) & ht->mask;
+        step += CL_HT_GROUP_WIDTH;
+        pos = (pos + step) & ht->mask;
     }
+}
 
-    if (p + 4 <= end)
+static void cl_ht_group_erase(cl_ht_t *ht, u64 index)
+{
+    // The slot can become empty again if no probe ever had to step over it, i.e. every group window covering it
+    // already had an empty slot; otherwise it stays a tombstone so longer probe sequences keep going
+    const u32 empty_after = cl_ht_group_match(ht->ctrl + index, CL_HT_CTRL_EMPTY);
+    const u32 empty_before = cl_ht_group_match(ht->ctrl + ((index - CL_HT_GROUP_WIDTH) & ht->mask), CL_HT_CTRL_EMPTY);
+    const bool never_full =
+        empty_before && empty_after &&
+        (u32)__builtin_ctz(empty_after) + (u32)(__builtin_clz(empty_before) - 16) < CL_HT_GROUP_WIDTH;
+
+    cl_ht_set_ctrl(ht, index, never_full ? CL_HT_CTRL_EMPTY : CL_HT_CTRL_DELETED);
+    if (never_full)
+        ht->growth_left++;
+    memset(&ht->entries[index], 0, sizeof(cl_ht_entry_t));
+}
+
+// Entries and, in the group-probing layout, the control bytes share one allocation. That layout tells full slots by
+// their control byte, so only the control bytes are initialised and entry pages are first touched as slots fill.
+static cl_ht_entry_t *cl_ht_alloc_slots(const cl_ht_t *ht, u64 capacity, bool grouped)
+{
+    const u64 entries_size = capacity * sizeof(cl_ht_entry_t);
+    const u64 ctrl_size = grouped ? capacity + CL_HT_GROUP_WIDTH - 1 : 0;
+    cl_ht_entry_t *entries = cl_mem_alloc(ht->allocator, entries_size + ctrl_size);
+    if (!entries)
+        return null;
+
+    if (grouped)
+        memset((u8 *)entries + entries_size, CL_HT_CTRL_EMPTY, ctrl_size);
+    else
+        memset(entries, 0, entries_size);
+    return entries;
+}
+
+static inline bool cl_ht_slot_full(const cl_ht_t *ht, u64 index)
+{
+    return ht->ctrl ? ht->ctrl[index] < CL_HT_CTRL_EMPTY : ht->entries[index].key != null;
+}
+
+static inline bool cl_ht_key_in_arena(const cl_ht_t *ht, u64 key_size)
+{
+    return (ht->flags & (CL_HT_FLAG_KEY_ARENA | CL_HT_FLAG_NOCOPY_KEYS)) == CL_HT_FLAG_KEY_ARENA &&
+           key_size <= CL_HT_KEY_ARENA_MAX;
+}
+
+static inline u32 cl_ht_key_class(u64 key_size)
+{
+    return key_size > 0 ? (u32)((key_size - 1) / CL_HT_KEY_CLASS_SIZE) : 0;
+}
+
+// The table's own copy of a key, or the caller's key itself with CL_HT_FLAG_NOCOPY_KEYS
+static void *cl_ht_copy_key(cl_ht_t *ht, const void *key, u64 key_size)
+{
+    if (ht->flags & CL_HT_FLAG_NOCOPY_KEYS)
+        return (void *)key;
+
+    void *new_key;
+    if (cl_ht_key_in_arena(ht, key_size))
     {
-        h64 ^= (u64)(*(u32 *)p) * PRIME64_1;
-        h64 = ((h64 << 23) | (h64 >> 41)) * PRIME64_2 + PRIME64_3;
-        p += 4;
+        const u32 key_class = cl_ht_key_class(key_size);
+        if (!ht->key_pools[key_class])
+        {
+            // Slabs come from the table's allocator like the rest of its memory
+            ht->key_pools[key_class] = cl_allocator_new(
+                CL_ALLOCATOR_TYPE_POOL, .flags = CL_ALLOCATOR_FLAG_GROWABLE,
+                .config.pool = {(key_class + 1) * CL_HT_KEY_CLASS_SIZE, CL_HT_KEY_ARENA_BLOCKS, ht->allocator});
+            if (!ht->key_pools[key_class])
+                return null;
+        }
+        new_key = cl_mem_alloc(ht->key_pools[key_class], key_size);
     }
-
-    while (p < end)
+    else
     {
-        h64 ^= (*p) * PRIME64_5;
-        h64 = ((h64 << 11) | (h64 >> 53)) * PRIME64_1;
-        p++;
+        new_key = cl_mem_alloc(ht->allocator, key_size);
     }
 
-    h64 ^= h64 >> 33;
-    h64 *= PRIME64_2;
-    h64 ^= h64 >> 29;
-    h64 *= PRIME64_3;
-    h64 ^= h64 >> 32;
+    if (new_key)
+        cl_mem_copy(new_key, key, key_size);
+    return new_key;
+}
 
-    return h64;
+static void cl_ht_free_key(cl_ht_t *ht, void *key, u64 key_size)
+{
+    if (ht->flags & CL_HT_FLAG_NOCOPY_KEYS)
+        return;
+    if (cl_ht_key_in_arena(ht, key_size))
+        cl_mem_free(ht->key_pools[cl_ht_key_class(key_size)], key);
+    else
+        cl_mem_free(ht->allocator, key);
 }
 
-static inline u64 cl_ht_probe_distance(const cl_ht_t *ht, u64 hash, u64 slot_index)
+// Frees every arena key at once
+static void cl_ht_release_key_arena(cl_ht_t *ht)
 {
-    return (slot_index + ht->capacity - (hash & ht->mask)) & ht->mask;
+    for (u32 i = 0; i < CL_HT_KEY_CLASSES; i++)
+    {
+        cl_allocator_destroy(ht->key_pools[i]);
+        ht->key_pools[i] = null;
+    }
 }
 
 static cl_ht_t *cl_ht_create_internal(const cl_allocator_t *allocator, u64 size, cl_ht_flags_t flags)
@@ -154,23 +247,36 @@ static cl_ht_t *cl_ht_create_internal(const cl_allocator_t *allocator, u64 size,
     if (!ht)
         return null;
 
+    const bool grouped = flags & CL_HT_FLAG_GROUP_PROBING;
     ht->capacity = size > 0 ? size : CL_HT_INITIAL_SIZE;
+    // A group never spans more than the whole table
+    if (grouped && ht->capacity < CL_HT_GROUP_WIDTH)
+        ht->capacity = CL_HT_GROUP_WIDTH;
     // Ensure capacity is a power of 2
     ht->capacity = 1ULL << (64 - __builtin_clzll(ht->capacity - 1));
-    ht->entries = cl_mem_alloc(allocator, ht->capacity * sizeof(cl_ht_entry_t));
+    ht->allocator = allocator;
+    ht->entries = cl_ht_alloc_slots(ht, ht->capacity, grouped);
     if (!ht->entries)
     {
         cl_mem_free(allocator, ht);
         return null;
     }
-    memset(ht->entries, 0, ht->capacity * sizeof(cl_ht_entry_t));
 
     ht->size = 0;
     ht->mask = ht->capacity - 1;
     ht->flags = flags;
-    ht->hash_func = cl_ht_default_hash;
+    ht->hash_func = null;
+    ht->seed = flags & CL_HT_FLAG_RANDOM_SEED ? cl_hash_random_seed() : 0;
     ht->free_func = null;
-    ht->allocator = allocator;
+    ht->ctrl = grouped ? (u8 *)(ht->entries + ht->capacity) : null;
+    ht->growth_left = cl_ht_group_growth(ht->capacity);
+    ht->old_entries = null;
+    ht->old_ctrl = null;
+    ht->old_capacity = 0;
+    ht->migrate_index = 0;
+    memset(ht->key_pools, 0, sizeof(ht->key_pools));
+    ht->perfect_seeds = null;
+    ht->perfect_buckets = 0;
 
     if (!(flags & CL_HT_FLAG_NO_LOCKING))
     {
@@ -221,6 +327,7 @@ void cl_ht_destroy(cl_ht_t *ht)
         cl_mutex_destroy(ht->mutex);
     }
     cl_mem_free(ht->allocator, ht->entries);
+    cl_mem_free(ht->allocator, ht->perfect_seeds);
     cl_mem_free(ht->allocator, ht);
 }
 
@@ -251,11 +358,12 @@ bool cl_ht_set_free_function(cl_ht_t *ht, cl_ht_free_func_t ff)
 
 cl_ht_flags_t cl_ht_get_flags(cl_ht_t *ht) { return ht ? ht->flags : CL_HT_FLAG_NONE; }
 
+// The layout and key storage are fixed when the table is created
 cl_ht_flags_t cl_ht_set_flag(cl_ht_t *ht, cl_ht_flags_t flag)
 {
     if (!ht)
         return CL_HT_FLAG_NONE;
-    ht->flags |= flag;
+    ht->flags |= flag & ~CL_HT_CREATION_FLAGS;
     return ht->flags;
 }
 
@@ -263,7 +371,7 @@ cl_ht_flags_t cl_ht_clear_flag(cl_ht_t *ht, cl_ht_flags_t flag)
 {
     if (!ht)
         return CL_HT_FLAG_NONE;
-    ht->flags &= ~flag;
+    ht->flags &= ~(flag & ~CL_HT_CREATION_FLAGS);
     return ht->flags;
 }
 
@@ -283,42 +391,269 @@ static bool cl_ht_keys_equal(const cl_ht_t *ht, const void *key1, u64 key1_size,
     }
 }
 
+// Returns the slot of entries holding the key, or mask + 1 when it is absent
+static inline u64 cl_ht_group_find_in(const cl_ht_t *ht, const cl_ht_entry_t *entries, const u8 *ctrl, u64 mask,
+                                      u64 hash, const void *key, u64 key_size)
+{
+    const u8 tag = cl_ht_tag(hash);
+    u64 pos = (hash >> 7) & mask;
+    u64 step = 0;
+    __builtin_prefetch(&entries[pos]);
+    while (true)
+    {
+        const u8 *group = ctrl + pos;
+        for (u32 match = cl_ht_group_match(group, tag); match; match &= match - 1)
+        {
+            const u64 index = (pos + __builtin_ctz(match)) & mask;
+            const cl_ht_entry_t *entry = &entries[index];
+            if (entry->hash == hash && cl_ht_keys_equal(ht, entry->key, entry->key_size, key, key_size))
+                return index;
+        }
+        if (cl_ht_group_match(group, CL_HT_CTRL_EMPTY))
+            return mask + 1;
+        step += CL_HT_GROUP_WIDTH;
+        pos = (pos + step) & mask;
+    }
+}
 
-bool cl_ht_get(cl_ht_t *ht, const void *key, u64 key_size, void **data, u64 *data_size)
+// Returns the slot holding the key, or capacity when it is absent
+static u64 cl_ht_group_find(const cl_ht_t *ht, u64 hash, const void *key, u64 key_size)
 {
-    if (!ht || !key)
-        return false;
+    return cl_ht_group_find_in(ht, ht->entries, ht->ctrl, ht->mask, hash, key, key_size);
+}
 
-    u64 hash = ht->hash_func(key, key_size);
-    u64 index = hash & ht->mask;
+// Robin Hood lookup over a slot array; returns mask + 1 when the key is absent
+static inline u64 cl_ht_robin_find_in(const cl_ht_t *ht, const cl_ht_entry_t *entries, u64 mask, u64 hash,
+                                      const void *key, u64 key_size)
+{
+    u64 index = hash & mask;
     u64 dist = 0;
 
     while (true)
     {
-        if (!ht->entries[index].key)
+        const cl_ht_entry_t *entry = &entries[index];
+        if (!entry->key)
         {
-            return false; // Key not found
+            return mask + 1; // Key not found
         }
 
-        if (ht->entries[index].hash == hash &&
-            cl_ht_keys_equal(ht, ht->entries[index].key, ht->entries[index].key_size, key, key_size))
+        if (entry->hash == hash && entry->key != CL_HT_MOVED_KEY &&
+            cl_ht_keys_equal(ht, entry->key, entry->key_size, key, key_size))
         {
-            if (data)
-                *data = ht->entries[index].data;
-            if (data_size)
-                *data_size = ht->entries[index].data_size;
-            return true;
+            return index;
         }
 
-        u64 probe_dist = cl_ht_probe_distance(ht, ht->entries[index].hash, index);
-        if (probe_dist < dist)
+        // An entry closer to its home slot than the key would be ends the run
+        if (cl_ht_probe_distance(mask, entry->hash, index) < dist)
         {
-            return false; // Key not found
+            return mask + 1; // Key not found
         }
 
+        index = (index + 1) & mask;
+        dist++;
+    }
+}
+
+// Returns the old-array slot holding the key, or old_capacity when it is absent or no resize is in progress
+static u64 cl_ht_old_find(const cl_ht_t *ht, u64 hash, const void *key, u64 key_size)
+{
+    if (!ht->old_entries)
+        return ht->old_capacity;
+    const u64 old_mask = ht->old_capacity - 1;
+    if (ht->old_ctrl)
+        return cl_ht_group_find_in(ht, ht->old_entries, ht->old_ctrl, old_mask, hash, key, key_size);
+    return cl_ht_robin_find_in(ht, ht->old_entries, old_mask, hash, key, key_size);
+}
+
+static inline u64 cl_ht_perfect_bucket(u64 hash, u64 buckets) { return ((hash >> 32) * buckets) >> 32; }
+
+static inline u64 cl_ht_perfect_slot(u64 hash, u32 seed, u64 capacity)
+{
+    return (cl_hash_u64(hash ^ (seed * 0x9E3779B97F4A7C15ull)) >> 32) * capacity >> 32;
+}
+
+// The one slot a key can occupy in a perfect table
+static inline u64 cl_ht_perfect_index(const cl_ht_t *ht, u64 hash)
+{
+    const u32 seed = ht->perfect_seeds[cl_ht_perfect_bucket(hash, ht->perfect_buckets)];
+    return seed & CL_HT_PERFECT_DIRECT ? seed & ~CL_HT_PERFECT_DIRECT : cl_ht_perfect_slot(hash, seed, ht->capacity);
+}
+
+// Returns the slot holding the key, or capacity when it is absent; a cleared table keeps its slots with null keys
+static u64 cl_ht_perfect_find(const cl_ht_t *ht, u64 hash, const void *key, u64 key_size)
+{
+    const u64 index = cl_ht_perfect_index(ht, hash);
+    const cl_ht_entry_t *entry = &ht->entries[index];
+    if (entry->key && entry->hash == hash && cl_ht_keys_equal(ht, entry->key, entry->key_size, key, key_size))
+        return index;
+    return ht->capacity;
+}
+
+// Places an entry known to be absent into the current array, keeping its key allocation
+static void cl_ht_insert_entry(cl_ht_t *ht, const cl_ht_entry_t *entry)
+{
+    if (ht->ctrl)
+    {
+        const u64 index = cl_ht_group_find_free(ht, entry->hash);
+        cl_ht_set_ctrl(ht, index, cl_ht_tag(entry->hash));
+        ht->entries[index] = *entry;
+        return;
+    }
+
+    // Robin Hood: take the slot of the first entry closer to its home slot, and carry that entry on instead
+    cl_ht_entry_t carried = *entry;
+    u64 index = carried.hash & ht->mask;
+    u64 dist = 0;
+    while (ht->entries[index].key)
+    {
+        const u64 probe_dist = cl_ht_probe_distance(ht->mask, ht->entries[index].hash, index);
+        if (probe_dist < dist)
+        {
+            const cl_ht_entry_t temp = ht->entries[index];
+            ht->entries[index] = carried;
+            carried = temp;
+            dist = probe_dist;
+        }
         index = (index + 1) & ht->mask;
         dist++;
     }
+    ht->entries[index] = carried;
+}
+
+// Backward-shift deletion: the entries after the slot that are away from their home slot each move back by one, so the
+// run stays ordered by probe distance and no tombstone is left behind
+static void cl_ht_robin_erase(cl_ht_t *ht, u64 index)
+{
+    u64 next_index = (index + 1) & ht->mask;
+    while (ht->entries[next_index].key && cl_ht_probe_distance(ht->mask, ht->entries[next_index].hash, next_index) != 0)
+    {
+        ht->entries[index] = ht->entries[next_index];
+        index = next_index;
+        next_index = (next_index + 1) & ht->mask;
+    }
+    memset(&ht->entries[index], 0, sizeof(cl_ht_entry_t));
+}
+
+// Moves up to count slots of the old array into the current one, and frees the old array once it is drained. A moved
+// slot is left marked rather than emptied, so lookups in the old array still probe past it.
+static void cl_ht_migrate(cl_ht_t *ht, u64 count)
+{
+    const u64 end = count < ht->old_capacity - ht->migrate_index ? ht->migrate_index + count : ht->old_capacity;
+    for (u64 i = ht->migrate_index; i < end; i++)
+    {
+        cl_ht_entry_t *entry = &ht->old_entries[i];
+        if (ht->old_ctrl ? ht->old_ctrl[i] >> 7 : !entry->key || entry->key == CL_HT_MOVED_KEY)
+            continue;
+        cl_ht_insert_entry(ht, entry);
+        if (ht->old_ctrl)
+            cl_ht_set_ctrl_in(ht->old_ctrl, ht->old_capacity - 1, i, CL_HT_CTRL_DELETED);
+        else
+            entry->key = CL_HT_MOVED_KEY;
+    }
+
+    ht->migrate_index = end;
+    if (end == ht->old_capacity)
+    {
+        cl_mem_free(ht->allocator, ht->old_entries);
+        ht->old_entries = null;
+        ht->old_ctrl = null;
+        ht->old_capacity = 0;
+        ht->migrate_index = 0;
+    }
+}
+
+static inline void cl_ht_finish_resize(cl_ht_t *ht)
+{
+    if (ht->old_entries)
+        cl_ht_migrate(ht, ht->old_capacity);
+}
+
+// Bounds the work of one operation while an incremental resize is in progress
+static inline void cl_ht_step_resize(cl_ht_t *ht)
+{
+    if (ht->old_entries)
+        cl_ht_migrate(ht, CL_HT_MIGRATE_SLOTS);
+}
+
+// An old-array entry is dropped by marking its slot, the same way migrating it would
+static void *cl_ht_old_remove(cl_ht_t *ht, u64 index)
+{
+    cl_ht_entry_t *entry = &ht->old_entries[index];
+    void *data = entry->data;
+    cl_ht_free_key(ht, entry->key, entry->key_size);
+    if (ht->old_ctrl)
+    {
+        cl_ht_set_ctrl_in(ht->old_ctrl, ht->old_capacity - 1, index, CL_HT_CTRL_DELETED);
+        ht->growth_left++; // Its slot in the new array was set aside when the resize began
+    }
+    else
+    {
+        entry->key = CL_HT_MOVED_KEY;
+    }
+    ht->size--;
+    return data;
+}
+
+static void cl_ht_update_entry(cl_ht_t *ht, cl_ht_entry_t *entry, void *data, u64 data_size, void **old_data)
+{
+    if (old_data)
+        *old_data = entry->data;
+    if (ht->free_func && !(ht->flags & CL_HT_FLAG_FREE_DATA))
+    {
+        ht->free_func(entry->data);
+    }
+    entry->data = data;
+    entry->data_size = data_size;
+}
+
+
+u64 cl_ht_hash(const cl_ht_t *ht, const void *key, u64 key_size) { return cl_ht_hash_key(ht, key, key_size); }
+
+bool cl_ht_builtin_seed(const cl_ht_t *ht, u64 *seed)
+{
+    *seed = ht->seed;
+    return ht->hash_func == null;
+}
+
+const cl_allocator_t *cl_ht_get_allocator(const cl_ht_t *ht) { return ht->allocator; }
+
+bool cl_ht_get(cl_ht_t *ht, const void *key, u64 key_size, void **data, u64 *data_size)
+{
+    if (!ht || !key)
+        return false;
+    return cl_ht_get_hashed(ht, cl_ht_hash_key(ht, key, key_size), key, key_size, data, data_size);
+}
+
+bool cl_ht_get_hashed(cl_ht_t *ht, u64 hash, const void *key, u64 key_size, void **data, u64 *data_size)
+{
+    cl_ht_step_resize(ht);
+
+    const cl_ht_entry_t *entry;
+    u64 index;
+    if (ht->perfect_seeds)
+        index = cl_ht_perfect_find(ht, hash, key, key_size);
+    else if (ht->ctrl)
+        index = cl_ht_group_find(ht, hash, key, key_size);
+    else
+        index = cl_ht_robin_find_in(ht, ht->entries, ht->mask, hash, key, key_size);
+    if (index != ht->capacity)
+    {
+        entry = &ht->entries[index];
+    }
+    else
+    {
+        // Until a resize finishes, keys it has not moved yet are only in the old array
+        const u64 old_index = cl_ht_old_find(ht, hash, key, key_size);
+        if (old_index == ht->old_capacity)
+            return false;
+        entry = &ht->old_entries[old_index];
+    }
+
+    if (data)
+        *data = entry->data;
+    if (data_size)
+        *data_size = entry->data_size;
+    return true;
 }
 
 
@@ -331,32 +666,113 @@ bool cl_ht_exists(cl_ht_t *ht, const void *key, u64 key_size)
 
 static bool cl_ht_resize(cl_ht_t *ht, u64 new_capacity)
 {
-    cl_ht_entry_t *new_entries = cl_mem_alloc(ht->allocator, new_capacity * sizeof(cl_ht_entry_t));
+    cl_ht_finish_resize(ht);
+    cl_ht_entry_t *new_entries = cl_ht_alloc_slots(ht, new_capacity, ht->ctrl != null);
     if (!new_entries)
         return false;
 
-    memset(new_entries, 0, new_capacity * sizeof(cl_ht_entry_t));
+    cl_ht_entry_t *old_entries = ht->entries;
+    const u8 *old_ctrl = ht->ctrl;
+    const u64 old_capacity = ht->capacity;
+    ht->entries = new_entries;
+    ht->capacity = new_capacity;
+    ht->mask = new_capacity - 1;
+    if (old_ctrl)
+    {
+        ht->ctrl = (u8 *)(new_entries + new_capacity);
+        ht->growth_left = cl_ht_group_growth(new_capacity) - ht->size;
+    }
 
-    u64 new_mask = new_capacity - 1;
-    for (u64 i = 0; i < ht->capacity; i++)
+    for (u64 i = 0; i < old_capacity; i++)
     {
-        cl_ht_entry_t *entry = &ht->entries[i];
-        if (entry->key)
-        {
-            u64 index = entry->hash & new_mask;
-            while (new_entries[index].key)
-            {
-                index = (index + 1) & new_mask;
-            }
-            new_entries[index] = *entry;
-        }
+        if (old_ctrl ? old_ctrl[i] < CL_HT_CTRL_EMPTY : old_entries[i].key != null)
+            cl_ht_insert_entry(ht, &old_entries[i]);
     }
 
-    cl_mem_free(ht->allocator, ht->entries);
+    cl_mem_free(ht->allocator, old_entries);
+    return true;
+}
+
+// Incremental tables only swap in the new array here; the entries follow a few slots per operation
+static bool cl_ht_grow(cl_ht_t *ht, u64 new_capacity)
+{
+    if (!(ht->flags & CL_HT_FLAG_INCREMENTAL_RESIZE))
+        return cl_ht_resize(ht, new_capacity);
+
+    cl_ht_finish_resize(ht);
+    cl_ht_entry_t *new_entries = cl_ht_alloc_slots(ht, new_capacity, ht->ctrl != null);
+    if (!new_entries)
+        return false;
+
+    ht->old_entries = ht->entries;
+    ht->old_ctrl = ht->ctrl;
+    ht->old_capacity = ht->capacity;
+    ht->migrate_index = 0;
     ht->entries = new_entries;
     ht->capacity = new_capacity;
-    ht->mask = new_mask;
+    ht->mask = new_capacity - 1;
+    if (ht->ctrl)
+    {
+        ht->ctrl = (u8 *)(new_entries + new_capacity);
+        // Room for every entry still in the old array is set aside up front
+        ht->growth_left = cl_ht_group_growth(new_capacity) - ht->size;
+    }
+    return true;
+}
 
+static bool cl_ht_group_put(cl_ht_t *ht, u64 hash, const void *key, u64 key_size, void *data, u64 data_size,
+                            void **old_data)
+{
+    u64 index = cl_ht_group_find(ht, hash, key, key_size);
+    if (index != ht->capacity)
+    {
+        cl_ht_update_entry(ht, &ht->entries[index], data, data_size, old_data);
+        return true;
+    }
+
+    index = cl_ht_group_find_free(ht, hash);
+    if (ht->ctrl[index] == CL_HT_CTRL_EMPTY && ht->growth_left == 0)
+    {
+        // Out of empty slots. When tombstones make up much of the load, rebuilding at the same size clears them;
+        // frozen tables never grow, so they rebuild in place as long as that frees anything
+        u64 new_capacity = ht->capacity * 2;
+        if (ht->size < cl_ht_group_growth(ht->capacity) / 2 || (ht->flags & CL_HT_FLAG_FROZEN))
+            new_capacity = ht->capacity;
+        if (ht->size >= cl_ht_group_growth(new_capacity) || !cl_ht_grow(ht, new_capacity))
+            return false;
+        index = cl_ht_group_find_free(ht, hash);
+    }
+
+    void *new_key = cl_ht_copy_key(ht, key, key_size);
+    if (!new_key)
+        return false;
+
+    if (ht->ctrl[index] == CL_HT_CTRL_EMPTY)
+        ht->growth_left--;
+    cl_ht_set_ctrl(ht, index, cl_ht_tag(hash));
+    ht->entries[index] = (cl_ht_entry_t){hash, key_size, new_key, data, data_size};
+    ht->size++;
+    if (old_data)
+        *old_data = null;
+    return true;
+}
+
+// Swaps a cleared perfect table back to an empty probing layout
+static bool cl_ht_thaw(cl_ht_t *ht)
+{
+    const bool grouped = ht->flags & CL_HT_FLAG_GROUP_PROBING;
+    cl_ht_entry_t *entries = cl_ht_alloc_slots(ht, CL_HT_INITIAL_SIZE, grouped);
+    if (!entries)
+        return false;
+    cl_mem_free(ht->allocator, ht->entries);
+    cl_mem_free(ht->allocator, ht->perfect_seeds);
+    ht->perfect_seeds = null;
+    ht->perfect_buckets = 0;
+    ht->entries = entries;
+    ht->capacity = CL_HT_INITIAL_SIZE;
+    ht->mask = CL_HT_INITIAL_SIZE - 1;
+    ht->ctrl = grouped ? (u8 *)(entries + CL_HT_INITIAL_SIZE) : null;
+    ht->growth_left = cl_ht_group_growth(CL_HT_INITIAL_SIZE);
     return true;
 }
 
@@ -364,97 +780,156 @@ bool cl_ht_put(cl_ht_t *ht, const void *key, u64 key_size, void *data, u64 data_
 {
     if (!ht || !key)
         return false;
+    return cl_ht_put_hashed(ht, cl_ht_hash_key(ht, key, key_size), key, key_size, data, data_size, old_data);
+}
+
+bool cl_ht_put_hashed(cl_ht_t *ht, u64 hash, const void *key, u64 key_size, void *data, u64 data_size,
+                      void **old_data)
+{
+    if (ht->perfect_seeds && ht->size > 0)
+    {
+        const u64 index = cl_ht_perfect_find(ht, hash, key, key_size);
+        if (index == ht->capacity)
+            return false;
+        cl_ht_update_entry(ht, &ht->entries[index], data, data_size, old_data);
+        return true;
+    }
+    if (ht->perfect_seeds && !cl_ht_thaw(ht))
+        return false;
 
-    if ((float)ht->size / ht->capacity > CL_HT_LOAD_FACTOR)
+    cl_ht_step_resize(ht);
+    if (!ht->ctrl && (float)ht->size / ht->capacity > CL_HT_LOAD_FACTOR)
     {
-        if (!(ht->flags & CL_HT_FLAG_FROZEN) && !cl_ht_resize(ht, ht->capacity * 2))
+        if (!(ht->flags & CL_HT_FLAG_FROZEN) && !cl_ht_grow(ht, ht->capacity * 2))
         {
             return false;
         }
     }
 
-    u64 hash = ht->hash_func(key, key_size);
-    u64 index = hash & ht->mask;
-    u64 dist = 0;
+    // A key the resize has not moved yet is updated where it is
+    const u64 old_index = cl_ht_old_find(ht, hash, key, key_size);
+    if (old_index != ht->old_capacity)
+    {
+        cl_ht_update_entry(ht, &ht->old_entries[old_index], data, data_size, old_data);
+        return true;
+    }
 
-    while (true)
+    if (ht->ctrl)
+        return cl_ht_group_put(ht, hash, key, key_size, data, data_size, old_data);
+
+    const u64 index = cl_ht_robin_find_in(ht, ht->entries, ht->mask, hash, key, key_size);
+    if (index != ht->capacity)
     {
-        if (!ht->entries[index].key)
-        {
-            // Insert new entry
-            void *new_key;
-            if (!(ht->flags & CL_HT_FLAG_NOCOPY_KEYS))
-            {
-                new_key = cl_mem_alloc(ht->allocator, key_size);
-                if (!new_key)
-                    return false;
-                cl_mem_copy(new_key, key, key_size);
-            }
-            else
-            {
-                new_key = (void *)key;
-            }
+        cl_ht_update_entry(ht, &ht->entries[index], data, data_size, old_data);
+        return true;
+    }
+
+    void *new_key = cl_ht_copy_key(ht, key, key_size);
+    if (!new_key)
+        return false;
 
-            ht->entries[index].key = new_key;
-            ht->entries[index].key_size = key_size;
-            ht->entries[index].data = data;
-            ht->entries[index].data_size = data_size;
-            ht->entries[index].hash = hash;
-            ht->size++;
+    cl_ht_insert_entry(ht, &(cl_ht_entry_t){hash, key_size, new_key, data, data_size});
+    ht->size++;
+    if (old_data)
+        *old_data = null;
+    return true;
+}
 
-            if (old_data)
-                *old_data = null;
-            return true;
-        }
+// Starts loading the slots a lookup of the hash reads first: the home group's control bytes, or the home entry
+static inline void cl_ht_prefetch(const cl_ht_t *ht, u64 hash)
+{
+    if (ht->perfect_seeds)
+        __builtin_prefetch(&ht->perfect_seeds[cl_ht_perfect_bucket(hash, ht->perfect_buckets)]);
+    else if (ht->ctrl)
+        __builtin_prefetch(ht->ctrl + ((hash >> 7) & ht->mask));
+    else
+        __builtin_prefetch(&ht->entries[hash & ht->mask]);
+}
 
-        if (ht->entries[index].hash == hash &&
-            cl_ht_keys_equal(ht, ht->entries[index].key, ht->entries[index].key_size, key, key_size))
+// Group-probing layout, once the home control bytes are in: starts loading the entry of the first tag match, which
+// can sit anywhere in the group's ten cache lines of entries. A perfect table loads its one slot once the seed is in.
+static inline void cl_ht_prefetch_match(const cl_ht_t *ht, u64 hash)
+{
+    if (ht->perfect_seeds)
+    {
+        __builtin_prefetch(&ht->entries[cl_ht_perfect_index(ht, hash)]);
+        return;
+    }
+    const u64 pos = (hash >> 7) & ht->mask;
+    const u32 match = cl_ht_group_match(ht->ctrl + pos, cl_ht_tag(hash));
+    if (match)
+        __builtin_prefetch(&ht->entries[(pos + __builtin_ctz(match)) & ht->mask]);
+}
+
+u64 cl_ht_get_batch(cl_ht_t *ht, const void *const *keys, const u64 *key_sizes, u64 n, void **out_data,
+                    bool *out_found)
+{
+    if (!ht || !keys || !key_sizes)
+        return 0;
+
+    u64 hashes[CL_HT_BATCH_SIZE];
+    u64 found = 0;
+    for (u64 base = 0; base < n; base += CL_HT_BATCH_SIZE)
+    {
+        const u64 count = n - base < CL_HT_BATCH_SIZE ? n - base : CL_HT_BATCH_SIZE;
+        for (u64 i = 0; i < count; i++)
         {
-            // Update existing entry
-            if (old_data)
-                *old_data = ht->entries[index].data;
-            if (ht->free_func && !(ht->flags & CL_HT_FLAG_FREE_DATA))
-            {
-                ht->free_func(ht->entries[index].data);
-            }
-            ht->entries[index].data = data;
-            ht->entries[index].data_size = data_size;
-            return true;
+            hashes[i] = cl_ht_hash_key(ht, keys[base + i], key_sizes[base + i]);
+            cl_ht_prefetch(ht, hashes[i]);
         }
-
-        u64 probe_dist = cl_ht_probe_distance(ht, ht->entries[index].hash, index);
-        if (probe_dist < dist)
+        for (u64 i = 0; i < count && (ht->ctrl || ht->perfect_seeds); i++)
+            cl_ht_prefetch_match(ht, hashes[i]);
+        for (u64 i = 0; i < count; i++)
         {
-            // Robin Hood hashing: swap with the current entry
-            cl_ht_entry_t temp = ht->entries[index];
+            void *data = null;
+            const bool hit = cl_ht_get_hashed(ht, hashes[i], keys[base + i], key_sizes[base + i], &data, null);
+            if (out_data)
+                out_data[base + i] = data;
+            if (out_found)
+                out_found[base + i] = hit;
+            found += hit;
+        }
+    }
+    return found;
+}
 
-            // Allocate new key for the entry being displaced
-            void *new_key;
-            if (!(ht->flags & CL_HT_FLAG_NOCOPY_KEYS))
-            {
-                new_key = cl_mem_alloc(ht->allocator, key_size);
-                if (!new_key)
-                    return false;
-                cl_mem_copy(new_key, key, key_size);
-            }
-            else
-            {
-                new_key = (void *)key;
-            }
+// Grows once to hold entries, so a bulk load does not resize several times on its way through
+static void cl_ht_reserve(cl_ht_t *ht, u64 entries)
+{
+    if ((ht->flags & CL_HT_FLAG_FROZEN) || ht->perfect_seeds)
+        return;
+    u64 capacity = ht->capacity;
+    while (capacity < (1ULL << 62) && (float)entries > capacity * CL_HT_LOAD_FACTOR)
+        capacity *= 2;
+    if (capacity > ht->capacity)
+        cl_ht_grow(ht, capacity);
+}
 
-            ht->entries[index] = (cl_ht_entry_t){hash, key_size, new_key, data, data_size};
+u64 cl_ht_put_batch(cl_ht_t *ht, const void *const *keys, const u64 *key_sizes, void *const *data,
+                    const u64 *data_sizes, u64 n)
+{
+    if (!ht || !keys || !key_sizes)
+        return 0;
+    cl_ht_reserve(ht, ht->size + n);
 
-            key = temp.key;
-            key_size = temp.key_size;
-            data = temp.data;
-            data_size = temp.data_size;
-            hash = temp.hash;
-            dist = probe_dist;
+    u64 hashes[CL_HT_BATCH_SIZE];
+    for (u64 base = 0; base < n; base += CL_HT_BATCH_SIZE)
+    {
+        const u64 count = n - base < CL_HT_BATCH_SIZE ? n - base : CL_HT_BATCH_SIZE;
+        for (u64 i = 0; i < count; i++)
+        {
+            hashes[i] = cl_ht_hash_key(ht, keys[base + i], key_sizes[base + i]);
+            cl_ht_prefetch(ht, hashes[i]);
+        }
+        for (u64 i = 0; i < count; i++)
+        {
+            const u64 k = base + i;
+            if (!cl_ht_put_hashed(ht, hashes[i], keys[k], key_sizes[k], data ? data[k] : null,
+                                  data_sizes ? data_sizes[k] : 0, null))
+                return k;
         }
-
-        index = (index + 1) & ht->mask;
-        dist++;
     }
+    return n;
 }
 
 
@@ -462,14 +937,15 @@ void cl_ht_clear(cl_ht_t *ht)
 {
     if (!ht)
         return;
+    cl_ht_finish_resize(ht);
 
     for (u64 i = 0; i < ht->capacity; i++)
     {
-        if (ht->entries[i].key)
+        if (cl_ht_slot_full(ht, i))
         {
-            if (!(ht->flags & CL_HT_FLAG_NOCOPY_KEYS))
+            if (!cl_ht_key_in_arena(ht, ht->entries[i].key_size))
             {
-                cl_mem_free(ht->allocator, ht->entries[i].key);
+                cl_ht_free_key(ht, ht->entries[i].key, ht->entries[i].key_size);
             }
             if (ht->free_func && !(ht->flags & CL_HT_FLAG_FREE_DATA))
             {
@@ -479,7 +955,13 @@ void cl_ht_clear(cl_ht_t *ht)
             ht->entries[i].data = null;
         }
     }
+    cl_ht_release_key_arena(ht);
     ht->size = 0;
+    if (ht->ctrl)
+    {
+        memset(ht->ctrl, CL_HT_CTRL_EMPTY, ht->capacity + CL_HT_GROUP_WIDTH - 1);
+        ht->growth_left = cl_ht_group_growth(ht->capacity);
+    }
 }
 
 
@@ -487,6 +969,7 @@ void **cl_ht_values(cl_ht_t *ht, u64 *num_values, u64 **value_sizes)
 {
     if (!ht || !num_values)
         return null;
+    cl_ht_finish_resize(ht);
 
     void **values = cl_mem_alloc(ht->allocator, ht->size * sizeof(void *));
     if (!values)
@@ -505,7 +988,7 @@ void **cl_ht_values(cl_ht_t *ht, u64 *num_values, u64 **value_sizes)
     u64 index = 0;
     for (u64 i = 0; i < ht->capacity; i++)
     {
-        if (ht->entries[i].key)
+        if (cl_ht_slot_full(ht, i))
         {
             values[index] = ht->entries[i].data;
             if (value_sizes)
@@ -523,62 +1006,45 @@ void *cl_ht_remove(cl_ht_t *ht, const void *key, u64 key_size)
 {
     if (!ht || !key)
         return null;
+    return cl_ht_remove_hashed(ht, cl_ht_hash_key(ht, key, key_size), key, key_size);
+}
 
-    u64 hash = ht->hash_func(key, key_size);
-    u64 index = hash & ht->mask;
-    u64 dist = 0;
+void *cl_ht_remove_hashed(cl_ht_t *ht, u64 hash, const void *key, u64 key_size)
+{
+    if (ht->perfect_seeds)
+        return null;
+    cl_ht_step_resize(ht);
+    const u64 old_index = cl_ht_old_find(ht, hash, key, key_size);
+    if (old_index != ht->old_capacity)
+        return cl_ht_old_remove(ht, old_index);
 
-    while (true)
+    if (ht->ctrl)
     {
-        if (!ht->entries[index].key)
-        {
-            return null; // Key not found
-        }
-
-        if (ht->entries[index].hash == hash &&
-            cl_ht_keys_equal(ht, ht->entries[index].key, ht->entries[index].key_size, key, key_size))
-        {
-            void *data = ht->entries[index].data;
-
-            if (!(ht->flags & CL_HT_FLAG_NOCOPY_KEYS))
-            {
-                cl_mem_free(ht->allocator, ht->entries[index].key);
-            }
-
-            // Backward-shift deletion
-            u64 next_index = (index + 1) & ht->mask;
-            while (true)
-            {
-                if (!ht->entries[next_index].key ||
-                    cl_ht_probe_distance(ht, ht->entries[next_index].hash, next_index) == 0)
-                {
-                    break;
-                }
-                ht->entries[index] = ht->entries[next_index];
-                index = next_index;
-                next_index = (next_index + 1) & ht->mask;
-            }
-
-            memset(&ht->entries[index], 0, sizeof(cl_ht_entry_t));
-            ht->size--;
-
-            return data;
-        }
-
-        u64 probe_dist = cl_ht_probe_distance(ht, ht->entries[index].hash, index);
-        if (probe_dist < dist)
-        {
-            return null; // Key not found
-        }
-
-        index = (index + 1) & ht->mask;
-        dist++;
+        const u64 found = cl_ht_group_find(ht, hash, key, key_size);
+        if (found == ht->capacity)
+            return null;
+        void *data = ht->entries[found].data;
+        cl_ht_free_key(ht, ht->entries[found].key, ht->entries[found].key_size);
+        cl_ht_group_erase(ht, found);
+        ht->size--;
+        return data;
     }
+
+    const u64 index = cl_ht_robin_find_in(ht, ht->entries, ht->mask, hash, key, key_size);
+    if (index == ht->capacity)
+        return null;
+    void *data = ht->entries[index].data;
+    cl_ht_free_key(ht, ht->entries[index].key, ht->entries[index].key_size);
+    cl_ht_robin_erase(ht, index);
+    ht->size--;
+    return data;
 }
+
 void **cl_ht_keys(cl_ht_t *ht, u64 *num_keys, u64 **key_sizes, bool fast)
 {
     if (!ht || !num_keys)
         return null;
+    cl_ht_finish_resize(ht);
 
     void **keys = cl_mem_alloc(ht->allocator, ht->size * sizeof(void *));
     if (!keys)
@@ -597,7 +1063,7 @@ void **cl_ht_keys(cl_ht_t *ht, u64 *num_keys, u64 **key_sizes, bool fast)
     u64 index = 0;
     for (u64 i = 0; i < ht->capacity; i++)
     {
-        if (ht->entries[i].key)
+        if (cl_ht_slot_full(ht, i))
         {
             if (fast)
             {
@@ -627,10 +1093,11 @@ bool cl_ht_iter_init(cl_ht_t *ht, void **key, u64 *key_size, void **data, u64 *d
 {
     if (!ht)
         return false;
+    cl_ht_finish_resize(ht);
 
     for (u64 i = 0; i < ht->capacity; i++)
     {
-        if (ht->entries[i].key)
+        if (cl_ht_slot_full(ht, i))
         {
             *key = ht->entries[i].key;
             *key_size = ht->entries[i].key_size;
@@ -648,12 +1115,13 @@ bool cl_ht_iter_next(cl_ht_t *ht, void **key, u64 *key_size, void **data, u64 *d
 {
     if (!ht)
         return false;
+    cl_ht_finish_resize(ht);
 
     static u64 current_index = 0;
 
     for (u64 i = current_index + 1; i < ht->capacity; i++)
     {
-        if (ht->entries[i].key)
+        if (cl_ht_slot_full(ht, i))
         {
             current_index = i;
             *key = ht->entries[i].key;
@@ -668,36 +1136,140 @@ bool cl_ht_iter_next(cl_ht_t *ht, void **key, u64 *key_size, void **data, u64 *d
     return false;
 }
 
+// Scan positions are slot indices; while an incremental resize is in progress the old array is walked first, from
+// its first unmoved slot, and these bits tell its positions apart from those of the current array that follow
+#define CL_HT_SCAN_OLD (1ull << 63)
+#define CL_HT_SCAN_NEW (1ull << 62)
+#define CL_HT_SCAN_SLOT (CL_HT_SCAN_NEW - 1)
+
+// First full slot of a slot array at or after index, or capacity; with control bytes a whole group of free slots is
+// skipped at once
+static u64 cl_ht_next_full(const cl_ht_entry_t *entries, const u8 *ctrl, u64 capacity, u64 index)
+{
+    if (!ctrl)
+    {
+        while (index < capacity && (!entries[index].key || entries[index].key == CL_HT_MOVED_KEY))
+            index++;
+        return index;
+    }
+    while (index < capacity)
+    {
+        // Control bytes past the end mirror the first group, so they are masked off
+        u32 full = ~cl_ht_group_match_free(ctrl + index) & 0xFFFF;
+        if (capacity - index < CL_HT_GROUP_WIDTH)
+            full &= (1u << (capacity - index)) - 1;
+        if (full)
+            return index + __builtin_ctz(full);
+        index += CL_HT_GROUP_WIDTH;
+    }
+    return capacity;
+}
+
+// Entry at the first full slot from *position on, which is left pointing at it, or null past the last one. Nothing is
+// migrated, so a scan never pays for the rest of a pending resize.
+static const cl_ht_entry_t *cl_ht_scan_next(const cl_ht_t *ht, u64 *position)
+{
+    u64 pos = *position == 0 && ht->old_entries ? CL_HT_SCAN_OLD : *position;
+    if (pos & CL_HT_SCAN_OLD)
+    {
+        // Slots before migrate_index are already in the current array; once the old array is gone, so are the rest
+        if (ht->old_entries)
+        {
+            u64 i = pos & CL_HT_SCAN_SLOT;
+            i = cl_ht_next_full(ht->old_entries, ht->old_ctrl, ht->old_capacity,
+                                i > ht->migrate_index ? i : ht->migrate_index);
+            if (i < ht->old_capacity)
+            {
+                *position = i | CL_HT_SCAN_OLD;
+                return &ht->old_entries[i];
+            }
+        }
+        pos = CL_HT_SCAN_NEW;
+    }
+
+    const u64 i = cl_ht_next_full(ht->entries, ht->ctrl, ht->capacity, pos & CL_HT_SCAN_SLOT);
+    *position = i | (pos & CL_HT_SCAN_NEW);
+    return i < ht->capacity ? &ht->entries[i] : null;
+}
+
+// Views of the full slots from *position on, leaving *position past the last one filled
+static u64 cl_ht_scan_from(const cl_ht_t *ht, u64 *position, cl_ht_entry_view_t *views, u64 count)
+{
+    u64 filled = 0;
+    const cl_ht_entry_t *entry;
+    while (filled < count && (entry = cl_ht_scan_next(ht, position)) != null)
+    {
+        views[filled++] = (cl_ht_entry_view_t){entry->key, entry->key_size, entry->data, entry->data_size};
+        (*position)++;
+    }
+    return filled;
+}
+
+void cl_ht_iterator_init(cl_ht_t *ht, cl_ht_iterator_t *it)
+{
+    if (!it)
+        return;
+    it->ht = ht;
+    it->index = 0;
+}
+
+bool cl_ht_iterator_next(cl_ht_iterator_t *it, cl_ht_entry_view_t *entry)
+{
+    if (!it || !it->ht || !entry)
+        return false;
+    return cl_ht_scan_from(it->ht, &it->index, entry, 1) == 1;
+}
+
+u64 cl_ht_scan(cl_ht_t *ht, u64 *cursor, cl_ht_entry_view_t *views, u64 count)
+{
+    if (!ht || !cursor || !views || count == 0)
+        return 0;
+    const u64 filled = cl_ht_scan_from(ht, cursor, views, count);
+    if (cl_ht_scan_next(ht, cursor) == null)
+        *cursor = 0;
+    return filled;
+}
+
 
 u64 cl_ht_foreach_remove(cl_ht_t *ht, cl_ht_remove_func_t r_fn, cl_ht_free_func_t ff, void *arg)
 {
-    if (!ht || !r_fn)
+    if (!ht || !r_fn || ht->perfect_seeds)
         return 0;
+    cl_ht_finish_resize(ht);
+
+    // A Robin Hood removal shifts the rest of its run back into the freed slot, so the walk starts at an empty slot,
+    // which no shift crosses, and looks at a slot again after removing from it
+    u64 start = 0;
+    while (!ht->ctrl && start < ht->mask && ht->entries[start].key)
+        start++;
 
     u64 removed = 0;
-    for (u64 i = 0; i < ht->capacity; i++)
+    u64 visited = 0;
+    while (visited < ht->capacity)
     {
-        if (ht->entries[i].key)
+        const u64 i = (start + visited) & ht->mask;
+        cl_ht_entry_t *entry = &ht->entries[i];
+        if (cl_ht_slot_full(ht, i) && r_fn(entry->key, entry->key_size, entry->data, entry->data_size, arg))
         {
-            if (r_fn(ht->entries[i].key, ht->entries[i].key_size, ht->entries[i].data, ht->entries[i].data_size, arg))
+            cl_ht_free_key(ht, entry->key, entry->key_size);
+            if (ff)
             {
-                if (!(ht->flags & CL_HT_FLAG_NOCOPY_KEYS))
-                {
-                    cl_mem_free(ht->allocator, ht->entries[i].key);
-                }
-                if (ff)
-                {
-                    ff(ht->entries[i].data);
-                }
-                else if (ht->free_func)
-                {
-                    ht->free_func(ht->entries[i].data);
-                }
-                memset(&ht->entries[i], 0, sizeof(cl_ht_entry_t));
-                ht->size--;
-                removed++;
+                ff(entry->data);
             }
+            else if (ht->free_func)
+            {
+                ht->free_func(entry->data);
+            }
+            ht->size--;
+            removed++;
+            if (!ht->ctrl)
+            {
+                cl_ht_robin_erase(ht, i);
+                continue;
+            }
+            cl_ht_group_erase(ht, i);
         }
+        visited++;
     }
 
     return removed;
@@ -706,11 +1278,12 @@ u64 cl_ht_foreach(cl_ht_t *ht, cl_ht_foreach_func_t fe_fn, void *arg)
 {
     if (!ht || !fe_fn)
         return 0;
+    cl_ht_finish_resize(ht);
 
     u64 count = 0;
     for (u64 i = 0; i < ht->capacity; i++)
     {
-        if (ht->entries[i].key)
+        if (cl_ht_slot_full(ht, i))
         {
             if (!fe_fn(ht->entries[i].key, ht->entries[i].key_size, ht->entries[i].data, ht->entries[i].data_size, arg))
             {
@@ -723,7 +1296,202 @@ u64 cl_ht_foreach(cl_ht_t *ht, cl_ht_foreach_func_t fe_fn, void *arg)
     return count;
 }
 
-bool cl_ht_rehash(cl_ht_t *ht) { return cl_ht_resize(ht, ht->capacity); }
+bool cl_ht_rehash(cl_ht_t *ht) { return !ht->perfect_seeds && cl_ht_resize(ht, ht->capacity); }
+
+// Finds a seed that sends every key of a bucket to its own free slot, and marks those slots taken
+static bool cl_ht_perfect_place(const cl_ht_entry_t *entries, const u64 *members, u64 count, u64 capacity,
+                                u64 *taken, u64 *slots, u32 *seed)
+{
+    for (u64 i = 0; i < count; i++)
+    {
+        for (u64 j = 0; j < i; j++)
+        {
+            // Equal hashes land together whatever the seed
+            if (entries[members[i]].hash == entries[members[j]].hash)
+                return false;
+        }
+    }
+
+    for (u32 s = 0; s < CL_HT_PERFECT_MAX_SEED; s++)
+    {
+        u64 placed = 0;
+        for (; placed < count; placed++)
+        {
+            const u64 slot = cl_ht_perfect_slot(entries[members[placed]].hash, s, capacity);
+            if (taken[slot / 64] & (1ULL << (slot % 64)))
+                break;
+            taken[slot / 64] |= 1ULL << (slot % 64);
+            slots[placed] = slot;
+        }
+        if (placed == count)
+        {
+            *seed = s;
+            return true;
+        }
+        for (u64 i = 0; i < placed; i++)
+            taken[slots[i] / 64] &= ~(1ULL << (slots[i] % 64));
+    }
+    return false;
+}
+
+// Hash and displace (CHD): keys go into buckets of about three by their high hash bits, and the buckets are placed
+// largest first, each with the first seed that sends all its keys to free slots. Buckets of one key take the slots
+// left over directly, which is where a seed search would get slow.
+bool cl_ht_freeze_perfect(cl_ht_t *ht)
+{
+    if (!ht || ht->size == 0 || ht->size >= CL_HT_PERFECT_DIRECT)
+        return false;
+    if (ht->perfect_seeds)
+        return true;
+    cl_ht_finish_resize(ht);
+
+    const u64 n = ht->size;
+    const u64 buckets = (n + CL_HT_PERFECT_BUCKET_KEYS - 1) / CL_HT_PERFECT_BUCKET_KEYS;
+    const u64 taken_words = (n + 63) / 64;
+    u32 *seeds = cl_mem_alloc(ht->allocator, buckets * sizeof(u32));
+    cl_ht_entry_t *entries = cl_mem_alloc(ht->allocator, n * sizeof(cl_ht_entry_t));
+    u64 *starts = cl_mem_alloc(ht->allocator, (buckets + 1) * sizeof(u64)); // Each bucket's run in members
+    u64 *members = cl_mem_alloc(ht->allocator, n * sizeof(u64)); // Slots in the current array, by bucket
+    u64 *order = cl_mem_alloc(ht->allocator, buckets * sizeof(u64));
+    u64 *taken = cl_mem_alloc(ht->allocator, taken_words * sizeof(u64));
+    u64 *by_size = null;
+    u64 *slots = null;
+    bool ok = seeds && entries && starts && members && order && taken;
+
+    u64 largest = 0;
+    if (ok)
+    {
+        memset(starts, 0, (buckets + 1) * sizeof(u64));
+        memset(taken, 0, taken_words * sizeof(u64));
+        for (u64 i = 0; i < ht->capacity; i++)
+        {
+            if (cl_ht_slot_full(ht, i))
+                starts[cl_ht_perfect_bucket(ht->entries[i].hash, buckets) + 1]++;
+        }
+        for (u64 b = 0; b < buckets; b++)
+        {
+            largest = starts[b + 1] > largest ? starts[b + 1] : largest;
+            starts[b + 1] += starts[b];
+            order[b] = starts[b]; // Fill position until the buckets are sorted
+        }
+        for (u64 i = 0; i < ht->capacity; i++)
+        {
+            if (cl_ht_slot_full(ht, i))
+                members[order[cl_ht_perfect_bucket(ht->entries[i].hash, buckets)]++] = i;
+        }
+        by_size = cl_mem_alloc(ht->allocator, (largest + 2) * sizeof(u64));
+        slots = cl_mem_alloc(ht->allocator, largest * sizeof(u64));
+        ok = by_size && slots;
+    }
+
+    if (ok)
+    {
+        // Counting sort of the buckets, largest first
+        memset(by_size, 0, (largest + 2) * sizeof(u64));
+        for (u64 b = 0; b < buckets; b++)
+            by_size[largest - (starts[b + 1] - starts[b]) + 1]++;
+        for (u64 i = 0; i <= largest; i++)
+            by_size[i + 1] += by_size[i];
+        for (u64 b = 0; b < buckets; b++)
+            order[by_size[largest - (starts[b + 1] - starts[b])]++] = b;
+
+        u64 next_free = 0;
+        for (u64 i = 0; i < buckets && ok; i++)
+        {
+            const u64 b = order[i];
+            const u64 count = starts[b + 1] - starts[b];
+            if (count > 1)
+            {
+                ok = cl_ht_perfect_place(ht->entries, members + starts[b], count, n, taken, slots, &seeds[b]);
+                continue;
+            }
+            if (count == 0)
+            {
+                seeds[b] = CL_HT_PERFECT_DIRECT; // Never matched; a lookup that lands here compares one slot and misses
+                continue;
+            }
+            while (taken[next_free / 64] & (1ULL << (next_free % 64)))
+                next_free++;
+            taken[next_free / 64] |= 1ULL << (next_free % 64);
+            seeds[b] = CL_HT_PERFECT_DIRECT | (u32)next_free;
+        }
+    }
+
+    if (ok)
+    {
+        for (u64 b = 0; b < buckets; b++)
+        {
+            for (u64 m = starts[b]; m < starts[b + 1]; m++)
+            {
+                const cl_ht_entry_t *entry = &ht->entries[members[m]];
+                const u64 slot = seeds[b] & CL_HT_PERFECT_DIRECT ? seeds[b] & ~CL_HT_PERFECT_DIRECT
+                                                                 : cl_ht_perfect_slot(entry->hash, seeds[b], n);
+                entries[slot] = *entry;
+            }
+        }
+        cl_mem_free(ht->allocator, ht->entries);
+        ht->entries = entries;
+        ht->capacity = n;
+        ht->mask = 0;
+        ht->ctrl = null;
+        ht->growth_left = 0;
+        ht->perfect_seeds = seeds;
+        ht->perfect_buckets = buckets;
+    }
+    else
+    {
+        cl_mem_free(ht->allocator, seeds);
+        cl_mem_free(ht->allocator, entries);
+    }
+    cl_mem_free(ht->allocator, starts);
+    cl_mem_free(ht->allocator, members);
+    cl_mem_free(ht->allocator, order);
+    cl_mem_free(ht->allocator, taken);
+    cl_mem_free(ht->allocator, by_size);
+    cl_mem_free(ht->allocator, slots);
+    return ok;
+}
+
+// Groups a lookup of the entry in the slot steps past before it reaches the group holding it
+static u64 cl_ht_group_probe_length(const cl_ht_t *ht, u64 hash, u64 index)
+{
+    u64 pos = (hash >> 7) & ht->mask;
+    u64 step = 0;
+    u64 length = 0;
+    while (((index - pos) & ht->mask) >= CL_HT_GROUP_WIDTH)
+    {
+        step += CL_HT_GROUP_WIDTH;
+        pos = (pos + step) & ht->mask;
+        length++;
+    }
+    return length;
+}
+
+u64 cl_ht_probe_lengths(cl_ht_t *ht, u64 *counts, u32 count)
+{
+    if (!ht || (!counts && count > 0))
+        return 0;
+    cl_ht_finish_resize(ht);
+
+    if (count > 0)
+        memset(counts, 0, count * sizeof(u64));
+    u64 longest = 0;
+    for (u64 i = 0; i < ht->capacity; i++)
+    {
+        if (!cl_ht_slot_full(ht, i))
+            continue;
+        const u64 hash = ht->entries[i].hash;
+        u64 length = 0;
+        if (ht->ctrl)
+            length = cl_ht_group_probe_length(ht, hash, i);
+        else if (!ht->perfect_seeds)
+            length = cl_ht_probe_distance(ht->mask, hash, i);
+        if (count > 0)
+            counts[length < count ? length : count - 1]++;
+        longest = length > longest ? length : longest;
+    }
+    return longest;
+}
 
 u64 cl_ht_size(cl_ht_t *ht) { return ht ? ht->size : 0; }
 
@@ -0,0 +1,20 @@
+/**
+ * Created by jraynor on 8/6/2024.
+ */
+#pragma once
+
+#include "clib/containers_lib.h"
+
+// Unseeded cl_hash_wy, the default for every table built on cl_ht's hashing
+u64 cl_ht_default_hash(const void *input, u64 length);
+
+// Hash table operations on a hash the caller already computed with cl_ht_hash, so containers built on top of cl_ht
+// (sharding, caching the hash) hash each key once. The hash must come from the same table's hash function.
+u64 cl_ht_hash(const cl_ht_t *ht, const void *key, u64 key_size);
+// The seed cl_ht_hash passes to cl_hash_wy; false when the table has its own hash function
+bool cl_ht_builtin_seed(const cl_ht_t *ht, u64 *seed);
+const cl_allocator_t *cl_ht_get_allocator(const cl_ht_t *ht);
+bool cl_ht_get_hashed(cl_ht_t *ht, u64 hash, const void *key, u64 key_size, void **data, u64 *data_size);
+bool cl_ht_put_hashed(cl_ht_t *ht, u64 hash, const void *key, u64 key_size, void *data, u64 data_size,
+                      void **old_data);
+void *cl_ht_remove_hashed(cl_ht_t *ht, u64 hash, const void *key, u64 key_size);
@@ -0,0 +1,373 @@
+/**
+ * Created by jraynor on 8/6/2024.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "cl_ht_internal.h"
+#include "clib/containers_lib.h"
+
+#define CL_HT_SNAPSHOT_MAGIC 0x31504E5354484C43ull // "CLHTSNP1" as a little-endian u64; reads differently elsewhere
+#define CL_HT_SNAPSHOT_VERSION 1
+#define CL_HT_SNAPSHOT_LOAD_FACTOR 0.75 // Entries per home slot at most
+#define CL_HT_SNAPSHOT_BUFFER (1 << 16) // Bytes gathered before each write to the file
+
+// File layout, every field native-endian and every offset from the start of the file:
+//   header | slots[slot_count] | records
+// A key's home slot is the top bits of its hash. Entries are sorted by hash and each takes the first slot at or after
+// its home that the previous one left free, so a probe can stop at the first empty slot or larger hash. The last
+// entries may run past 2^bits, which is why slot_count can be larger. Records are key_size, data_size, the key, and
+// the value, each part starting on an 8-byte boundary.
+typedef struct cl_ht_snapshot_header
+{
+    u64 magic;
+    u32 version;
+    u32 header_size;
+    u64 seed; // Seed of cl_hash_wy for every hash in the file
+    u64 count;
+    u32 bits;
+    u32 reserved;
+    u64 slot_count;
+    u64 records_offset;
+    u64 file_size;
+} cl_ht_snapshot_header_t;
+
+typedef struct cl_ht_snapshot_slot
+{
+    u64 hash;
+    u64 offset; // Of the entry's record; 0 for an empty slot
+} cl_ht_snapshot_slot_t;
+
+struct cl_ht_snapshot
+{
+    const u8 *data;
+    u64 size;
+    const cl_ht_snapshot_slot_t *slots;
+    u64 slot_count;
+    u64 count;
+    u64 seed;
+    u32 bits;
+    u64 records_offset;
+    const cl_allocator_t *allocator;
+};
+
+typedef struct cl_ht_snapshot_item
+{
+    u64 hash;
+    const void *key;
+    u64 key_size;
+    const void *data;
+    u64 data_size;
+} cl_ht_snapshot_item_t;
+
+typedef struct cl_ht_snapshot_collect
+{
+    cl_ht_t *ht;
+    cl_ht_snapshot_item_t *items;
+    u64 count;
+    u64 capacity;
+} cl_ht_snapshot_collect_t;
+
+typedef struct cl_ht_snapshot_writer
+{
+    cl_file_t *file;
+    u8 *buffer;
+    u64 used;
+    bool ok;
+} cl_ht_snapshot_writer_t;
+
+static inline u64 cl_ht_snapshot_align(u64 size) { return (size + 7) & ~7ull; }
+
+static inline u64 cl_ht_snapshot_home(u64 hash, u32 bits) { return bits ? hash >> (64 - bits) : 0; }
+
+// A value with no size is an opaque pointer in cl_ht; its bits are stored in place of the bytes it points at
+static inline u64 cl_ht_snapshot_value_size(u64 data_size) { return data_size ? data_size : sizeof(void *); }
+
+static inline u64 cl_ht_snapshot_record_size(const cl_ht_snapshot_item_t *item)
+{
+    return 2 * sizeof(u64) + cl_ht_snapshot_align(item->key_size) +
+           cl_ht_snapshot_align(cl_ht_snapshot_value_size(item->data_size));
+}
+
+static bool cl_ht_snapshot_collect(void *key, u64 key_size, void *data, u64 data_size, void *arg)
+{
+    cl_ht_snapshot_collect_t *collect = arg;
+    if (collect->count == collect->capacity)
+        return false;
+    collect->items[collect->count++] =
+        (cl_ht_snapshot_item_t){cl_ht_hash(collect->ht, key, key_size), key, key_size, data, data_size};
+    return true;
+}
+
+static int cl_ht_snapshot_compare(const void *a, const void *b)
+{
+    const u64 x = ((const cl_ht_snapshot_item_t *)a)->hash, y = ((const cl_ht_snapshot_item_t *)b)->hash;
+    return x < y ? -1 : x > y;
+}
+
+static void cl_ht_snapshot_flush(cl_ht_snapshot_writer_t *writer)
+{
+    u64 written = 0;
+    while (writer->ok && written < writer->used)
+    {
+        const u64 n = cl_fs_write_file(writer->file, writer->buffer + written, writer->used - written);
+        writer->ok = n > 0;
+        written += n;
+    }
+    writer->used = 0;
+}
+
+static void cl_ht_snapshot_write_bytes(cl_ht_snapshot_writer_t *writer, const void *bytes, u64 size)
+{
+    const u8 *p = bytes;
+    while (size > 0 && writer->ok)
+    {
+        if (writer->used == CL_HT_SNAPSHOT_BUFFER)
+            cl_ht_snapshot_flush(writer);
+        const u64 room = CL_HT_SNAPSHOT_BUFFER - writer->used;
+        const u64 n = size < room ? size : room;
+        if (p)
+        {
+            memcpy(writer->buffer + writer->used, p, n);
+            p += n;
+        }
+        else
+        {
+            memset(writer->buffer + writer->used, 0, n);
+        }
+        writer->used += n;
+        size -= n;
+    }
+}
+
+static void cl_ht_snapshot_write_items(cl_ht_snapshot_writer_t *writer, const cl_ht_snapshot_item_t *items, u64 count,
+                                       u32 bits, u64 records_offset)
+{
+    // Slots, with the empty runs between entries written as zeros
+    u64 next = 0;
+    u64 offset = records_offset;
+    for (u64 i = 0; i < count; i++)
+    {
+        const u64 home = cl_ht_snapshot_home(items[i].hash, bits);
+        if (home > next)
+        {
+            cl_ht_snapshot_write_bytes(writer, null, (home - next) * sizeof(cl_ht_snapshot_slot_t));
+            next = home;
+        }
+        const cl_ht_snapshot_slot_t slot = {items[i].hash, offset};
+        cl_ht_snapshot_write_bytes(writer, &slot, sizeof(slot));
+        next++;
+        offset += cl_ht_snapshot_record_size(&items[i]);
+    }
+    if (next < (1ull << bits))
+        cl_ht_snapshot_write_bytes(writer, null, ((1ull << bits) - next) * sizeof(cl_ht_snapshot_slot_t));
+
+    for (u64 i = 0; i < count; i++)
+    {
+        const cl_ht_snapshot_item_t *item = &items[i];
+        const u64 sizes[2] = {item->key_size, item->data_size};
+        const u64 value_size = cl_ht_snapshot_value_size(item->data_size);
+        cl_ht_snapshot_write_bytes(writer, sizes, sizeof(sizes));
+        cl_ht_snapshot_write_bytes(writer, item->key, item->key_size);
+        cl_ht_snapshot_write_bytes(writer, null, cl_ht_snapshot_align(item->key_size) - item->key_size);
+        cl_ht_snapshot_write_bytes(writer, item->data_size ? item->data : (const void *)&item->data, value_size);
+        cl_ht_snapshot_write_bytes(writer, null, cl_ht_snapshot_align(value_size) - value_size);
+    }
+}
+
+bool cl_ht_snapshot_write(cl_ht_t *ht, cl_fs_t *fs, const char *path)
+{
+    u64 seed;
+    if (!ht || !fs || !path || !cl_ht_builtin_seed(ht, &seed))
+        return false;
+
+    const cl_allocator_t *allocator = cl_ht_get_allocator(ht);
+    const u64 count = cl_ht_size(ht);
+    cl_ht_snapshot_collect_t collect = {ht, null, 0, count};
+    collect.items = cl_mem_alloc(allocator, (count ? count : 1) * sizeof(cl_ht_snapshot_item_t));
+    if (!collect.items)
+        return false;
+    cl_ht_foreach(ht, cl_ht_snapshot_collect, &collect);
+    qsort(collect.items, count, sizeof(cl_ht_snapshot_item_t), cl_ht_snapshot_compare);
+
+    u32 bits = 0;
+    while ((f64)(1ull << bits) * CL_HT_SNAPSHOT_LOAD_FACTOR < (f64)count)
+        bits++;
+    u64 slot_count = 1ull << bits;
+    u64 records_size = 0;
+    for (u64 i = 0, next = 0; i < count; i++)
+    {
+        const u64 home = cl_ht_snapshot_home(collect.items[i].hash, bits);
+        next = (home > next ? home : next) + 1;
+        slot_count = next > slot_count ? next : slot_count;
+        records_size += cl_ht_snapshot_record_size(&collect.items[i]);
+    }
+    const cl_ht_snapshot_header_t header = {
+        .magic = CL_HT_SNAPSHOT_MAGIC,
+        .version = CL_HT_SNAPSHOT_VERSION,
+        .header_size = sizeof(cl_ht_snapshot_header_t),
+        .seed = seed,
+        .count = count,
+        .bits = bits,
+        .slot_count = slot_count,
+        .records_offset = sizeof(cl_ht_snapshot_header_t) + slot_count * sizeof(cl_ht_snapshot_slot_t),
+        .file_size = sizeof(cl_ht_snapshot_header_t) + slot_count * sizeof(cl_ht_snapshot_slot_t) + records_size,
+    };
+
+    // Written beside the target and renamed over it, so a process mapping the old file never sees a partial one
+    const u64 path_length = strlen(path);
+    char *temp_path = cl_mem_alloc(allocator, path_length + 5);
+    cl_ht_snapshot_writer_t writer = {null, cl_mem_alloc(allocator, CL_HT_SNAPSHOT_BUFFER), 0, false};
+    if (temp_path && writer.buffer)
+    {
+        memcpy(temp_path, path, path_length);
+        memcpy(temp_path + path_length, ".tmp", 5);
+        writer.file = cl_fs_open_file(fs, temp_path, CL_FILE_MODE_WRITE);
+        writer.ok = writer.file != null;
+    }
+    if (writer.ok)
+    {
+        cl_ht_snapshot_write_bytes(&writer, &header, sizeof(header));
+        cl_ht_snapshot_write_items(&writer, collect.items, count, bits, header.records_offset);
+        cl_ht_snapshot_flush(&writer);
+        cl_fs_close_file(writer.file);
+        if (writer.ok && !cl_fs_rename(fs, temp_path, path))
+        {
+            // Platforms whose rename will not replace a file
+            writer.ok = cl_fs_remove_file(fs, path) && cl_fs_rename(fs, temp_path, path);
+        }
+        if (!writer.ok)
+            cl_fs_remove_file(fs, temp_path);
+    }
+    cl_mem_free(allocator, writer.buffer);
+    cl_mem_free(allocator, temp_path);
+    cl_mem_free(allocator, collect.items);
+    return writer.ok;
+}
+
+cl_ht_snapshot_t *cl_ht_snapshot_open(const cl_allocator_t *allocator, cl_fs_t *fs, const char *path)
+{
+    if (!fs || !path)
+        return null;
+    cl_file_t *file = cl_fs_open_file(fs, path, CL_FILE_MODE_READ);
+    if (!file)
+        return null;
+    u64 size = 0;
+    const u8 *data = cl_fs_map_file(file, &size);
+    cl_fs_close_file(file);
+    if (!data)
+        return null;
+
+    // Only the header is checked here, so opening touches one page; lookups bounds-check the records they read
+    cl_ht_snapshot_header_t header;
+    bool valid = size >= sizeof(header);
+    if (valid)
+    {
+        memcpy(&header, data, sizeof(header));
+        const u64 max_slots = (size - sizeof(header)) / sizeof(cl_ht_snapshot_slot_t);
+        valid = header.magic == CL_HT_SNAPSHOT_MAGIC && header.version == CL_HT_SNAPSHOT_VERSION &&
+                header.header_size == sizeof(header) && header.file_size == size && header.bits < 64 &&
+                header.slot_count <= max_slots && header.slot_count >= (1ull << header.bits) &&
+                header.records_offset == sizeof(header) + header.slot_count * sizeof(cl_ht_snapshot_slot_t) &&
+                header.count <= header.slot_count;
+    }
+    cl_ht_snapshot_t *snapshot = valid ? cl_mem_alloc(allocator, sizeof(cl_ht_snapshot_t)) : null;
+    if (!snapshot)
+    {
+        cl_fs_unmap_file(data, size);
+        return null;
+    }
+    *snapshot = (cl_ht_snapshot_t){
+        .data = data,
+        .size = size,
+        .slots = (const cl_ht_snapshot_slot_t *)(data + sizeof(header)),
+        .slot_count = header.slot_count,
+        .count = header.count,
+        .seed = header.seed,
+        .bits = header.bits,
+        .records_offset = header.records_offset,
+        .allocator = allocator,
+    };
+    return snapshot;
+}
+
+void cl_ht_snapshot_close(cl_ht_snapshot_t *snapshot)
+{
+    if (!snapshot)
+        return;
+    cl_fs_unmap_file(snapshot->data, snapshot->size);
+    cl_mem_free(snapshot->allocator, snapshot);
+}
+
+u64 cl_ht_snapshot_size(const cl_ht_snapshot_t *snapshot) { return snapshot ? snapshot->count : 0; }
+
+// The record at a slot's offset, or false when it does not fit in the file
+static bool cl_ht_snapshot_record(const cl_ht_snapshot_t *snapshot, u64 offset, const void **key, u64 *key_size,
+                                  const void **data, u64 *data_size)
+{
+    if (offset < snapshot->records_offset || offset > snapshot->size - 2 * sizeof(u64))
+        return false;
+    u64 sizes[2];
+    memcpy(sizes, snapshot->data + offset, sizeof(sizes));
+    const u64 room = snapshot->size - offset - sizeof(sizes);
+    const u64 value_size = cl_ht_snapshot_value_size(sizes[1]);
+    if (sizes[0] > room || value_size > room || cl_ht_snapshot_align(sizes[0]) > room - value_size)
+        return false;
+    const u8 *record = snapshot->data + offset + sizeof(sizes);
+    *key = record;
+    *key_size = sizes[0];
+    *data_size = sizes[1];
+    if (sizes[1])
+        *data = record + cl_ht_snapshot_align(sizes[0]);
+    else
+        memcpy((void *)data, record + cl_ht_snapshot_align(sizes[0]), sizeof(void *));
+    return true;
+}
+
+bool cl_ht_snapshot_get(const cl_ht_snapshot_t *snapshot, const void *key, u64 key_size, const void **data,
+                        u64 *data_size)
+{
+    if (!snapshot || !key)
+        return false;
+    const u64 hash = cl_hash_wy(key, key_size, snapshot->seed);
+    for (u64 i = cl_ht_snapshot_home(hash, snapshot->bits); i < snapshot->slot_count; i++)
+    {
+        const cl_ht_snapshot_slot_t *slot = &snapshot->slots[i];
+        if (slot->offset == 0 || slot->hash > hash)
+            return false;
+        if (slot->hash != hash)
+            continue;
+        const void *found_key;
+        const void *found_data;
+        u64 found_key_size;
+        u64 found_data_size;
+        if (cl_ht_snapshot_record(snapshot, slot->offset, &found_key, &found_key_size, &found_data,
+                                  &found_data_size) &&
+            found_key_size == key_size && memcmp(found_key, key, key_size) == 0)
+        {
+            if (data)
+                *data = found_data;
+            if (data_size)
+                *data_size = found_data_size;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool cl_ht_snapshot_next(const cl_ht_snapshot_t *snapshot, u64 *cursor, const void **key, u64 *key_size,
+                         const void **data, u64 *data_size)
+{
+    if (!snapshot || !cursor || !key || !key_size)
+        return false;
+    const void *ignored_data;
+    u64 ignored_size;
+    while (*cursor < snapshot->slot_count)
+    {
+        const cl_ht_snapshot_slot_t *slot = &snapshot->slots[(*cursor)++];
+        if (slot->offset != 0 && cl_ht_snapshot_record(snapshot, slot->offset, key, key_size,
+                                                       data ? data : &ignored_data,
+                                                       data_size ? data_size : &ignored_size))
+            return true;
+    }
+    return false;
+}
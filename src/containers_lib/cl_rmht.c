@@ -0,0 +1,479 @@
+/**
+ * Created by jraynor on 8/6/2024.
+ */
+#include <stdatomic.h>
+#include <stddef.h>
+#include <string.h>
+#include "cl_ht_internal.h"
+#include "clib/containers_lib.h"
+#include "clib/log_lib.h"
+
+#define CL_RMHT_INITIAL_SIZE 16
+#define CL_RMHT_LOAD_FACTOR 0.75f // Live entries and tombstones together
+#define CL_RMHT_STRIPES 64 // Reader counters, one cache line each; threads are spread over them round-robin
+#define CL_RMHT_RECLAIM_BATCH 64 // Retired nodes and tables held back before a grace period frees them together
+
+// Entries are immutable once published: a put of an existing key swaps in a new node, and a remove leaves the
+// tombstone marker so later keys on the probe sequence stay reachable. Slots only ever change by a single atomic
+// store, so a reader sees each one either before or after a write and never a half-written entry, and keys never
+// move within a slot array. A resize builds a new array and publishes it whole; the old one stays intact for the
+// readers still probing it.
+typedef struct cl_rmht_node
+{
+    u64 hash;
+    void *data;
+    u64 data_size;
+    u64 key_size;
+    char key[];
+} cl_rmht_node_t;
+
+// The hash sits next to the node pointer so a probe steps over other keys without touching their nodes. A writer
+// stores the hash before the node, and the hash only changes when a tombstone is reused, so a reader pairing a stale
+// node with a newer hash can at worst miss a key that was being removed at the time.
+typedef struct cl_rmht_slot
+{
+    _Atomic(cl_rmht_node_t *) node;
+    atomic_uint_fast64_t hash;
+} cl_rmht_slot_t;
+
+typedef struct cl_rmht_table
+{
+    u64 capacity;
+    u64 mask;
+    cl_rmht_slot_t slots[];
+} cl_rmht_table_t;
+
+typedef struct cl_rmht_retired
+{
+    void *ptr;
+    bool table; // A slot array rather than a node
+    bool free_data; // Pass the node's data to the free function when it is reclaimed
+} cl_rmht_retired_t;
+
+typedef struct cl_rmht_stripe
+{
+    _Alignas(64) atomic_uint_fast64_t readers[2]; // Indexed by the parity of the epoch a reader entered under
+} cl_rmht_stripe_t;
+
+struct cl_rmht
+{
+    cl_rmht_stripe_t stripes[CL_RMHT_STRIPES];
+    _Alignas(64) _Atomic(cl_rmht_table_t *) table;
+    atomic_uint_fast64_t mask; // Copy of the current array's mask for the prefetch ahead of a read section
+    atomic_uint_fast64_t epoch;
+    atomic_uint_fast64_t size;
+    cl_ht_hash_func_t hash_func;
+    cl_ht_free_func_t free_func;
+    const cl_allocator_t *allocator;
+
+    // Writer state, guarded by the mutex
+    cl_mutex_t *mutex;
+    u64 used; // Slots holding an entry or a tombstone in the current array
+    cl_rmht_retired_t limbo[CL_RMHT_RECLAIM_BATCH];
+    u32 limbo_count;
+};
+
+static cl_rmht_node_t cl_rmht_tombstone;
+#define CL_RMHT_TOMBSTONE (&cl_rmht_tombstone)
+
+static atomic_uint cl_rmht_next_stripe = 0;
+static CL_THREAD_LOCAL u32 cl_rmht_thread_stripe = UINT32_MAX;
+
+static inline u32 cl_rmht_stripe(void)
+{
+    if (cl_rmht_thread_stripe == UINT32_MAX)
+        cl_rmht_thread_stripe = atomic_fetch_add_explicit(&cl_rmht_next_stripe, 1, memory_order_relaxed) %
+                                CL_RMHT_STRIPES;
+    return cl_rmht_thread_stripe;
+}
+
+// Readers and writers use sequentially consistent accesses for the counters, the epoch and every published pointer:
+// a writer that unpublished a pointer and then finds a counter at zero knows any reader that registers later will
+// load the replacement. On x86 the loads stay plain moves.
+u32 cl_rmht_read_lock(cl_rmht_t *rmht)
+{
+    const u32 stripe = cl_rmht_stripe();
+    const u32 parity = (u32)(atomic_load(&rmht->epoch) & 1);
+    atomic_fetch_add(&rmht->stripes[stripe].readers[parity], 1);
+    return stripe << 1 | parity;
+}
+
+void cl_rmht_read_unlock(cl_rmht_t *rmht, u32 token)
+{
+    atomic_fetch_sub_explicit(&rmht->stripes[token >> 1].readers[token & 1], 1, memory_order_release);
+}
+
+// Must be called with the mutex held and outside any read section of this thread
+static void cl_rmht_wait_for_readers(cl_rmht_t *rmht)
+{
+    // A reader may sample the epoch just before a flip and register under the old parity afterwards, so each parity
+    // has to drain once after the flips began; new readers meanwhile go to the other parity and cannot starve this
+    for (u32 phase = 0; phase < 2; phase++)
+    {
+        const u32 parity = (u32)(atomic_fetch_add(&rmht->epoch, 1) & 1);
+        for (u32 i = 0; i < CL_RMHT_STRIPES; i++)
+        {
+            while (atomic_load(&rmht->stripes[i].readers[parity]) != 0)
+                cl_thread_yield();
+        }
+    }
+}
+
+static void cl_rmht_free_retired(cl_rmht_t *rmht, const cl_rmht_retired_t *retired)
+{
+    if (!retired->table && retired->free_data && rmht->free_func)
+        rmht->free_func(((cl_rmht_node_t *)retired->ptr)->data);
+    cl_mem_free(rmht->allocator, retired->ptr);
+}
+
+// Must be called with the mutex held
+static void cl_rmht_reclaim(cl_rmht_t *rmht)
+{
+    cl_rmht_wait_for_readers(rmht);
+    for (u32 i = 0; i < rmht->limbo_count; i++)
+        cl_rmht_free_retired(rmht, &rmht->limbo[i]);
+    rmht->limbo_count = 0;
+}
+
+// Must be called with the mutex held, after ptr was unpublished
+static void cl_rmht_retire(cl_rmht_t *rmht, void *ptr, bool table, bool free_data)
+{
+    if (rmht->limbo_count == CL_RMHT_RECLAIM_BATCH)
+        cl_rmht_reclaim(rmht);
+    rmht->limbo[rmht->limbo_count++] = (cl_rmht_retired_t){ptr, table, free_data};
+}
+
+static cl_rmht_table_t *cl_rmht_alloc_table(const cl_rmht_t *rmht, u64 capacity)
+{
+    cl_rmht_table_t *table =
+        cl_mem_alloc(rmht->allocator, sizeof(cl_rmht_table_t) + capacity * sizeof(cl_rmht_slot_t));
+    if (!table)
+        return null;
+    table->capacity = capacity;
+    table->mask = capacity - 1;
+    for (u64 i = 0; i < capacity; i++)
+    {
+        atomic_init(&table->slots[i].node, null);
+        atomic_init(&table->slots[i].hash, 0);
+    }
+    return table;
+}
+
+cl_rmht_t *cl_rmht_create(const cl_allocator_t *allocator)
+{
+    cl_rmht_t *rmht = cl_mem_aligned_alloc(allocator, _Alignof(cl_rmht_t), sizeof(cl_rmht_t));
+    if (!rmht)
+        return null;
+
+    rmht->allocator = allocator;
+    cl_rmht_table_t *table = cl_rmht_alloc_table(rmht, CL_RMHT_INITIAL_SIZE);
+    rmht->mutex = cl_mutex_create();
+    if (!table || !rmht->mutex)
+    {
+        cl_log_warn("Failed to create read-mostly hash table");
+        cl_mem_free(allocator, table);
+        cl_mutex_destroy(rmht->mutex);
+        cl_mem_aligned_free(allocator, rmht);
+        return null;
+    }
+
+    for (u32 i = 0; i < CL_RMHT_STRIPES; i++)
+    {
+        atomic_init(&rmht->stripes[i].readers[0], 0);
+        atomic_init(&rmht->stripes[i].readers[1], 0);
+    }
+    atomic_init(&rmht->table, table);
+    atomic_init(&rmht->mask, table->mask);
+    atomic_init(&rmht->epoch, 0);
+    atomic_init(&rmht->size, 0);
+    rmht->hash_func = cl_ht_default_hash;
+    rmht->free_func = null;
+    rmht->used = 0;
+    rmht->limbo_count = 0;
+    return rmht;
+}
+
+// Frees a slot array along with its nodes, and their data when a free function is set
+static void cl_rmht_free_table(cl_rmht_t *rmht, cl_rmht_table_t *table)
+{
+    for (u64 i = 0; i < table->capacity; i++)
+    {
+        cl_rmht_node_t *node = atomic_load_explicit(&table->slots[i].node, memory_order_relaxed);
+        if (node && node != CL_RMHT_TOMBSTONE)
+            cl_rmht_free_retired(rmht, &(cl_rmht_retired_t){node, false, true});
+    }
+    cl_mem_free(rmht->allocator, table);
+}
+
+void cl_rmht_destroy(cl_rmht_t *rmht)
+{
+    if (!rmht)
+        return;
+    for (u32 i = 0; i < rmht->limbo_count; i++)
+        cl_rmht_free_retired(rmht, &rmht->limbo[i]);
+    cl_rmht_free_table(rmht, atomic_load(&rmht->table));
+    cl_mutex_destroy(rmht->mutex);
+    cl_mem_aligned_free(rmht->allocator, rmht);
+}
+
+bool cl_rmht_set_hash_function(cl_rmht_t *rmht, cl_ht_hash_func_t hf)
+{
+    if (!rmht || !hf)
+        return false;
+    cl_mutex_lock(rmht->mutex);
+    const bool empty = atomic_load(&rmht->size) == 0;
+    if (empty)
+        rmht->hash_func = hf;
+    cl_mutex_unlock(rmht->mutex);
+    return empty;
+}
+
+bool cl_rmht_set_free_function(cl_rmht_t *rmht, cl_ht_free_func_t ff)
+{
+    if (!rmht)
+        return false;
+    cl_mutex_lock(rmht->mutex);
+    rmht->free_func = ff;
+    cl_mutex_unlock(rmht->mutex);
+    return true;
+}
+
+static inline bool cl_rmht_node_matches(const cl_rmht_node_t *node, u64 hash, const void *key, u64 key_size)
+{
+    return node->hash == hash && node->key_size == key_size && memcmp(node->key, key, key_size) == 0;
+}
+
+bool cl_rmht_get(cl_rmht_t *rmht, const void *key, u64 key_size, void **data, u64 *data_size)
+{
+    if (!rmht || !key)
+        return false;
+
+    const u64 hash = rmht->hash_func(key, key_size);
+    // The locked add in cl_rmht_read_lock is a full barrier; starting the home slot's cache miss before it lets the
+    // two overlap. Nothing is dereferenced yet and a prefetch never faults, so a stale table or mask is harmless.
+    const uintptr_t hint = (uintptr_t)atomic_load_explicit(&rmht->table, memory_order_relaxed) +
+                           offsetof(cl_rmht_table_t, slots) +
+                           (hash & atomic_load_explicit(&rmht->mask, memory_order_relaxed)) * sizeof(cl_rmht_slot_t);
+    __builtin_prefetch((const void *)hint);
+
+    const u32 token = cl_rmht_read_lock(rmht);
+    cl_rmht_table_t *table = atomic_load(&rmht->table);
+    bool found = false;
+    // Writers keep the load below one, so every probe sequence reaches an empty slot
+    for (u64 index = hash & table->mask;; index = (index + 1) & table->mask)
+    {
+        const cl_rmht_node_t *node = atomic_load(&table->slots[index].node);
+        if (!node)
+            break;
+        if (node != CL_RMHT_TOMBSTONE &&
+            atomic_load_explicit(&table->slots[index].hash, memory_order_relaxed) == hash &&
+            cl_rmht_node_matches(node, hash, key, key_size))
+        {
+            if (data)
+                *data = node->data;
+            if (data_size)
+                *data_size = node->data_size;
+            found = true;
+            break;
+        }
+    }
+    cl_rmht_read_unlock(rmht, token);
+    return found;
+}
+
+bool cl_rmht_exists(cl_rmht_t *rmht, const void *key, u64 key_size)
+{
+    return cl_rmht_get(rmht, key, key_size, null, null);
+}
+
+u64 cl_rmht_size(cl_rmht_t *rmht) { return rmht ? atomic_load_explicit(&rmht->size, memory_order_relaxed) : 0; }
+
+u64 cl_rmht_foreach(cl_rmht_t *rmht, cl_ht_foreach_func_t fe_fn, void *arg)
+{
+    if (!rmht || !fe_fn)
+        return 0;
+
+    const u32 token = cl_rmht_read_lock(rmht);
+    cl_rmht_table_t *table = atomic_load(&rmht->table);
+    u64 count = 0;
+    for (u64 i = 0; i < table->capacity; i++)
+    {
+        cl_rmht_node_t *node = atomic_load(&table->slots[i].node);
+        if (!node || node == CL_RMHT_TOMBSTONE)
+            continue;
+        if (!fe_fn(node->key, node->key_size, node->data, node->data_size, arg))
+            break;
+        count++;
+    }
+    cl_rmht_read_unlock(rmht, token);
+    return count;
+}
+
+// Must be called with the mutex held. Copies the live entries into a new array sized for twice the live count and
+// publishes it; the old array goes to limbo while its nodes carry over.
+static bool cl_rmht_resize(cl_rmht_t *rmht, cl_rmht_table_t *old_table)
+{
+    const u64 live = atomic_load_explicit(&rmht->size, memory_order_relaxed);
+    u64 capacity = CL_RMHT_INITIAL_SIZE;
+    while ((live + 1) * 2 > capacity)
+        capacity *= 2;
+
+    cl_rmht_table_t *table = cl_rmht_alloc_table(rmht, capacity);
+    if (!table)
+        return false;
+    for (u64 i = 0; i < old_table->capacity; i++)
+    {
+        cl_rmht_node_t *node = atomic_load_explicit(&old_table->slots[i].node, memory_order_relaxed);
+        if (!node || node == CL_RMHT_TOMBSTONE)
+            continue;
+        u64 index = node->hash & table->mask;
+        while (atomic_load_explicit(&table->slots[index].node, memory_order_relaxed))
+            index = (index + 1) & table->mask;
+        atomic_store_explicit(&table->slots[index].hash, node->hash, memory_order_relaxed);
+        atomic_store_explicit(&table->slots[index].node, node, memory_order_relaxed);
+    }
+
+    atomic_store(&rmht->table, table);
+    atomic_store_explicit(&rmht->mask, table->mask, memory_order_relaxed);
+    rmht->used = live;
+    cl_rmht_retire(rmht, old_table, true, false);
+    return true;
+}
+
+// Must be called with the mutex held; returns the slot holding the key, or capacity when it is absent and *free_slot
+// is where it would go (the first tombstone on its probe sequence, else the empty slot ending it)
+static u64 cl_rmht_find(const cl_rmht_table_t *table, u64 hash, const void *key, u64 key_size, u64 *free_slot)
+{
+    *free_slot = table->capacity;
+    for (u64 index = hash & table->mask;; index = (index + 1) & table->mask)
+    {
+        const cl_rmht_node_t *node = atomic_load_explicit(&table->slots[index].node, memory_order_relaxed);
+        if (!node)
+        {
+            if (*free_slot == table->capacity)
+                *free_slot = index;
+            return table->capacity;
+        }
+        if (node == CL_RMHT_TOMBSTONE)
+        {
+            if (*free_slot == table->capacity)
+                *free_slot = index;
+        }
+        else if (atomic_load_explicit(&table->slots[index].hash, memory_order_relaxed) == hash &&
+                 cl_rmht_node_matches(node, hash, key, key_size))
+        {
+            return index;
+        }
+    }
+}
+
+bool cl_rmht_put(cl_rmht_t *rmht, const void *key, u64 key_size, void *data, u64 data_size, void **old_data)
+{
+    if (!rmht || !key)
+        return false;
+
+    const u64 hash = rmht->hash_func(key, key_size);
+    cl_rmht_node_t *node = cl_mem_alloc(rmht->allocator, sizeof(cl_rmht_node_t) + key_size);
+    if (!node)
+        return false;
+    node->hash = hash;
+    node->data = data;
+    node->data_size = data_size;
+    node->key_size = key_size;
+    memcpy(node->key, key, key_size);
+
+    cl_mutex_lock(rmht->mutex);
+    cl_rmht_table_t *table = atomic_load_explicit(&rmht->table, memory_order_relaxed);
+    u64 free_slot;
+    const u64 index = cl_rmht_find(table, hash, key, key_size, &free_slot);
+    if (index != table->capacity)
+    {
+        // Replace the node; readers holding the old one keep reading it until reclamation
+        cl_rmht_node_t *old = atomic_load_explicit(&table->slots[index].node, memory_order_relaxed);
+        atomic_store(&table->slots[index].node, node);
+        if (old_data)
+            *old_data = old->data;
+        cl_rmht_retire(rmht, old, false, old->data != data);
+        cl_mutex_unlock(rmht->mutex);
+        return true;
+    }
+
+    const bool reuses_tombstone = atomic_load_explicit(&table->slots[free_slot].node, memory_order_relaxed) != null;
+    if (!reuses_tombstone && (float)(rmht->used + 1) > table->capacity * CL_RMHT_LOAD_FACTOR)
+    {
+        if (!cl_rmht_resize(rmht, table))
+        {
+            cl_mutex_unlock(rmht->mutex);
+            cl_mem_free(rmht->allocator, node);
+            return false;
+        }
+        table = atomic_load_explicit(&rmht->table, memory_order_relaxed);
+        cl_rmht_find(table, hash, key, key_size, &free_slot);
+    }
+
+    if (atomic_load_explicit(&table->slots[free_slot].node, memory_order_relaxed) == null)
+        rmht->used++;
+    atomic_store_explicit(&table->slots[free_slot].hash, hash, memory_order_relaxed);
+    atomic_store(&table->slots[free_slot].node, node);
+    atomic_fetch_add_explicit(&rmht->size, 1, memory_order_relaxed);
+    cl_mutex_unlock(rmht->mutex);
+    if (old_data)
+        *old_data = null;
+    return true;
+}
+
+void *cl_rmht_remove(cl_rmht_t *rmht, const void *key, u64 key_size)
+{
+    if (!rmht || !key)
+        return null;
+
+    const u64 hash = rmht->hash_func(key, key_size);
+    cl_mutex_lock(rmht->mutex);
+    cl_rmht_table_t *table = atomic_load_explicit(&rmht->table, memory_order_relaxed);
+    u64 free_slot;
+    const u64 index = cl_rmht_find(table, hash, key, key_size, &free_slot);
+    void *data = null;
+    if (index != table->capacity)
+    {
+        cl_rmht_node_t *node = atomic_load_explicit(&table->slots[index].node, memory_order_relaxed);
+        data = node->data;
+        atomic_store(&table->slots[index].node, CL_RMHT_TOMBSTONE);
+        atomic_fetch_sub_explicit(&rmht->size, 1, memory_order_relaxed);
+        cl_rmht_retire(rmht, node, false, false);
+    }
+    cl_mutex_unlock(rmht->mutex);
+    return data;
+}
+
+void cl_rmht_clear(cl_rmht_t *rmht)
+{
+    if (!rmht)
+        return;
+
+    cl_rmht_table_t *table = cl_rmht_alloc_table(rmht, CL_RMHT_INITIAL_SIZE);
+    if (!table)
+    {
+        cl_log_warn("Failed to allocate an empty slot array to clear read-mostly hash table");
+        return;
+    }
+
+    cl_mutex_lock(rmht->mutex);
+    cl_rmht_table_t *old_table = atomic_load_explicit(&rmht->table, memory_order_relaxed);
+    atomic_store(&rmht->table, table);
+    atomic_store_explicit(&rmht->mask, table->mask, memory_order_relaxed);
+    atomic_store_explicit(&rmht->size, 0, memory_order_relaxed);
+    rmht->used = 0;
+    // Every node goes at once, so wait for the readers here instead of queueing them one by one
+    cl_rmht_reclaim(rmht);
+    cl_rmht_free_table(rmht, old_table);
+    cl_mutex_unlock(rmht->mutex);
+}
+
+void cl_rmht_synchronize(cl_rmht_t *rmht)
+{
+    if (!rmht)
+        return;
+    cl_mutex_lock(rmht->mutex);
+    cl_rmht_reclaim(rmht);
+    cl_mutex_unlock(rmht->mutex);
+}
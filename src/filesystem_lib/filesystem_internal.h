@@ -48,6 +48,8 @@ u64 cl_fs_platform_read_file(cl_file_t *file, void *buffer, u64 size);
 u64 cl_fs_platform_write_file(cl_file_t *file, const void *buffer, u64 size);
 bool cl_fs_platform_seek_file(cl_file_t *file, i64 offset, i32 origin);
 i64 cl_fs_platform_tell_file(cl_file_t *file);
+const void *cl_fs_platform_map_file(cl_file_t *file, u64 *size);
+void cl_fs_platform_unmap_file(const void *data, u64 size);
 
 bool cl_fs_platform_create_directory(cl_fs_t *fs, const char *path);
 bool cl_fs_platform_remove_directory(cl_fs_t *fs, const char *path);
@@ -80,6 +80,19 @@ i64 cl_fs_tell_file(cl_file_t *file) {
     return cl_fs_platform_tell_file(file);
 }
 
+const void *cl_fs_map_file(cl_file_t *file, u64 *size) {
+    if (file == null || size == null) {
+        return null;
+    }
+    return cl_fs_platform_map_file(file, size);
+}
+
+void cl_fs_unmap_file(const void *data, u64 size) {
+    if (data) {
+        cl_fs_platform_unmap_file(data, size);
+    }
+}
+
 bool cl_fs_create_directory(cl_fs_t *fs, const char *path) {
     char *normalized_path = cl_fs_normalize_path(fs, path);
     if (normalized_path == null) {
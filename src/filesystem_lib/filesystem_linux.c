@@ -15,6 +15,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -236,6 +237,32 @@ i64 cl_fs_platform_tell_file(cl_file_t *file)
     return (i64)position;
 }
 
+const void *cl_fs_platform_map_file(cl_file_t *file, u64 *size)
+{
+    const int fd = (int)(intptr_t)file->handle;
+    struct stat st;
+    if (fstat(fd, &st) == -1)
+    {
+        cl_fs_set_last_error(file->fs, strerror(errno));
+        return null;
+    }
+    if (st.st_size == 0)
+    {
+        cl_fs_set_last_error(file->fs, "Cannot map an empty file");
+        return null;
+    }
+    void *data = mmap(null, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if (data == MAP_FAILED)
+    {
+        cl_fs_set_last_error(file->fs, strerror(errno));
+        return null;
+    }
+    *size = (u64)st.st_size;
+    return data;
+}
+
+void cl_fs_platform_unmap_file(const void *data, u64 size) { munmap((void *)data, (size_t)size); }
+
 bool cl_fs_platform_create_directory(cl_fs_t *fs, const char *path)
 {
     if (mkdir(path, 0755) == -1)
@@ -421,6 +448,31 @@ cl_fs_dir_iterator_t *cl_fs_platform_open_directory(cl_fs_t *fs, const char *pat
     return iterator;
 }
 
+cl_fs_dir_entry_t *cl_fs_platform_current_working_directory(cl_fs_t *fs)
+{
+    char *path = getcwd(null, 0);
+    if (path == null)
+    {
+        cl_fs_set_last_error(fs, strerror(errno));
+        return null;
+    }
+
+    cl_fs_dir_entry_t *entry = cl_mem_alloc(fs->allocator, sizeof(cl_fs_dir_entry_t));
+    if (entry == null)
+    {
+        cl_fs_set_last_error(fs, "Failed to allocate memory for directory entry");
+        free(path);
+        return null;
+    }
+
+    entry->name = path;
+    entry->is_directory = true;
+    entry->size = -1;
+    entry->last_write_time = 0;
+
+    return entry;
+}
+
 bool cl_fs_platform_read_directory(cl_fs_dir_iterator_t *iterator, cl_fs_dir_entry_t *entry)
 {
     struct dirent *dir_entry;
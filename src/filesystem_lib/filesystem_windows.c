@@ -171,6 +171,38 @@ i64 cl_fs_platform_tell_file(cl_file_t *file)
     return li.QuadPart;
 }
 
+const void *cl_fs_platform_map_file(cl_file_t *file, u64 *size)
+{
+    LARGE_INTEGER file_size;
+    if (GetFileSizeEx(file->handle, &file_size) == 0 || file_size.QuadPart == 0)
+    {
+        cl_fs_set_last_error(file->fs, "Failed to map file");
+        return null;
+    }
+    // The view keeps the mapping object alive, so its handle can be closed right away
+    HANDLE mapping = CreateFileMappingW(file->handle, null, PAGE_READONLY, 0, 0, null);
+    if (mapping == null)
+    {
+        cl_fs_set_last_error(file->fs, "Failed to map file");
+        return null;
+    }
+    const void *data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+    if (data == null)
+    {
+        cl_fs_set_last_error(file->fs, "Failed to map file");
+        return null;
+    }
+    *size = (u64)file_size.QuadPart;
+    return data;
+}
+
+void cl_fs_platform_unmap_file(const void *data, u64 size)
+{
+    (void)size;
+    UnmapViewOfFile(data);
+}
+
 bool cl_fs_platform_create_directory(cl_fs_t *fs, const char *path)
 {
     WCHAR wide_path[MAX_PATH];
@@ -317,8 +317,7 @@ static void format_log_message(char *buffer, u64 buffer_size, cl_log_level_t lev
     }
 
     written += snprintf(buffer + written, buffer_size - written, "%s\n", wrapped_message);
-    written +=
-        snprintf(buffer + written, buffer_size - written, "%s%s%s", level_colors[level], LOG_CORNER_BOTTOM_RIGHT);
+    written += snprintf(buffer + written, buffer_size - written, "%s%s", level_colors[level], LOG_CORNER_BOTTOM_RIGHT);
     // Renders a straight line
     // Set the color to the level color
     written += snprintf(buffer + written, buffer_size - written, "%s", level_colors[level]);
@@ -2,10 +2,96 @@
  * Created by jraynor on 8/3/2024.
  */
 #pragma once
+#include <stdatomic.h>
 #include "clib/memory_lib.h"
 
+#define MEM_DEFAULT_FLAG_ALIGNMENT 64
+
+// Alignment an allocator applies to every allocation: config.alignment under CL_ALLOCATOR_FLAG_ALIGN, else its default
+static inline u64 mem_config_alignment(const cl_allocator_config_t *config, u64 default_alignment)
+{
+    if ((config->flags & CL_ALLOCATOR_FLAG_ALIGN) == 0)
+        return default_alignment;
+    const u64 alignment = config->alignment > 0 ? config->alignment : MEM_DEFAULT_FLAG_ALIGNMENT;
+    return alignment > default_alignment ? alignment : default_alignment;
+}
+
 bool init_platform_allocator(cl_allocator_t *allocator, const cl_allocator_config_t *config);
 void deinit_platform_allocator(const cl_allocator_t *allocator);
+// Aligned system allocation for allocator bookkeeping and backing memory; release with platform_aligned_free
+void *platform_aligned_malloc(u64 size, u64 alignment);
+void platform_aligned_free(void *ptr);
 
 bool init_arena_allocator(cl_allocator_t *allocator, const cl_allocator_config_t *config);
 void deinit_arena_allocator(const cl_allocator_t *allocator);
+
+bool init_pool_allocator(cl_allocator_t *allocator, const cl_allocator_config_t *config);
+void deinit_pool_allocator(const cl_allocator_t *allocator);
+
+bool init_concurrent_pool_allocator(cl_allocator_t *allocator, const cl_allocator_config_t *config);
+void deinit_concurrent_pool_allocator(const cl_allocator_t *allocator);
+
+bool init_freelist_allocator(cl_allocator_t *allocator, const cl_allocator_config_t *config);
+void deinit_freelist_allocator(const cl_allocator_t *allocator);
+
+// Every proxy's state starts with its mode so the shared entry points can tell them apart
+static inline cl_proxy_mode_t proxy_mode(const cl_allocator_t *allocator)
+{
+    return *(const cl_proxy_mode_t *)allocator->user_data;
+}
+
+bool init_proxy_allocator(cl_allocator_t *allocator, const cl_allocator_config_t *config);
+void deinit_proxy_allocator(const cl_allocator_t *allocator);
+
+bool init_tracking_allocator(cl_allocator_t *allocator, const cl_allocator_config_t *config);
+void deinit_tracking_allocator(const cl_allocator_t *allocator);
+
+// Call site of the cl_mem_*_at call in progress on this thread, null when the caller gave none
+extern CL_THREAD_LOCAL const char *mem_call_site_file;
+extern CL_THREAD_LOCAL i32 mem_call_site_line;
+
+bool init_guard_allocator(cl_allocator_t *allocator, const cl_allocator_config_t *config);
+void deinit_guard_allocator(const cl_allocator_t *allocator);
+
+bool init_linear_allocator(cl_allocator_t *allocator, const cl_allocator_config_t *config);
+void deinit_linear_allocator(const cl_allocator_t *allocator);
+cl_mem_marker_t linear_allocator_mark(const cl_allocator_t *allocator);
+bool linear_allocator_rollback(const cl_allocator_t *allocator, cl_mem_marker_t marker);
+
+bool init_stack_allocator(cl_allocator_t *allocator, const cl_allocator_config_t *config);
+void deinit_stack_allocator(const cl_allocator_t *allocator);
+cl_mem_marker_t stack_allocator_mark(const cl_allocator_t *allocator);
+bool stack_allocator_rollback(const cl_allocator_t *allocator, cl_mem_marker_t marker);
+
+// Virtual memory primitives shared by the allocators that manage address space directly
+u64 vm_page_size(void);
+void *vm_reserve(u64 size, u64 alignment);
+bool vm_commit(void *ptr, u64 size);
+void vm_decommit(void *ptr, u64 size);
+void vm_release(void *ptr, u64 size);
+void vm_advise_huge_pages(void *ptr, u64 size);
+
+// Minimal spin lock for allocators shared between threads; critical sections are a handful of pointer swaps
+typedef struct mem_spinlock
+{
+    atomic_bool locked;
+} mem_spinlock_t;
+
+static inline void mem_spinlock_lock(mem_spinlock_t *lock)
+{
+    while (atomic_exchange_explicit(&lock->locked, true, memory_order_acquire))
+    {
+        // Wait on a plain load so contending cores do not keep stealing the cache line
+        while (atomic_load_explicit(&lock->locked, memory_order_relaxed))
+        {
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        }
+    }
+}
+
+static inline void mem_spinlock_unlock(mem_spinlock_t *lock)
+{
+    atomic_store_explicit(&lock->locked, false, memory_order_release);
+}
@@ -4,67 +4,304 @@
 #include "clib/log_lib.h"
 #include "clib/memory_lib.h"
 #define ARENA_BLOCK_SIZE (64 * 1024) // 64 KB default block size
+#define ARENA_ALIGNMENT 8
+#define ARENA_HUGE_PAGE_SIZE (2 * 1024 * 1024)
 
+// Blocks are a single malloc: this header followed by the usable memory
 typedef struct arena_block
 {
-    void *memory;
+    struct arena_block *next;
     size_t size;
     size_t used;
-    struct arena_block *next;
+    size_t last; // Offset of the most recent allocation's header, so it can be resized in place
 } arena_block_t;
 
+#define ARENA_BLOCK_HEADER_SIZE CL_MEMORY_ALIGN(sizeof(arena_block_t), 16)
+#define ARENA_BLOCK_MEMORY(block) ((char *)(block) + ARENA_BLOCK_HEADER_SIZE)
+
+// Every allocation remembers its requested size so realloc copies only live bytes
+typedef struct arena_header
+{
+    u64 size;
+} arena_header_t;
+
 typedef struct arena_allocator
 {
     arena_block_t *current_block;
+    arena_block_t *free_blocks; // Blocks retained by cl_arena_reset, reused before asking malloc
     size_t block_size;
+    u64 alignment; // Applied to every allocation; ARENA_ALIGNMENT unless CL_ALLOCATOR_FLAG_ALIGN asks for more
+
+    // Virtual memory mode: one reserved range, committed block_size at a time as it fills up
+    char *vm_base;
+    u64 vm_reserved;
+    u64 vm_committed;
+    u64 vm_used;
+    u64 vm_last;
 } arena_allocator_t;
 
-static void *arena_alloc(u64 size, void *user_data)
+static inline u64 arena_footprint(u64 size) { return sizeof(arena_header_t) + CL_MEMORY_ALIGN(size, ARENA_ALIGNMENT); }
+
+static arena_block_t *arena_acquire_block(arena_allocator_t *arena, u64 needed)
 {
-    arena_allocator_t *arena = (arena_allocator_t *)user_data;
+    // Prefer a retained block that is large enough
+    arena_block_t **link = &arena->free_blocks;
+    while (*link)
+    {
+        arena_block_t *block = *link;
+        if (block->size >= needed)
+        {
+            *link = block->next;
+            return block;
+        }
+        link = &block->next;
+    }
+
+    const u64 block_size = needed > arena->block_size ? needed : arena->block_size;
+    arena_block_t *new_block = malloc(ARENA_BLOCK_HEADER_SIZE + block_size);
+    if (new_block == null)
+    {
+        cl_log_warn("Failed to allocate memory for arena block");
+        return null;
+    }
+
+    new_block->size = block_size;
+    return new_block;
+}
+
+// Offset of the payload for an allocation placed at used bytes into memory, so that its address is aligned
+static inline u64 arena_payload_offset(const char *memory, u64 used, u64 alignment)
+{
+    const uintptr_t payload = (uintptr_t)(memory + used + sizeof(arena_header_t));
+    return (u64)(CL_MEMORY_ALIGN(payload, alignment) - (uintptr_t)memory);
+}
 
-    // Align size to 8 bytes
-    size = (size + 7) & ~7;
+static void *arena_alloc_aligned(arena_allocator_t *arena, u64 size, u64 alignment)
+{
+    arena_block_t *block = arena->current_block;
+    u64 payload = block ? arena_payload_offset(ARENA_BLOCK_MEMORY(block), block->used, alignment) : 0;
+    const u64 end = payload + CL_MEMORY_ALIGN(size, ARENA_ALIGNMENT);
 
-    if (arena->current_block == null || arena->current_block->used + size > arena->current_block->size)
+    if (block == null || end > block->size)
     {
-        // Allocate a new block
-        const u64 block_size = size > arena->block_size ? size : arena->block_size;
-        arena_block_t *new_block = malloc(sizeof(arena_block_t));
+        // Block memory is only 16-byte aligned, so an over-aligned payload can start up to alignment bytes in
+        const u64 padding = alignment > ARENA_ALIGNMENT ? alignment - sizeof(arena_header_t) : 0;
+        arena_block_t *new_block = arena_acquire_block(arena, arena_footprint(size) + padding);
         if (new_block == null)
             return null;
 
-        new_block->memory = malloc(block_size);
-        if (new_block->memory == null)
-        {
-            free(new_block);
-            cl_log_warn("Failed to allocate memory for arena block");
-            return null;
-        }
-
-        new_block->size = block_size;
         new_block->used = 0;
+        new_block->last = 0;
         new_block->next = arena->current_block;
         arena->current_block = new_block;
+        block = new_block;
+        payload = arena_payload_offset(ARENA_BLOCK_MEMORY(block), 0, alignment);
+    }
+
+    arena_header_t *header = (arena_header_t *)(ARENA_BLOCK_MEMORY(block) + payload) - 1;
+    header->size = size;
+    block->last = payload - sizeof(arena_header_t);
+    block->used = payload + CL_MEMORY_ALIGN(size, ARENA_ALIGNMENT);
+    return header + 1;
+}
+
+static void *arena_alloc(u64 size, void *user_data)
+{
+    arena_allocator_t *arena = (arena_allocator_t *)user_data;
+    return arena_alloc_aligned(arena, size, arena->alignment);
+}
+
+static void *arena_aligned_alloc(u64 size, u64 alignment, void *user_data)
+{
+    arena_allocator_t *arena = (arena_allocator_t *)user_data;
+    return arena_alloc_aligned(arena, size, alignment > arena->alignment ? alignment : arena->alignment);
+}
+
+// Lays count allocations of size back to back from used; the caller has made room for all of them
+static u64 arena_carve(char *memory, u64 used, u64 size, u64 count, void **out_ptrs)
+{
+    const u64 stride = arena_footprint(size);
+    for (u64 i = 0; i < count; i++)
+    {
+        arena_header_t *header = (arena_header_t *)(memory + used);
+        header->size = size;
+        out_ptrs[i] = header + 1;
+        used += stride;
+    }
+    return used;
+}
+
+static u64 arena_alloc_batch(u64 size, u64 count, void **out_ptrs, void *user_data)
+{
+    arena_allocator_t *arena = (arena_allocator_t *)user_data;
+    const u64 stride = arena_footprint(size);
+
+    // Over-aligned arenas pad each allocation differently, so only the default layout is carved in one go
+    if (arena->alignment != ARENA_ALIGNMENT || count == 0 || count > UINT64_MAX / stride)
+    {
+        for (u64 i = 0; i < count; i++)
+        {
+            if ((out_ptrs[i] = arena_alloc_aligned(arena, size, arena->alignment)) == null)
+                return i;
+        }
+        return count;
+    }
+
+    arena_block_t *block = arena->current_block;
+    if (block == null || block->size - block->used < stride * count)
+    {
+        block = arena_acquire_block(arena, stride * count);
+        if (block == null)
+            return 0;
+        block->used = 0;
+        block->next = arena->current_block;
+        arena->current_block = block;
     }
 
-    void *ptr = (char *)arena->current_block->memory + arena->current_block->used;
-    arena->current_block->used += size;
-    return ptr;
+    block->used = arena_carve(ARENA_BLOCK_MEMORY(block), block->used, size, count, out_ptrs);
+    block->last = block->used - stride;
+    return count;
 }
 
 static void *arena_realloc(void *ptr, u64 new_size, void *user_data)
 {
-    // Arena allocator doesn't support reallocation, so we allocate new memory and copy
     arena_allocator_t *arena = (arena_allocator_t *)user_data;
+    if (ptr == null)
+        return arena_alloc(new_size, arena);
+
+    arena_header_t *header = (arena_header_t *)ptr - 1;
+    const u64 old_size = header->size;
+
+    // The newest allocation in the current block can grow or shrink where it is
+    arena_block_t *block = arena->current_block;
+    if (block && (char *)header == ARENA_BLOCK_MEMORY(block) + block->last &&
+        block->last + arena_footprint(new_size) <= block->size)
+    {
+        header->size = new_size;
+        block->used = block->last + arena_footprint(new_size);
+        return ptr;
+    }
+
+    if (new_size <= old_size)
+    {
+        header->size = new_size;
+        return ptr;
+    }
+
     void *new_ptr = arena_alloc(new_size, arena);
-    if (new_ptr && ptr)
+    if (new_ptr)
+    {
+        memcpy(new_ptr, ptr, old_size);
+    }
+    return new_ptr;
+}
+
+static bool arena_vm_ensure_committed(arena_allocator_t *arena, u64 end)
+{
+    if (end <= arena->vm_committed)
+        return true;
+    if (end > arena->vm_reserved)
+        return false;
+
+    u64 new_committed = CL_MEMORY_ALIGN(end, arena->block_size);
+    if (new_committed > arena->vm_reserved)
+        new_committed = arena->vm_reserved;
+    if (!vm_commit(arena->vm_base + arena->vm_committed, new_committed - arena->vm_committed))
+    {
+        cl_log_warn("Failed to commit memory for arena");
+        return false;
+    }
+    arena->vm_committed = new_committed;
+    return true;
+}
+
+static void *arena_vm_alloc_aligned(arena_allocator_t *arena, u64 size, u64 alignment)
+{
+    const u64 payload = arena_payload_offset(arena->vm_base, arena->vm_used, alignment);
+    if (size > arena->vm_reserved || payload > arena->vm_reserved - size)
+        return null;
+
+    const u64 end = payload + CL_MEMORY_ALIGN(size, ARENA_ALIGNMENT);
+    if (!arena_vm_ensure_committed(arena, end))
+        return null;
+
+    arena_header_t *header = (arena_header_t *)(arena->vm_base + payload) - 1;
+    header->size = size;
+    arena->vm_last = payload - sizeof(arena_header_t);
+    arena->vm_used = end;
+    return header + 1;
+}
+
+static void *arena_vm_alloc(u64 size, void *user_data)
+{
+    arena_allocator_t *arena = (arena_allocator_t *)user_data;
+    return arena_vm_alloc_aligned(arena, size, arena->alignment);
+}
+
+static void *arena_vm_aligned_alloc(u64 size, u64 alignment, void *user_data)
+{
+    arena_allocator_t *arena = (arena_allocator_t *)user_data;
+    return arena_vm_alloc_aligned(arena, size, alignment > arena->alignment ? alignment : arena->alignment);
+}
+
+static void *arena_vm_realloc(void *ptr, u64 new_size, void *user_data)
+{
+    arena_allocator_t *arena = (arena_allocator_t *)user_data;
+    if (ptr == null)
+        return arena_vm_alloc(new_size, arena);
+
+    arena_header_t *header = (arena_header_t *)ptr - 1;
+    const u64 old_size = header->size;
+
+    // The region is contiguous, so the newest allocation can always grow until the reservation runs out
+    if ((char *)header == arena->vm_base + arena->vm_last && arena->vm_last < arena->vm_used)
+    {
+        const u64 needed = arena_footprint(new_size);
+        if (needed > arena->vm_reserved || !arena_vm_ensure_committed(arena, arena->vm_last + needed))
+            return null;
+        header->size = new_size;
+        arena->vm_used = arena->vm_last + needed;
+        return ptr;
+    }
+
+    if (new_size <= old_size)
+    {
+        header->size = new_size;
+        return ptr;
+    }
+
+    void *new_ptr = arena_vm_alloc(new_size, arena);
+    if (new_ptr)
     {
-        memcpy(new_ptr, ptr, new_size); // This might copy more than necessary, but it's simple
+        memcpy(new_ptr, ptr, old_size);
     }
     return new_ptr;
 }
 
+static u64 arena_vm_alloc_batch(u64 size, u64 count, void **out_ptrs, void *user_data)
+{
+    arena_allocator_t *arena = (arena_allocator_t *)user_data;
+    const u64 stride = arena_footprint(size);
+
+    if (arena->alignment != ARENA_ALIGNMENT || count == 0 || count > UINT64_MAX / stride)
+    {
+        for (u64 i = 0; i < count; i++)
+        {
+            if ((out_ptrs[i] = arena_vm_alloc_aligned(arena, size, arena->alignment)) == null)
+                return i;
+        }
+        return count;
+    }
+
+    // One commit check covers the whole run
+    if (stride * count > arena->vm_reserved - arena->vm_used ||
+        !arena_vm_ensure_committed(arena, arena->vm_used + stride * count))
+        return 0;
+    arena->vm_used = arena_carve(arena->vm_base, arena->vm_used, size, count, out_ptrs);
+    arena->vm_last = arena->vm_used - stride;
+    return count;
+}
+
 static void arena_free(void *ptr, void *user_data)
 {
     // Arena allocator doesn't free individual allocations
@@ -72,23 +309,59 @@ static void arena_free(void *ptr, void *user_data)
     (void)user_data;
 }
 
+static void arena_free_batch(void **ptrs, u64 count, void *user_data)
+{
+    (void)ptrs;
+    (void)count;
+    (void)user_data;
+}
+
 bool init_arena_allocator(cl_allocator_t *allocator, const cl_allocator_config_t *config)
 {
     arena_allocator_t *arena = malloc(sizeof(arena_allocator_t));
     if (!arena)
         return false;
-    if (config->config.arena.size < 0)
-    {
-        free(arena);
-        return false;
-    }
 
     arena->current_block = null;
+    arena->free_blocks = null;
     arena->block_size = config->config.arena.size > 0 ? config->config.arena.size : ARENA_BLOCK_SIZE;
+    arena->alignment = mem_config_alignment(config, ARENA_ALIGNMENT);
+    arena->vm_base = null;
+    arena->vm_reserved = 0;
+    arena->vm_committed = 0;
+    arena->vm_used = 0;
+    arena->vm_last = 0;
 
     allocator->alloc = arena_alloc;
     allocator->realloc = arena_realloc;
+    allocator->aligned_alloc = arena_aligned_alloc;
+    allocator->alloc_batch = arena_alloc_batch;
+
+    if (config->config.arena.reserve > 0)
+    {
+        // Commit in whole pages, or whole huge pages when asked for them
+        const bool huge_pages = (config->flags & CL_ALLOCATOR_FLAG_HUGE_PAGES) != 0;
+        const u64 granularity = huge_pages ? ARENA_HUGE_PAGE_SIZE : vm_page_size();
+        arena->block_size = CL_MEMORY_ALIGN(arena->block_size, granularity);
+        arena->vm_reserved = CL_MEMORY_ALIGN(config->config.arena.reserve, granularity);
+        arena->vm_base = vm_reserve(arena->vm_reserved, granularity);
+        if (arena->vm_base == null)
+        {
+            cl_log_warn("Failed to reserve address space for arena");
+            free(arena);
+            return false;
+        }
+        if (huge_pages)
+            vm_advise_huge_pages(arena->vm_base, arena->vm_reserved);
+
+        allocator->alloc = arena_vm_alloc;
+        allocator->realloc = arena_vm_realloc;
+        allocator->aligned_alloc = arena_vm_aligned_alloc;
+        allocator->alloc_batch = arena_vm_alloc_batch;
+    }
+
     allocator->free = arena_free;
+    allocator->free_batch = arena_free_batch;
     allocator->type = CL_ALLOCATOR_TYPE_ARENA;
     allocator->flags = config->flags;
     allocator->user_data = arena;
@@ -96,18 +369,79 @@ bool init_arena_allocator(cl_allocator_t *allocator, const cl_allocator_config_t
     return true;
 }
 
+static void arena_free_blocks(arena_block_t *block)
+{
+    while (block)
+    {
+        arena_block_t *next = block->next;
+        free(block);
+        block = next;
+    }
+}
+
 void deinit_arena_allocator(const cl_allocator_t *allocator)
 {
     arena_allocator_t *arena = (arena_allocator_t *)allocator->user_data;
+    if (arena->vm_base)
+        vm_release(arena->vm_base, arena->vm_reserved);
+    arena_free_blocks(arena->current_block);
+    arena_free_blocks(arena->free_blocks);
+    free(arena);
+}
+
+bool cl_arena_reset(const cl_allocator_t *allocator, u64 keep_blocks)
+{
+    if (allocator == null || allocator->type != CL_ALLOCATOR_TYPE_ARENA)
+        return false;
+
+    arena_allocator_t *arena = (arena_allocator_t *)allocator->user_data;
+
+    if (arena->vm_base)
+    {
+        // Keep keep_blocks worth of pages resident and give the rest back to the OS
+        const u64 keep = keep_blocks < arena->vm_reserved / arena->block_size ? keep_blocks * arena->block_size
+                                                                              : arena->vm_reserved;
+        if (arena->vm_committed > keep)
+        {
+            vm_decommit(arena->vm_base + keep, arena->vm_committed - keep);
+            arena->vm_committed = keep;
+        }
+        arena->vm_used = 0;
+        arena->vm_last = 0;
+        return true;
+    }
+
+    // Gather every block into one list, then keep the first keep_blocks of them for reuse
     arena_block_t *block = arena->current_block;
+    arena_block_t *pending = arena->free_blocks;
+    arena->current_block = null;
+    arena->free_blocks = null;
 
-    while (block)
+    // Kept blocks stay in order, so the block a steady-state cycle just used is the one it gets back
+    arena_block_t **tail = &arena->free_blocks;
+    u64 kept = 0;
+    while (block || pending)
     {
+        if (block == null)
+        {
+            block = pending;
+            pending = null;
+        }
+
         arena_block_t *next = block->next;
-        free(block->memory);
-        free(block);
+        if (kept < keep_blocks)
+        {
+            block->next = null;
+            *tail = block;
+            tail = &block->next;
+            kept++;
+        }
+        else
+        {
+            free(block);
+        }
         block = next;
     }
 
-    free(arena);
+    return true;
 }
@@ -0,0 +1,326 @@
+/**
+ * Created by jraynor on 8/3/2024.
+ */
+#include "allocator_internal.h"
+#include "clib/log_lib.h"
+#include "clib/memory_lib.h"
+#define CPOOL_DEFAULT_BLOCK_COUNT 64 // Blocks per slab when no count is configured
+#define CPOOL_MIN_ALIGNMENT 8
+#define CPOOL_MAX_NATURAL_ALIGNMENT 64 // Power-of-two block sizes get this much alignment without asking
+#define CPOOL_MAX_RESERVE (16ull * 1024 * 1024 * 1024) // Address space a growable pool may grow into
+#define CPOOL_MAX_BLOCKS 0xFFFFFFFEull // Block index + 1 has to fit the low half of the tagged head
+#define CPOOL_CACHE_LINE 64
+
+// The pool reserves its whole capacity up front, so a block's index is just its offset from the base and
+// slabs only differ in when they were committed. The free list is a Treiber stack of block indices whose head
+// carries a tag in its upper half that every pop bumps, which makes a pop that raced a pop-push-pop of the same
+// block fail its CAS instead of installing a stale link (ABA). Links live in a side array rather than in the
+// blocks, so a stale pop only ever reads pool memory, never memory the new owner is writing.
+typedef struct concurrent_pool
+{
+    char *base; // Blocks, followed by the link array, in one reservation
+    _Atomic u32 *links; // links[i] is the index + 1 of the block after block i on the free list
+    u64 reserved;
+    u64 block_size;
+    u64 blocks_per_slab;
+    u64 limit; // Blocks that may ever be handed out: one slab, or the whole reservation when growable
+    u64 alignment; // Every block is aligned to this
+    bool huge_pages;
+    mem_spinlock_t grow_lock; // Only taken to commit the next slab
+
+    // Kept on their own cache lines, every thread hammers these
+    _Alignas(CPOOL_CACHE_LINE) _Atomic u64 free_head; // (tag << 32) | (index + 1), zero index when empty
+    _Alignas(CPOOL_CACHE_LINE) _Atomic u64 next_block; // Never-used blocks are handed out from here
+    _Alignas(CPOOL_CACHE_LINE) _Atomic u64 committed_blocks;
+} concurrent_pool_t;
+
+static u64 cpool_links_offset(u64 block_size, u64 capacity)
+{
+    return CL_MEMORY_ALIGN(block_size * capacity, vm_page_size());
+}
+
+static bool cpool_commit_range(void *start, u64 size)
+{
+    // Slab edges need not fall on pages; committing a page twice is harmless
+    const u64 page = vm_page_size();
+    const uintptr_t begin = (uintptr_t)start & ~(uintptr_t)(page - 1);
+    const uintptr_t end = CL_MEMORY_ALIGN((uintptr_t)start + size, page);
+    return vm_commit((void *)begin, end - begin);
+}
+
+// Makes sure the slab holding index is usable; slabs are committed in order, under the grow lock
+static bool cpool_ensure_committed(concurrent_pool_t *pool, u64 index)
+{
+    if (index < atomic_load_explicit(&pool->committed_blocks, memory_order_acquire))
+        return true;
+
+    bool ok = true;
+    mem_spinlock_lock(&pool->grow_lock);
+    u64 committed = atomic_load_explicit(&pool->committed_blocks, memory_order_relaxed);
+    while (ok && committed <= index)
+    {
+        char *blocks = pool->base + committed * pool->block_size;
+        ok = cpool_commit_range(blocks, pool->blocks_per_slab * pool->block_size) &&
+            cpool_commit_range((void *)(pool->links + committed), pool->blocks_per_slab * sizeof(u32));
+        if (ok && pool->huge_pages)
+            vm_advise_huge_pages(blocks, pool->blocks_per_slab * pool->block_size);
+        if (ok)
+        {
+            committed += pool->blocks_per_slab;
+            atomic_store_explicit(&pool->committed_blocks, committed, memory_order_release);
+        }
+    }
+    mem_spinlock_unlock(&pool->grow_lock);
+
+    if (!ok)
+        cl_log_warn("Failed to commit memory for concurrent pool slab");
+    return ok;
+}
+
+// Claims a run of up to count never-used blocks and returns its length, or 0 when none are left. Runs never reach past
+// the committed slabs, so a commit that fails leaves no block claimed that nobody can use.
+static u64 cpool_claim(concurrent_pool_t *pool, u64 count, u64 *first)
+{
+    u64 index = atomic_load_explicit(&pool->next_block, memory_order_relaxed);
+    for (;;)
+    {
+        if (index >= pool->limit)
+            return 0;
+        const u64 committed = atomic_load_explicit(&pool->committed_blocks, memory_order_acquire);
+        if (index >= committed)
+        {
+            if (!cpool_ensure_committed(pool, index))
+                return 0;
+            index = atomic_load_explicit(&pool->next_block, memory_order_relaxed);
+            continue;
+        }
+
+        const u64 run = committed - index < count ? committed - index : count;
+        if (atomic_compare_exchange_weak_explicit(&pool->next_block, &index, index + run, memory_order_relaxed,
+                                                  memory_order_relaxed))
+        {
+            *first = index;
+            return run;
+        }
+    }
+}
+
+static void *concurrent_pool_alloc(u64 size, void *user_data)
+{
+    concurrent_pool_t *pool = (concurrent_pool_t *)user_data;
+    if (size > pool->block_size)
+        return null;
+
+    u64 head = atomic_load_explicit(&pool->free_head, memory_order_acquire);
+    while ((u32)head != 0)
+    {
+        const u32 index = (u32)head - 1;
+        const u64 next = atomic_load_explicit(&pool->links[index], memory_order_relaxed);
+        const u64 popped = (((head >> 32) + 1) << 32) | next;
+        if (atomic_compare_exchange_weak_explicit(&pool->free_head, &head, popped, memory_order_acquire,
+                                                  memory_order_acquire))
+            return pool->base + (u64)index * pool->block_size;
+    }
+
+    // The free list is empty, claim a never-used block
+    u64 index;
+    if (cpool_claim(pool, 1, &index) == 0)
+        return null;
+    return pool->base + index * pool->block_size;
+}
+
+static void *concurrent_pool_aligned_alloc(u64 size, u64 alignment, void *user_data)
+{
+    const concurrent_pool_t *pool = (const concurrent_pool_t *)user_data;
+    if (alignment > pool->alignment)
+        return null;
+    return concurrent_pool_alloc(size, user_data);
+}
+
+static void concurrent_pool_free(void *ptr, void *user_data)
+{
+    concurrent_pool_t *pool = (concurrent_pool_t *)user_data;
+    if (ptr == null)
+        return;
+
+    const u32 index = (u32)(((char *)ptr - pool->base) / pool->block_size);
+    u64 head = atomic_load_explicit(&pool->free_head, memory_order_relaxed);
+    u64 pushed;
+    do
+    {
+        // Pushing keeps the tag, only pops have to be told apart
+        atomic_store_explicit(&pool->links[index], (u32)head, memory_order_relaxed);
+        pushed = (head & 0xFFFFFFFF00000000ull) | (index + 1);
+    }
+    while (!atomic_compare_exchange_weak_explicit(&pool->free_head, &head, pushed, memory_order_release,
+                                                  memory_order_relaxed));
+}
+
+static u64 concurrent_pool_alloc_batch(u64 size, u64 count, void **out_ptrs, void *user_data)
+{
+    concurrent_pool_t *pool = (concurrent_pool_t *)user_data;
+    if (size > pool->block_size || count == 0)
+        return 0;
+
+    // Detach up to count blocks with a single CAS; the tag catches any change to the chain walked here
+    u64 done = 0;
+    u64 head = atomic_load_explicit(&pool->free_head, memory_order_acquire);
+    while ((u32)head != 0)
+    {
+        u64 taken = 1;
+        u32 last = (u32)head - 1;
+        u32 next = atomic_load_explicit(&pool->links[last], memory_order_relaxed);
+        while (taken < count && next != 0)
+        {
+            last = next - 1;
+            next = atomic_load_explicit(&pool->links[last], memory_order_relaxed);
+            taken++;
+        }
+        const u64 popped = (((head >> 32) + 1) << 32) | next;
+        if (atomic_compare_exchange_weak_explicit(&pool->free_head, &head, popped, memory_order_acquire,
+                                                  memory_order_acquire))
+        {
+            u32 index = (u32)head - 1;
+            for (; done < taken; done++)
+            {
+                out_ptrs[done] = pool->base + (u64)index * pool->block_size;
+                index = atomic_load_explicit(&pool->links[index], memory_order_relaxed) - 1;
+            }
+            break;
+        }
+    }
+    if (done == count)
+        return done;
+
+    // Claim the rest as runs of never-used blocks, one per committed slab they span
+    while (done < count)
+    {
+        u64 index;
+        const u64 run = cpool_claim(pool, count - done, &index);
+        if (run == 0)
+            break;
+        for (u64 i = 0; i < run; i++)
+            out_ptrs[done++] = pool->base + (index + i) * pool->block_size;
+    }
+    return done;
+}
+
+static void concurrent_pool_free_batch(void **ptrs, u64 count, void *user_data)
+{
+    concurrent_pool_t *pool = (concurrent_pool_t *)user_data;
+
+    // Chain the blocks privately, then publish the whole chain with one push
+    const u32 first = (u32)(((char *)ptrs[0] - pool->base) / pool->block_size);
+    u32 last = first;
+    for (u64 i = 1; i < count; i++)
+    {
+        const u32 index = (u32)(((char *)ptrs[i] - pool->base) / pool->block_size);
+        atomic_store_explicit(&pool->links[last], index + 1, memory_order_relaxed);
+        last = index;
+    }
+
+    u64 head = atomic_load_explicit(&pool->free_head, memory_order_relaxed);
+    u64 pushed;
+    do
+    {
+        atomic_store_explicit(&pool->links[last], (u32)head, memory_order_relaxed);
+        pushed = (head & 0xFFFFFFFF00000000ull) | (first + 1);
+    }
+    while (!atomic_compare_exchange_weak_explicit(&pool->free_head, &head, pushed, memory_order_release,
+                                                  memory_order_relaxed));
+}
+
+static void *concurrent_pool_realloc(void *ptr, u64 new_size, void *user_data)
+{
+    const concurrent_pool_t *pool = (const concurrent_pool_t *)user_data;
+    if (ptr == null)
+        return concurrent_pool_alloc(new_size, user_data);
+    if (new_size == 0)
+    {
+        concurrent_pool_free(ptr, user_data);
+        return null;
+    }
+    return new_size <= pool->block_size ? ptr : null;
+}
+
+bool init_concurrent_pool_allocator(cl_allocator_t *allocator, const cl_allocator_config_t *config)
+{
+    if (config->config.pool.block_size == 0)
+        return false;
+
+    concurrent_pool_t *pool = platform_aligned_malloc(sizeof(concurrent_pool_t), CPOOL_CACHE_LINE);
+    if (!pool)
+        return false;
+
+    pool->alignment = mem_config_alignment(config, CPOOL_MIN_ALIGNMENT);
+    pool->block_size = CL_MEMORY_ALIGN(config->config.pool.block_size, pool->alignment);
+    while (pool->alignment < CPOOL_MAX_NATURAL_ALIGNMENT && (pool->block_size & pool->alignment) == 0)
+        pool->alignment <<= 1;
+    pool->blocks_per_slab =
+        config->config.pool.block_count > 0 ? config->config.pool.block_count : CPOOL_DEFAULT_BLOCK_COUNT;
+    pool->huge_pages = (config->flags & CL_ALLOCATOR_FLAG_HUGE_PAGES) != 0;
+
+    u64 capacity = pool->blocks_per_slab;
+    if (config->flags & CL_ALLOCATOR_FLAG_GROWABLE)
+    {
+        capacity = CPOOL_MAX_RESERVE / (pool->block_size + sizeof(u32));
+        if (capacity > CPOOL_MAX_BLOCKS)
+            capacity = CPOOL_MAX_BLOCKS;
+        capacity -= capacity % pool->blocks_per_slab;
+    }
+    if (capacity < pool->blocks_per_slab || pool->blocks_per_slab > CPOOL_MAX_BLOCKS)
+    {
+        platform_aligned_free(pool);
+        return false;
+    }
+
+    // Smaller address spaces get a smaller ceiling rather than no pool
+    pool->base = null;
+    while (pool->base == null && capacity >= pool->blocks_per_slab)
+    {
+        pool->reserved = cpool_links_offset(pool->block_size, capacity) +
+            CL_MEMORY_ALIGN(capacity * sizeof(u32), vm_page_size());
+        pool->base = vm_reserve(pool->reserved, pool->alignment);
+        if (pool->base == null)
+            capacity = (capacity / 2) - (capacity / 2) % pool->blocks_per_slab;
+    }
+    if (pool->base == null)
+    {
+        cl_log_warn("Failed to reserve address space for concurrent pool");
+        platform_aligned_free(pool);
+        return false;
+    }
+
+    pool->links = (_Atomic u32 *)(pool->base + cpool_links_offset(pool->block_size, capacity));
+    pool->limit = capacity;
+    atomic_init(&pool->grow_lock.locked, false);
+    atomic_init(&pool->free_head, 0);
+    atomic_init(&pool->next_block, 0);
+    atomic_init(&pool->committed_blocks, 0);
+
+    if (!cpool_ensure_committed(pool, 0))
+    {
+        vm_release(pool->base, pool->reserved);
+        platform_aligned_free(pool);
+        return false;
+    }
+
+    allocator->alloc = concurrent_pool_alloc;
+    allocator->realloc = concurrent_pool_realloc;
+    allocator->free = concurrent_pool_free;
+    allocator->aligned_alloc = concurrent_pool_aligned_alloc;
+    allocator->alloc_batch = concurrent_pool_alloc_batch;
+    allocator->free_batch = concurrent_pool_free_batch;
+    allocator->type = CL_ALLOCATOR_TYPE_POOL;
+    allocator->flags = config->flags;
+    allocator->user_data = pool;
+
+    return true;
+}
+
+void deinit_concurrent_pool_allocator(const cl_allocator_t *allocator)
+{
+    concurrent_pool_t *pool = (concurrent_pool_t *)allocator->user_data;
+    vm_release(pool->base, pool->reserved);
+    platform_aligned_free(pool);
+}
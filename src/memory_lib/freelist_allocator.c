@@ -1,3 +1,376 @@
 /**
  * Created by jraynor on 8/3/2024.
  */
+#include <stdlib.h>
+#include <string.h>
+#include "allocator_internal.h"
+#include "clib/log_lib.h"
+#include "clib/memory_lib.h"
+#define FREE_LIST_DEFAULT_SIZE (1024 * 1024) // 1 MB default region size
+#define FREE_LIST_ALIGNMENT 16
+#define FREE_LIST_BIN_COUNT 64
+#define FREE_LIST_USED_BIT 1ULL
+#define FREE_LIST_BEST_FIT_SCAN 8 // Candidates inspected in the exact bin before settling for a larger one
+
+// Every block, free or used, starts with this header. The previous block's size lets free() find its
+// physical neighbour without a footer; sizes are multiples of 16 so the low bit marks a block as used.
+typedef struct freelist_block
+{
+    u64 size;
+    u64 prev_size;
+} freelist_block_t;
+
+// Free blocks additionally keep their bin links in what would be the payload
+typedef struct freelist_free_block
+{
+    freelist_block_t header;
+    struct freelist_free_block *next;
+    struct freelist_free_block *prev;
+} freelist_free_block_t;
+
+#define FREE_LIST_HEADER_SIZE sizeof(freelist_block_t)
+#define FREE_LIST_MIN_BLOCK_SIZE sizeof(freelist_free_block_t)
+
+typedef struct freelist_allocator
+{
+    void *memory; // Region as handed to us, before alignment
+    char *start;
+    char *end; // Address of the zero-sized sentinel block that terminates the region
+    bool owns_memory;
+    u64 bin_bitmap; // Bit n is set while bins[n] is non-empty
+    freelist_free_block_t *bins[FREE_LIST_BIN_COUNT];
+    u64 used_size;
+    u64 allocation_count;
+    u64 alignment; // Applied to every allocation; FREE_LIST_ALIGNMENT unless CL_ALLOCATOR_FLAG_ALIGN asks for more
+} freelist_allocator_t;
+
+static inline u64 block_size(const freelist_block_t *block) { return block->size & ~FREE_LIST_USED_BIT; }
+
+static inline bool block_is_used(const freelist_block_t *block) { return (block->size & FREE_LIST_USED_BIT) != 0; }
+
+static inline freelist_block_t *block_next(const freelist_block_t *block)
+{
+    return (freelist_block_t *)((char *)block + block_size(block));
+}
+
+static inline freelist_block_t *block_prev(const freelist_block_t *block)
+{
+    return (freelist_block_t *)((char *)block - block->prev_size);
+}
+
+static inline u32 freelist_bin_index(u64 size) { return 63 - __builtin_clzll(size); }
+
+static void freelist_bin_insert(freelist_allocator_t *fl, freelist_free_block_t *block)
+{
+    const u32 bin = freelist_bin_index(block_size(&block->header));
+    block->prev = null;
+    block->next = fl->bins[bin];
+    if (block->next)
+        block->next->prev = block;
+    fl->bins[bin] = block;
+    fl->bin_bitmap |= 1ULL << bin;
+}
+
+static void freelist_bin_remove(freelist_allocator_t *fl, freelist_free_block_t *block)
+{
+    const u32 bin = freelist_bin_index(block_size(&block->header));
+    if (block->prev)
+        block->prev->next = block->next;
+    else
+        fl->bins[bin] = block->next;
+    if (block->next)
+        block->next->prev = block->prev;
+    if (fl->bins[bin] == null)
+        fl->bin_bitmap &= ~(1ULL << bin);
+}
+
+static freelist_free_block_t *freelist_find_fit(freelist_allocator_t *fl, u64 size)
+{
+    // The bin holding sizes in [2^n, 2^(n+1)) may contain blocks too small for the request, so search it
+    // for the best of a few candidates; any block in a higher bin is guaranteed to fit.
+    const u32 bin = freelist_bin_index(size);
+    freelist_free_block_t *best = null;
+    u32 scanned = 0;
+    for (freelist_free_block_t *it = fl->bins[bin]; it && scanned < FREE_LIST_BEST_FIT_SCAN; it = it->next, scanned++)
+    {
+        const u64 it_size = block_size(&it->header);
+        if (it_size >= size && (best == null || it_size < block_size(&best->header)))
+        {
+            best = it;
+            if (it_size == size)
+                break;
+        }
+    }
+    if (best)
+        return best;
+
+    const u64 higher = bin + 1 < FREE_LIST_BIN_COUNT ? fl->bin_bitmap & (~0ULL << (bin + 1)) : 0;
+    if (higher == 0)
+        return null;
+    return fl->bins[__builtin_ctzll(higher)];
+}
+
+// Shrinks a used block to size, returning the tail to the free lists when it is large enough to stand alone
+static void freelist_split(freelist_allocator_t *fl, freelist_block_t *block, u64 size)
+{
+    const u64 total = block_size(block);
+    if (total - size < FREE_LIST_MIN_BLOCK_SIZE)
+        return;
+
+    freelist_block_t *rest = (freelist_block_t *)((char *)block + size);
+    rest->size = total - size;
+    rest->prev_size = size;
+    block->size = size | FREE_LIST_USED_BIT;
+
+    freelist_block_t *next = block_next(rest);
+    next->prev_size = block_size(rest);
+
+    // The tail may border another free block
+    if ((char *)next < fl->end && !block_is_used(next))
+    {
+        freelist_bin_remove(fl, (freelist_free_block_t *)next);
+        rest->size += block_size(next);
+        block_next(rest)->prev_size = block_size(rest);
+    }
+    freelist_bin_insert(fl, (freelist_free_block_t *)rest);
+}
+
+static inline u64 freelist_block_size_for(u64 size)
+{
+    const u64 needed = CL_MEMORY_ALIGN(size + FREE_LIST_HEADER_SIZE, FREE_LIST_ALIGNMENT);
+    return needed < FREE_LIST_MIN_BLOCK_SIZE ? FREE_LIST_MIN_BLOCK_SIZE : needed;
+}
+
+static inline bool freelist_owns(const freelist_allocator_t *fl, const void *ptr)
+{
+    return (const char *)ptr >= fl->start + FREE_LIST_HEADER_SIZE && (const char *)ptr < fl->end;
+}
+
+static void *freelist_alloc_aligned(freelist_allocator_t *fl, u64 size, u64 alignment)
+{
+    if (size == 0 || size > (u64)(fl->end - fl->start))
+        return null;
+
+    // Over-aligned requests need room to cut a free block off the front of whatever block they land in
+    const u64 needed = freelist_block_size_for(size);
+    const u64 search = alignment > FREE_LIST_ALIGNMENT ? needed + alignment + FREE_LIST_MIN_BLOCK_SIZE : needed;
+    freelist_free_block_t *free_block = freelist_find_fit(fl, search);
+    if (free_block == null)
+        return null;
+
+    freelist_bin_remove(fl, free_block);
+    freelist_block_t *block = &free_block->header;
+
+    char *payload = (char *)block + FREE_LIST_HEADER_SIZE;
+    char *aligned = (char *)CL_MEMORY_ALIGN((uintptr_t)payload, alignment);
+    if (aligned != payload)
+    {
+        // The leading gap becomes a free block of its own; its left neighbour is in use, free blocks never touch
+        while ((u64)(aligned - payload) < FREE_LIST_MIN_BLOCK_SIZE)
+            aligned += alignment;
+        const u64 gap = (u64)(aligned - payload);
+        const u64 total = block_size(block);
+
+        freelist_block_t *moved = (freelist_block_t *)(aligned - FREE_LIST_HEADER_SIZE);
+        moved->size = total - gap;
+        moved->prev_size = gap;
+        block_next(moved)->prev_size = total - gap;
+        block->size = gap;
+        freelist_bin_insert(fl, (freelist_free_block_t *)block);
+        block = moved;
+    }
+
+    block->size |= FREE_LIST_USED_BIT;
+    freelist_split(fl, block, needed);
+
+    fl->used_size += block_size(block);
+    fl->allocation_count++;
+    return (char *)block + FREE_LIST_HEADER_SIZE;
+}
+
+static void *freelist_alloc(u64 size, void *user_data)
+{
+    freelist_allocator_t *fl = (freelist_allocator_t *)user_data;
+    return freelist_alloc_aligned(fl, size, fl->alignment);
+}
+
+static void *freelist_aligned_alloc(u64 size, u64 alignment, void *user_data)
+{
+    freelist_allocator_t *fl = (freelist_allocator_t *)user_data;
+    return freelist_alloc_aligned(fl, size, alignment > fl->alignment ? alignment : fl->alignment);
+}
+
+static void freelist_free(void *ptr, void *user_data)
+{
+    freelist_allocator_t *fl = (freelist_allocator_t *)user_data;
+    if (ptr == null)
+        return;
+    if (!freelist_owns(fl, ptr))
+    {
+        cl_log_warn("Pointer %p does not belong to this free list allocator", ptr);
+        return;
+    }
+
+    freelist_block_t *block = (freelist_block_t *)((char *)ptr - FREE_LIST_HEADER_SIZE);
+    fl->used_size -= block_size(block);
+    fl->allocation_count--;
+    block->size &= ~FREE_LIST_USED_BIT;
+
+    // Coalesce with the physical neighbours so the region does not splinter
+    freelist_block_t *next = block_next(block);
+    if ((char *)next < fl->end && !block_is_used(next))
+    {
+        freelist_bin_remove(fl, (freelist_free_block_t *)next);
+        block->size += block_size(next);
+    }
+    if ((char *)block > fl->start)
+    {
+        freelist_block_t *prev = block_prev(block);
+        if (!block_is_used(prev))
+        {
+            freelist_bin_remove(fl, (freelist_free_block_t *)prev);
+            prev->size += block_size(block);
+            block = prev;
+        }
+    }
+
+    block_next(block)->prev_size = block_size(block);
+    freelist_bin_insert(fl, (freelist_free_block_t *)block);
+}
+
+static void *freelist_realloc(void *ptr, u64 new_size, void *user_data)
+{
+    freelist_allocator_t *fl = (freelist_allocator_t *)user_data;
+    if (ptr == null)
+        return freelist_alloc(new_size, user_data);
+    if (new_size == 0)
+    {
+        freelist_free(ptr, user_data);
+        return null;
+    }
+    if (!freelist_owns(fl, ptr))
+        return null;
+
+    freelist_block_t *block = (freelist_block_t *)((char *)ptr - FREE_LIST_HEADER_SIZE);
+    const u64 old_size = block_size(block);
+    const u64 needed = freelist_block_size_for(new_size);
+
+    // Shrink, or grow into a free right-hand neighbour, without moving the data
+    if (needed > old_size)
+    {
+        freelist_block_t *next = block_next(block);
+        if ((char *)next >= fl->end || block_is_used(next) || old_size + block_size(next) < needed)
+        {
+            void *new_ptr = freelist_alloc(new_size, user_data);
+            if (new_ptr == null)
+                return null;
+            memcpy(new_ptr, ptr, old_size - FREE_LIST_HEADER_SIZE);
+            freelist_free(ptr, user_data);
+            return new_ptr;
+        }
+        freelist_bin_remove(fl, (freelist_free_block_t *)next);
+        block->size += block_size(next);
+        block_next(block)->prev_size = block_size(block);
+    }
+
+    freelist_split(fl, block, needed);
+    fl->used_size += block_size(block) - old_size;
+    return ptr;
+}
+
+bool init_freelist_allocator(cl_allocator_t *allocator, const cl_allocator_config_t *config)
+{
+    freelist_allocator_t *fl = malloc(sizeof(freelist_allocator_t));
+    if (!fl)
+        return false;
+    memset(fl, 0, sizeof(freelist_allocator_t));
+
+    u64 size = config->config.free_list.size > 0 ? config->config.free_list.size : FREE_LIST_DEFAULT_SIZE;
+    char *memory = config->config.free_list.start;
+    fl->owns_memory = memory == null;
+    if (fl->owns_memory)
+    {
+        memory = malloc(size);
+        if (memory == null)
+        {
+            cl_log_warn("Failed to reserve memory for free list allocator");
+            free(fl);
+            return false;
+        }
+    }
+
+    // Caller-provided regions may be arbitrarily aligned, trim them to the block granularity
+    char *aligned = (char *)CL_MEMORY_ALIGN((uintptr_t)memory, FREE_LIST_ALIGNMENT);
+    const u64 lost = (u64)(aligned - memory);
+    if (size < lost + FREE_LIST_MIN_BLOCK_SIZE + FREE_LIST_HEADER_SIZE)
+    {
+        if (fl->owns_memory)
+            free(memory);
+        free(fl);
+        return false;
+    }
+    const u64 usable = (size - lost - FREE_LIST_HEADER_SIZE) & ~(u64)(FREE_LIST_ALIGNMENT - 1);
+
+    fl->memory = memory;
+    fl->alignment = mem_config_alignment(config, FREE_LIST_ALIGNMENT);
+    fl->start = aligned;
+    fl->end = aligned + usable;
+
+    freelist_block_t *first = (freelist_block_t *)fl->start;
+    first->size = usable;
+    first->prev_size = 0;
+
+    // A permanently used, empty block at the end stops coalescing from running off the region
+    freelist_block_t *sentinel = (freelist_block_t *)fl->end;
+    sentinel->size = FREE_LIST_USED_BIT;
+    sentinel->prev_size = usable;
+
+    freelist_bin_insert(fl, (freelist_free_block_t *)first);
+
+    allocator->alloc = freelist_alloc;
+    allocator->realloc = freelist_realloc;
+    allocator->free = freelist_free;
+    allocator->aligned_alloc = freelist_aligned_alloc;
+    allocator->type = CL_ALLOCATOR_TYPE_FREE_LIST;
+    allocator->flags = config->flags;
+    allocator->user_data = fl;
+
+    return true;
+}
+
+void deinit_freelist_allocator(const cl_allocator_t *allocator)
+{
+    freelist_allocator_t *fl = (freelist_allocator_t *)allocator->user_data;
+    if (fl->owns_memory)
+        free(fl->memory);
+    free(fl);
+}
+
+bool cl_freelist_get_stats(const cl_allocator_t *allocator, cl_freelist_stats_t *stats)
+{
+    if (allocator == null || stats == null || allocator->type != CL_ALLOCATOR_TYPE_FREE_LIST)
+        return false;
+
+    const freelist_allocator_t *fl = (const freelist_allocator_t *)allocator->user_data;
+    memset(stats, 0, sizeof(cl_freelist_stats_t));
+    stats->total_size = (u64)(fl->end - fl->start);
+    stats->used_size = fl->used_size;
+    stats->allocation_count = fl->allocation_count;
+
+    for (u32 bin = 0; bin < FREE_LIST_BIN_COUNT; bin++)
+    {
+        for (const freelist_free_block_t *it = fl->bins[bin]; it; it = it->next)
+        {
+            // Report what a caller could actually request, not the raw block size
+            const u64 payload = block_size(&it->header) - FREE_LIST_HEADER_SIZE;
+            stats->free_size += payload;
+            stats->free_block_count++;
+            if (payload > stats->largest_free_block)
+                stats->largest_free_block = payload;
+        }
+    }
+
+    stats->fragmentation =
+        stats->free_size > 0 ? 1.0 - (f64)stats->largest_free_block / (f64)stats->free_size : 0.0;
+    return true;
+}
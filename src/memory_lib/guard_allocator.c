@@ -0,0 +1,303 @@
+/**
+ * Created by jraynor on 8/3/2024.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "allocator_internal.h"
+#include "clib/log_lib.h"
+#include "clib/memory_lib.h"
+#define GUARD_ALIGNMENT 16 // Same guarantee as malloc; overruns into this much tail padding go unnoticed
+#define GUARD_INITIAL_SLOTS 64
+#define GUARD_QUARANTINE 64 // Freed regions stay inaccessible for this many frees to catch use after free
+
+// Sampled allocations get their own mapping with the payload pushed against a trailing inaccessible page:
+// [committed pages ... payload][guard page]. Nothing is written into the mapping, so the payload's neighbours
+// are the previous page's padding and the guard page, and the bookkeeping lives in a side table instead.
+typedef struct guard_region
+{
+    char *ptr; // Payload, null for an empty slot
+    char *base;
+    u64 mapped; // Reserved bytes, guard page included
+    u64 size;
+    u64 alignment; // What the payload was placed for, so a realloc keeps an over-aligned block aligned
+} guard_region_t;
+
+typedef struct guard_allocator
+{
+    const cl_allocator_t *backing;
+    u32 sample_rate;
+    u64 alignment;
+    atomic_uint_fast64_t counter; // Allocations seen, every sample_rate-th one is guarded
+    mem_spinlock_t lock; // Guards the tables below; the backing allocator keeps its own threading rules
+
+    // Open-addressing set of live guarded regions keyed on the payload pointer
+    guard_region_t *regions;
+    u64 region_slots;
+    u64 region_count;
+
+    // Freed regions, decommitted but still reserved until they fall out of the ring
+    guard_region_t quarantine[GUARD_QUARANTINE];
+    u32 quarantine_next;
+} guard_allocator_t;
+
+static inline u64 guard_hash(const void *ptr)
+{
+    const u64 hash = (u64)(uintptr_t)ptr * 0x9E3779B97F4A7C15ull;
+    return hash ^ (hash >> 29);
+}
+
+// Must be called with the lock held; returns the slot holding ptr, or the empty slot where it would go
+static u64 guard_find_slot(const guard_allocator_t *guard, const void *ptr)
+{
+    u64 slot = guard_hash(ptr) & (guard->region_slots - 1);
+    while (guard->regions[slot].ptr != null && guard->regions[slot].ptr != ptr)
+        slot = (slot + 1) & (guard->region_slots - 1);
+    return slot;
+}
+
+static bool guard_grow_regions(guard_allocator_t *guard)
+{
+    const u64 old_slots = guard->region_slots;
+    guard_region_t *old_regions = guard->regions;
+    guard_region_t *regions = calloc(old_slots * 2, sizeof(guard_region_t));
+    if (regions == null)
+        return false;
+
+    guard->regions = regions;
+    guard->region_slots = old_slots * 2;
+    for (u64 i = 0; i < old_slots; i++)
+    {
+        if (old_regions[i].ptr != null)
+            guard->regions[guard_find_slot(guard, old_regions[i].ptr)] = old_regions[i];
+    }
+    free(old_regions);
+    return true;
+}
+
+// Must be called with the lock held; backward-shift deletion keeps probe chains intact without tombstones
+static void guard_remove_slot(guard_allocator_t *guard, u64 slot)
+{
+    const u64 mask = guard->region_slots - 1;
+    u64 next = (slot + 1) & mask;
+    while (guard->regions[next].ptr != null)
+    {
+        const u64 home = guard_hash(guard->regions[next].ptr) & mask;
+        // Move the entry back if the hole lies between its home slot and where it sits now
+        if (((next - home) & mask) >= ((next - slot) & mask))
+        {
+            guard->regions[slot] = guard->regions[next];
+            slot = next;
+        }
+        next = (next + 1) & mask;
+    }
+    guard->regions[slot].ptr = null;
+    guard->region_count--;
+}
+
+static void *guard_alloc_region(guard_allocator_t *guard, u64 size, u64 alignment)
+{
+    const u64 page = vm_page_size();
+    if (alignment > page || size > UINT64_MAX - 2 * page)
+        return null;
+
+    const u64 data = CL_MEMORY_ALIGN(size > 0 ? size : 1, page);
+    char *base = vm_reserve(data + page, page);
+    if (base == null)
+        return null;
+    if (!vm_commit(base, data))
+    {
+        vm_release(base, data + page);
+        return null;
+    }
+
+    // Rounding down to the alignment leaves the tail padding, if any, as the only unguarded bytes
+    char *ptr = (char *)(((uintptr_t)(base + data) - size) & ~(uintptr_t)(alignment - 1));
+
+    mem_spinlock_lock(&guard->lock);
+    bool ok = guard->region_count * 2 < guard->region_slots || guard_grow_regions(guard);
+    if (ok)
+    {
+        guard->regions[guard_find_slot(guard, ptr)] =
+            (guard_region_t){.ptr = ptr, .base = base, .mapped = data + page, .size = size, .alignment = alignment};
+        guard->region_count++;
+    }
+    mem_spinlock_unlock(&guard->lock);
+
+    if (!ok)
+    {
+        cl_log_warn("Failed to grow guard allocator region table");
+        vm_release(base, data + page);
+        return null;
+    }
+    return ptr;
+}
+
+// Looks up and unlinks a guarded region; false when ptr came from the backing allocator
+static bool guard_take_region(guard_allocator_t *guard, const void *ptr, guard_region_t *region)
+{
+    mem_spinlock_lock(&guard->lock);
+    const u64 slot = guard_find_slot(guard, ptr);
+    const bool found = guard->regions[slot].ptr != null;
+    if (found)
+    {
+        *region = guard->regions[slot];
+        guard_remove_slot(guard, slot);
+    }
+    mem_spinlock_unlock(&guard->lock);
+    return found;
+}
+
+static void guard_retire_region(guard_allocator_t *guard, const guard_region_t *region)
+{
+    // The pages stay reserved but inaccessible, so a dangling pointer faults instead of reading reused memory
+    vm_decommit(region->base, region->mapped - vm_page_size());
+
+    mem_spinlock_lock(&guard->lock);
+    const guard_region_t evicted = guard->quarantine[guard->quarantine_next];
+    guard->quarantine[guard->quarantine_next] = *region;
+    guard->quarantine_next = (guard->quarantine_next + 1) % GUARD_QUARANTINE;
+    mem_spinlock_unlock(&guard->lock);
+
+    if (evicted.base != null)
+        vm_release(evicted.base, evicted.mapped);
+}
+
+static inline bool guard_sample(guard_allocator_t *guard)
+{
+    return atomic_fetch_add_explicit(&guard->counter, 1, memory_order_relaxed) % guard->sample_rate == 0;
+}
+
+static void *guard_aligned_alloc(u64 size, u64 alignment, void *user_data)
+{
+    guard_allocator_t *guard = (guard_allocator_t *)user_data;
+    if (alignment < guard->alignment)
+        alignment = guard->alignment;
+
+    // Only a native aligned path can be released with a plain free later, anything else is always guarded
+    if (!guard_sample(guard) && guard->backing != null && guard->backing->aligned_alloc != null)
+        return cl_mem_aligned_alloc(guard->backing, alignment, size);
+    return guard_alloc_region(guard, size, alignment);
+}
+
+static void *guard_alloc(u64 size, void *user_data)
+{
+    guard_allocator_t *guard = (guard_allocator_t *)user_data;
+    if (guard->alignment > GUARD_ALIGNMENT)
+        return guard_aligned_alloc(size, guard->alignment, user_data);
+    if (guard_sample(guard))
+        return guard_alloc_region(guard, size, guard->alignment);
+    return cl_mem_alloc(guard->backing, size);
+}
+
+static void guard_free(void *ptr, void *user_data)
+{
+    guard_allocator_t *guard = (guard_allocator_t *)user_data;
+    if (ptr == null)
+        return;
+
+    guard_region_t region;
+    if (guard_take_region(guard, ptr, &region))
+        guard_retire_region(guard, &region);
+    else
+        cl_mem_free(guard->backing, ptr);
+}
+
+static void *guard_realloc(void *ptr, u64 new_size, void *user_data)
+{
+    guard_allocator_t *guard = (guard_allocator_t *)user_data;
+    if (ptr == null)
+        return guard_alloc(new_size, user_data);
+
+    guard_region_t region;
+    if (!guard_take_region(guard, ptr, &region))
+        return cl_mem_realloc(guard->backing, ptr, new_size);
+    if (new_size == 0)
+    {
+        guard_retire_region(guard, &region);
+        return null;
+    }
+
+    // A guarded block stays guarded, and always moves so its end sits against the new guard page
+    void *new_ptr = guard_alloc_region(guard, new_size, region.alignment);
+    if (new_ptr == null)
+    {
+        // Put the old region back, it is still valid
+        mem_spinlock_lock(&guard->lock);
+        guard->regions[guard_find_slot(guard, ptr)] = region;
+        guard->region_count++;
+        mem_spinlock_unlock(&guard->lock);
+        return null;
+    }
+    memcpy(new_ptr, ptr, region.size < new_size ? region.size : new_size);
+    guard_retire_region(guard, &region);
+    return new_ptr;
+}
+
+bool init_guard_allocator(cl_allocator_t *allocator, const cl_allocator_config_t *config)
+{
+    guard_allocator_t *guard = malloc(sizeof(guard_allocator_t));
+    if (!guard)
+        return false;
+
+    guard->regions = calloc(GUARD_INITIAL_SLOTS, sizeof(guard_region_t));
+    if (guard->regions == null)
+    {
+        cl_log_warn("Failed to allocate region table for guard allocator");
+        free(guard);
+        return false;
+    }
+
+    guard->backing = config->config.guard.allocator;
+    guard->sample_rate = config->config.guard.sample_rate > 0 ? config->config.guard.sample_rate : 1;
+    guard->alignment = mem_config_alignment(config, GUARD_ALIGNMENT);
+    atomic_init(&guard->counter, 0);
+    atomic_init(&guard->lock.locked, false);
+    guard->region_slots = GUARD_INITIAL_SLOTS;
+    guard->region_count = 0;
+    memset(guard->quarantine, 0, sizeof(guard->quarantine));
+    guard->quarantine_next = 0;
+
+    allocator->alloc = guard_alloc;
+    allocator->realloc = guard_realloc;
+    allocator->free = guard_free;
+    allocator->aligned_alloc = guard_aligned_alloc;
+    allocator->type = CL_ALLOCATOR_TYPE_GUARD;
+    allocator->flags = config->flags;
+    allocator->user_data = guard;
+
+    return true;
+}
+
+void deinit_guard_allocator(const cl_allocator_t *allocator)
+{
+    guard_allocator_t *guard = (guard_allocator_t *)allocator->user_data;
+    if (guard->region_count > 0)
+        cl_log_warn("Guard allocator destroyed with %llu live guarded allocations",
+                    (unsigned long long)guard->region_count);
+
+    for (u64 i = 0; i < guard->region_slots; i++)
+    {
+        if (guard->regions[i].ptr != null)
+            vm_release(guard->regions[i].base, guard->regions[i].mapped);
+    }
+    for (u32 i = 0; i < GUARD_QUARANTINE; i++)
+    {
+        if (guard->quarantine[i].base != null)
+            vm_release(guard->quarantine[i].base, guard->quarantine[i].mapped);
+    }
+
+    free(guard->regions);
+    free(guard);
+}
+
+bool cl_guard_contains(const cl_allocator_t *allocator, const void *ptr)
+{
+    if (allocator == null || allocator->type != CL_ALLOCATOR_TYPE_GUARD || ptr == null)
+        return false;
+
+    guard_allocator_t *guard = (guard_allocator_t *)allocator->user_data;
+    mem_spinlock_lock(&guard->lock);
+    const bool found = guard->regions[guard_find_slot(guard, ptr)].ptr != null;
+    mem_spinlock_unlock(&guard->lock);
+    return found;
+}
@@ -0,0 +1,149 @@
+/**
+ * Created by jraynor on 8/3/2024.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "allocator_internal.h"
+#include "clib/log_lib.h"
+#include "clib/memory_lib.h"
+#define LINEAR_DEFAULT_SIZE (64 * 1024) // 64 KB default region size
+#define LINEAR_ALIGNMENT 8
+
+typedef struct linear_allocator
+{
+    char *start;
+    u64 size;
+    u64 offset; // First free byte
+    u64 last; // Offset of the most recent allocation, equal to offset when there is none
+    u64 alignment;
+    bool owns_memory;
+} linear_allocator_t;
+
+static void *linear_alloc_aligned(linear_allocator_t *linear, u64 size, u64 alignment)
+{
+    // Align the address rather than the offset, caller-provided regions can start anywhere
+    const uintptr_t address = CL_MEMORY_ALIGN((uintptr_t)(linear->start + linear->offset), alignment);
+    const u64 aligned = (u64)(address - (uintptr_t)linear->start);
+    if (size > linear->size || aligned > linear->size - size)
+        return null;
+
+    linear->last = aligned;
+    linear->offset = aligned + size;
+    return linear->start + aligned;
+}
+
+static void *linear_alloc(u64 size, void *user_data)
+{
+    linear_allocator_t *linear = (linear_allocator_t *)user_data;
+    return linear_alloc_aligned(linear, size, linear->alignment);
+}
+
+static void *linear_aligned_alloc(u64 size, u64 alignment, void *user_data)
+{
+    linear_allocator_t *linear = (linear_allocator_t *)user_data;
+    return linear_alloc_aligned(linear, size, alignment > linear->alignment ? alignment : linear->alignment);
+}
+
+static void *linear_realloc(void *ptr, u64 new_size, void *user_data)
+{
+    linear_allocator_t *linear = (linear_allocator_t *)user_data;
+    if (ptr == null)
+        return linear_alloc(new_size, user_data);
+
+    const u64 ptr_offset = (u64)((char *)ptr - linear->start);
+
+    // The most recent allocation can simply move the bump pointer
+    if (ptr_offset == linear->last && linear->last < linear->offset)
+    {
+        if (new_size > linear->size - ptr_offset)
+            return null;
+        linear->offset = ptr_offset + new_size;
+        return ptr;
+    }
+
+    // Anything older has to move; nothing past the current offset is live, so that bounds the copy
+    const u64 available = linear->offset - ptr_offset;
+    void *new_ptr = linear_alloc(new_size, user_data);
+    if (new_ptr)
+        memcpy(new_ptr, ptr, new_size < available ? new_size : available);
+    return new_ptr;
+}
+
+static void linear_free(void *ptr, void *user_data)
+{
+    // Linear allocations are only released by rolling back to a marker
+    (void)ptr;
+    (void)user_data;
+}
+
+bool init_linear_allocator(cl_allocator_t *allocator, const cl_allocator_config_t *config)
+{
+    linear_allocator_t *linear = malloc(sizeof(linear_allocator_t));
+    if (!linear)
+        return false;
+
+    char *start = config->config.linear.start;
+    u64 size = config->config.linear.size;
+    if (start != null && config->config.linear.end != null)
+        size = (u64)((char *)config->config.linear.end - start);
+    if (size == 0)
+        size = LINEAR_DEFAULT_SIZE;
+
+    linear->owns_memory = start == null;
+    if (linear->owns_memory)
+    {
+        start = malloc(size);
+        if (start == null)
+        {
+            cl_log_warn("Failed to reserve memory for linear allocator");
+            free(linear);
+            return false;
+        }
+    }
+
+    linear->start = start;
+    linear->size = size;
+    linear->offset = 0;
+    linear->alignment = mem_config_alignment(config, LINEAR_ALIGNMENT);
+
+    // Callers handing over a partially used buffer can tell us where the free space begins
+    const char *current = config->config.linear.current;
+    if (!linear->owns_memory && current != null && current >= start && current <= start + size)
+        linear->offset = (u64)(current - start);
+    linear->last = linear->offset;
+
+    allocator->alloc = linear_alloc;
+    allocator->realloc = linear_realloc;
+    allocator->free = linear_free;
+    allocator->aligned_alloc = linear_aligned_alloc;
+    allocator->type = CL_ALLOCATOR_TYPE_LINEAR;
+    allocator->flags = config->flags;
+    allocator->user_data = linear;
+
+    return true;
+}
+
+void deinit_linear_allocator(const cl_allocator_t *allocator)
+{
+    linear_allocator_t *linear = (linear_allocator_t *)allocator->user_data;
+    if (linear->owns_memory)
+        free(linear->start);
+    free(linear);
+}
+
+cl_mem_marker_t linear_allocator_mark(const cl_allocator_t *allocator)
+{
+    const linear_allocator_t *linear = (const linear_allocator_t *)allocator->user_data;
+    return (cl_mem_marker_t){.position = linear->offset, .last = linear->last};
+}
+
+bool linear_allocator_rollback(const cl_allocator_t *allocator, cl_mem_marker_t marker)
+{
+    linear_allocator_t *linear = (linear_allocator_t *)allocator->user_data;
+    if (marker.position > linear->offset)
+        return false;
+
+    linear->offset = marker.position;
+    linear->last = marker.last;
+    return true;
+}
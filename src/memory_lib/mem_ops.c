@@ -0,0 +1,624 @@
+/**
+ * Created by jraynor on 8/3/2024.
+ */
+#include <string.h>
+#include "allocator_internal.h"
+#include "clib/memory_lib.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define MEM_OPS_X86
+#include <immintrin.h>
+#if defined(CL_COMPILER_MSVC)
+#include <intrin.h>
+#define MEM_TARGET_SSE2
+#define MEM_TARGET_AVX2
+#else
+#include <cpuid.h>
+#define MEM_TARGET_SSE2 __attribute__((target("sse2")))
+#define MEM_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#define MEM_NT_THRESHOLD (32 * 1024 * 1024) // Copies this large bypass the caches; below it libc's copy won or tied
+#define MEM_REP_MOVSB_THRESHOLD 2048        // With ERMS, microcoded rep movsb beats vector loops from here on
+
+typedef struct mem_ops
+{
+    const char *name;
+    bool libc;    // set, move and compare are libc's, so the wrappers call them directly
+    u64 copy_min; // Copies below this go straight to memcpy
+    void (*set)(void *ptr, int value, u64 num);
+    void (*copy)(void *dest, const void *src, u64 num);
+    void (*move)(void *dest, const void *src, u64 num);
+    int (*compare)(const void *ptr1, const void *ptr2, u64 num);
+} mem_ops_t;
+
+static void libc_set(void *ptr, int value, u64 num) { memset(ptr, value, num); }
+
+static void libc_copy(void *dest, const void *src, u64 num) { memcpy(dest, src, num); }
+
+static void libc_move(void *dest, const void *src, u64 num) { memmove(dest, src, num); }
+
+static int libc_compare(const void *ptr1, const void *ptr2, u64 num) { return memcmp(ptr1, ptr2, num); }
+
+static const mem_ops_t mem_ops_libc = {"libc", true, UINT64_MAX, libc_set, libc_copy, libc_move, libc_compare};
+
+#ifdef MEM_OPS_X86
+
+// Up to 16 bytes as two overlapping loads of the widest fitting word; every load happens before any store, so
+// this is also safe for overlapping moves
+static inline void mem_copy_small(char *d, const char *s, u64 n)
+{
+    if (n >= 8)
+    {
+        u64 head, tail;
+        memcpy(&head, s, 8);
+        memcpy(&tail, s + n - 8, 8);
+        memcpy(d, &head, 8);
+        memcpy(d + n - 8, &tail, 8);
+    }
+    else if (n >= 4)
+    {
+        u32 head, tail;
+        memcpy(&head, s, 4);
+        memcpy(&tail, s + n - 4, 4);
+        memcpy(d, &head, 4);
+        memcpy(d + n - 4, &tail, 4);
+    }
+    else if (n >= 2)
+    {
+        u16 head, tail;
+        memcpy(&head, s, 2);
+        memcpy(&tail, s + n - 2, 2);
+        memcpy(d, &head, 2);
+        memcpy(d + n - 2, &tail, 2);
+    }
+    else if (n == 1)
+    {
+        *d = *s;
+    }
+}
+
+static inline void mem_set_small(char *d, u8 value, u64 n)
+{
+    const u64 pattern = value * 0x0101010101010101ull;
+    if (n >= 8)
+    {
+        memcpy(d, &pattern, 8);
+        memcpy(d + n - 8, &pattern, 8);
+    }
+    else if (n >= 4)
+    {
+        memcpy(d, &pattern, 4);
+        memcpy(d + n - 4, &pattern, 4);
+    }
+    else if (n >= 2)
+    {
+        memcpy(d, &pattern, 2);
+        memcpy(d + n - 2, &pattern, 2);
+    }
+    else if (n == 1)
+    {
+        *d = (char)value;
+    }
+}
+
+// Compares up to 16 bytes a word at a time; the lowest differing byte of the xor is the first mismatch
+static inline int mem_compare_small(const u8 *a, const u8 *b, u64 n)
+{
+    u64 i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        u64 wa, wb;
+        memcpy(&wa, a + i, 8);
+        memcpy(&wb, b + i, 8);
+        if (wa != wb)
+        {
+            const u32 byte = (u32)__builtin_ctzll(wa ^ wb) / 8;
+            return (int)a[i + byte] - (int)b[i + byte];
+        }
+    }
+    for (; i < n; i++)
+    {
+        if (a[i] != b[i])
+            return (int)a[i] - (int)b[i];
+    }
+    return 0;
+}
+
+// ---- SSE2 ----------------------------------------------------------------------------------------------------------
+
+// Copies n > 32 bytes front to back. Head and tail are loaded first and stored last, and the loop reads each
+// chunk before writing it, so the destination may overlap the source from below.
+MEM_TARGET_SSE2 static void sse2_copy_forward(char *d, const char *s, u64 n, bool stream)
+{
+    const __m128i head = _mm_loadu_si128((const __m128i *)s);
+    const __m128i tail = _mm_loadu_si128((const __m128i *)(s + n - 16));
+
+    u64 p = 16 - ((uintptr_t)d & 15);
+    if (stream)
+    {
+        for (; p + 64 <= n; p += 64)
+        {
+            const __m128i a = _mm_loadu_si128((const __m128i *)(s + p));
+            const __m128i b = _mm_loadu_si128((const __m128i *)(s + p + 16));
+            const __m128i c = _mm_loadu_si128((const __m128i *)(s + p + 32));
+            const __m128i e = _mm_loadu_si128((const __m128i *)(s + p + 48));
+            _mm_stream_si128((__m128i *)(d + p), a);
+            _mm_stream_si128((__m128i *)(d + p + 16), b);
+            _mm_stream_si128((__m128i *)(d + p + 32), c);
+            _mm_stream_si128((__m128i *)(d + p + 48), e);
+        }
+        _mm_sfence();
+    }
+    for (; p + 64 <= n; p += 64)
+    {
+        const __m128i a = _mm_loadu_si128((const __m128i *)(s + p));
+        const __m128i b = _mm_loadu_si128((const __m128i *)(s + p + 16));
+        const __m128i c = _mm_loadu_si128((const __m128i *)(s + p + 32));
+        const __m128i e = _mm_loadu_si128((const __m128i *)(s + p + 48));
+        _mm_store_si128((__m128i *)(d + p), a);
+        _mm_store_si128((__m128i *)(d + p + 16), b);
+        _mm_store_si128((__m128i *)(d + p + 32), c);
+        _mm_store_si128((__m128i *)(d + p + 48), e);
+    }
+    for (; p + 16 <= n; p += 16)
+        _mm_store_si128((__m128i *)(d + p), _mm_loadu_si128((const __m128i *)(s + p)));
+
+    _mm_storeu_si128((__m128i *)d, head);
+    _mm_storeu_si128((__m128i *)(d + n - 16), tail);
+}
+
+// Mirror image of sse2_copy_forward for destinations overlapping the source from above
+MEM_TARGET_SSE2 static void sse2_copy_backward(char *d, const char *s, u64 n)
+{
+    const __m128i head = _mm_loadu_si128((const __m128i *)s);
+    const __m128i tail = _mm_loadu_si128((const __m128i *)(s + n - 16));
+
+    u64 p = n - ((uintptr_t)(d + n) & 15);
+    for (; p >= 64; p -= 64)
+    {
+        const __m128i a = _mm_loadu_si128((const __m128i *)(s + p - 16));
+        const __m128i b = _mm_loadu_si128((const __m128i *)(s + p - 32));
+        const __m128i c = _mm_loadu_si128((const __m128i *)(s + p - 48));
+        const __m128i e = _mm_loadu_si128((const __m128i *)(s + p - 64));
+        _mm_store_si128((__m128i *)(d + p - 16), a);
+        _mm_store_si128((__m128i *)(d + p - 32), b);
+        _mm_store_si128((__m128i *)(d + p - 48), c);
+        _mm_store_si128((__m128i *)(d + p - 64), e);
+    }
+    for (; p >= 16; p -= 16)
+        _mm_store_si128((__m128i *)(d + p - 16), _mm_loadu_si128((const __m128i *)(s + p - 16)));
+
+    _mm_storeu_si128((__m128i *)d, head);
+    _mm_storeu_si128((__m128i *)(d + n - 16), tail);
+}
+
+MEM_TARGET_SSE2 static inline bool sse2_copy_short(char *d, const char *s, u64 n)
+{
+    if (n <= 16)
+    {
+        mem_copy_small(d, s, n);
+        return true;
+    }
+    if (n <= 32)
+    {
+        const __m128i head = _mm_loadu_si128((const __m128i *)s);
+        const __m128i tail = _mm_loadu_si128((const __m128i *)(s + n - 16));
+        _mm_storeu_si128((__m128i *)d, head);
+        _mm_storeu_si128((__m128i *)(d + n - 16), tail);
+        return true;
+    }
+    return false;
+}
+
+MEM_TARGET_SSE2 static void sse2_copy(void *dest, const void *src, u64 num)
+{
+    if (!sse2_copy_short(dest, src, num))
+        sse2_copy_forward(dest, src, num, num >= MEM_NT_THRESHOLD);
+}
+
+MEM_TARGET_SSE2 static void sse2_move(void *dest, const void *src, u64 num)
+{
+    if (sse2_copy_short(dest, src, num))
+        return;
+    // Unsigned distance: anything but a destination inside (src, src + num) can be copied front to back
+    if ((uintptr_t)dest - (uintptr_t)src >= num)
+        sse2_copy_forward(dest, src, num, false);
+    else
+        sse2_copy_backward(dest, src, num);
+}
+
+MEM_TARGET_SSE2 static void sse2_set(void *ptr, int value, u64 num)
+{
+    char *d = ptr;
+    if (num <= 16)
+    {
+        mem_set_small(d, (u8)value, num);
+        return;
+    }
+
+    const __m128i v = _mm_set1_epi8((char)value);
+    _mm_storeu_si128((__m128i *)d, v);
+    _mm_storeu_si128((__m128i *)(d + num - 16), v);
+
+    u64 p = 16 - ((uintptr_t)d & 15);
+    for (; p + 64 <= num; p += 64)
+    {
+        _mm_store_si128((__m128i *)(d + p), v);
+        _mm_store_si128((__m128i *)(d + p + 16), v);
+        _mm_store_si128((__m128i *)(d + p + 32), v);
+        _mm_store_si128((__m128i *)(d + p + 48), v);
+    }
+    for (; p + 16 <= num; p += 16)
+        _mm_store_si128((__m128i *)(d + p), v);
+}
+
+MEM_TARGET_SSE2 static inline int sse2_compare_at(const u8 *a, const u8 *b, u64 i)
+{
+    const __m128i eq = _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)(a + i)),
+                                      _mm_loadu_si128((const __m128i *)(b + i)));
+    const u32 mask = (u32)_mm_movemask_epi8(eq) ^ 0xFFFF;
+    if (mask == 0)
+        return 0;
+    const u32 byte = (u32)__builtin_ctz(mask);
+    return (int)a[i + byte] - (int)b[i + byte];
+}
+
+MEM_TARGET_SSE2 static int sse2_compare(const void *ptr1, const void *ptr2, u64 num)
+{
+    const u8 *a = ptr1;
+    const u8 *b = ptr2;
+    if (num < 16)
+        return mem_compare_small(a, b, num);
+
+    int result;
+    u64 i = 0;
+    for (; i + 16 <= num; i += 16)
+    {
+        if ((result = sse2_compare_at(a, b, i)) != 0)
+            return result;
+    }
+    // The last partial chunk overlaps bytes already known to be equal
+    return i < num ? sse2_compare_at(a, b, num - 16) : 0;
+}
+
+static const mem_ops_t mem_ops_sse2 = {"sse2", false, 0, sse2_set, sse2_copy, sse2_move, sse2_compare};
+
+// ---- AVX2 ----------------------------------------------------------------------------------------------------------
+
+// Same shape as the SSE2 version with 32-byte vectors, for n > 64
+MEM_TARGET_AVX2 static void avx2_copy_forward(char *d, const char *s, u64 n, bool stream)
+{
+    const __m256i head = _mm256_loadu_si256((const __m256i *)s);
+    const __m256i tail = _mm256_loadu_si256((const __m256i *)(s + n - 32));
+
+    u64 p = 32 - ((uintptr_t)d & 31);
+    if (stream)
+    {
+        for (; p + 128 <= n; p += 128)
+        {
+            const __m256i a = _mm256_loadu_si256((const __m256i *)(s + p));
+            const __m256i b = _mm256_loadu_si256((const __m256i *)(s + p + 32));
+            const __m256i c = _mm256_loadu_si256((const __m256i *)(s + p + 64));
+            const __m256i e = _mm256_loadu_si256((const __m256i *)(s + p + 96));
+            _mm256_stream_si256((__m256i *)(d + p), a);
+            _mm256_stream_si256((__m256i *)(d + p + 32), b);
+            _mm256_stream_si256((__m256i *)(d + p + 64), c);
+            _mm256_stream_si256((__m256i *)(d + p + 96), e);
+        }
+        _mm_sfence();
+    }
+    for (; p + 128 <= n; p += 128)
+    {
+        const __m256i a = _mm256_loadu_si256((const __m256i *)(s + p));
+        const __m256i b = _mm256_loadu_si256((const __m256i *)(s + p + 32));
+        const __m256i c = _mm256_loadu_si256((const __m256i *)(s + p + 64));
+        const __m256i e = _mm256_loadu_si256((const __m256i *)(s + p + 96));
+        _mm256_store_si256((__m256i *)(d + p), a);
+        _mm256_store_si256((__m256i *)(d + p + 32), b);
+        _mm256_store_si256((__m256i *)(d + p + 64), c);
+        _mm256_store_si256((__m256i *)(d + p + 96), e);
+    }
+    for (; p + 32 <= n; p += 32)
+        _mm256_store_si256((__m256i *)(d + p), _mm256_loadu_si256((const __m256i *)(s + p)));
+
+    _mm256_storeu_si256((__m256i *)d, head);
+    _mm256_storeu_si256((__m256i *)(d + n - 32), tail);
+}
+
+MEM_TARGET_AVX2 static void avx2_copy_backward(char *d, const char *s, u64 n)
+{
+    const __m256i head = _mm256_loadu_si256((const __m256i *)s);
+    const __m256i tail = _mm256_loadu_si256((const __m256i *)(s + n - 32));
+
+    u64 p = n - ((uintptr_t)(d + n) & 31);
+    for (; p >= 128; p -= 128)
+    {
+        const __m256i a = _mm256_loadu_si256((const __m256i *)(s + p - 32));
+        const __m256i b = _mm256_loadu_si256((const __m256i *)(s + p - 64));
+        const __m256i c = _mm256_loadu_si256((const __m256i *)(s + p - 96));
+        const __m256i e = _mm256_loadu_si256((const __m256i *)(s + p - 128));
+        _mm256_store_si256((__m256i *)(d + p - 32), a);
+        _mm256_store_si256((__m256i *)(d + p - 64), b);
+        _mm256_store_si256((__m256i *)(d + p - 96), c);
+        _mm256_store_si256((__m256i *)(d + p - 128), e);
+    }
+    for (; p >= 32; p -= 32)
+        _mm256_store_si256((__m256i *)(d + p - 32), _mm256_loadu_si256((const __m256i *)(s + p - 32)));
+
+    _mm256_storeu_si256((__m256i *)d, head);
+    _mm256_storeu_si256((__m256i *)(d + n - 32), tail);
+}
+
+MEM_TARGET_AVX2 static inline bool avx2_copy_short(char *d, const char *s, u64 n)
+{
+    if (n <= 32)
+        return sse2_copy_short(d, s, n);
+    if (n <= 64)
+    {
+        const __m256i head = _mm256_loadu_si256((const __m256i *)s);
+        const __m256i tail = _mm256_loadu_si256((const __m256i *)(s + n - 32));
+        _mm256_storeu_si256((__m256i *)d, head);
+        _mm256_storeu_si256((__m256i *)(d + n - 32), tail);
+        return true;
+    }
+    return false;
+}
+
+MEM_TARGET_AVX2 static void avx2_copy(void *dest, const void *src, u64 num)
+{
+    if (!avx2_copy_short(dest, src, num))
+        avx2_copy_forward(dest, src, num, num >= MEM_NT_THRESHOLD);
+}
+
+MEM_TARGET_AVX2 static void avx2_move(void *dest, const void *src, u64 num)
+{
+    if (avx2_copy_short(dest, src, num))
+        return;
+    if ((uintptr_t)dest - (uintptr_t)src >= num)
+        avx2_copy_forward(dest, src, num, false);
+    else
+        avx2_copy_backward(dest, src, num);
+}
+
+MEM_TARGET_AVX2 static void avx2_set(void *ptr, int value, u64 num)
+{
+    char *d = ptr;
+    if (num <= 32)
+    {
+        sse2_set(d, value, num);
+        return;
+    }
+
+    const __m256i v = _mm256_set1_epi8((char)value);
+    _mm256_storeu_si256((__m256i *)d, v);
+    _mm256_storeu_si256((__m256i *)(d + num - 32), v);
+
+    u64 p = 32 - ((uintptr_t)d & 31);
+    for (; p + 128 <= num; p += 128)
+    {
+        _mm256_store_si256((__m256i *)(d + p), v);
+        _mm256_store_si256((__m256i *)(d + p + 32), v);
+        _mm256_store_si256((__m256i *)(d + p + 64), v);
+        _mm256_store_si256((__m256i *)(d + p + 96), v);
+    }
+    for (; p + 32 <= num; p += 32)
+        _mm256_store_si256((__m256i *)(d + p), v);
+}
+
+MEM_TARGET_AVX2 static inline int avx2_compare_at(const u8 *a, const u8 *b, u64 i)
+{
+    const __m256i eq = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a + i)),
+                                         _mm256_loadu_si256((const __m256i *)(b + i)));
+    const u32 mask = ~(u32)_mm256_movemask_epi8(eq);
+    if (mask == 0)
+        return 0;
+    const u32 byte = (u32)__builtin_ctz(mask);
+    return (int)a[i + byte] - (int)b[i + byte];
+}
+
+MEM_TARGET_AVX2 static int avx2_compare(const void *ptr1, const void *ptr2, u64 num)
+{
+    const u8 *a = ptr1;
+    const u8 *b = ptr2;
+    if (num < 32)
+        return sse2_compare(a, b, num);
+
+    int result;
+    u64 i = 0;
+    for (; i + 128 <= num; i += 128)
+    {
+        // Four vectors per step, folded into one test while they match
+        const __m256i eq0 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a + i)),
+                                              _mm256_loadu_si256((const __m256i *)(b + i)));
+        const __m256i eq1 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a + i + 32)),
+                                              _mm256_loadu_si256((const __m256i *)(b + i + 32)));
+        const __m256i eq2 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a + i + 64)),
+                                              _mm256_loadu_si256((const __m256i *)(b + i + 64)));
+        const __m256i eq3 = _mm256_cmpeq_epi8(_mm256_loadu_si256((const __m256i *)(a + i + 96)),
+                                              _mm256_loadu_si256((const __m256i *)(b + i + 96)));
+        const __m256i eq = _mm256_and_si256(_mm256_and_si256(eq0, eq1), _mm256_and_si256(eq2, eq3));
+        if ((u32)_mm256_movemask_epi8(eq) != 0xFFFFFFFFu)
+            break;
+    }
+    for (; i + 32 <= num; i += 32)
+    {
+        if ((result = avx2_compare_at(a, b, i)) != 0)
+            return result;
+    }
+    return i < num ? avx2_compare_at(a, b, num - 32) : 0;
+}
+
+static inline void mem_rep_movsb(void *dest, const void *src, u64 num)
+{
+#if defined(CL_COMPILER_MSVC)
+    __movsb(dest, src, num);
+#else
+    __asm__ volatile("rep movsb" : "+D"(dest), "+S"(src), "+c"(num) : : "memory");
+#endif
+}
+
+// Medium copies on CPUs with enhanced rep movsb; moves keep the vector loops since rep movsb only runs forwards
+MEM_TARGET_AVX2 static void avx2_erms_copy(void *dest, const void *src, u64 num)
+{
+    if (num >= MEM_REP_MOVSB_THRESHOLD && num < MEM_NT_THRESHOLD)
+        mem_rep_movsb(dest, src, num);
+    else
+        avx2_copy(dest, src, num);
+}
+
+MEM_TARGET_AVX2 static void avx2_erms_set(void *ptr, int value, u64 num)
+{
+    if (num >= MEM_REP_MOVSB_THRESHOLD)
+    {
+#if defined(CL_COMPILER_MSVC)
+        __stosb(ptr, (unsigned char)value, num);
+#else
+        __asm__ volatile("rep stosb" : "+D"(ptr), "+c"(num) : "a"(value) : "memory");
+#endif
+        return;
+    }
+    avx2_set(ptr, value, num);
+}
+
+static const mem_ops_t mem_ops_avx2 = {"avx2", false, 0, avx2_set, avx2_copy, avx2_move, avx2_compare};
+static const mem_ops_t mem_ops_avx2_erms = {"avx2", false, 0, avx2_erms_set, avx2_erms_copy, avx2_move, avx2_compare};
+
+// The default on AVX2 machines: libc everywhere except the streaming copies that measurably beat it
+static const mem_ops_t mem_ops_libc_avx2 = {"libc+avx2", true, MEM_NT_THRESHOLD, libc_set, avx2_copy, libc_move,
+                                            libc_compare};
+
+static bool mem_cpu_has_sse2(void)
+{
+#if defined(__x86_64__) || defined(_M_X64)
+    return true;
+#elif defined(CL_COMPILER_MSVC)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[3] & (1 << 26)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+#endif
+}
+
+static bool mem_cpu_has_avx2(void)
+{
+#if defined(CL_COMPILER_MSVC)
+    // AVX2 needs the CPU feature bit and the OS saving YMM state (OSXSAVE and XCR0 bits 1-2)
+    int info[4];
+    __cpuid(info, 1);
+    if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 0x6) != 0x6)
+        return false;
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+static bool mem_cpu_has_erms(void)
+{
+    int info[4];
+#if defined(CL_COMPILER_MSVC)
+    __cpuidex(info, 7, 0);
+#else
+    unsigned int regs[4];
+    if (!__get_cpuid_count(7, 0, &regs[0], &regs[1], &regs[2], &regs[3]))
+        return false;
+    info[1] = (int)regs[1];
+#endif
+    return (info[1] & (1 << 9)) != 0;
+}
+
+static const mem_ops_t *mem_ops_avx2_best(void) { return mem_cpu_has_erms() ? &mem_ops_avx2_erms : &mem_ops_avx2; }
+
+#endif
+
+static _Atomic(const mem_ops_t *) mem_ops_active = null;
+
+// glibc matched or beat the SSE2/AVX2 kernels at every size and op except large copies, so those stay opt-in
+static const mem_ops_t *mem_ops_detect(void)
+{
+#ifdef MEM_OPS_X86
+    if (mem_cpu_has_avx2())
+        return &mem_ops_libc_avx2;
+#endif
+    return &mem_ops_libc;
+}
+
+// Resolved on first use; racing threads all detect the same table, so a plain store is enough
+static inline const mem_ops_t *mem_ops(void)
+{
+    const mem_ops_t *ops = atomic_load_explicit(&mem_ops_active, memory_order_relaxed);
+    if (ops == null)
+    {
+        ops = mem_ops_detect();
+        atomic_store_explicit(&mem_ops_active, ops, memory_order_relaxed);
+    }
+    return ops;
+}
+
+const char *cl_mem_ops_name(void) { return mem_ops()->name; }
+
+bool cl_mem_ops_select(const char *name)
+{
+    if (name == null)
+        return false;
+
+    const mem_ops_t *ops = null;
+    if (strcmp(name, mem_ops_libc.name) == 0)
+        ops = &mem_ops_libc;
+#ifdef MEM_OPS_X86
+    else if (strcmp(name, mem_ops_sse2.name) == 0 && mem_cpu_has_sse2())
+        ops = &mem_ops_sse2;
+    else if (strcmp(name, mem_ops_avx2.name) == 0 && mem_cpu_has_avx2())
+        ops = mem_ops_avx2_best();
+    else if (strcmp(name, mem_ops_libc_avx2.name) == 0 && mem_cpu_has_avx2())
+        ops = &mem_ops_libc_avx2;
+#endif
+    else if (strcmp(name, "auto") == 0)
+        ops = mem_ops_detect();
+    if (ops == null)
+        return false;
+
+    atomic_store_explicit(&mem_ops_active, ops, memory_order_relaxed);
+    return true;
+}
+
+// libc is called directly wherever the active set defers to it, so the common sizes skip the indirect call
+
+void cl_mem_set(void *ptr, const int value, const u64 num)
+{
+    const mem_ops_t *ops = mem_ops();
+    if (ops->libc)
+        memset(ptr, value, num);
+    else
+        ops->set(ptr, value, num);
+}
+
+void cl_mem_copy(void *dest, const void *src, const u64 num)
+{
+    const mem_ops_t *ops = mem_ops();
+    if (num < ops->copy_min)
+        memcpy(dest, src, num);
+    else
+        ops->copy(dest, src, num);
+}
+
+void cl_mem_move(void *dest, const void *src, const u64 num)
+{
+    const mem_ops_t *ops = mem_ops();
+    if (ops->libc)
+        memmove(dest, src, num);
+    else
+        ops->move(dest, src, num);
+}
+
+int cl_mem_compare(const void *ptr1, const void *ptr2, const u64 num)
+{
+    const mem_ops_t *ops = mem_ops();
+    return ops->libc ? memcmp(ptr1, ptr2, num) : ops->compare(ptr1, ptr2, num);
+}
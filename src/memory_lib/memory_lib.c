@@ -6,14 +6,25 @@
 #include <string.h>
 #include "allocator_internal.h"
 
+// The call-site macros must not rewrite the definitions below
+#undef cl_mem_alloc
+#undef cl_mem_realloc
+
+CL_THREAD_LOCAL const char *mem_call_site_file = null;
+CL_THREAD_LOCAL i32 mem_call_site_line = 0;
+
 cl_allocator_t *cl_allocator_create(const cl_allocator_config_t *config)
 {
     if (config == null)
         return null;
 
+    if ((config->flags & CL_ALLOCATOR_FLAG_ALIGN) && (config->alignment & (config->alignment - 1)) != 0)
+        return null;
+
     cl_allocator_t *allocator = malloc(sizeof(cl_allocator_t));
     if (allocator == null)
         return null;
+    memset(allocator, 0, sizeof(cl_allocator_t));
 
     switch (config->type)
     {
@@ -31,6 +42,50 @@ cl_allocator_t *cl_allocator_create(const cl_allocator_config_t *config)
             return null;
         }
         break;
+    case CL_ALLOCATOR_TYPE_POOL:
+        if (!((config->flags & CL_ALLOCATOR_FLAG_CONCURRENT) ? init_concurrent_pool_allocator(allocator, config)
+                                                              : init_pool_allocator(allocator, config)))
+        {
+            free(allocator);
+            return null;
+        }
+        break;
+    case CL_ALLOCATOR_TYPE_LINEAR:
+        if (!init_linear_allocator(allocator, config))
+        {
+            free(allocator);
+            return null;
+        }
+        break;
+    case CL_ALLOCATOR_TYPE_STACK:
+        if (!init_stack_allocator(allocator, config))
+        {
+            free(allocator);
+            return null;
+        }
+        break;
+    case CL_ALLOCATOR_TYPE_FREE_LIST:
+        if (!init_freelist_allocator(allocator, config))
+        {
+            free(allocator);
+            return null;
+        }
+        break;
+    case CL_ALLOCATOR_TYPE_PROXY:
+        if (!(config->config.proxy.mode == CL_PROXY_MODE_TRACKING ? init_tracking_allocator(allocator, config)
+                                                                  : init_proxy_allocator(allocator, config)))
+        {
+            free(allocator);
+            return null;
+        }
+        break;
+    case CL_ALLOCATOR_TYPE_GUARD:
+        if (!init_guard_allocator(allocator, config))
+        {
+            free(allocator);
+            return null;
+        }
+        break;
     default:
         free(allocator);
         return null;
@@ -50,6 +105,31 @@ void cl_allocator_destroy(cl_allocator_t *allocator)
         break;
     case CL_ALLOCATOR_TYPE_ARENA:
         deinit_arena_allocator(allocator);
+        break;
+    case CL_ALLOCATOR_TYPE_POOL:
+        if (allocator->flags & CL_ALLOCATOR_FLAG_CONCURRENT)
+            deinit_concurrent_pool_allocator(allocator);
+        else
+            deinit_pool_allocator(allocator);
+        break;
+    case CL_ALLOCATOR_TYPE_LINEAR:
+        deinit_linear_allocator(allocator);
+        break;
+    case CL_ALLOCATOR_TYPE_STACK:
+        deinit_stack_allocator(allocator);
+        break;
+    case CL_ALLOCATOR_TYPE_FREE_LIST:
+        deinit_freelist_allocator(allocator);
+        break;
+    case CL_ALLOCATOR_TYPE_PROXY:
+        if (proxy_mode(allocator) == CL_PROXY_MODE_TRACKING)
+            deinit_tracking_allocator(allocator);
+        else
+            deinit_proxy_allocator(allocator);
+        break;
+    case CL_ALLOCATOR_TYPE_GUARD:
+        deinit_guard_allocator(allocator);
+        break;
     default:
         break;
     }
@@ -57,6 +137,36 @@ void cl_allocator_destroy(cl_allocator_t *allocator)
     free(allocator);
 }
 
+cl_mem_marker_t cl_mem_mark(const cl_allocator_t *allocator)
+{
+    if (allocator == null)
+        return (cl_mem_marker_t){0};
+    switch (allocator->type)
+    {
+    case CL_ALLOCATOR_TYPE_LINEAR:
+        return linear_allocator_mark(allocator);
+    case CL_ALLOCATOR_TYPE_STACK:
+        return stack_allocator_mark(allocator);
+    default:
+        return (cl_mem_marker_t){0};
+    }
+}
+
+bool cl_mem_rollback(const cl_allocator_t *allocator, const cl_mem_marker_t marker)
+{
+    if (allocator == null)
+        return false;
+    switch (allocator->type)
+    {
+    case CL_ALLOCATOR_TYPE_LINEAR:
+        return linear_allocator_rollback(allocator, marker);
+    case CL_ALLOCATOR_TYPE_STACK:
+        return stack_allocator_rollback(allocator, marker);
+    default:
+        return false;
+    }
+}
+
 void *cl_mem_alloc(const cl_allocator_t *allocator, const u64 size)
 {
     if (allocator == null || allocator->alloc == null)
@@ -71,72 +181,127 @@ void *cl_mem_realloc(const cl_allocator_t *allocator, void *ptr, const u64 new_s
     return allocator->realloc(ptr, new_size, allocator->user_data);
 }
 
+void *cl_mem_alloc_at(const cl_allocator_t *allocator, const u64 size, const char *file, const i32 line)
+{
+    mem_call_site_file = file;
+    mem_call_site_line = line;
+    void *ptr = cl_mem_alloc(allocator, size);
+    mem_call_site_file = null;
+    return ptr;
+}
+
+void *cl_mem_realloc_at(const cl_allocator_t *allocator, void *ptr, const u64 new_size, const char *file,
+                        const i32 line)
+{
+    mem_call_site_file = file;
+    mem_call_site_line = line;
+    void *new_ptr = cl_mem_realloc(allocator, ptr, new_size);
+    mem_call_site_file = null;
+    return new_ptr;
+}
+
 void cl_mem_free(const cl_allocator_t *allocator, void *ptr)
 {
     if (allocator == null || allocator->free == null)
         return free(ptr);
     allocator->free(ptr, allocator->user_data);
 }
-void *cl_mem_aligned_alloc(cl_allocator_t *allocator, u64 alignment, u64 size)
+void *cl_mem_aligned_alloc(const cl_allocator_t *allocator, const u64 alignment, const u64 size)
 {
-    // Aligns the memory allocation to the specified alignment
-    // The alignment must be a power of 2
-    // The size must be a multiple of the alignment
-
-    if (allocator == null || allocator->alloc == null)
-        return null;
-
     if (alignment == 0 || (alignment & (alignment - 1)) != 0)
         return null;
 
-    if (size % alignment != 0)
+    if (allocator == null)
+        return platform_aligned_malloc(size, alignment);
+    if (allocator->aligned_alloc)
+        return allocator->aligned_alloc(size, alignment, allocator->user_data);
+    if (allocator->alloc == null)
         return null;
 
-    // Allocate memory with extra space for alignment
-    u64 total_size = size + alignment;
-    void *ptr = allocator->alloc(total_size, allocator->user_data);
+    // Allocators without a native path get the original pointer stored just below the aligned address
+    char *ptr = allocator->alloc(size + alignment + sizeof(void *), allocator->user_data);
     if (ptr == null)
         return null;
 
-        // Calculate the aligned memory address
-#ifdef _WIN32
-    void *aligned_ptr = (void *)(((uintptr_t)ptr + alignment - 1) & ~(alignment - 1));
-#else
-    void *aligned_ptr = null;
-    if (posix_memalign(&aligned_ptr, alignment, size) != 0)
-    {
-        allocator->free(ptr, allocator->user_data);
-        return null;
-    }
-#endif
-
-    // Store the original pointer before the aligned address
-    void **store_ptr = (void **)aligned_ptr - 1;
-    *store_ptr = ptr;
-
+    void **aligned_ptr = (void **)CL_MEMORY_ALIGN((uintptr_t)(ptr + sizeof(void *)), alignment);
+    aligned_ptr[-1] = ptr;
     return aligned_ptr;
 }
 
 void cl_mem_aligned_free(const cl_allocator_t *allocator, void *ptr)
 {
-    if (allocator == null || allocator->free == null)
+    if (ptr == null)
         return;
 
-    if (ptr == null)
+    if (allocator == null)
+    {
+        platform_aligned_free(ptr);
+        return;
+    }
+    if (allocator->aligned_alloc)
+    {
+        cl_mem_free(allocator, ptr);
+        return;
+    }
+    if (allocator->free == null)
         return;
 
     // Retrieve the original pointer before the aligned address
-    void **store_ptr = (void **)ptr - 1;
-    void *original_ptr = *store_ptr;
-
-    allocator->free(original_ptr, allocator->user_data);
+    allocator->free(((void **)ptr)[-1], allocator->user_data);
 }
 
+bool cl_mem_alloc_batch(const cl_allocator_t *allocator, const u64 size, const u64 count, void **out_ptrs)
+{
+    if (count == 0)
+        return true;
+    if (out_ptrs == null)
+        return false;
 
-void cl_mem_set(void *ptr, const int value, const u64 num) { memset(ptr, value, num); }
+    u64 done = 0;
+    if (allocator != null && allocator->alloc_batch != null)
+    {
+        done = allocator->alloc_batch(size, count, out_ptrs, allocator->user_data);
+    }
+    else
+    {
+        while (done < count && (out_ptrs[done] = cl_mem_alloc(allocator, size)) != null)
+            done++;
+    }
+    if (done == count)
+        return true;
 
-void cl_mem_copy(void *dest, const void *src, const u64 num) { memcpy(dest, src, num); }
+    // Hand back a partial batch so callers never have to track one
+    cl_mem_free_batch(allocator, out_ptrs, done);
+    memset(out_ptrs, 0, count * sizeof(void *));
+    return false;
+}
 
-void cl_mem_move(void *dest, const void *src, const u64 num) { memmove(dest, src, num); }
+void cl_mem_free_batch(const cl_allocator_t *allocator, void **ptrs, const u64 count)
+{
+    if (ptrs == null)
+        return;
 
-int cl_mem_compare(const void *ptr1, const void *ptr2, const u64 num) { return memcmp(ptr1, ptr2, num); }
+    // Native batch frees take a dense run, so nulls split the array into runs
+    u64 start = 0;
+    while (start < count)
+    {
+        if (ptrs[start] == null)
+        {
+            start++;
+            continue;
+        }
+        u64 end = start;
+        while (end < count && ptrs[end] != null)
+            end++;
+        if (allocator != null && allocator->free_batch != null)
+        {
+            allocator->free_batch(ptrs + start, end - start, allocator->user_data);
+        }
+        else
+        {
+            for (u64 i = start; i < end; i++)
+                cl_mem_free(allocator, ptrs[i]);
+        }
+        start = end;
+    }
+}
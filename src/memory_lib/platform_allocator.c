@@ -8,12 +8,14 @@
 
 #include <stdbool.h>
 #include <stdlib.h>
+#include <string.h>
 
 #ifdef CL_PLATFORM_WINDOWS
 #ifndef WIN32_LEAN_AND_MEAN
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
 #endif
+#include <malloc.h>
 #elif defined(CL_PLATFORM_APPLE) || defined(CL_PLATFORM_LINUX)
 #include <stdlib.h>
 #endif
@@ -63,14 +65,89 @@ static void platform_free(void *ptr, void *user_data)
 #endif
 }
 
+void *platform_aligned_malloc(u64 size, u64 alignment)
+{
+#ifdef _WIN32
+    return _aligned_malloc(size, alignment);
+#else
+    // posix_memalign wants at least pointer alignment
+    void *ptr = null;
+    if (posix_memalign(&ptr, alignment < sizeof(void *) ? sizeof(void *) : alignment, size) != 0)
+        return null;
+    return ptr;
+#endif
+}
+
+void platform_aligned_free(void *ptr)
+{
+#ifdef _WIN32
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+// With CL_ALLOCATOR_FLAG_ALIGN the platform allocator has no state besides the alignment, so user_data carries it
+static void *platform_flag_aligned_alloc(u64 size, void *user_data)
+{
+    return platform_aligned_malloc(size, (u64)(uintptr_t)user_data);
+}
+
+static void *platform_flag_aligned_realloc(void *ptr, u64 new_size, void *user_data)
+{
+    const u64 alignment = (u64)(uintptr_t)user_data;
+#ifdef _WIN32
+    return _aligned_realloc(ptr, new_size, alignment);
+#else
+    // realloc keeps the contents; only when it lands off alignment do they have to move once more
+    void *new_ptr = realloc(ptr, new_size);
+    if (new_ptr == null || ((uintptr_t)new_ptr & (alignment - 1)) == 0)
+        return new_ptr;
+
+    void *aligned = platform_aligned_malloc(new_size, alignment);
+    if (aligned)
+        memcpy(aligned, new_ptr, new_size);
+    free(new_ptr);
+    return aligned;
+#endif
+}
+
+#ifdef _WIN32
+static void platform_flag_aligned_free(void *ptr, void *user_data)
+{
+    (void)user_data; // Unused
+    _aligned_free(ptr);
+}
+#else
+static void *platform_aligned_alloc(u64 size, u64 alignment, void *user_data)
+{
+    (void)user_data; // Unused
+    return platform_aligned_malloc(size, alignment);
+}
+#endif
+
 bool init_platform_allocator(cl_allocator_t *allocator, const cl_allocator_config_t *config)
 {
     allocator->alloc = platform_alloc;
     allocator->realloc = platform_realloc;
     allocator->free = platform_free;
+#ifndef _WIN32
+    // HeapAlloc memory cannot be over-aligned in place, so Windows keeps the generic aligned path
+    allocator->aligned_alloc = platform_aligned_alloc;
+#endif
     allocator->type = CL_ALLOCATOR_TYPE_PLATFORM;
     allocator->flags = config->flags;
     allocator->user_data = config->user_data;
+
+    if (config->flags & CL_ALLOCATOR_FLAG_ALIGN)
+    {
+        allocator->alloc = platform_flag_aligned_alloc;
+        allocator->realloc = platform_flag_aligned_realloc;
+#ifdef _WIN32
+        allocator->free = platform_flag_aligned_free;
+#endif
+        allocator->user_data = (void *)(uintptr_t)mem_config_alignment(config, sizeof(void *));
+    }
     return true;
 }
 
@@ -0,0 +1,211 @@
+/**
+ * Created by jraynor on 8/3/2024.
+ */
+#include <stdlib.h>
+#include "allocator_internal.h"
+#include "clib/log_lib.h"
+#include "clib/memory_lib.h"
+#define POOL_DEFAULT_BLOCK_COUNT 64 // Blocks per slab when no count is configured
+#define POOL_MIN_ALIGNMENT 8
+#define POOL_MAX_NATURAL_ALIGNMENT 64 // Power-of-two block sizes get this much alignment without asking
+
+// Slabs are chained through a small footer behind their blocks, so the first block starts at the slab's
+// (aligned) base address; blocks themselves carry no header
+typedef struct pool_slab
+{
+    struct pool_slab *next;
+} pool_slab_t;
+
+typedef struct pool_allocator
+{
+    void *free_list; // Intrusive list threaded through the first word of each free block
+    pool_slab_t *slabs;
+    char *bump; // Next never-used block in the newest slab
+    char *bump_end;
+    u64 block_size;
+    u64 blocks_per_slab;
+    u64 alignment; // Every block is aligned to this
+    bool growable;
+    const cl_allocator_t *backing; // Slab source, platform memory when null
+} pool_allocator_t;
+
+static bool pool_add_slab(pool_allocator_t *pool)
+{
+    const u64 blocks_size = pool->block_size * pool->blocks_per_slab;
+    char *memory = pool->backing
+                       ? cl_mem_aligned_alloc(pool->backing, pool->alignment, blocks_size + sizeof(pool_slab_t))
+                       : platform_aligned_malloc(blocks_size + sizeof(pool_slab_t), pool->alignment);
+    if (memory == null)
+    {
+        cl_log_warn("Failed to allocate memory for pool slab");
+        return false;
+    }
+
+    pool_slab_t *slab = (pool_slab_t *)(memory + blocks_size);
+    slab->next = pool->slabs;
+    pool->slabs = slab;
+
+    // Blocks are handed out lazily from the bump range so a fresh slab is never touched up front
+    pool->bump = memory;
+    pool->bump_end = memory + blocks_size;
+    return true;
+}
+
+static void *pool_alloc(u64 size, void *user_data)
+{
+    pool_allocator_t *pool = (pool_allocator_t *)user_data;
+
+    if (size > pool->block_size)
+        return null;
+
+    if (pool->free_list)
+    {
+        void *block = pool->free_list;
+        pool->free_list = *(void **)block;
+        return block;
+    }
+
+    if (pool->bump == pool->bump_end)
+    {
+        if (!pool->growable || !pool_add_slab(pool))
+            return null;
+    }
+
+    void *block = pool->bump;
+    pool->bump += pool->block_size;
+    return block;
+}
+
+static void *pool_aligned_alloc(u64 size, u64 alignment, void *user_data)
+{
+    // Alignment is a property of the whole pool, a stricter request cannot be met by any block
+    const pool_allocator_t *pool = (const pool_allocator_t *)user_data;
+    if (alignment > pool->alignment)
+        return null;
+    return pool_alloc(size, user_data);
+}
+
+static void pool_free(void *ptr, void *user_data)
+{
+    pool_allocator_t *pool = (pool_allocator_t *)user_data;
+    if (ptr == null)
+        return;
+
+    *(void **)ptr = pool->free_list;
+    pool->free_list = ptr;
+}
+
+static u64 pool_alloc_batch(u64 size, u64 count, void **out_ptrs, void *user_data)
+{
+    pool_allocator_t *pool = (pool_allocator_t *)user_data;
+    if (size > pool->block_size)
+        return 0;
+
+    u64 done = 0;
+    void *block = pool->free_list;
+    while (done < count && block)
+    {
+        out_ptrs[done++] = block;
+        block = *(void **)block;
+    }
+    pool->free_list = block;
+
+    while (done < count)
+    {
+        if (pool->bump == pool->bump_end && (!pool->growable || !pool_add_slab(pool)))
+            break;
+        out_ptrs[done++] = pool->bump;
+        pool->bump += pool->block_size;
+    }
+    return done;
+}
+
+static void pool_free_batch(void **ptrs, u64 count, void *user_data)
+{
+    pool_allocator_t *pool = (pool_allocator_t *)user_data;
+    for (u64 i = 0; i < count; i++)
+    {
+        *(void **)ptrs[i] = pool->free_list;
+        pool->free_list = ptrs[i];
+    }
+}
+
+static void *pool_realloc(void *ptr, u64 new_size, void *user_data)
+{
+    // Every block has the same capacity, so realloc either fits in place or cannot be satisfied
+    pool_allocator_t *pool = (pool_allocator_t *)user_data;
+    if (ptr == null)
+        return pool_alloc(new_size, user_data);
+    if (new_size == 0)
+    {
+        pool_free(ptr, user_data);
+        return null;
+    }
+    return new_size <= pool->block_size ? ptr : null;
+}
+
+bool init_pool_allocator(cl_allocator_t *allocator, const cl_allocator_config_t *config)
+{
+    if (config->config.pool.block_size == 0)
+        return false;
+
+    pool_allocator_t *pool = malloc(sizeof(pool_allocator_t));
+    if (!pool)
+        return false;
+
+    // Every block must be able to hold the free list link
+    u64 block_size = config->config.pool.block_size;
+    if (block_size < sizeof(void *))
+        block_size = sizeof(void *);
+
+    pool->free_list = null;
+    pool->slabs = null;
+    pool->bump = null;
+    pool->bump_end = null;
+    // Blocks are laid out back to back, so rounding their size to the alignment keeps every one of them aligned
+    pool->alignment = mem_config_alignment(config, POOL_MIN_ALIGNMENT);
+    pool->block_size = CL_MEMORY_ALIGN(block_size, pool->alignment);
+    while (pool->alignment < POOL_MAX_NATURAL_ALIGNMENT && (pool->block_size & pool->alignment) == 0)
+        pool->alignment <<= 1;
+    pool->blocks_per_slab =
+        config->config.pool.block_count > 0 ? config->config.pool.block_count : POOL_DEFAULT_BLOCK_COUNT;
+    pool->growable = (config->flags & CL_ALLOCATOR_FLAG_GROWABLE) != 0;
+    pool->backing = config->config.pool.allocator;
+
+    if (!pool_add_slab(pool))
+    {
+        free(pool);
+        return false;
+    }
+
+    allocator->alloc = pool_alloc;
+    allocator->realloc = pool_realloc;
+    allocator->free = pool_free;
+    allocator->aligned_alloc = pool_aligned_alloc;
+    allocator->alloc_batch = pool_alloc_batch;
+    allocator->free_batch = pool_free_batch;
+    allocator->type = CL_ALLOCATOR_TYPE_POOL;
+    allocator->flags = config->flags;
+    allocator->user_data = pool;
+
+    return true;
+}
+
+void deinit_pool_allocator(const cl_allocator_t *allocator)
+{
+    pool_allocator_t *pool = (pool_allocator_t *)allocator->user_data;
+    pool_slab_t *slab = pool->slabs;
+
+    while (slab)
+    {
+        pool_slab_t *next = slab->next;
+        char *memory = (char *)slab - pool->block_size * pool->blocks_per_slab;
+        if (pool->backing)
+            cl_mem_aligned_free(pool->backing, memory);
+        else
+            platform_aligned_free(memory);
+        slab = next;
+    }
+
+    free(pool);
+}
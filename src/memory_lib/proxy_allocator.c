@@ -0,0 +1,378 @@
+/**
+ * Created by jraynor on 8/3/2024.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "allocator_internal.h"
+#include "clib/log_lib.h"
+#include "clib/memory_lib.h"
+#define PROXY_CLASS_COUNT 40
+#define PROXY_MAX_CLASS_SIZE (32 * 1024) // larger requests bypass the thread caches
+#define PROXY_LARGE_CLASS 0xFFFFFFFFu
+#define PROXY_DEFAULT_CACHE_SIZE 64 // blocks per size class and thread
+#define PROXY_MIN_CACHE_SIZE 4
+#define PROXY_CACHE_BYTES (256 * 1024) // per size class and thread, caps the magazines of the large classes
+#define PROXY_MAX_INSTANCES 64
+#define PROXY_ALIGNMENT 16 // Guaranteed for every block; stricter requests take the large path
+
+// Every block carries its size class so any thread can return it to the right magazine
+typedef struct proxy_header
+{
+    u32 size_class;
+    u32 offset; // Distance from the backing allocation to the payload for over-aligned blocks, 0 otherwise
+    u64 size;
+} proxy_header_t;
+
+// A stack of free blocks of a single size class, owned by one thread
+typedef struct proxy_magazine
+{
+    u32 count;
+    u32 capacity;
+    proxy_header_t **blocks;
+} proxy_magazine_t;
+
+typedef struct proxy_thread_cache
+{
+    struct proxy_thread_cache *next; // Every cache of the proxy, so destroy can drain them
+    proxy_magazine_t magazines[PROXY_CLASS_COUNT];
+} proxy_thread_cache_t;
+
+typedef struct proxy_allocator
+{
+    cl_proxy_mode_t mode;
+    const cl_allocator_t *backing;
+    bool backing_locked; // Only the platform allocator is safe to call from several threads at once
+    bool backing_resizes; // Whether the backing realloc may be used on large blocks without losing alignment
+    mem_spinlock_t backing_lock;
+    mem_spinlock_t caches_lock;
+    proxy_thread_cache_t *caches;
+    u32 cache_size;
+    u32 instance;
+    u64 id;
+    u64 alignment;
+} proxy_allocator_t;
+
+// Threads find their cache through the proxy's instance slot; the id tells a live proxy from a destroyed one
+typedef struct proxy_tls_slot
+{
+    u64 id;
+    proxy_thread_cache_t *cache;
+} proxy_tls_slot_t;
+
+static CL_THREAD_LOCAL proxy_tls_slot_t proxy_tls_slots[PROXY_MAX_INSTANCES];
+static atomic_ullong proxy_instances[PROXY_MAX_INSTANCES];
+static atomic_ullong proxy_next_id = 1;
+
+// Classes step by 16 bytes up to 128, then by a quarter of the power of two below them
+static inline u32 proxy_size_class(u64 size)
+{
+    if (size <= 128)
+        return size == 0 ? 0 : (u32)((size - 1) / 16);
+    const u32 shift = 63 - __builtin_clzll(size - 1);
+    const u64 base = 1ull << shift;
+    return 8 + (shift - 7) * 4 + (u32)((size - base - 1) / (base / 4));
+}
+
+static inline u64 proxy_class_size(u32 size_class)
+{
+    if (size_class < 8)
+        return (size_class + 1) * 16;
+    const u32 step = size_class - 8;
+    const u64 base = 1ull << (7 + step / 4);
+    return base + (step % 4 + 1) * (base / 4);
+}
+
+static inline void proxy_backing_lock(proxy_allocator_t *proxy)
+{
+    if (proxy->backing_locked)
+        mem_spinlock_lock(&proxy->backing_lock);
+}
+
+static inline void proxy_backing_unlock(proxy_allocator_t *proxy)
+{
+    if (proxy->backing_locked)
+        mem_spinlock_unlock(&proxy->backing_lock);
+}
+
+static proxy_thread_cache_t *proxy_create_thread_cache(proxy_allocator_t *proxy)
+{
+    u64 total = 0;
+    u32 capacities[PROXY_CLASS_COUNT];
+    for (u32 i = 0; i < PROXY_CLASS_COUNT; i++)
+    {
+        const u64 by_bytes = PROXY_CACHE_BYTES / proxy_class_size(i);
+        capacities[i] = by_bytes < proxy->cache_size ? (u32)by_bytes : proxy->cache_size;
+        if (capacities[i] < PROXY_MIN_CACHE_SIZE)
+            capacities[i] = PROXY_MIN_CACHE_SIZE;
+        total += capacities[i];
+    }
+
+    // One allocation holds the cache and every magazine's slots
+    proxy_thread_cache_t *cache = malloc(sizeof(proxy_thread_cache_t) + total * sizeof(proxy_header_t *));
+    if (cache == null)
+    {
+        cl_log_warn("Failed to allocate thread cache for proxy allocator");
+        return null;
+    }
+
+    proxy_header_t **slots = (proxy_header_t **)(cache + 1);
+    for (u32 i = 0; i < PROXY_CLASS_COUNT; i++)
+    {
+        cache->magazines[i].count = 0;
+        cache->magazines[i].capacity = capacities[i];
+        cache->magazines[i].blocks = slots;
+        slots += capacities[i];
+    }
+
+    mem_spinlock_lock(&proxy->caches_lock);
+    cache->next = proxy->caches;
+    proxy->caches = cache;
+    mem_spinlock_unlock(&proxy->caches_lock);
+    return cache;
+}
+
+static inline proxy_thread_cache_t *proxy_thread_cache(proxy_allocator_t *proxy)
+{
+    proxy_tls_slot_t *slot = &proxy_tls_slots[proxy->instance];
+    if (slot->id != proxy->id)
+    {
+        // First use on this thread; a stale slot belonged to a destroyed proxy that already freed its cache
+        proxy_thread_cache_t *cache = proxy_create_thread_cache(proxy);
+        if (cache == null)
+            return null;
+        slot->id = proxy->id;
+        slot->cache = cache;
+    }
+    return slot->cache;
+}
+
+static bool proxy_refill(proxy_allocator_t *proxy, proxy_magazine_t *magazine, u32 size_class)
+{
+    const u64 block_size = sizeof(proxy_header_t) + proxy_class_size(size_class);
+    const u32 batch = magazine->capacity / 2 > 0 ? magazine->capacity / 2 : 1;
+
+    proxy_backing_lock(proxy);
+    while (magazine->count < batch)
+    {
+        proxy_header_t *header = cl_mem_aligned_alloc(proxy->backing, PROXY_ALIGNMENT, block_size);
+        if (header == null)
+            break;
+        header->size_class = size_class;
+        header->offset = 0;
+        magazine->blocks[magazine->count++] = header;
+    }
+    proxy_backing_unlock(proxy);
+    return magazine->count > 0;
+}
+
+static void proxy_flush(proxy_allocator_t *proxy, proxy_magazine_t *magazine, u32 count)
+{
+    // Hand back the coldest blocks at the bottom of the stack and keep the recently freed ones
+    proxy_backing_lock(proxy);
+    for (u32 i = 0; i < count; i++)
+        cl_mem_aligned_free(proxy->backing, magazine->blocks[i]);
+    proxy_backing_unlock(proxy);
+
+    magazine->count -= count;
+    memmove(magazine->blocks, magazine->blocks + count, magazine->count * sizeof(proxy_header_t *));
+}
+
+static void *proxy_alloc_large(proxy_allocator_t *proxy, u64 size, u64 alignment)
+{
+    // Over-aligned payloads sit a whole alignment into the backing block so the header fits in front of them
+    const u64 offset = alignment > PROXY_ALIGNMENT ? alignment : sizeof(proxy_header_t);
+    if (offset > UINT32_MAX)
+        return null;
+
+    proxy_backing_lock(proxy);
+    char *memory = cl_mem_aligned_alloc(proxy->backing, alignment, offset + size);
+    proxy_backing_unlock(proxy);
+    if (memory == null)
+        return null;
+
+    proxy_header_t *header = (proxy_header_t *)(memory + offset) - 1;
+    header->size_class = PROXY_LARGE_CLASS;
+    header->offset = alignment > PROXY_ALIGNMENT ? (u32)offset : 0;
+    header->size = size;
+    return header + 1;
+}
+
+static void *proxy_alloc(u64 size, void *user_data)
+{
+    proxy_allocator_t *proxy = (proxy_allocator_t *)user_data;
+    if (size > PROXY_MAX_CLASS_SIZE || proxy->alignment > PROXY_ALIGNMENT)
+        return proxy_alloc_large(proxy, size, proxy->alignment);
+
+    proxy_thread_cache_t *cache = proxy_thread_cache(proxy);
+    if (cache == null)
+        return null;
+
+    const u32 size_class = proxy_size_class(size);
+    proxy_magazine_t *magazine = &cache->magazines[size_class];
+    if (magazine->count == 0 && !proxy_refill(proxy, magazine, size_class))
+        return null;
+
+    proxy_header_t *header = magazine->blocks[--magazine->count];
+    header->size = size;
+    return header + 1;
+}
+
+static void *proxy_aligned_alloc(u64 size, u64 alignment, void *user_data)
+{
+    proxy_allocator_t *proxy = (proxy_allocator_t *)user_data;
+    if (alignment <= PROXY_ALIGNMENT)
+        return proxy_alloc(size, user_data);
+    return proxy_alloc_large(proxy, size, alignment > proxy->alignment ? alignment : proxy->alignment);
+}
+
+static void proxy_free(void *ptr, void *user_data)
+{
+    proxy_allocator_t *proxy = (proxy_allocator_t *)user_data;
+    if (ptr == null)
+        return;
+
+    proxy_header_t *header = (proxy_header_t *)ptr - 1;
+    proxy_thread_cache_t *cache = header->size_class == PROXY_LARGE_CLASS ? null : proxy_thread_cache(proxy);
+    if (cache == null)
+    {
+        char *memory = header->offset ? (char *)ptr - header->offset : (char *)header;
+        proxy_backing_lock(proxy);
+        cl_mem_aligned_free(proxy->backing, memory);
+        proxy_backing_unlock(proxy);
+        return;
+    }
+
+    // Blocks freed on another thread than the one that allocated them simply join this thread's cache
+    proxy_magazine_t *magazine = &cache->magazines[header->size_class];
+    if (magazine->count == magazine->capacity)
+        proxy_flush(proxy, magazine, magazine->capacity / 2 > 0 ? magazine->capacity / 2 : 1);
+    magazine->blocks[magazine->count++] = header;
+}
+
+static void *proxy_realloc(void *ptr, u64 new_size, void *user_data)
+{
+    proxy_allocator_t *proxy = (proxy_allocator_t *)user_data;
+    if (ptr == null)
+        return proxy_alloc(new_size, user_data);
+
+    proxy_header_t *header = (proxy_header_t *)ptr - 1;
+    const u64 old_size = header->size;
+
+    // Anything that still fits the block's size class stays where it is
+    if (header->size_class != PROXY_LARGE_CLASS && new_size <= proxy_class_size(header->size_class))
+    {
+        header->size = new_size;
+        return ptr;
+    }
+
+    // Large blocks stay large, so the backing allocator can resize them itself
+    if (header->size_class == PROXY_LARGE_CLASS && header->offset == 0 && new_size > PROXY_MAX_CLASS_SIZE &&
+        proxy->backing_resizes)
+    {
+        proxy_backing_lock(proxy);
+        proxy_header_t *new_header = cl_mem_realloc(proxy->backing, header, sizeof(proxy_header_t) + new_size);
+        proxy_backing_unlock(proxy);
+        if (new_header == null)
+            return null;
+        new_header->size = new_size;
+        return new_header + 1;
+    }
+
+    void *new_ptr = proxy_alloc(new_size, user_data);
+    if (new_ptr)
+    {
+        memcpy(new_ptr, ptr, new_size < old_size ? new_size : old_size);
+        proxy_free(ptr, user_data);
+    }
+    return new_ptr;
+}
+
+bool init_proxy_allocator(cl_allocator_t *allocator, const cl_allocator_config_t *config)
+{
+    proxy_allocator_t *proxy = malloc(sizeof(proxy_allocator_t));
+    if (!proxy)
+        return false;
+
+    // Claim an instance slot so threads can index their caches without a lookup table
+    const u64 id = atomic_fetch_add(&proxy_next_id, 1);
+    proxy->instance = PROXY_MAX_INSTANCES;
+    for (u32 i = 0; i < PROXY_MAX_INSTANCES; i++)
+    {
+        unsigned long long expected = 0;
+        if (atomic_compare_exchange_strong(&proxy_instances[i], &expected, id))
+        {
+            proxy->instance = i;
+            break;
+        }
+    }
+    if (proxy->instance == PROXY_MAX_INSTANCES)
+    {
+        cl_log_warn("Too many proxy allocators alive, the limit is %d", PROXY_MAX_INSTANCES);
+        free(proxy);
+        return false;
+    }
+
+    proxy->mode = CL_PROXY_MODE_THREAD_CACHE;
+    proxy->backing = config->config.proxy.allocator;
+    proxy->backing_locked = proxy->backing != null && proxy->backing->type != CL_ALLOCATOR_TYPE_PLATFORM;
+#ifdef CL_PLATFORM_WINDOWS
+    proxy->backing_resizes = false;
+#else
+    // Platform reallocs keep malloc's 16-byte alignment and accept posix_memalign blocks
+    proxy->backing_resizes = proxy->backing == null || proxy->backing->type == CL_ALLOCATOR_TYPE_PLATFORM;
+#endif
+    proxy->alignment = mem_config_alignment(config, PROXY_ALIGNMENT);
+    atomic_init(&proxy->backing_lock.locked, false);
+    atomic_init(&proxy->caches_lock.locked, false);
+    proxy->caches = null;
+    proxy->cache_size =
+        config->config.proxy.cache_size > 0 ? (u32)config->config.proxy.cache_size : PROXY_DEFAULT_CACHE_SIZE;
+    if (proxy->cache_size < PROXY_MIN_CACHE_SIZE)
+        proxy->cache_size = PROXY_MIN_CACHE_SIZE;
+    proxy->id = id;
+
+    allocator->alloc = proxy_alloc;
+    allocator->realloc = proxy_realloc;
+    allocator->free = proxy_free;
+    allocator->aligned_alloc = proxy_aligned_alloc;
+    allocator->type = CL_ALLOCATOR_TYPE_PROXY;
+    allocator->flags = config->flags;
+    allocator->user_data = proxy;
+
+    return true;
+}
+
+void deinit_proxy_allocator(const cl_allocator_t *allocator)
+{
+    proxy_allocator_t *proxy = (proxy_allocator_t *)allocator->user_data;
+
+    // Caches of threads that have exited are still here; drain all of them into the backing allocator
+    proxy_thread_cache_t *cache = proxy->caches;
+    while (cache)
+    {
+        proxy_thread_cache_t *next = cache->next;
+        for (u32 i = 0; i < PROXY_CLASS_COUNT; i++)
+            proxy_flush(proxy, &cache->magazines[i], cache->magazines[i].count);
+        free(cache);
+        cache = next;
+    }
+
+    atomic_store(&proxy_instances[proxy->instance], 0);
+    free(proxy);
+}
+
+bool cl_proxy_flush_thread_cache(const cl_allocator_t *allocator)
+{
+    if (allocator == null || allocator->type != CL_ALLOCATOR_TYPE_PROXY ||
+        proxy_mode(allocator) != CL_PROXY_MODE_THREAD_CACHE)
+        return false;
+
+    proxy_allocator_t *proxy = (proxy_allocator_t *)allocator->user_data;
+    const proxy_tls_slot_t *slot = &proxy_tls_slots[proxy->instance];
+    if (slot->id != proxy->id)
+        return true;
+
+    for (u32 i = 0; i < PROXY_CLASS_COUNT; i++)
+        proxy_flush(proxy, &slot->cache->magazines[i], slot->cache->magazines[i].count);
+    return true;
+}
@@ -0,0 +1,171 @@
+/**
+ * Created by jraynor on 8/3/2024.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "allocator_internal.h"
+#include "clib/log_lib.h"
+#include "clib/memory_lib.h"
+#define STACK_DEFAULT_SIZE (64 * 1024) // 64 KB default region size
+#define STACK_ALIGNMENT 8
+
+// Written just below every allocation so popping it restores the exact previous state
+typedef struct stack_header
+{
+    u64 prev_offset;
+    u64 prev_top;
+} stack_header_t;
+
+typedef struct stack_allocator
+{
+    char *start;
+    u64 size;
+    u64 offset; // First free byte
+    u64 top; // Payload offset of the top allocation, 0 when the stack is empty
+    u64 alignment;
+    bool owns_memory;
+} stack_allocator_t;
+
+static void *stack_alloc_aligned(stack_allocator_t *stack, u64 size, u64 alignment)
+{
+    // The header sits directly below the payload, whatever padding the alignment needs goes below the header
+    const uintptr_t address =
+        CL_MEMORY_ALIGN((uintptr_t)(stack->start + stack->offset + sizeof(stack_header_t)), alignment);
+    const u64 payload = (u64)(address - (uintptr_t)stack->start);
+    if (size > stack->size || payload > stack->size - size)
+        return null;
+
+    stack_header_t *header = (stack_header_t *)(stack->start + payload - sizeof(stack_header_t));
+    header->prev_offset = stack->offset;
+    header->prev_top = stack->top;
+
+    stack->top = payload;
+    stack->offset = payload + size;
+    return stack->start + payload;
+}
+
+static void *stack_alloc(u64 size, void *user_data)
+{
+    stack_allocator_t *stack = (stack_allocator_t *)user_data;
+    return stack_alloc_aligned(stack, size, stack->alignment);
+}
+
+static void *stack_aligned_alloc(u64 size, u64 alignment, void *user_data)
+{
+    stack_allocator_t *stack = (stack_allocator_t *)user_data;
+    return stack_alloc_aligned(stack, size, alignment > stack->alignment ? alignment : stack->alignment);
+}
+
+static void stack_free(void *ptr, void *user_data)
+{
+    stack_allocator_t *stack = (stack_allocator_t *)user_data;
+    if (ptr == null)
+        return;
+
+    if ((char *)ptr != stack->start + stack->top || stack->top == 0)
+    {
+        cl_log_warn("Stack allocator can only free its top allocation");
+        return;
+    }
+
+    const stack_header_t *header = (const stack_header_t *)((char *)ptr - sizeof(stack_header_t));
+    stack->offset = header->prev_offset;
+    stack->top = header->prev_top;
+}
+
+static void *stack_realloc(void *ptr, u64 new_size, void *user_data)
+{
+    stack_allocator_t *stack = (stack_allocator_t *)user_data;
+    if (ptr == null)
+        return stack_alloc(new_size, user_data);
+
+    const u64 ptr_offset = (u64)((char *)ptr - stack->start);
+
+    // The top allocation can grow or shrink in place
+    if (ptr_offset == stack->top && stack->top != 0)
+    {
+        if (new_size > stack->size - ptr_offset)
+            return null;
+        stack->offset = ptr_offset + new_size;
+        return ptr;
+    }
+
+    // Anything below the top has to move; nothing past the current offset is live, so that bounds the copy
+    const u64 available = stack->offset - ptr_offset;
+    void *new_ptr = stack_alloc(new_size, user_data);
+    if (new_ptr)
+        memcpy(new_ptr, ptr, new_size < available ? new_size : available);
+    return new_ptr;
+}
+
+bool init_stack_allocator(cl_allocator_t *allocator, const cl_allocator_config_t *config)
+{
+    stack_allocator_t *stack = malloc(sizeof(stack_allocator_t));
+    if (!stack)
+        return false;
+
+    char *start = config->config.stack.start;
+    u64 size = config->config.stack.size;
+    if (start != null && config->config.stack.end != null)
+        size = (u64)((char *)config->config.stack.end - start);
+    if (size == 0)
+        size = STACK_DEFAULT_SIZE;
+
+    stack->owns_memory = start == null;
+    if (stack->owns_memory)
+    {
+        start = malloc(size);
+        if (start == null)
+        {
+            cl_log_warn("Failed to reserve memory for stack allocator");
+            free(stack);
+            return false;
+        }
+    }
+
+    stack->start = start;
+    stack->size = size;
+    stack->offset = 0;
+    stack->top = 0;
+    stack->alignment = mem_config_alignment(config, STACK_ALIGNMENT);
+
+    // Callers handing over a partially used buffer can tell us where the free space begins
+    const char *current = config->config.stack.current;
+    if (!stack->owns_memory && current != null && current >= start && current <= start + size)
+        stack->offset = (u64)(current - start);
+
+    allocator->alloc = stack_alloc;
+    allocator->realloc = stack_realloc;
+    allocator->free = stack_free;
+    allocator->aligned_alloc = stack_aligned_alloc;
+    allocator->type = CL_ALLOCATOR_TYPE_STACK;
+    allocator->flags = config->flags;
+    allocator->user_data = stack;
+
+    return true;
+}
+
+void deinit_stack_allocator(const cl_allocator_t *allocator)
+{
+    stack_allocator_t *stack = (stack_allocator_t *)allocator->user_data;
+    if (stack->owns_memory)
+        free(stack->start);
+    free(stack);
+}
+
+cl_mem_marker_t stack_allocator_mark(const cl_allocator_t *allocator)
+{
+    const stack_allocator_t *stack = (const stack_allocator_t *)allocator->user_data;
+    return (cl_mem_marker_t){.position = stack->offset, .last = stack->top};
+}
+
+bool stack_allocator_rollback(const cl_allocator_t *allocator, cl_mem_marker_t marker)
+{
+    stack_allocator_t *stack = (stack_allocator_t *)allocator->user_data;
+    if (marker.position > stack->offset)
+        return false;
+
+    stack->offset = marker.position;
+    stack->top = marker.last;
+    return true;
+}
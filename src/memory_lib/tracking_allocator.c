@@ -0,0 +1,387 @@
+/**
+ * Created by jraynor on 8/3/2024.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include "allocator_internal.h"
+#include "clib/log_lib.h"
+#include "clib/memory_lib.h"
+#define TRACKING_INITIAL_SITE_SLOTS 64
+
+// Written in front of every allocation so frees can be attributed without a lookup
+typedef struct tracking_header
+{
+    u64 size;
+    u32 site; // Index into the site list
+    u32 offset; // Distance from the backing allocation to the payload for over-aligned blocks, 0 otherwise
+} tracking_header_t;
+
+typedef struct tracking_allocator
+{
+    cl_proxy_mode_t mode;
+    const cl_allocator_t *backing;
+    mem_spinlock_t lock; // Guards the statistics only; the backing allocator keeps its own threading rules
+    cl_mem_stats_t stats;
+    u64 alignment; // Only set under CL_ALLOCATOR_FLAG_ALIGN, otherwise the backing allocator's alignment applies
+
+    // Sites are appended and never move, so headers can refer to them by index; entry 0 is the unknown site
+    cl_mem_site_stats_t *sites;
+    u32 site_count;
+    u32 site_capacity;
+
+    // Open-addressing index from (file, line) to site index + 1
+    u32 *site_slots;
+    u32 site_slot_count;
+} tracking_allocator_t;
+
+static inline u32 tracking_histogram_bucket(u64 size)
+{
+    if (size <= 1)
+        return 0;
+    const u32 bucket = 64 - __builtin_clzll(size - 1);
+    return bucket < CL_MEM_HISTOGRAM_BUCKETS ? bucket : CL_MEM_HISTOGRAM_BUCKETS - 1;
+}
+
+static inline u32 tracking_site_hash(const char *file, i32 line)
+{
+    u64 hash = (u64)(uintptr_t)file * 0x9E3779B97F4A7C15ull ^ (u64)(u32)line * 0xC2B2AE3D27D4EB4Full;
+    return (u32)(hash ^ (hash >> 32));
+}
+
+static bool tracking_grow_site_slots(tracking_allocator_t *tracking)
+{
+    const u32 slot_count = tracking->site_slot_count * 2;
+    u32 *slots = calloc(slot_count, sizeof(u32));
+    if (slots == null)
+        return false;
+
+    // Only the index is rebuilt; site numbers stored in live headers stay valid
+    for (u32 i = 1; i < tracking->site_count; i++)
+    {
+        u32 slot = tracking_site_hash(tracking->sites[i].file, tracking->sites[i].line) & (slot_count - 1);
+        while (slots[slot] != 0)
+            slot = (slot + 1) & (slot_count - 1);
+        slots[slot] = i + 1;
+    }
+
+    free(tracking->site_slots);
+    tracking->site_slots = slots;
+    tracking->site_slot_count = slot_count;
+    return true;
+}
+
+// Must be called with the lock held
+static u32 tracking_find_site(tracking_allocator_t *tracking, const char *file, i32 line)
+{
+    if (file == null)
+        return 0;
+
+    u32 slot = tracking_site_hash(file, line) & (tracking->site_slot_count - 1);
+    while (tracking->site_slots[slot] != 0)
+    {
+        const u32 index = tracking->site_slots[slot] - 1;
+        if (tracking->sites[index].file == file && tracking->sites[index].line == line)
+            return index;
+        slot = (slot + 1) & (tracking->site_slot_count - 1);
+    }
+
+    // New site; keep the index at most half full and fall back to the unknown site if memory runs out
+    if (tracking->site_count == tracking->site_capacity)
+    {
+        cl_mem_site_stats_t *sites = realloc(tracking->sites, tracking->site_capacity * 2 * sizeof(*sites));
+        if (sites == null)
+            return 0;
+        tracking->sites = sites;
+        tracking->site_capacity *= 2;
+    }
+    if ((tracking->site_count + 1) * 2 > tracking->site_slot_count)
+    {
+        if (!tracking_grow_site_slots(tracking))
+            return 0;
+        slot = tracking_site_hash(file, line) & (tracking->site_slot_count - 1);
+        while (tracking->site_slots[slot] != 0)
+            slot = (slot + 1) & (tracking->site_slot_count - 1);
+    }
+
+    const u32 index = tracking->site_count++;
+    tracking->sites[index] = (cl_mem_site_stats_t){.file = file, .line = line};
+    tracking->site_slots[slot] = index + 1;
+    return index;
+}
+
+static void tracking_record_alloc(tracking_allocator_t *tracking, tracking_header_t *header, u64 size)
+{
+    mem_spinlock_lock(&tracking->lock);
+    cl_mem_stats_t *stats = &tracking->stats;
+    stats->live_bytes += size;
+    if (stats->live_bytes > stats->peak_bytes)
+        stats->peak_bytes = stats->live_bytes;
+    stats->live_count++;
+    stats->total_allocations++;
+    stats->total_bytes += size;
+    stats->histogram[tracking_histogram_bucket(size)]++;
+
+    header->site = tracking_find_site(tracking, mem_call_site_file, mem_call_site_line);
+    cl_mem_site_stats_t *site = &tracking->sites[header->site];
+    site->allocations++;
+    site->total_bytes += size;
+    site->live_bytes += size;
+    site->live_count++;
+    mem_spinlock_unlock(&tracking->lock);
+}
+
+static void *tracking_alloc_aligned(tracking_allocator_t *tracking, u64 size, u64 alignment)
+{
+    // Over-aligned payloads sit a whole alignment into the backing block so the header fits in front of them
+    if (alignment > UINT32_MAX)
+        return null;
+    char *memory = cl_mem_aligned_alloc(tracking->backing, alignment, alignment + size);
+    if (memory == null)
+        return null;
+
+    tracking_header_t *header = (tracking_header_t *)(memory + alignment) - 1;
+    header->size = size;
+    header->offset = (u32)alignment;
+    tracking_record_alloc(tracking, header, size);
+    return header + 1;
+}
+
+static void *tracking_alloc(u64 size, void *user_data)
+{
+    tracking_allocator_t *tracking = (tracking_allocator_t *)user_data;
+    if (tracking->alignment > 0)
+        return tracking_alloc_aligned(tracking, size, tracking->alignment);
+
+    tracking_header_t *header = cl_mem_alloc(tracking->backing, sizeof(tracking_header_t) + size);
+    if (header == null)
+        return null;
+
+    header->size = size;
+    header->offset = 0;
+    tracking_record_alloc(tracking, header, size);
+    return header + 1;
+}
+
+static void *tracking_aligned_alloc(u64 size, u64 alignment, void *user_data)
+{
+    tracking_allocator_t *tracking = (tracking_allocator_t *)user_data;
+    if (alignment < sizeof(tracking_header_t))
+        alignment = sizeof(tracking_header_t);
+    return tracking_alloc_aligned(tracking, size, alignment > tracking->alignment ? alignment : tracking->alignment);
+}
+
+static void tracking_free(void *ptr, void *user_data)
+{
+    tracking_allocator_t *tracking = (tracking_allocator_t *)user_data;
+    if (ptr == null)
+        return;
+
+    tracking_header_t *header = (tracking_header_t *)ptr - 1;
+    mem_spinlock_lock(&tracking->lock);
+    tracking->stats.live_bytes -= header->size;
+    tracking->stats.live_count--;
+    tracking->stats.total_frees++;
+    tracking->sites[header->site].live_bytes -= header->size;
+    tracking->sites[header->site].live_count--;
+    mem_spinlock_unlock(&tracking->lock);
+
+    if (header->offset)
+        cl_mem_aligned_free(tracking->backing, (char *)ptr - header->offset);
+    else
+        cl_mem_free(tracking->backing, header);
+}
+
+static void *tracking_realloc(void *ptr, u64 new_size, void *user_data)
+{
+    tracking_allocator_t *tracking = (tracking_allocator_t *)user_data;
+    if (ptr == null)
+        return tracking_alloc(new_size, user_data);
+
+    tracking_header_t *header = (tracking_header_t *)ptr - 1;
+    const u64 old_size = header->size;
+
+    // Over-aligned blocks cannot go through the backing realloc, which knows nothing of the offset
+    if (header->offset)
+    {
+        void *new_ptr = tracking_alloc(new_size, user_data);
+        if (new_ptr)
+        {
+            memcpy(new_ptr, ptr, new_size < old_size ? new_size : old_size);
+            tracking_free(ptr, user_data);
+        }
+        return new_ptr;
+    }
+
+    tracking_header_t *new_header = cl_mem_realloc(tracking->backing, header, sizeof(tracking_header_t) + new_size);
+    if (new_header == null)
+        return null;
+    new_header->size = new_size;
+
+    // A resize stays attributed to the site that made the original allocation
+    mem_spinlock_lock(&tracking->lock);
+    cl_mem_stats_t *stats = &tracking->stats;
+    stats->live_bytes = stats->live_bytes - old_size + new_size;
+    if (stats->live_bytes > stats->peak_bytes)
+        stats->peak_bytes = stats->live_bytes;
+    stats->total_reallocations++;
+    if (new_size > old_size)
+        stats->total_bytes += new_size - old_size;
+    stats->histogram[tracking_histogram_bucket(new_size)]++;
+    cl_mem_site_stats_t *site = &tracking->sites[new_header->site];
+    site->live_bytes = site->live_bytes - old_size + new_size;
+    if (new_size > old_size)
+        site->total_bytes += new_size - old_size;
+    mem_spinlock_unlock(&tracking->lock);
+
+    return new_header + 1;
+}
+
+bool init_tracking_allocator(cl_allocator_t *allocator, const cl_allocator_config_t *config)
+{
+    tracking_allocator_t *tracking = malloc(sizeof(tracking_allocator_t));
+    if (!tracking)
+        return false;
+
+    tracking->sites = malloc(TRACKING_INITIAL_SITE_SLOTS / 2 * sizeof(cl_mem_site_stats_t));
+    tracking->site_slots = calloc(TRACKING_INITIAL_SITE_SLOTS, sizeof(u32));
+    if (tracking->sites == null || tracking->site_slots == null)
+    {
+        cl_log_warn("Failed to allocate call site table for tracking allocator");
+        free(tracking->sites);
+        free(tracking->site_slots);
+        free(tracking);
+        return false;
+    }
+
+    tracking->mode = CL_PROXY_MODE_TRACKING;
+    tracking->backing = config->config.proxy.allocator;
+    atomic_init(&tracking->lock.locked, false);
+    memset(&tracking->stats, 0, sizeof(tracking->stats));
+    tracking->alignment = mem_config_alignment(config, 0);
+    tracking->sites[0] = (cl_mem_site_stats_t){0};
+    tracking->site_count = 1;
+    tracking->site_capacity = TRACKING_INITIAL_SITE_SLOTS / 2;
+    tracking->site_slot_count = TRACKING_INITIAL_SITE_SLOTS;
+
+    allocator->alloc = tracking_alloc;
+    allocator->realloc = tracking_realloc;
+    allocator->free = tracking_free;
+    allocator->aligned_alloc = tracking_aligned_alloc;
+    allocator->type = CL_ALLOCATOR_TYPE_PROXY;
+    allocator->flags = config->flags;
+    allocator->user_data = tracking;
+
+    return true;
+}
+
+void deinit_tracking_allocator(const cl_allocator_t *allocator)
+{
+    tracking_allocator_t *tracking = (tracking_allocator_t *)allocator->user_data;
+    if (tracking->stats.live_count > 0)
+    {
+        cl_log_warn("Tracking allocator destroyed with %llu live allocations (%llu bytes)",
+                    (unsigned long long)tracking->stats.live_count, (unsigned long long)tracking->stats.live_bytes);
+    }
+
+    free(tracking->sites);
+    free(tracking->site_slots);
+    free(tracking);
+}
+
+static tracking_allocator_t *tracking_from(const cl_allocator_t *allocator)
+{
+    if (allocator == null || allocator->type != CL_ALLOCATOR_TYPE_PROXY ||
+        proxy_mode(allocator) != CL_PROXY_MODE_TRACKING)
+        return null;
+    return (tracking_allocator_t *)allocator->user_data;
+}
+
+bool cl_tracking_get_stats(const cl_allocator_t *allocator, cl_mem_stats_t *stats)
+{
+    tracking_allocator_t *tracking = tracking_from(allocator);
+    if (tracking == null || stats == null)
+        return false;
+
+    mem_spinlock_lock(&tracking->lock);
+    *stats = tracking->stats;
+    mem_spinlock_unlock(&tracking->lock);
+    return true;
+}
+
+static int tracking_compare_sites(const void *a, const void *b)
+{
+    const cl_mem_site_stats_t *site_a = a;
+    const cl_mem_site_stats_t *site_b = b;
+    if (site_a->allocations != site_b->allocations)
+        return site_a->allocations > site_b->allocations ? -1 : 1;
+    return site_a->total_bytes > site_b->total_bytes ? -1 : site_a->total_bytes < site_b->total_bytes;
+}
+
+u64 cl_tracking_get_sites(const cl_allocator_t *allocator, cl_mem_site_stats_t *sites, u64 capacity)
+{
+    tracking_allocator_t *tracking = tracking_from(allocator);
+    if (tracking == null || sites == null || capacity == 0)
+        return 0;
+
+    // Sort a snapshot so the lock is not held while ordering
+    mem_spinlock_lock(&tracking->lock);
+    const u32 count = tracking->site_count;
+    cl_mem_site_stats_t *snapshot = malloc(count * sizeof(cl_mem_site_stats_t));
+    if (snapshot != null)
+        memcpy(snapshot, tracking->sites, count * sizeof(cl_mem_site_stats_t));
+    mem_spinlock_unlock(&tracking->lock);
+    if (snapshot == null)
+        return 0;
+
+    qsort(snapshot, count, sizeof(cl_mem_site_stats_t), tracking_compare_sites);
+
+    // The unknown site only matters when it saw allocations
+    u64 written = 0;
+    for (u32 i = 0; i < count && written < capacity; i++)
+    {
+        if (snapshot[i].file == null && snapshot[i].allocations == 0)
+            continue;
+        sites[written++] = snapshot[i];
+    }
+    free(snapshot);
+    return written;
+}
+
+void cl_tracking_dump(const cl_allocator_t *allocator, u64 max_sites)
+{
+    cl_mem_stats_t stats;
+    if (!cl_tracking_get_stats(allocator, &stats))
+        return;
+
+    cl_log_info("Memory: %llu bytes live in %llu allocations, peak %llu bytes", (unsigned long long)stats.live_bytes,
+                (unsigned long long)stats.live_count, (unsigned long long)stats.peak_bytes);
+    cl_log_info("Memory: %llu allocations, %llu reallocations, %llu frees, %llu bytes requested",
+                (unsigned long long)stats.total_allocations, (unsigned long long)stats.total_reallocations,
+                (unsigned long long)stats.total_frees, (unsigned long long)stats.total_bytes);
+
+    for (u32 i = 0; i < CL_MEM_HISTOGRAM_BUCKETS; i++)
+    {
+        if (stats.histogram[i] == 0)
+            continue;
+        if (i == CL_MEM_HISTOGRAM_BUCKETS - 1)
+            cl_log_info("  > %llu bytes: %llu", 1ull << (i - 1), (unsigned long long)stats.histogram[i]);
+        else
+            cl_log_info("  <= %llu bytes: %llu", 1ull << i, (unsigned long long)stats.histogram[i]);
+    }
+
+    if (max_sites == 0)
+        return;
+    cl_mem_site_stats_t *sites = malloc(max_sites * sizeof(cl_mem_site_stats_t));
+    if (sites == null)
+        return;
+
+    const u64 count = cl_tracking_get_sites(allocator, sites, max_sites);
+    for (u64 i = 0; i < count; i++)
+    {
+        cl_log_info("  %s:%d: %llu allocations, %llu bytes requested, %llu bytes live in %llu allocations",
+                    sites[i].file ? sites[i].file : "<unknown>", sites[i].line,
+                    (unsigned long long)sites[i].allocations, (unsigned long long)sites[i].total_bytes,
+                    (unsigned long long)sites[i].live_bytes, (unsigned long long)sites[i].live_count);
+    }
+    free(sites);
+}
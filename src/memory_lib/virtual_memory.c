@@ -0,0 +1,98 @@
+/**
+ * Created by jraynor on 8/3/2024.
+ */
+#include "allocator_internal.h"
+#include "clib/defines.h"
+
+#ifdef CL_PLATFORM_WINDOWS
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <Windows.h>
+#else
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+u64 vm_page_size(void)
+{
+    static u64 page_size = 0;
+    if (page_size == 0)
+    {
+#ifdef CL_PLATFORM_WINDOWS
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        page_size = info.dwPageSize;
+#else
+        page_size = (u64)sysconf(_SC_PAGESIZE);
+#endif
+    }
+    return page_size;
+}
+
+void *vm_reserve(u64 size, u64 alignment)
+{
+#ifdef CL_PLATFORM_WINDOWS
+    // Reservations are already aligned to the 64 KB allocation granularity, larger alignments are best effort
+    (void)alignment;
+    return VirtualAlloc(null, size, MEM_RESERVE, PAGE_NOACCESS);
+#else
+    if (alignment <= vm_page_size())
+    {
+        void *ptr = mmap(null, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        return ptr == MAP_FAILED ? null : ptr;
+    }
+
+    // Over-reserve, then trim the unaligned head and the leftover tail
+    char *ptr = mmap(null, size + alignment, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (ptr == MAP_FAILED)
+        return null;
+    char *aligned = (char *)CL_MEMORY_ALIGN((uintptr_t)ptr, alignment);
+    if (aligned > ptr)
+        munmap(ptr, (size_t)(aligned - ptr));
+    if (aligned + size < ptr + size + alignment)
+        munmap(aligned + size, (size_t)(ptr + size + alignment - (aligned + size)));
+    return aligned;
+#endif
+}
+
+bool vm_commit(void *ptr, u64 size)
+{
+#ifdef CL_PLATFORM_WINDOWS
+    return VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE) != null;
+#else
+    return mprotect(ptr, size, PROT_READ | PROT_WRITE) == 0;
+#endif
+}
+
+void vm_decommit(void *ptr, u64 size)
+{
+#ifdef CL_PLATFORM_WINDOWS
+    VirtualFree(ptr, size, MEM_DECOMMIT);
+#else
+    // Hand the pages back to the kernel, then make stray accesses fault until they are committed again
+    madvise(ptr, size, MADV_DONTNEED);
+    mprotect(ptr, size, PROT_NONE);
+#endif
+}
+
+void vm_release(void *ptr, u64 size)
+{
+#ifdef CL_PLATFORM_WINDOWS
+    (void)size;
+    VirtualFree(ptr, 0, MEM_RELEASE);
+#else
+    munmap(ptr, size);
+#endif
+}
+
+void vm_advise_huge_pages(void *ptr, u64 size)
+{
+#if defined(CL_PLATFORM_LINUX) && defined(MADV_HUGEPAGE)
+    madvise(ptr, size, MADV_HUGEPAGE);
+#else
+    // Large pages are opt-in and privileged elsewhere, so this is only a hint where the kernel offers THP
+    (void)ptr;
+    (void)size;
+#endif
+}
@@ -2,6 +2,7 @@
 
 #include <stdio.h>
 #include <string.h>
+#define STR_SPLIT_BATCH 64 // Tokens allocated per cl_mem_alloc_batch call
 
 // String view functions
 str_view str_view_create(const char *data, u32 length) { return (str_view){length, data}; }
@@ -121,28 +122,65 @@ str str_concat(const cl_allocator_t *allocator, const str_view *s1, const str_vi
 str *str_split(const cl_allocator_t *allocator, const str_view *s, char delimiter)
 {
     u32 count = 1;
-    for (u32 i = 0; i < s->len; i++)
+    u32 max_len = 0;
+    u32 start = 0;
+    for (u32 i = 0; i <= s->len; i++)
     {
-        if (s->data[i] == delimiter)
+        if (i == s->len || s->data[i] == delimiter)
         {
-            count++;
+            if (i - start > max_len)
+                max_len = i - start;
+            if (i < s->len)
+                count++;
+            start = i + 1;
         }
     }
 
     str *result = cl_mem_alloc(allocator, (count + 1) * sizeof(str));
-    u32 start = 0;
+    if (result == null)
+        return null;
+
+    // Tokens of similar length all fit one size and are allocated in batches; a few long tokens among many
+    // short ones would waste too much that way, so those are allocated one by one
+    const bool batched = (u64)count * (max_len + 1) <= 2 * ((u64)s->len + count);
+    void *blocks[STR_SPLIT_BATCH];
+    u32 batch_size = 0;
+    u32 batch_next = 0;
     u32 index = 0;
+    start = 0;
 
-    for (u32 i = 0; i < s->len; i++)
+    for (u32 i = 0; i <= s->len; i++)
     {
-        if (s->data[i] == delimiter)
+        if (i < s->len && s->data[i] != delimiter)
+            continue;
+
+        if (!batched)
         {
             result[index++] = str_create(allocator, s->data + start, i - start);
             start = i + 1;
+            continue;
+        }
+
+        if (batch_next == batch_size)
+        {
+            batch_size = count - index < STR_SPLIT_BATCH ? count - index : STR_SPLIT_BATCH;
+            batch_next = 0;
+            if (!cl_mem_alloc_batch(allocator, max_len + 1, batch_size, blocks))
+            {
+                for (u32 j = 0; j < index; j++)
+                    str_destroy(allocator, &result[j]);
+                cl_mem_free(allocator, result);
+                return null;
+            }
         }
+        str *token = &result[index++];
+        token->len = i - start;
+        token->data = blocks[batch_next++];
+        cl_mem_copy(token->data, s->data + start, token->len);
+        token->data[token->len] = '\0';
+        start = i + 1;
     }
 
-    result[index++] = str_create(allocator, s->data + start, s->len - start);
     result[index] = (str){0, null}; // Null-terminate the array
     return result;
 }
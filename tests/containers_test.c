@@ -1,13 +1,33 @@
 // table_tests.c
 
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "clib/containers_lib.h"
+#include "clib/ht_define.h"
 #include "clib/test_lib.h"
+#include "clib/thread_lib.h"
 #include "clib/time_lib.h"
 
 #define TEST_ALLOCATOR null // Replace with your actual test allocator if needed
+#define TEST_HT_CHURN_KEYS 4096
+#define TEST_HT_CHURN_OPS 200000
+#define TEST_HT_CHURN_LIVE 2900 // Most of the table's growth allowance at 4096 slots
+#define TEST_HT_INCREMENTAL_KEYS 20000
+#define TEST_HT_BATCH_KEYS 10000
+#define TEST_HT_DEFINE_KEYS 4096
+#define TEST_HT_DEFINE_OPS 100000
+#define TEST_HT_PERFECT_KEYS 20000
+#define TEST_HT_SNAPSHOT_KEYS 5000
+#define TEST_HT_SNAPSHOT_FILE "test_ht_snapshot.bin"
+#define TEST_HT_SCAN_KEYS 10000
+#define TEST_HT_SCAN_BATCH 7
+#define TEST_CHT_THREADS 8
+#define TEST_CHT_KEYS_PER_THREAD 5000
+#define TEST_RMHT_READERS 4
+#define TEST_RMHT_STABLE_KEYS 1000 // Always present while the writer churns the rest
+#define TEST_RMHT_WRITES 20000
 
 // Helper function to generate random strings
 char *generate_random_string(int length)
@@ -195,6 +215,16 @@ static bool foreach_callback(void *key, u64 key_size, void *data, u64 data_size,
     return true;
 }
 
+static bool foreach_count_callback(void *key, u64 key_size, void *data, u64 data_size, void *arg)
+{
+    (void)key;
+    (void)key_size;
+    (void)data;
+    (void)data_size;
+    ((foreach_data_t *)arg)->count++;
+    return true;
+}
+
 CL_TEST(test_ht_foreach)
 {
     cl_ht_t *ht = cl_ht_create(TEST_ALLOCATOR);
@@ -323,6 +353,1126 @@ CL_TEST(test_ht_performance)
     cl_ht_destroy(ht);
 }
 
+CL_TEST(test_ht_group_probing)
+{
+    cl_ht_t *ht = cl_ht_create_with_flags(TEST_ALLOCATOR, CL_HT_FLAG_GROUP_PROBING);
+    CL_ASSERT(ht != null);
+    CL_ASSERT(cl_ht_get_flags(ht) & CL_HT_FLAG_GROUP_PROBING);
+
+    // The layout cannot be switched on a live table
+    CL_ASSERT(cl_ht_clear_flag(ht, CL_HT_FLAG_GROUP_PROBING) & CL_HT_FLAG_GROUP_PROBING);
+
+    const int num_entries = 10000;
+    bool all_valid = true;
+    for (int i = 0; i < num_entries; i++)
+    {
+        char key[16];
+        snprintf(key, sizeof(key), "key%d", i);
+        all_valid &= cl_ht_put(ht, key, strlen(key), (void *)(uintptr_t)(i + 1), sizeof(int), null);
+    }
+    CL_ASSERT(cl_ht_size(ht) == (u64)num_entries);
+
+    void *old_data = null;
+    CL_ASSERT(cl_ht_put(ht, "key7", 4, (void *)(uintptr_t)42, sizeof(int), &old_data));
+    CL_ASSERT(old_data == (void *)(uintptr_t)8);
+    CL_ASSERT(cl_ht_put(ht, "key7", 4, (void *)(uintptr_t)8, sizeof(int), null));
+
+    for (int i = 0; i < num_entries && all_valid; i++)
+    {
+        char key[16];
+        void *data = null;
+        snprintf(key, sizeof(key), "key%d", i);
+        all_valid &= cl_ht_get(ht, key, strlen(key), &data, null) && data == (void *)(uintptr_t)(i + 1);
+        snprintf(key, sizeof(key), "missing%d", i);
+        all_valid &= !cl_ht_exists(ht, key, strlen(key));
+    }
+    CL_ASSERT(all_valid);
+
+    foreach_data_t fd = {0, true};
+    CL_ASSERT(cl_ht_foreach(ht, foreach_count_callback, &fd) == (u64)num_entries);
+
+    for (int i = 0; i < num_entries; i += 2)
+    {
+        char key[16];
+        snprintf(key, sizeof(key), "key%d", i);
+        all_valid &= cl_ht_remove(ht, key, strlen(key)) == (void *)(uintptr_t)(i + 1);
+    }
+    CL_ASSERT(cl_ht_size(ht) == (u64)num_entries / 2);
+    CL_ASSERT(cl_ht_rehash(ht));
+    for (int i = 0; i < num_entries && all_valid; i++)
+    {
+        char key[16];
+        snprintf(key, sizeof(key), "key%d", i);
+        all_valid &= cl_ht_exists(ht, key, strlen(key)) == (i % 2 == 1);
+    }
+    CL_ASSERT(all_valid);
+
+    cl_ht_clear(ht);
+    CL_ASSERT(cl_ht_is_empty(ht));
+    CL_ASSERT(!cl_ht_exists(ht, "key1", 4));
+    cl_ht_destroy(ht);
+}
+
+CL_TEST(test_ht_group_probing_churn)
+{
+    cl_ht_t *ht = cl_ht_create_with_flags(TEST_ALLOCATOR, CL_HT_FLAG_GROUP_PROBING | CL_HT_FLAG_NOCOPY_KEYS);
+    static u64 keys[TEST_HT_CHURN_KEYS];
+    static bool present[TEST_HT_CHURN_KEYS];
+    for (u64 i = 0; i < TEST_HT_CHURN_KEYS; i++)
+        keys[i] = i * 0x9E3779B97F4A7C15ull;
+
+    // Fill, then freeze: steady insert/remove churn must then be absorbed by reusing tombstones and rebuilding in place
+    for (u64 i = 0; i < TEST_HT_CHURN_LIVE; i++)
+        present[i] = cl_ht_put(ht, &keys[i], sizeof(u64), &keys[i], sizeof(u64), null);
+    cl_ht_set_flag(ht, CL_HT_FLAG_FROZEN);
+
+    bool all_valid = true;
+    u64 live = TEST_HT_CHURN_LIVE;
+    u32 seed = 12345;
+    for (int i = 0; i < TEST_HT_CHURN_OPS && all_valid; i++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        const u64 k = (seed >> 8) % TEST_HT_CHURN_KEYS;
+        if (present[k])
+        {
+            all_valid &= cl_ht_remove(ht, &keys[k], sizeof(u64)) == &keys[k];
+            present[k] = false;
+            live--;
+        }
+        else if (live < TEST_HT_CHURN_LIVE)
+        {
+            all_valid &= cl_ht_put(ht, &keys[k], sizeof(u64), &keys[k], sizeof(u64), null);
+            present[k] = true;
+            live++;
+        }
+    }
+    CL_ASSERT(all_valid);
+    CL_ASSERT(cl_ht_size(ht) == live);
+
+    for (u64 i = 0; i < TEST_HT_CHURN_KEYS; i++)
+    {
+        void *data = null;
+        const bool found = cl_ht_get(ht, &keys[i], sizeof(u64), &data, null);
+        all_valid &= found == present[i] && (!found || data == &keys[i]);
+    }
+    CL_ASSERT(all_valid);
+    cl_ht_destroy(ht);
+}
+
+// Removes the entries whose data points at an odd index of the key array passed as arg
+static bool test_remove_odd_callback(void *key, u64 key_size, void *data, u64 data_size, void *arg)
+{
+    (void)key;
+    (void)key_size;
+    (void)data_size;
+    return ((u64 *)data - (u64 *)arg) % 2 == 1;
+}
+
+CL_TEST(test_ht_robin_hood_churn)
+{
+    cl_ht_t *ht = cl_ht_create_with_flags(TEST_ALLOCATOR, CL_HT_FLAG_NOCOPY_KEYS);
+    static u64 keys[TEST_HT_CHURN_KEYS];
+    static bool present[TEST_HT_CHURN_KEYS];
+    for (u64 i = 0; i < TEST_HT_CHURN_KEYS; i++)
+        keys[i] = i * 0x9E3779B97F4A7C15ull;
+
+    // Grow through several resizes, then churn: displacement on insert and backward shifts on remove keep every
+    // key reachable and probes short without tombstones
+    bool all_valid = true;
+    for (u64 i = 0; i < TEST_HT_CHURN_LIVE; i++)
+        all_valid &= present[i] = cl_ht_put(ht, &keys[i], sizeof(u64), &keys[i], sizeof(u64), null);
+    u32 seed = 54321;
+    for (int i = 0; i < TEST_HT_CHURN_OPS && all_valid; i++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        const u64 k = (seed >> 8) % TEST_HT_CHURN_KEYS;
+        if (present[k])
+            all_valid &= cl_ht_remove(ht, &keys[k], sizeof(u64)) == &keys[k];
+        else
+            all_valid &= cl_ht_put(ht, &keys[k], sizeof(u64), &keys[k], sizeof(u64), null);
+        present[k] = !present[k];
+    }
+    CL_ASSERT(all_valid);
+
+    u64 live = 0;
+    for (u64 i = 0; i < TEST_HT_CHURN_KEYS; i++)
+    {
+        void *data = null;
+        const bool found = cl_ht_get(ht, &keys[i], sizeof(u64), &data, null);
+        all_valid &= found == present[i] && (!found || data == &keys[i]);
+        live += present[i];
+    }
+    CL_ASSERT(all_valid);
+    CL_ASSERT(cl_ht_size(ht) == live);
+
+    u64 counts[8];
+    CL_ASSERT(cl_ht_probe_lengths(ht, counts, 8) < 32);
+    u64 counted = 0;
+    for (int i = 0; i < 8; i++)
+        counted += counts[i];
+    CL_ASSERT(counted == live);
+
+    // Removing while walking the slots must not skip the entries each removal shifts back
+    u64 odd = 0;
+    for (u64 i = 1; i < TEST_HT_CHURN_KEYS; i += 2)
+        odd += present[i];
+    CL_ASSERT(cl_ht_foreach_remove(ht, test_remove_odd_callback, null, keys) == odd);
+    for (u64 i = 0; i < TEST_HT_CHURN_KEYS; i++)
+        all_valid &= cl_ht_exists(ht, &keys[i], sizeof(u64)) == (present[i] && i % 2 == 0);
+    CL_ASSERT(all_valid);
+    CL_ASSERT(cl_ht_size(ht) == live - odd);
+    cl_ht_destroy(ht);
+}
+
+CL_TEST(test_ht_key_arena)
+{
+    cl_ht_t *ht = cl_ht_create_with_flags(TEST_ALLOCATOR, CL_HT_FLAG_KEY_ARENA | CL_HT_FLAG_GROUP_PROBING);
+    CL_ASSERT(ht != null);
+    // Storage cannot change while the table holds keys
+    CL_ASSERT(cl_ht_clear_flag(ht, CL_HT_FLAG_KEY_ARENA) & CL_HT_FLAG_KEY_ARENA);
+
+    // Key lengths cover every size class and the longer keys that still get their own allocation
+    char key[48];
+    bool all_valid = true;
+    for (int round = 0; round < 2; round++)
+    {
+        for (int i = 0; i < 4000; i++)
+        {
+            const int length = snprintf(key, sizeof(key), "%0*d", 1 + i % 40, i);
+            all_valid &= cl_ht_put(ht, key, length, (void *)(uintptr_t)(i + 1), sizeof(int), null);
+        }
+        for (int i = 0; i < 4000; i += 2)
+        {
+            const int length = snprintf(key, sizeof(key), "%0*d", 1 + i % 40, i);
+            all_valid &= cl_ht_remove(ht, key, length) == (void *)(uintptr_t)(i + 1);
+        }
+        for (int i = 0; i < 4000; i++)
+        {
+            void *data = null;
+            const int length = snprintf(key, sizeof(key), "%0*d", 1 + i % 40, i);
+            const bool found = cl_ht_get(ht, key, length, &data, null);
+            all_valid &= found == (i % 2 == 1) && (!found || data == (void *)(uintptr_t)(i + 1));
+        }
+        CL_ASSERT(all_valid);
+        CL_ASSERT(cl_ht_size(ht) == 2000);
+        // Frees the arena in bulk; the next round starts from fresh pools
+        cl_ht_clear(ht);
+        CL_ASSERT(!cl_ht_exists(ht, "1", 1));
+    }
+    cl_ht_destroy(ht);
+
+    // Key slabs come from the table's allocator, so a tracking proxy sees them arrive and go
+    cl_allocator_t *tracking =
+        cl_allocator_new(CL_ALLOCATOR_TYPE_PROXY, .config.proxy = {.mode = CL_PROXY_MODE_TRACKING});
+    ht = cl_ht_create_with_flags(tracking, CL_HT_FLAG_KEY_ARENA | CL_HT_FLAG_GROUP_PROBING);
+    CL_ASSERT(tracking != null && ht != null);
+    for (u64 i = 0; i < 4000; i++)
+        all_valid &= cl_ht_put(ht, &i, sizeof(i), null, 0, null);
+    CL_ASSERT(all_valid);
+    cl_mem_stats_t with_keys, cleared;
+    CL_ASSERT(cl_tracking_get_stats(tracking, &with_keys));
+    cl_ht_clear(ht);
+    CL_ASSERT(cl_tracking_get_stats(tracking, &cleared));
+    CL_ASSERT(with_keys.live_bytes - cleared.live_bytes >= 4000 * sizeof(u64));
+    cl_ht_destroy(ht);
+    CL_ASSERT(cl_tracking_get_stats(tracking, &cleared));
+    CL_ASSERT_EQUAL(cleared.live_count, 0);
+    cl_allocator_destroy(tracking);
+}
+
+CL_TEST(test_ht_batch_operations)
+{
+    static u64 keys[TEST_HT_BATCH_KEYS * 2];
+    static const void *key_ptrs[TEST_HT_BATCH_KEYS * 2];
+    static u64 key_sizes[TEST_HT_BATCH_KEYS * 2];
+    static void *data[TEST_HT_BATCH_KEYS * 2];
+    static bool found[TEST_HT_BATCH_KEYS * 2];
+    for (u64 i = 0; i < TEST_HT_BATCH_KEYS * 2; i++)
+    {
+        keys[i] = i * 0x9E3779B97F4A7C15ull;
+        key_ptrs[i] = &keys[i];
+        key_sizes[i] = sizeof(u64);
+        data[i] = &keys[i];
+    }
+
+    const cl_ht_flags_t layouts[] = {CL_HT_FLAG_NONE, CL_HT_FLAG_GROUP_PROBING};
+    for (u32 l = 0; l < sizeof(layouts) / sizeof(layouts[0]); l++)
+    {
+        cl_ht_t *ht = cl_ht_create_with_flags(TEST_ALLOCATOR, layouts[l]);
+        CL_ASSERT(ht != null);
+
+        // The second half of the keys is never stored, so every other chunk of the lookup misses
+        CL_ASSERT(cl_ht_put_batch(ht, key_ptrs, key_sizes, data, null, TEST_HT_BATCH_KEYS) == TEST_HT_BATCH_KEYS);
+        CL_ASSERT(cl_ht_size(ht) == TEST_HT_BATCH_KEYS);
+        static void *out_data[TEST_HT_BATCH_KEYS * 2];
+        CL_ASSERT(cl_ht_get_batch(ht, key_ptrs, key_sizes, TEST_HT_BATCH_KEYS * 2, out_data, found) ==
+                  TEST_HT_BATCH_KEYS);
+        bool all_valid = true;
+        for (u64 i = 0; i < TEST_HT_BATCH_KEYS * 2; i++)
+            all_valid &= found[i] == (i < TEST_HT_BATCH_KEYS) && out_data[i] == (found[i] ? &keys[i] : null);
+        CL_ASSERT(all_valid);
+
+        // Storing the same keys again only updates them
+        CL_ASSERT(cl_ht_put_batch(ht, key_ptrs, key_sizes, null, null, 100) == 100);
+        CL_ASSERT(cl_ht_size(ht) == TEST_HT_BATCH_KEYS);
+        CL_ASSERT(cl_ht_get_batch(ht, key_ptrs, key_sizes, 100, out_data, null) == 100);
+        CL_ASSERT(out_data[0] == null && out_data[99] == null);
+        CL_ASSERT(cl_ht_get_batch(ht, key_ptrs, key_sizes, 0, null, null) == 0);
+        cl_ht_destroy(ht);
+    }
+}
+
+static u64 test_constant_hash(const void *key, u64 length)
+{
+    (void)key;
+    (void)length;
+    return 42;
+}
+
+static bool test_count_callback(void *key, u64 key_size, void *data, u64 data_size, void *arg)
+{
+    (void)key;
+    (void)key_size;
+    (void)data;
+    (void)data_size;
+    (*(u64 *)arg)++;
+    return true;
+}
+
+CL_TEST(test_ht_freeze_perfect)
+{
+    static char keys[TEST_HT_PERFECT_KEYS * 2][16];
+    for (u64 i = 0; i < TEST_HT_PERFECT_KEYS * 2; i++)
+        snprintf(keys[i], sizeof(keys[i]), "symbol_%llu", (unsigned long long)i);
+
+    const cl_ht_flags_t layouts[] = {CL_HT_FLAG_NONE, CL_HT_FLAG_GROUP_PROBING | CL_HT_FLAG_KEY_ARENA};
+    for (u32 l = 0; l < sizeof(layouts) / sizeof(layouts[0]); l++)
+    {
+        // Every size up to a few buckets, then a table large enough for the seed search to work at it
+        bool all_valid = true;
+        for (u64 n = 1; n <= TEST_HT_PERFECT_KEYS; n = n == 40 ? TEST_HT_PERFECT_KEYS : n + 1)
+        {
+            cl_ht_t *ht = cl_ht_create_with_flags(TEST_ALLOCATOR, layouts[l]);
+            all_valid &= ht != null;
+            for (u64 i = 0; i < n && ht; i++)
+                all_valid &= cl_ht_put(ht, keys[i], strlen(keys[i]), keys[i], 0, null);
+            all_valid &= ht && cl_ht_freeze_perfect(ht) && cl_ht_size(ht) == n;
+            for (u64 i = 0; i < n * 2 && all_valid; i++)
+            {
+                void *data = null;
+                const bool found = cl_ht_get(ht, keys[i], strlen(keys[i]), &data, null);
+                all_valid &= found == (i < n) && data == (found ? keys[i] : null);
+            }
+            u64 visited = 0;
+            u64 counts[2] = {0};
+            all_valid &= all_valid && cl_ht_foreach(ht, test_count_callback, &visited) == n && visited == n;
+            all_valid &= all_valid && cl_ht_probe_lengths(ht, counts, 2) == 0 && counts[0] == n;
+            cl_ht_destroy(ht);
+        }
+        CL_ASSERT(all_valid);
+
+        // The key set is fixed: values can be replaced, but new keys and removals are refused
+        cl_ht_t *ht = cl_ht_create_with_flags(TEST_ALLOCATOR, layouts[l]);
+        CL_ASSERT(ht != null);
+        for (u64 i = 0; i < 100; i++)
+            cl_ht_put(ht, keys[i], strlen(keys[i]), keys[i], 0, null);
+        CL_ASSERT(cl_ht_freeze_perfect(ht));
+        CL_ASSERT(cl_ht_freeze_perfect(ht));
+        void *old = null;
+        CL_ASSERT(cl_ht_put(ht, keys[5], strlen(keys[5]), keys[6], 0, &old) && old == keys[5]);
+        CL_ASSERT(cl_ht_get_str(ht, keys[5]) == keys[6]);
+        CL_ASSERT(!cl_ht_put(ht, keys[100], strlen(keys[100]), keys[100], 0, null));
+        CL_ASSERT(cl_ht_remove(ht, keys[1], strlen(keys[1])) == null);
+        CL_ASSERT(cl_ht_size(ht) == 100 && !cl_ht_rehash(ht));
+
+        const void *batch[4] = {keys[0], keys[1], keys[99], keys[100]};
+        const u64 sizes[4] = {strlen(keys[0]), strlen(keys[1]), strlen(keys[99]), strlen(keys[100])};
+        CL_ASSERT(cl_ht_get_batch(ht, batch, sizes, 4, null, null) == 3);
+
+        // Clearing makes room for a fresh key set in the probing layout
+        cl_ht_clear(ht);
+        CL_ASSERT(cl_ht_size(ht) == 0 && !cl_ht_exists_str(ht, keys[0]));
+        CL_ASSERT(cl_ht_put(ht, keys[100], strlen(keys[100]), keys[100], 0, null));
+        CL_ASSERT(cl_ht_remove(ht, keys[100], strlen(keys[100])) == keys[100]);
+        cl_ht_destroy(ht);
+    }
+
+    // Keys that share a full hash cannot be told apart by any seed, so the table stays as it was
+    cl_ht_t *ht = cl_ht_create_with_flags(TEST_ALLOCATOR, CL_HT_FLAG_NONE);
+    CL_ASSERT(ht != null && cl_ht_set_hash_function(ht, test_constant_hash));
+    cl_ht_put_str(ht, keys[0], keys[0]);
+    cl_ht_put_str(ht, keys[1], keys[1]);
+    CL_ASSERT(!cl_ht_freeze_perfect(ht));
+    CL_ASSERT(cl_ht_get_str(ht, keys[1]) == keys[1] && cl_ht_remove_str(ht, keys[0]) == keys[0]);
+    cl_ht_destroy(ht);
+
+    ht = cl_ht_create_with_flags(TEST_ALLOCATOR, CL_HT_FLAG_NONE);
+    CL_ASSERT(ht != null && !cl_ht_freeze_perfect(ht));
+    cl_ht_destroy(ht);
+}
+
+CL_TEST(test_ht_snapshot)
+{
+    cl_allocator_t *allocator = cl_allocator_create(&(cl_allocator_config_t){.type = CL_ALLOCATOR_TYPE_PLATFORM});
+    cl_fs_t *fs = cl_fs_init(allocator, &(cl_fs_config_t){.type = CL_FS_TYPE_LOCAL, .root_path = "."});
+    CL_ASSERT(fs != null);
+
+    // Sized values are copied into the file; the odd keys store an integer in the pointer with no size
+    static char keys[TEST_HT_SNAPSHOT_KEYS * 2][16];
+    static u64 values[TEST_HT_SNAPSHOT_KEYS];
+    cl_ht_t *ht = cl_ht_create_with_flags(TEST_ALLOCATOR, CL_HT_FLAG_GROUP_PROBING | CL_HT_FLAG_RANDOM_SEED);
+    bool all_valid = ht != null;
+    for (u64 i = 0; i < TEST_HT_SNAPSHOT_KEYS * 2; i++)
+        snprintf(keys[i], sizeof(keys[i]), "snapshot_%llu", (unsigned long long)i);
+    for (u64 i = 0; i < TEST_HT_SNAPSHOT_KEYS && all_valid; i++)
+    {
+        values[i] = i * 3;
+        all_valid &= i % 2 ? cl_ht_put(ht, keys[i], strlen(keys[i]), (void *)(uintptr_t)i, 0, null)
+                           : cl_ht_put(ht, keys[i], strlen(keys[i]), &values[i], sizeof(u64), null);
+    }
+    CL_ASSERT(all_valid && cl_ht_snapshot_write(ht, fs, TEST_HT_SNAPSHOT_FILE));
+
+    cl_ht_snapshot_t *snapshot = cl_ht_snapshot_open(TEST_ALLOCATOR, fs, TEST_HT_SNAPSHOT_FILE);
+    CL_ASSERT(snapshot != null && cl_ht_snapshot_size(snapshot) == TEST_HT_SNAPSHOT_KEYS);
+    for (u64 i = 0; i < TEST_HT_SNAPSHOT_KEYS * 2 && snapshot; i++)
+    {
+        const void *data = null;
+        u64 data_size = 1;
+        const bool found = cl_ht_snapshot_get(snapshot, keys[i], strlen(keys[i]), &data, &data_size);
+        if (i >= TEST_HT_SNAPSHOT_KEYS)
+            all_valid &= !found;
+        else if (i % 2)
+            all_valid &= found && data == (void *)(uintptr_t)i && data_size == 0;
+        else
+            all_valid &= found && data != &values[i] && data_size == sizeof(u64) && *(const u64 *)data == i * 3;
+    }
+    CL_ASSERT(all_valid);
+
+    u64 cursor = 0;
+    u64 visited = 0;
+    const void *key;
+    u64 key_size;
+    while (snapshot && cl_ht_snapshot_next(snapshot, &cursor, &key, &key_size, null, null))
+        all_valid &= cl_ht_exists(ht, key, key_size) && ++visited <= TEST_HT_SNAPSHOT_KEYS;
+    CL_ASSERT(all_valid && visited == TEST_HT_SNAPSHOT_KEYS);
+
+    // Replacing the file leaves the mapping already open on the old one intact
+    cl_ht_clear(ht);
+    CL_ASSERT(cl_ht_snapshot_write(ht, fs, TEST_HT_SNAPSHOT_FILE));
+    CL_ASSERT(snapshot && cl_ht_snapshot_get(snapshot, keys[0], strlen(keys[0]), null, null));
+    cl_ht_snapshot_close(snapshot);
+    snapshot = cl_ht_snapshot_open(TEST_ALLOCATOR, fs, TEST_HT_SNAPSHOT_FILE);
+    CL_ASSERT(snapshot != null && cl_ht_snapshot_size(snapshot) == 0);
+    CL_ASSERT(!cl_ht_snapshot_get(snapshot, keys[0], strlen(keys[0]), null, null));
+    cl_ht_snapshot_close(snapshot);
+    cl_ht_destroy(ht);
+
+    // Only the built-in hash can be recomputed by the reader
+    ht = cl_ht_create(TEST_ALLOCATOR);
+    CL_ASSERT(ht != null && cl_ht_set_hash_function(ht, test_constant_hash));
+    CL_ASSERT(!cl_ht_snapshot_write(ht, fs, TEST_HT_SNAPSHOT_FILE));
+    cl_ht_destroy(ht);
+
+    cl_file_t *file = cl_fs_open_file(fs, TEST_HT_SNAPSHOT_FILE, CL_FILE_MODE_WRITE);
+    CL_ASSERT(file != null);
+    cl_fs_write_file(file, keys, sizeof(keys));
+    cl_fs_close_file(file);
+    CL_ASSERT(cl_ht_snapshot_open(TEST_ALLOCATOR, fs, TEST_HT_SNAPSHOT_FILE) == null);
+    CL_ASSERT(cl_ht_snapshot_open(TEST_ALLOCATOR, fs, "missing_" TEST_HT_SNAPSHOT_FILE) == null);
+
+    cl_fs_remove_file(fs, TEST_HT_SNAPSHOT_FILE);
+    cl_fs_destroy(fs);
+    cl_allocator_destroy(allocator);
+}
+
+// Every key of 0..count-1 seen exactly once, each with its own index as its value
+static bool test_scan_keys(cl_ht_t *ht, u64 count)
+{
+    static u8 seen[TEST_HT_SCAN_KEYS];
+    memset(seen, 0, sizeof(seen));
+    cl_ht_entry_view_t views[TEST_HT_SCAN_BATCH];
+    u64 cursor = 0;
+    u64 total = 0;
+    bool all_valid = true;
+    do
+    {
+        const u64 n = cl_ht_scan(ht, &cursor, views, TEST_HT_SCAN_BATCH);
+        for (u64 v = 0; v < n; v++)
+        {
+            const u64 key = *(const u64 *)views[v].key;
+            all_valid &= views[v].key_size == sizeof(u64) && key < count &&
+                         views[v].data == (void *)(uintptr_t)key && seen[key]++ == 0;
+        }
+        total += n;
+        all_valid &= total <= count;
+    }
+    while (cursor != 0 && all_valid);
+    return all_valid && total == count;
+}
+
+static bool test_scan_all(cl_ht_t *ht) { return test_scan_keys(ht, TEST_HT_SCAN_KEYS); }
+
+CL_TEST(test_ht_scan)
+{
+    const cl_ht_flags_t layouts[] = {CL_HT_FLAG_NONE, CL_HT_FLAG_GROUP_PROBING};
+    for (u32 l = 0; l < sizeof(layouts) / sizeof(layouts[0]); l++)
+    {
+        cl_ht_t *ht = cl_ht_create_with_flags(TEST_ALLOCATOR, layouts[l]);
+        CL_ASSERT(ht != null);
+        cl_ht_entry_view_t views[TEST_HT_SCAN_BATCH];
+        u64 cursor = 0;
+        cl_ht_iterator_t a;
+        cl_ht_iterator_t b;
+        cl_ht_entry_view_t view_a;
+        cl_ht_entry_view_t view_b;
+        cl_ht_iterator_init(ht, &a);
+        CL_ASSERT(cl_ht_scan(ht, &cursor, views, TEST_HT_SCAN_BATCH) == 0 && cursor == 0);
+        CL_ASSERT(!cl_ht_iterator_next(&a, &view_a));
+
+        bool all_valid = true;
+        for (u64 i = 0; i < TEST_HT_SCAN_KEYS; i++)
+            all_valid &= cl_ht_put(ht, &i, sizeof(i), (void *)(uintptr_t)i, 0, null);
+        CL_ASSERT(all_valid && test_scan_all(ht));
+
+        // Two iterations over one table at once, each with its own position
+        u64 count_a = 0;
+        u64 count_b = 0;
+        cl_ht_iterator_init(ht, &a);
+        cl_ht_iterator_init(ht, &b);
+        while (cl_ht_iterator_next(&a, &view_a))
+        {
+            count_a++;
+            if (count_a % 2 && cl_ht_iterator_next(&b, &view_b))
+                count_b++;
+        }
+        while (cl_ht_iterator_next(&b, &view_b))
+            count_b++;
+        CL_ASSERT(count_a == TEST_HT_SCAN_KEYS && count_b == TEST_HT_SCAN_KEYS);
+
+        if (layouts[l] & CL_HT_FLAG_GROUP_PROBING)
+        {
+            // Removing what a scan returns leaves the rest of the pass intact
+            cursor = 0;
+            do
+            {
+                const u64 n = cl_ht_scan(ht, &cursor, views, TEST_HT_SCAN_BATCH);
+                for (u64 v = 0; v < n; v++)
+                {
+                    const u64 key = *(const u64 *)views[v].key;
+                    all_valid &= cl_ht_remove(ht, &key, sizeof(key)) == views[v].data;
+                }
+            }
+            while (cursor != 0);
+            CL_ASSERT(all_valid && cl_ht_size(ht) == 0);
+        }
+        else
+        {
+            CL_ASSERT(cl_ht_freeze_perfect(ht) && test_scan_all(ht));
+        }
+        cl_ht_destroy(ht);
+    }
+}
+
+CL_TEST(test_ht_scan_incremental_resize)
+{
+    // Keys are not copied, so the tracking proxy only sees the table and its slot arrays
+    static u64 keys[TEST_HT_SCAN_KEYS];
+    cl_allocator_t *tracking =
+        cl_allocator_new(CL_ALLOCATOR_TYPE_PROXY, .config.proxy = {.mode = CL_PROXY_MODE_TRACKING});
+    CL_ASSERT_NOT_NULL(tracking);
+
+    const cl_ht_flags_t layouts[] = {CL_HT_FLAG_NONE, CL_HT_FLAG_GROUP_PROBING};
+    for (u32 l = 0; l < sizeof(layouts) / sizeof(layouts[0]); l++)
+    {
+        cl_ht_t *ht = cl_ht_create_with_flags(tracking, layouts[l] | CL_HT_FLAG_INCREMENTAL_RESIZE |
+                                                            CL_HT_FLAG_NOCOPY_KEYS);
+        CL_ASSERT(ht != null);
+        cl_mem_stats_t stats;
+        CL_ASSERT(cl_tracking_get_stats(tracking, &stats));
+        const u64 settled = stats.live_count;
+
+        // Stop right after a resize of a few thousand slots starts, while the old array is still live
+        bool all_valid = true;
+        u64 count = 0;
+        bool resizing = false;
+        while (count < TEST_HT_SCAN_KEYS && !(resizing && count > 2000))
+        {
+            keys[count] = count;
+            all_valid &= cl_ht_put(ht, &keys[count], sizeof(u64), (void *)(uintptr_t)count, 0, null);
+            count++;
+            all_valid &= cl_tracking_get_stats(tracking, &stats);
+            resizing = stats.live_count > settled;
+        }
+        CL_ASSERT(all_valid && resizing);
+
+        // Full passes with the cursor and an iterator return every key once and leave the old array in place
+        CL_ASSERT(test_scan_keys(ht, count));
+        cl_ht_iterator_t it;
+        cl_ht_entry_view_t view;
+        u64 iterated = 0;
+        cl_ht_iterator_init(ht, &it);
+        while (cl_ht_iterator_next(&it, &view))
+            iterated++;
+        CL_ASSERT_EQUAL(iterated, count);
+        CL_ASSERT(cl_tracking_get_stats(tracking, &stats));
+        CL_ASSERT_EQUAL(stats.live_count, settled + 1);
+
+        // Lookups made between batches move entries along, and the pass still sees every key at least once
+        static u8 seen[TEST_HT_SCAN_KEYS];
+        memset(seen, 0, sizeof(seen));
+        cl_ht_entry_view_t views[TEST_HT_SCAN_BATCH];
+        u64 cursor = 0;
+        do
+        {
+            const u64 n = cl_ht_scan(ht, &cursor, views, TEST_HT_SCAN_BATCH);
+            for (u64 v = 0; v < n; v++)
+                seen[*(const u64 *)views[v].key] = 1;
+            all_valid &= cl_ht_exists(ht, &keys[0], sizeof(u64));
+        }
+        while (cursor != 0);
+        for (u64 i = 0; i < count; i++)
+            all_valid &= seen[i] == 1;
+        CL_ASSERT(all_valid);
+        CL_ASSERT(cl_tracking_get_stats(tracking, &stats));
+        CL_ASSERT_EQUAL(stats.live_count, settled);
+        cl_ht_destroy(ht);
+    }
+    cl_allocator_destroy(tracking);
+}
+
+CL_TEST(test_hash_functions)
+{
+    // Published xxHash64 and wyhash values
+    const char *text = "Nobody inspects the spammish repetition";
+    CL_ASSERT(cl_hash_xxh64("", 0, 0) == 0xEF46DB3751D8E999ull);
+    CL_ASSERT(cl_hash_xxh64("abc", 3, 0) == 0x44BC2CF5AD770999ull);
+    CL_ASSERT(cl_hash_xxh64(text, strlen(text), 0) == 0xFBCEA83C8A378BF1ull);
+    CL_ASSERT(cl_hash_wy("", 0, 0) == 0x93228A4DE0EEC5A2ull);
+
+    // Every length through the short, medium and long paths hashes the same at any alignment, and the seed changes it
+    static u8 buffer[256 + 8];
+    for (u32 i = 0; i < sizeof(buffer); i++)
+        buffer[i] = (u8)(i * 131 + 7);
+    bool all_valid = true;
+    for (u64 length = 0; length <= 200; length++)
+    {
+        u8 aligned[200];
+        memcpy(aligned, buffer + 3, length);
+        all_valid &= cl_hash_wy(buffer + 3, length, 0) == cl_hash_wy(aligned, length, 0);
+        all_valid &= cl_hash_xxh64(buffer + 3, length, 0) == cl_hash_xxh64(aligned, length, 0);
+        all_valid &= cl_hash_wy(aligned, length, 1) != cl_hash_wy(aligned, length, 2);
+        all_valid &= cl_hash_xxh64(aligned, length, 1) != cl_hash_xxh64(aligned, length, 2);
+        all_valid &= length == 0 || cl_hash_wy(aligned, length, 0) != cl_hash_wy(aligned, length - 1, 0);
+    }
+    CL_ASSERT(all_valid);
+    CL_ASSERT(cl_hash_u64(1) != cl_hash_u64(2));
+    CL_ASSERT(cl_hash_random_seed() != cl_hash_random_seed());
+
+    // Seeded tables place keys differently but find them all the same
+    cl_ht_t *a = cl_ht_create_with_flags(TEST_ALLOCATOR, CL_HT_FLAG_RANDOM_SEED);
+    cl_ht_t *b = cl_ht_create_with_flags(TEST_ALLOCATOR, CL_HT_FLAG_RANDOM_SEED | CL_HT_FLAG_GROUP_PROBING);
+    CL_ASSERT(a != null && b != null);
+    CL_ASSERT(cl_ht_clear_flag(a, CL_HT_FLAG_RANDOM_SEED) & CL_HT_FLAG_RANDOM_SEED);
+    for (u64 i = 0; i < 1000; i++)
+    {
+        all_valid &= cl_ht_put(a, &i, sizeof(u64), null, 0, null);
+        all_valid &= cl_ht_put(b, &i, sizeof(u64), null, 0, null);
+    }
+    for (u64 i = 0; i < 1000; i++)
+        all_valid &= cl_ht_exists(a, &i, sizeof(u64)) && cl_ht_exists(b, &i, sizeof(u64));
+    CL_ASSERT(all_valid);
+    cl_ht_destroy(a);
+    cl_ht_destroy(b);
+}
+
+// Every key lands in the same home slot, so probes run as long as the map allows
+static inline u64 test_clash_hash(u32 key)
+{
+    (void)key;
+    return 0;
+}
+
+CL_HT_DEFINE(test_u64_map, u64, u64, cl_ht_hash_u64, cl_ht_eq)
+CL_HT_DEFINE(test_ptr_map, const void *, u32, cl_ht_hash_ptr, cl_ht_eq)
+CL_HT_DEFINE(test_clash_map, u32, u32, test_clash_hash, cl_ht_eq)
+
+CL_TEST(test_ht_define)
+{
+    static bool present[TEST_HT_DEFINE_KEYS];
+    test_u64_map_t *map = test_u64_map_create(TEST_ALLOCATOR);
+    CL_ASSERT(map != null);
+
+    // Random puts, replaces and removes checked against a plain array, through several resizes and long shifts
+    bool all_valid = true;
+    u64 live = 0;
+    u32 seed = 12345;
+    for (u64 i = 0; i < TEST_HT_DEFINE_OPS; i++)
+    {
+        seed = seed * 1103515245u + 12345u;
+        const u64 k = (seed >> 8) % TEST_HT_DEFINE_KEYS;
+        u64 value = 0;
+        if (seed & 0x80000000u)
+        {
+            all_valid &= test_u64_map_remove(map, k, &value) == present[k] && (!present[k] || value == k * 3);
+            live -= present[k];
+            present[k] = false;
+        }
+        else
+        {
+            all_valid &= test_u64_map_put(map, k, k * 3, null);
+            live += !present[k];
+            present[k] = true;
+        }
+        if (i % 1000 == 0)
+        {
+            for (u64 j = 0; j < TEST_HT_DEFINE_KEYS; j++)
+                all_valid &= test_u64_map_exists(map, j) == present[j];
+        }
+    }
+    CL_ASSERT(all_valid);
+    CL_ASSERT(test_u64_map_size(map) == live);
+
+    // Replacing hands back the old value; find gives the inline value to update in place
+    u64 old = 0;
+    CL_ASSERT(test_u64_map_put(map, 7, 70, null));
+    CL_ASSERT(test_u64_map_put(map, 7, 71, &old) && old == 70);
+    *test_u64_map_find(map, 7) += 1;
+    u64 value = 0;
+    CL_ASSERT(test_u64_map_get(map, 7, &value) && value == 72);
+
+    u64 cursor = 0;
+    u64 visited = 0;
+    u64 key;
+    while (test_u64_map_next(map, &cursor, &key, null))
+        visited += key < TEST_HT_DEFINE_KEYS;
+    CL_ASSERT(visited == test_u64_map_size(map));
+    test_u64_map_clear(map);
+    CL_ASSERT(test_u64_map_size(map) == 0 && !test_u64_map_exists(map, 7));
+    test_u64_map_destroy(map);
+
+    test_ptr_map_t *ptrs = test_ptr_map_create_with_size(TEST_ALLOCATOR, TEST_HT_DEFINE_KEYS);
+    CL_ASSERT(ptrs != null);
+    for (u32 i = 0; i < TEST_HT_DEFINE_KEYS; i++)
+        all_valid &= test_ptr_map_put(ptrs, &present[i], i, null);
+    u32 index = 0;
+    CL_ASSERT(all_valid && test_ptr_map_get(ptrs, &present[100], &index) && index == 100);
+    CL_ASSERT(!test_ptr_map_exists(ptrs, null));
+    test_ptr_map_destroy(ptrs);
+
+    // A byte holds the probe distance, so one home slot takes 255 keys; the next put fails and loses nothing
+    test_clash_map_t *clash = test_clash_map_create(TEST_ALLOCATOR);
+    CL_ASSERT(clash != null);
+    for (u32 i = 0; i < CL_HT_DEFINE_MAX_PROBE; i++)
+        all_valid &= test_clash_map_put(clash, i, i, null);
+    CL_ASSERT(all_valid);
+    CL_ASSERT(!test_clash_map_put(clash, CL_HT_DEFINE_MAX_PROBE, 0, null));
+    CL_ASSERT(test_clash_map_size(clash) == CL_HT_DEFINE_MAX_PROBE);
+    for (u32 i = 0; i < CL_HT_DEFINE_MAX_PROBE; i++)
+        all_valid &= test_clash_map_exists(clash, i);
+    CL_ASSERT(all_valid && test_clash_map_remove(clash, 0, null) && test_clash_map_exists(clash, 254));
+    test_clash_map_destroy(clash);
+}
+
+CL_TEST(test_ht_incremental_resize)
+{
+    static u64 keys[TEST_HT_INCREMENTAL_KEYS];
+    static bool present[TEST_HT_INCREMENTAL_KEYS];
+    for (u64 i = 0; i < TEST_HT_INCREMENTAL_KEYS; i++)
+        keys[i] = i * 0x9E3779B97F4A7C15ull;
+
+    const cl_ht_flags_t layouts[] = {CL_HT_FLAG_NONE, CL_HT_FLAG_GROUP_PROBING};
+    for (u32 l = 0; l < sizeof(layouts) / sizeof(layouts[0]); l++)
+    {
+        cl_ht_t *ht = cl_ht_create_with_flags(TEST_ALLOCATOR, layouts[l] | CL_HT_FLAG_INCREMENTAL_RESIZE);
+        CL_ASSERT(ht != null);
+        memset(present, 0, sizeof(present));
+
+        // Resizes are still migrating while later keys go in, get updated and get removed, so every operation has
+        // to find keys in whichever array holds them
+        bool all_valid = true;
+        u64 live = 0;
+        for (u64 i = 0; i < TEST_HT_INCREMENTAL_KEYS; i++)
+        {
+            all_valid &= cl_ht_put(ht, &keys[i], sizeof(u64), &keys[i], sizeof(u64), null);
+            present[i] = true;
+            live++;
+            if (i % 3 == 2)
+            {
+                all_valid &= cl_ht_remove(ht, &keys[i / 2], sizeof(u64)) == (present[i / 2] ? &keys[i / 2] : null);
+                live -= present[i / 2];
+                present[i / 2] = false;
+            }
+            const u64 k = i * 7 / 11;
+            void *old_data = null;
+            all_valid &= cl_ht_put(ht, &keys[k], sizeof(u64), &keys[k], sizeof(u64), &old_data);
+            all_valid &= old_data == (present[k] ? &keys[k] : null);
+            live += !present[k];
+            present[k] = true;
+        }
+        CL_ASSERT(all_valid);
+        CL_ASSERT(cl_ht_size(ht) == live);
+
+        for (u64 i = 0; i < TEST_HT_INCREMENTAL_KEYS; i++)
+        {
+            void *data = null;
+            const bool found = cl_ht_get(ht, &keys[i], sizeof(u64), &data, null);
+            all_valid &= found == present[i] && (!found || data == &keys[i]);
+        }
+        CL_ASSERT(all_valid);
+
+        foreach_data_t fd = {0, true};
+        CL_ASSERT(cl_ht_foreach(ht, foreach_count_callback, &fd) == live);
+        cl_ht_clear(ht);
+        CL_ASSERT(!cl_ht_exists(ht, &keys[0], sizeof(u64)));
+        cl_ht_destroy(ht);
+    }
+}
+
+// FNV-1a, standing in for a caller-supplied hash function
+static u64 test_fnv_hash(const void *key, u64 length)
+{
+    u64 hash = 0xCBF29CE484222325ull;
+    for (u64 i = 0; i < length; i++)
+        hash = (hash ^ ((const u8 *)key)[i]) * 0x100000001B3ull;
+    return hash;
+}
+
+CL_TEST(test_cht_basic_operations)
+{
+    cl_cht_t *cht = cl_cht_create(TEST_ALLOCATOR, 5, CL_HT_FLAG_NONE);
+    CL_ASSERT_NOT_NULL(cht);
+    CL_ASSERT_EQUAL(cl_cht_shard_count(cht), 8u);
+
+    const int num_entries = 10000;
+    bool all_valid = true;
+    for (int i = 0; i < num_entries; i++)
+    {
+        char key[16];
+        snprintf(key, sizeof(key), "key%d", i);
+        all_valid &= cl_cht_put(cht, key, strlen(key), (void *)(uintptr_t)(i + 1), sizeof(int), null);
+    }
+    CL_ASSERT(all_valid);
+    CL_ASSERT(cl_cht_size(cht) == (u64)num_entries);
+
+    void *old_data = null;
+    CL_ASSERT(cl_cht_put(cht, "key7", 4, (void *)(uintptr_t)42, sizeof(int), &old_data));
+    CL_ASSERT(old_data == (void *)(uintptr_t)8);
+    CL_ASSERT(cl_cht_remove(cht, "key7", 4) == (void *)(uintptr_t)42);
+    CL_ASSERT(!cl_cht_exists(cht, "key7", 4));
+    CL_ASSERT(cl_cht_put(cht, "key7", 4, (void *)(uintptr_t)8, sizeof(int), null));
+
+    for (int i = 0; i < num_entries && all_valid; i++)
+    {
+        char key[16];
+        void *data = null;
+        snprintf(key, sizeof(key), "key%d", i);
+        all_valid &= cl_cht_get(cht, key, strlen(key), &data, null) && data == (void *)(uintptr_t)(i + 1);
+        snprintf(key, sizeof(key), "missing%d", i);
+        all_valid &= !cl_cht_exists(cht, key, strlen(key));
+    }
+    CL_ASSERT(all_valid);
+
+    foreach_data_t fd = {0, true};
+    CL_ASSERT(cl_cht_foreach(cht, foreach_count_callback, &fd) == (u64)num_entries);
+
+    // The hash function can only change while nothing was placed with the old one
+    CL_ASSERT(!cl_cht_set_hash_function(cht, test_fnv_hash));
+    cl_cht_clear(cht);
+    CL_ASSERT(cl_cht_size(cht) == 0);
+    CL_ASSERT(cl_cht_set_hash_function(cht, test_fnv_hash));
+    CL_ASSERT(cl_cht_put(cht, "key1", 4, (void *)(uintptr_t)1, sizeof(int), null));
+    CL_ASSERT(cl_cht_exists(cht, "key1", 4));
+    cl_cht_destroy(cht);
+}
+
+// A caller-supplied hash that only fills the low 32 bits
+static u64 test_u32_hash(const void *key, u64 length) { return (u32)test_fnv_hash(key, length); }
+
+#define TEST_CHT_SPREAD_SHARDS 16
+#define TEST_CHT_SPREAD_KEYS 4096
+
+CL_TEST(test_cht_shard_spread)
+{
+    cl_cht_t *cht = cl_cht_create(TEST_ALLOCATOR, TEST_CHT_SPREAD_SHARDS, CL_HT_FLAG_NONE);
+    CL_ASSERT_NOT_NULL(cht);
+    CL_ASSERT(cl_cht_set_hash_function(cht, test_u32_hash));
+
+    bool all_valid = true;
+    for (u64 i = 0; i < TEST_CHT_SPREAD_KEYS; i++)
+        all_valid &= cl_cht_put(cht, &i, sizeof(i), (void *)(uintptr_t)(i + 1), sizeof(u64), null);
+    CL_ASSERT(all_valid);
+
+    // Each shard expects 256 keys; none may be left empty or take more than twice its share
+    u64 total = 0;
+    for (u32 i = 0; i < TEST_CHT_SPREAD_SHARDS; i++)
+    {
+        const u64 size = cl_cht_shard_size(cht, i);
+        all_valid &= size > 0 && size <= 2 * TEST_CHT_SPREAD_KEYS / TEST_CHT_SPREAD_SHARDS;
+        total += size;
+    }
+    CL_ASSERT(all_valid);
+    CL_ASSERT(total == TEST_CHT_SPREAD_KEYS);
+    CL_ASSERT(cl_cht_shard_size(cht, TEST_CHT_SPREAD_SHARDS) == 0);
+
+    for (u64 i = 0; i < TEST_CHT_SPREAD_KEYS; i++)
+    {
+        void *data = null;
+        all_valid &= cl_cht_get(cht, &i, sizeof(i), &data, null) && data == (void *)(uintptr_t)(i + 1);
+    }
+    CL_ASSERT(all_valid);
+    cl_cht_destroy(cht);
+}
+
+typedef struct cht_thread_context
+{
+    cl_cht_t *cht;
+    u64 *keys; // This thread's keys, TEST_CHT_KEYS_PER_THREAD of them
+    const u64 *shared_keys; // Keys every thread reads while the others write
+    bool ok;
+} cht_thread_context_t;
+
+static void *cht_worker(void *arg)
+{
+    cht_thread_context_t *context = (cht_thread_context_t *)arg;
+    context->ok = true;
+    for (int round = 0; round < 3; round++)
+    {
+        for (int i = 0; i < TEST_CHT_KEYS_PER_THREAD; i++)
+        {
+            u64 *key = &context->keys[i];
+            context->ok &= cl_cht_put(context->cht, key, sizeof(u64), key, sizeof(u64), null);
+            void *data = null;
+            context->ok &= cl_cht_get(context->cht, &context->shared_keys[i % 64], sizeof(u64), &data, null) &&
+                           data == &context->shared_keys[i % 64];
+        }
+        for (int i = 0; i < TEST_CHT_KEYS_PER_THREAD; i++)
+        {
+            void *data = null;
+            context->ok &= cl_cht_get(context->cht, &context->keys[i], sizeof(u64), &data, null) &&
+                           data == &context->keys[i];
+            // The last round leaves every other key in place for the main thread to check
+            if (round < 2 || i % 2 == 0)
+                context->ok &= cl_cht_remove(context->cht, &context->keys[i], sizeof(u64)) == &context->keys[i];
+        }
+    }
+    return null;
+}
+
+CL_TEST(test_cht_threads)
+{
+    cl_cht_t *cht = cl_cht_create(TEST_ALLOCATOR, 16, CL_HT_FLAG_NONE);
+    CL_ASSERT_NOT_NULL(cht);
+
+    u64 *keys = malloc(TEST_CHT_THREADS * TEST_CHT_KEYS_PER_THREAD * sizeof(u64));
+    u64 shared_keys[64];
+    CL_ASSERT_NOT_NULL(keys);
+    for (u64 i = 0; i < TEST_CHT_THREADS * TEST_CHT_KEYS_PER_THREAD; i++)
+        keys[i] = i * 0x9E3779B97F4A7C15ull;
+    for (u64 i = 0; i < 64; i++)
+    {
+        shared_keys[i] = ~i;
+        CL_ASSERT(cl_cht_put(cht, &shared_keys[i], sizeof(u64), &shared_keys[i], sizeof(u64), null));
+    }
+
+    cht_thread_context_t contexts[TEST_CHT_THREADS];
+    cl_thread_t *threads[TEST_CHT_THREADS];
+    for (int i = 0; i < TEST_CHT_THREADS; i++)
+    {
+        contexts[i] = (cht_thread_context_t){cht, keys + i * TEST_CHT_KEYS_PER_THREAD, shared_keys, false};
+        threads[i] = cl_thread_create(cht_worker, &contexts[i], CL_THREAD_FLAG_NONE);
+        CL_ASSERT_NOT_NULL(threads[i]);
+    }
+    for (int i = 0; i < TEST_CHT_THREADS; i++)
+    {
+        cl_thread_join(threads[i], null);
+        cl_thread_destroy(threads[i]);
+        CL_ASSERT(contexts[i].ok);
+    }
+
+    CL_ASSERT(cl_cht_size(cht) == 64 + TEST_CHT_THREADS * TEST_CHT_KEYS_PER_THREAD / 2);
+    bool all_valid = true;
+    for (int i = 0; i < TEST_CHT_THREADS * TEST_CHT_KEYS_PER_THREAD; i++)
+        all_valid &= cl_cht_exists(cht, &keys[i], sizeof(u64)) == (i % TEST_CHT_KEYS_PER_THREAD % 2 == 1);
+    CL_ASSERT(all_valid);
+
+    cl_cht_destroy(cht);
+    free(keys);
+}
+
+static int rmht_freed = 0;
+
+static void rmht_count_free(void *data)
+{
+    (void)data;
+    rmht_freed++;
+}
+
+CL_TEST(test_rmht_basic_operations)
+{
+    cl_rmht_t *rmht = cl_rmht_create(TEST_ALLOCATOR);
+    CL_ASSERT_NOT_NULL(rmht);
+
+    const int num_entries = 10000;
+    bool all_valid = true;
+    for (int i = 0; i < num_entries; i++)
+    {
+        char key[16];
+        snprintf(key, sizeof(key), "key%d", i);
+        all_valid &= cl_rmht_put(rmht, key, strlen(key), (void *)(uintptr_t)(i + 1), sizeof(int), null);
+    }
+    CL_ASSERT(all_valid);
+    CL_ASSERT(cl_rmht_size(rmht) == (u64)num_entries);
+
+    void *old_data = null;
+    CL_ASSERT(cl_rmht_put(rmht, "key7", 4, (void *)(uintptr_t)42, sizeof(int), &old_data));
+    CL_ASSERT(old_data == (void *)(uintptr_t)8);
+    CL_ASSERT(cl_rmht_remove(rmht, "key7", 4) == (void *)(uintptr_t)42);
+    CL_ASSERT(!cl_rmht_exists(rmht, "key7", 4));
+    CL_ASSERT(cl_rmht_put(rmht, "key7", 4, (void *)(uintptr_t)8, sizeof(int), null));
+
+    for (int i = 0; i < num_entries && all_valid; i++)
+    {
+        char key[16];
+        void *data = null;
+        u64 data_size = 0;
+        snprintf(key, sizeof(key), "key%d", i);
+        all_valid &= cl_rmht_get(rmht, key, strlen(key), &data, &data_size) && data == (void *)(uintptr_t)(i + 1) &&
+                     data_size == sizeof(int);
+        snprintf(key, sizeof(key), "missing%d", i);
+        all_valid &= !cl_rmht_exists(rmht, key, strlen(key));
+    }
+    CL_ASSERT(all_valid);
+
+    foreach_data_t fd = {0, true};
+    CL_ASSERT(cl_rmht_foreach(rmht, foreach_count_callback, &fd) == (u64)num_entries);
+
+    // Removing everything and inserting again reuses the tombstones instead of growing without bound
+    for (int round = 0; round < 3; round++)
+    {
+        for (int i = 0; i < num_entries; i++)
+        {
+            char key[16];
+            snprintf(key, sizeof(key), "key%d", i);
+            all_valid &= cl_rmht_remove(rmht, key, strlen(key)) == (void *)(uintptr_t)(i + 1);
+            all_valid &= cl_rmht_put(rmht, key, strlen(key), (void *)(uintptr_t)(i + 1), sizeof(int), null);
+        }
+    }
+    CL_ASSERT(all_valid);
+    CL_ASSERT(cl_rmht_size(rmht) == (u64)num_entries);
+
+    CL_ASSERT(!cl_rmht_set_hash_function(rmht, test_fnv_hash));
+    cl_rmht_clear(rmht);
+    CL_ASSERT(cl_rmht_size(rmht) == 0);
+    CL_ASSERT(!cl_rmht_exists(rmht, "key1", 4));
+    CL_ASSERT(cl_rmht_set_hash_function(rmht, test_fnv_hash));
+    CL_ASSERT(cl_rmht_put(rmht, "key1", 4, (void *)(uintptr_t)1, sizeof(int), null));
+    CL_ASSERT(cl_rmht_exists(rmht, "key1", 4));
+    cl_rmht_destroy(rmht);
+}
+
+CL_TEST(test_rmht_deferred_free)
+{
+    cl_rmht_t *rmht = cl_rmht_create(TEST_ALLOCATOR);
+    CL_ASSERT_NOT_NULL(rmht);
+    CL_ASSERT(cl_rmht_set_free_function(rmht, rmht_count_free));
+    rmht_freed = 0;
+
+    int values[3];
+    CL_ASSERT(cl_rmht_put(rmht, "route", 5, &values[0], sizeof(int), null));
+
+    // A reader holding the old value keeps it alive past the replacement until the read section ends
+    const u32 token = cl_rmht_read_lock(rmht);
+    void *data = null;
+    CL_ASSERT(cl_rmht_get(rmht, "route", 5, &data, null));
+    CL_ASSERT(data == &values[0]);
+    CL_ASSERT(cl_rmht_put(rmht, "route", 5, &values[1], sizeof(int), null));
+    CL_ASSERT_EQUAL(rmht_freed, 0);
+    cl_rmht_read_unlock(rmht, token);
+
+    cl_rmht_synchronize(rmht);
+    CL_ASSERT_EQUAL(rmht_freed, 1);
+    CL_ASSERT(cl_rmht_get(rmht, "route", 5, &data, null));
+    CL_ASSERT(data == &values[1]);
+
+    CL_ASSERT(cl_rmht_put(rmht, "other", 5, &values[2], sizeof(int), null));
+    cl_rmht_destroy(rmht);
+    CL_ASSERT_EQUAL(rmht_freed, 3);
+}
+
+typedef struct rmht_reader_context
+{
+    cl_rmht_t *rmht;
+    const u64 *keys;
+    atomic_bool *done;
+    u64 lookups;
+    bool ok;
+} rmht_reader_context_t;
+
+static void *rmht_reader(void *arg)
+{
+    rmht_reader_context_t *context = (rmht_reader_context_t *)arg;
+    context->ok = true;
+    context->lookups = 0;
+    // Stable keys must be found through every replacement, removal and resize the writer makes around them
+    while (!atomic_load(context->done) || context->lookups < TEST_RMHT_STABLE_KEYS)
+    {
+        const u64 i = context->lookups++ % TEST_RMHT_STABLE_KEYS;
+        void *data = null;
+        context->ok &= cl_rmht_get(context->rmht, &context->keys[i], sizeof(u64), &data, null);
+        context->ok &= data == (void *)&context->keys[i];
+    }
+    return null;
+}
+
+CL_TEST(test_rmht_concurrent_readers)
+{
+    cl_rmht_t *rmht = cl_rmht_create(TEST_ALLOCATOR);
+    CL_ASSERT_NOT_NULL(rmht);
+
+    const u64 key_count = TEST_RMHT_STABLE_KEYS + TEST_RMHT_WRITES;
+    u64 *keys = malloc(key_count * sizeof(u64));
+    CL_ASSERT_NOT_NULL(keys);
+    for (u64 i = 0; i < key_count; i++)
+        keys[i] = i * 0x9E3779B97F4A7C15ull;
+    for (u64 i = 0; i < TEST_RMHT_STABLE_KEYS; i++)
+        CL_ASSERT(cl_rmht_put(rmht, &keys[i], sizeof(u64), &keys[i], sizeof(u64), null));
+
+    atomic_bool done;
+    atomic_init(&done, false);
+    rmht_reader_context_t contexts[TEST_RMHT_READERS];
+    cl_thread_t *threads[TEST_RMHT_READERS];
+    for (int i = 0; i < TEST_RMHT_READERS; i++)
+    {
+        contexts[i] = (rmht_reader_context_t){rmht, keys, &done, 0, false};
+        threads[i] = cl_thread_create(rmht_reader, &contexts[i], CL_THREAD_FLAG_NONE);
+        CL_ASSERT_NOT_NULL(threads[i]);
+    }
+
+    bool all_valid = true;
+    for (u64 i = 0; i < TEST_RMHT_WRITES; i++)
+    {
+        const u64 *key = &keys[TEST_RMHT_STABLE_KEYS + i];
+        all_valid &= cl_rmht_put(rmht, key, sizeof(u64), (void *)key, sizeof(u64), null);
+        // Rewrite a stable key with the same value, so readers race a node swap
+        const u64 *stable = &keys[i % TEST_RMHT_STABLE_KEYS];
+        all_valid &= cl_rmht_put(rmht, stable, sizeof(u64), (void *)stable, sizeof(u64), null);
+        if (i % 3 != 0)
+            all_valid &= cl_rmht_remove(rmht, key, sizeof(u64)) == key;
+    }
+    atomic_store(&done, true);
+    CL_ASSERT(all_valid);
+
+    for (int i = 0; i < TEST_RMHT_READERS; i++)
+    {
+        cl_thread_join(threads[i], null);
+        cl_thread_destroy(threads[i]);
+        CL_ASSERT(contexts[i].ok);
+    }
+    CL_ASSERT(cl_rmht_size(rmht) == TEST_RMHT_STABLE_KEYS + (TEST_RMHT_WRITES + 2) / 3);
+
+    cl_rmht_destroy(rmht);
+    free(keys);
+}
 
 CL_TEST_SUITE_BEGIN(HashTableTests)
 CL_TEST_SUITE_TEST(test_ht_basic_operations)
@@ -333,6 +1483,24 @@ CL_TEST_SUITE_TEST(test_ht_iteration)
 CL_TEST_SUITE_TEST(test_ht_foreach)
 CL_TEST_SUITE_TEST(test_ht_edge_cases)
 CL_TEST_SUITE_TEST(test_ht_performance)
+CL_TEST_SUITE_TEST(test_ht_group_probing)
+CL_TEST_SUITE_TEST(test_ht_group_probing_churn)
+CL_TEST_SUITE_TEST(test_ht_robin_hood_churn)
+CL_TEST_SUITE_TEST(test_ht_key_arena)
+CL_TEST_SUITE_TEST(test_ht_batch_operations)
+CL_TEST_SUITE_TEST(test_ht_define)
+CL_TEST_SUITE_TEST(test_hash_functions)
+CL_TEST_SUITE_TEST(test_ht_freeze_perfect)
+CL_TEST_SUITE_TEST(test_ht_snapshot)
+CL_TEST_SUITE_TEST(test_ht_scan)
+CL_TEST_SUITE_TEST(test_ht_scan_incremental_resize)
+CL_TEST_SUITE_TEST(test_ht_incremental_resize)
+CL_TEST_SUITE_TEST(test_cht_basic_operations)
+CL_TEST_SUITE_TEST(test_cht_shard_spread)
+CL_TEST_SUITE_TEST(test_cht_threads)
+CL_TEST_SUITE_TEST(test_rmht_basic_operations)
+CL_TEST_SUITE_TEST(test_rmht_deferred_free)
+CL_TEST_SUITE_TEST(test_rmht_concurrent_readers)
 CL_TEST_SUITE_END
 
 int main()
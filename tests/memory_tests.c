@@ -1,10 +1,39 @@
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "clib/log_lib.h"
 #include "clib/memory_lib.h"
 #include "clib/test_lib.h"
+#include "clib/thread_lib.h"
+
+#ifndef CL_PLATFORM_WINDOWS
+#include <signal.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 #define TEST_ALLOC_SIZE 100
+#define TEST_POOL_BLOCK_SIZE 48
+#define TEST_POOL_BLOCK_COUNT 16
+#define TEST_CHURN_ITERATIONS 100000
+#define TEST_CHURN_LIVE_BLOCKS 1024
+#define TEST_FREE_LIST_SIZE (64 * 1024)
+#define TEST_SCRATCH_SIZE 4096
+#define TEST_PROXY_THREADS 4
+#define TEST_PROXY_THREAD_ITERATIONS 200000
+#define TEST_PROXY_LIVE_BLOCKS 256
+#define TEST_CPOOL_THREADS 8
+#define TEST_CPOOL_ITERATIONS 100000
+#define TEST_CPOOL_SLOTS 512
+#define TEST_CPOOL_SLAB_BLOCKS 64 // 4 KB blocks, so each slab is 256 KB to commit
+#define TEST_GUARD_SAMPLE_RATE 4
+#define TEST_BATCH_COUNT 100
+#define TEST_MEM_OPS_MAX_SIZE 300
+#define TEST_MEM_OPS_LARGE_SIZE (32 * 1024 * 1024 + 77)
+#define TEST_MEM_OPS_SWEEP_MAX_SIZE (64 * 1024 * 1024)
 
 static cl_allocator_t *test_allocator;
 static cl_allocator_t *arena_allocator;
@@ -177,6 +206,1431 @@ CL_TEST(test_arena_allocator_realloc)
     memset((unsigned char *)ptr2 + TEST_ALLOC_SIZE, 0xDD, TEST_ALLOC_SIZE);
 }
 
+CL_TEST(test_arena_allocator_realloc_in_place)
+{
+    cl_allocator_t *allocator = cl_allocator_new(CL_ALLOCATOR_TYPE_ARENA, .config.arena = {.size = 1024});
+    CL_ASSERT_NOT_NULL(allocator);
+
+    // The newest allocation grows in place while the block has room
+    unsigned char *ptr1 = cl_mem_alloc(allocator, TEST_ALLOC_SIZE);
+    memset(ptr1, 0xCC, TEST_ALLOC_SIZE);
+    CL_ASSERT(cl_mem_realloc(allocator, ptr1, TEST_ALLOC_SIZE * 2) == ptr1);
+
+    // Older allocations move, copying only their own bytes
+    unsigned char *ptr2 = cl_mem_alloc(allocator, TEST_ALLOC_SIZE);
+    memset(ptr2, 0xEE, TEST_ALLOC_SIZE);
+    unsigned char *moved = cl_mem_realloc(allocator, ptr1, TEST_ALLOC_SIZE * 3);
+    CL_ASSERT(moved != ptr1);
+    bool all_valid = true;
+    for (int i = 0; i < TEST_ALLOC_SIZE; i++)
+    {
+        all_valid &= moved[i] == 0xCC && ptr2[i] == 0xEE;
+    }
+    CL_ASSERT(all_valid);
+
+    // Growing past the block size spills into a new block and still preserves the data
+    unsigned char *spilled = cl_mem_realloc(allocator, moved, 4096);
+    CL_ASSERT_NOT_NULL(spilled);
+    for (int i = 0; i < TEST_ALLOC_SIZE; i++)
+    {
+        all_valid &= spilled[i] == 0xCC;
+    }
+    CL_ASSERT(all_valid);
+
+    cl_allocator_destroy(allocator);
+}
+
+CL_TEST(test_arena_allocator_reset)
+{
+    cl_allocator_t *allocator = cl_allocator_new(CL_ALLOCATOR_TYPE_ARENA, .config.arena = {.size = 1024});
+    CL_ASSERT_NOT_NULL(allocator);
+
+    for (int i = 0; i < 50; i++)
+    {
+        CL_ASSERT_NOT_NULL(cl_mem_alloc(allocator, TEST_ALLOC_SIZE));
+    }
+
+    // Each cycle after a reset reuses the retained blocks instead of allocating new ones
+    CL_ASSERT(cl_arena_reset(allocator, 16));
+    void *cycle_first = cl_mem_alloc(allocator, TEST_ALLOC_SIZE);
+    CL_ASSERT_NOT_NULL(cycle_first);
+    for (int round = 0; round < 3; round++)
+    {
+        CL_ASSERT(cl_arena_reset(allocator, 16));
+        CL_ASSERT(cl_mem_alloc(allocator, TEST_ALLOC_SIZE) == cycle_first);
+    }
+
+    // Dropping every block is also allowed
+    CL_ASSERT(cl_arena_reset(allocator, 0));
+    CL_ASSERT_NOT_NULL(cl_mem_alloc(allocator, TEST_ALLOC_SIZE));
+
+    // Only arenas can be reset
+    CL_ASSERT(!cl_arena_reset(test_allocator, 1));
+
+    cl_allocator_destroy(allocator);
+}
+
+CL_TEST(test_arena_allocator_reserved)
+{
+    const u64 reserve = 64 * 1024 * 1024;
+    cl_allocator_t *allocator =
+        cl_allocator_new(CL_ALLOCATOR_TYPE_ARENA, .config.arena = {.size = 64 * 1024, .reserve = reserve});
+    CL_ASSERT_NOT_NULL(allocator);
+
+    // A growing buffer never moves: the reservation is contiguous
+    unsigned char *buffer = cl_mem_alloc(allocator, TEST_ALLOC_SIZE);
+    CL_ASSERT_NOT_NULL(buffer);
+    bool in_place = true;
+    for (u64 size = 1024; size <= 8 * 1024 * 1024; size *= 2)
+    {
+        unsigned char *grown = cl_mem_realloc(allocator, buffer, size);
+        in_place &= grown == buffer;
+        memset(buffer + size / 2, 0xAB, size / 2);
+    }
+    CL_ASSERT(in_place);
+
+    // Allocations are laid out back to back in the same range
+    unsigned char *next = cl_mem_alloc(allocator, TEST_ALLOC_SIZE);
+    CL_ASSERT(next > buffer && next < buffer + reserve);
+
+    // Requests beyond the reservation fail instead of overrunning it
+    CL_ASSERT_null(cl_mem_alloc(allocator, reserve));
+
+    // Reset starts again at the beginning of the range, keeping some pages committed
+    CL_ASSERT(cl_arena_reset(allocator, 1));
+    unsigned char *again = cl_mem_alloc(allocator, TEST_ALLOC_SIZE);
+    CL_ASSERT(again == buffer);
+    memset(again, 0xCD, TEST_ALLOC_SIZE);
+
+    // Pages released by the reset are committed again on demand
+    unsigned char *large = cl_mem_alloc(allocator, 4 * 1024 * 1024);
+    CL_ASSERT_NOT_NULL(large);
+    memset(large, 0xEF, 4 * 1024 * 1024);
+
+    cl_allocator_destroy(allocator);
+}
+
+CL_TEST(test_arena_allocator_reserved_huge_pages)
+{
+    cl_allocator_t *allocator = cl_allocator_new(CL_ALLOCATOR_TYPE_ARENA, .flags = CL_ALLOCATOR_FLAG_HUGE_PAGES,
+                                                 .config.arena = {.reserve = 64 * 1024 * 1024});
+    CL_ASSERT_NOT_NULL(allocator);
+
+    unsigned char *ptr = cl_mem_alloc(allocator, 3 * 1024 * 1024);
+    CL_ASSERT_NOT_NULL(ptr);
+    memset(ptr, 0x11, 3 * 1024 * 1024);
+
+    cl_allocator_destroy(allocator);
+}
+
+CL_TEST(test_pool_allocator_create_and_destroy)
+{
+    cl_allocator_t *allocator = cl_allocator_new(CL_ALLOCATOR_TYPE_POOL,
+                                                 .config.pool = {.block_size = TEST_POOL_BLOCK_SIZE,
+                                                                 .block_count = TEST_POOL_BLOCK_COUNT});
+    CL_ASSERT_NOT_NULL(allocator);
+    cl_allocator_destroy(allocator);
+
+    // A zero block size cannot describe a pool
+    allocator = cl_allocator_new(CL_ALLOCATOR_TYPE_POOL, .config.pool = {.block_size = 0, .block_count = 8});
+    CL_ASSERT_null(allocator);
+}
+
+CL_TEST(test_pool_allocator_alloc_and_reuse)
+{
+    cl_allocator_t *allocator = cl_allocator_new(CL_ALLOCATOR_TYPE_POOL,
+                                                 .config.pool = {.block_size = TEST_POOL_BLOCK_SIZE,
+                                                                 .block_count = TEST_POOL_BLOCK_COUNT});
+    CL_ASSERT_NOT_NULL(allocator);
+
+    void *ptr1 = cl_mem_alloc(allocator, TEST_POOL_BLOCK_SIZE);
+    void *ptr2 = cl_mem_alloc(allocator, 1);
+    CL_ASSERT_NOT_NULL(ptr1);
+    CL_ASSERT_NOT_NULL(ptr2);
+    CL_ASSERT(ptr1 != ptr2);
+    CL_ASSERT((u64)((char *)ptr2 - (char *)ptr1) >= TEST_POOL_BLOCK_SIZE);
+    memset(ptr1, 0xAA, TEST_POOL_BLOCK_SIZE);
+    memset(ptr2, 0xBB, TEST_POOL_BLOCK_SIZE);
+
+    // Requests larger than the block size are refused
+    CL_ASSERT_null(cl_mem_alloc(allocator, TEST_POOL_BLOCK_SIZE + 1));
+
+    // Freed blocks are handed back out first
+    cl_mem_free(allocator, ptr1);
+    void *ptr3 = cl_mem_alloc(allocator, TEST_POOL_BLOCK_SIZE);
+    CL_ASSERT(ptr3 == ptr1);
+
+    // Realloc stays in place while it fits in the block
+    CL_ASSERT(cl_mem_realloc(allocator, ptr3, TEST_POOL_BLOCK_SIZE / 2) == ptr3);
+    CL_ASSERT_null(cl_mem_realloc(allocator, ptr3, TEST_POOL_BLOCK_SIZE * 2));
+
+    cl_mem_free(allocator, ptr2);
+    cl_mem_free(allocator, ptr3);
+    cl_allocator_destroy(allocator);
+}
+
+CL_TEST(test_pool_allocator_exhaustion)
+{
+    cl_allocator_t *allocator = cl_allocator_new(CL_ALLOCATOR_TYPE_POOL,
+                                                 .config.pool = {.block_size = TEST_POOL_BLOCK_SIZE,
+                                                                 .block_count = TEST_POOL_BLOCK_COUNT});
+    CL_ASSERT_NOT_NULL(allocator);
+
+    void *blocks[TEST_POOL_BLOCK_COUNT];
+    bool all_valid = true;
+    for (int i = 0; i < TEST_POOL_BLOCK_COUNT; i++)
+    {
+        blocks[i] = cl_mem_alloc(allocator, TEST_POOL_BLOCK_SIZE);
+        all_valid &= blocks[i] != null;
+    }
+    CL_ASSERT(all_valid);
+
+    // A fixed pool refuses to grow past its configured capacity
+    CL_ASSERT_null(cl_mem_alloc(allocator, TEST_POOL_BLOCK_SIZE));
+
+    cl_mem_free(allocator, blocks[3]);
+    CL_ASSERT(cl_mem_alloc(allocator, TEST_POOL_BLOCK_SIZE) == blocks[3]);
+
+    cl_allocator_destroy(allocator);
+}
+
+CL_TEST(test_pool_allocator_growable)
+{
+    cl_allocator_t *allocator = cl_allocator_new(CL_ALLOCATOR_TYPE_POOL, .flags = CL_ALLOCATOR_FLAG_GROWABLE,
+                                                 .config.pool = {.block_size = TEST_POOL_BLOCK_SIZE,
+                                                                 .block_count = TEST_POOL_BLOCK_COUNT});
+    CL_ASSERT_NOT_NULL(allocator);
+
+    const int count = TEST_POOL_BLOCK_COUNT * 10;
+    void *blocks[TEST_POOL_BLOCK_COUNT * 10];
+    bool all_valid = true;
+    for (int i = 0; i < count; i++)
+    {
+        blocks[i] = cl_mem_alloc(allocator, TEST_POOL_BLOCK_SIZE);
+        all_valid &= blocks[i] != null;
+        if (blocks[i])
+            memset(blocks[i], i & 0xFF, TEST_POOL_BLOCK_SIZE);
+    }
+    CL_ASSERT(all_valid);
+
+    // Blocks from different slabs must not overlap
+    for (int i = 0; i < count && all_valid; i++)
+    {
+        all_valid &= ((unsigned char *)blocks[i])[0] == (i & 0xFF);
+        all_valid &= ((unsigned char *)blocks[i])[TEST_POOL_BLOCK_SIZE - 1] == (i & 0xFF);
+    }
+    CL_ASSERT(all_valid);
+
+    for (int i = 0; i < count; i++)
+    {
+        cl_mem_free(allocator, blocks[i]);
+    }
+    cl_allocator_destroy(allocator);
+}
+
+static bool is_aligned(const void *ptr, u64 alignment) { return ((uintptr_t)ptr & (alignment - 1)) == 0; }
+
+// Timing lives in clib_bench_memory; this only checks the pool hands out distinct blocks under churn
+CL_TEST(test_pool_allocator_churn)
+{
+    static u8 *live[TEST_CHURN_LIVE_BLOCKS];
+    bool all_valid = true;
+
+    cl_allocator_t *pool = cl_allocator_new(CL_ALLOCATOR_TYPE_POOL, .flags = CL_ALLOCATOR_FLAG_GROWABLE,
+                                            .config.pool = {.block_size = TEST_POOL_BLOCK_SIZE,
+                                                            .block_count = TEST_CHURN_LIVE_BLOCKS / 4});
+    CL_ASSERT_NOT_NULL(pool);
+
+    // Every live block carries its slot number, so a block handed out twice overwrites another slot's mark
+    for (u32 i = 0; i < TEST_CHURN_LIVE_BLOCKS; i++)
+    {
+        live[i] = cl_mem_alloc(pool, TEST_POOL_BLOCK_SIZE);
+        all_valid &= live[i] != null;
+        if (live[i])
+            memset(live[i], (u8)i, TEST_POOL_BLOCK_SIZE);
+    }
+    for (u32 i = 0; i < TEST_CHURN_ITERATIONS && all_valid; i++)
+    {
+        // Free and reallocate in a scattered order so the free list does not degrade to a stack of one
+        const u32 slot = (i * 7919u) & (TEST_CHURN_LIVE_BLOCKS - 1);
+        all_valid &= live[slot][0] == (u8)slot && live[slot][TEST_POOL_BLOCK_SIZE - 1] == (u8)slot;
+        cl_mem_free(pool, live[slot]);
+        live[slot] = cl_mem_alloc(pool, TEST_POOL_BLOCK_SIZE);
+        all_valid &= live[slot] != null;
+        if (live[slot])
+            memset(live[slot], (u8)slot, TEST_POOL_BLOCK_SIZE);
+    }
+    for (u32 i = 0; i < TEST_CHURN_LIVE_BLOCKS && all_valid; i++)
+    {
+        all_valid &= live[i][0] == (u8)i;
+        cl_mem_free(pool, live[i]);
+    }
+    CL_ASSERT(all_valid);
+    cl_allocator_destroy(pool);
+}
+
+CL_TEST(test_concurrent_pool_allocator_capacity)
+{
+    cl_allocator_t *pool =
+        cl_allocator_new(CL_ALLOCATOR_TYPE_POOL, .flags = CL_ALLOCATOR_FLAG_CONCURRENT,
+                         .config.pool = {.block_size = TEST_POOL_BLOCK_SIZE, .block_count = TEST_POOL_BLOCK_COUNT});
+    CL_ASSERT_NOT_NULL(pool);
+
+    void *blocks[TEST_POOL_BLOCK_COUNT];
+    for (int i = 0; i < TEST_POOL_BLOCK_COUNT; i++)
+    {
+        blocks[i] = cl_mem_alloc(pool, TEST_POOL_BLOCK_SIZE);
+        CL_ASSERT(blocks[i] != null && is_aligned(blocks[i], 16));
+        memset(blocks[i], i, TEST_POOL_BLOCK_SIZE);
+    }
+    CL_ASSERT_null(cl_mem_alloc(pool, TEST_POOL_BLOCK_SIZE));
+    CL_ASSERT_null(cl_mem_alloc(pool, TEST_POOL_BLOCK_SIZE + 1));
+    for (int i = 0; i < TEST_POOL_BLOCK_COUNT; i++)
+        CL_ASSERT_EQUAL(((unsigned char *)blocks[i])[TEST_POOL_BLOCK_SIZE - 1], (unsigned char)i);
+
+    // Freed blocks come back most recent first
+    cl_mem_free(pool, blocks[3]);
+    cl_mem_free(pool, blocks[7]);
+    CL_ASSERT(cl_mem_alloc(pool, 1) == blocks[7]);
+    CL_ASSERT(cl_mem_realloc(pool, blocks[7], TEST_POOL_BLOCK_SIZE) == blocks[7]);
+    CL_ASSERT_null(cl_mem_realloc(pool, blocks[7], TEST_POOL_BLOCK_SIZE + 1));
+    CL_ASSERT(cl_mem_aligned_alloc(pool, 16, 1) == blocks[3]);
+    cl_allocator_destroy(pool);
+}
+
+#ifdef CL_PLATFORM_LINUX
+// Commits past RLIMIT_DATA fail, which stands in for running out of memory. Returns 0 when the failed allocations
+// gave every block back, 1 when they lost some, and 2 when the limit did not make the commit fail.
+static int concurrent_pool_commit_failure(void)
+{
+    static void *blocks[TEST_CPOOL_SLAB_BLOCKS * 3];
+    cl_allocator_t *pool =
+        cl_allocator_new(CL_ALLOCATOR_TYPE_POOL, .flags = CL_ALLOCATOR_FLAG_CONCURRENT | CL_ALLOCATOR_FLAG_GROWABLE,
+                         .config.pool = {.block_size = 4096, .block_count = TEST_CPOOL_SLAB_BLOCKS});
+    if (pool == null)
+        return 1;
+    // A fresh pool hands out its blocks in address order, so this fills exactly the first slab
+    for (int i = 0; i < TEST_CPOOL_SLAB_BLOCKS; i++)
+    {
+        if ((blocks[i] = cl_mem_alloc(pool, 4096)) == null)
+            return 1;
+    }
+
+    // Cap writable memory at what the process already uses, well short of another slab
+    struct rlimit saved;
+    unsigned long data_kb = 0;
+    char line[128];
+    FILE *status = fopen("/proc/self/status", "r");
+    while (status != null && fgets(line, sizeof(line), status) != null && sscanf(line, "VmData: %lu", &data_kb) != 1)
+    {
+    }
+    if (status != null)
+        fclose(status);
+    if (data_kb == 0 || getrlimit(RLIMIT_DATA, &saved) != 0)
+        return 2;
+    const struct rlimit capped = {.rlim_cur = data_kb * 1024 + 16 * 1024, .rlim_max = saved.rlim_max};
+    if (setrlimit(RLIMIT_DATA, &capped) != 0)
+        return 2;
+    const bool failed = !cl_mem_alloc_batch(pool, 4096, TEST_CPOOL_SLAB_BLOCKS * 2, blocks + TEST_CPOOL_SLAB_BLOCKS) &&
+                        cl_mem_alloc(pool, 4096) == null;
+    setrlimit(RLIMIT_DATA, &saved);
+    if (!failed)
+        return 2;
+
+    // Nothing was claimed by the failed calls, so the next block is the first one of the second slab
+    const char *next = cl_mem_alloc(pool, 4096);
+    return next == (char *)blocks[0] + TEST_CPOOL_SLAB_BLOCKS * 4096 ? 0 : 1;
+}
+#endif
+
+CL_TEST(test_concurrent_pool_allocator_commit_failure)
+{
+#ifdef CL_PLATFORM_LINUX
+    // Runs in a child so the lowered limit cannot touch the rest of the suite
+    const pid_t pid = fork();
+    if (pid == 0)
+        _exit(concurrent_pool_commit_failure());
+    int status = 0;
+    CL_ASSERT(pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status));
+    CL_ASSERT(WEXITSTATUS(status) == 0 || WEXITSTATUS(status) == 2);
+#endif
+}
+
+typedef struct concurrent_pool_context
+{
+    const cl_allocator_t *allocator;
+    _Atomic(_Atomic u64 *) *slots;
+    u32 seed;
+    bool valid;
+} concurrent_pool_context_t;
+
+// The pool keeps its free list outside the blocks, so the first word of a block is ours to use as an owned flag;
+// a block handed to two owners at once, or freed twice, trips the exchange
+static bool concurrent_pool_release(const cl_allocator_t *allocator, _Atomic u64 *block)
+{
+    const bool owned = atomic_exchange(block, 0) == 1;
+    cl_mem_free(allocator, (void *)block);
+    return owned;
+}
+
+static void *concurrent_pool_churn(void *arg)
+{
+    concurrent_pool_context_t *context = arg;
+    u32 state = context->seed;
+    context->valid = true;
+
+    // Blocks are parked in shared slots and usually picked up and freed by a different thread
+    for (u32 i = 0; i < TEST_CPOOL_ITERATIONS; i++)
+    {
+        state = state * 1664525u + 1013904223u;
+        const u32 slot = (state >> 8) % TEST_CPOOL_SLOTS;
+        _Atomic u64 *block = atomic_exchange(&context->slots[slot], null);
+        if (block)
+        {
+            context->valid &= concurrent_pool_release(context->allocator, block);
+            continue;
+        }
+
+        block = cl_mem_alloc(context->allocator, TEST_POOL_BLOCK_SIZE);
+        context->valid &= block != null;
+        if (block == null)
+            continue;
+        context->valid &= atomic_exchange(block, 1) == 0;
+        block = atomic_exchange(&context->slots[slot], block);
+        if (block)
+            context->valid &= concurrent_pool_release(context->allocator, block);
+    }
+    return null;
+}
+
+CL_TEST(test_concurrent_pool_allocator_threads)
+{
+    // Small slabs so the threads also race each other growing the pool
+    cl_allocator_t *pool = cl_allocator_new(CL_ALLOCATOR_TYPE_POOL,
+                                            .flags = CL_ALLOCATOR_FLAG_CONCURRENT | CL_ALLOCATOR_FLAG_GROWABLE,
+                                            .config.pool = {.block_size = TEST_POOL_BLOCK_SIZE, .block_count = 32});
+    CL_ASSERT_NOT_NULL(pool);
+
+    static _Atomic(_Atomic u64 *) slots[TEST_CPOOL_SLOTS];
+    cl_thread_t *threads[TEST_CPOOL_THREADS];
+    concurrent_pool_context_t contexts[TEST_CPOOL_THREADS];
+
+    for (u32 i = 0; i < TEST_CPOOL_THREADS; i++)
+    {
+        contexts[i] = (concurrent_pool_context_t){.allocator = pool, .slots = slots, .seed = i * 2654435761u + 1};
+        threads[i] = cl_thread_create(concurrent_pool_churn, &contexts[i], CL_THREAD_FLAG_NONE);
+        CL_ASSERT_NOT_NULL(threads[i]);
+    }
+    bool all_valid = true;
+    for (u32 i = 0; i < TEST_CPOOL_THREADS; i++)
+    {
+        cl_thread_join(threads[i], null);
+        cl_thread_destroy(threads[i]);
+        all_valid &= contexts[i].valid;
+    }
+
+    for (u32 i = 0; i < TEST_CPOOL_SLOTS; i++)
+    {
+        _Atomic u64 *block = atomic_exchange(&slots[i], null);
+        if (block)
+            all_valid &= concurrent_pool_release(pool, block);
+    }
+
+    // Every block is back on the free list exactly once, so draining it hands out each block only once
+    static _Atomic u64 *drained[TEST_CPOOL_SLOTS * 4];
+    for (u32 i = 0; i < TEST_CPOOL_SLOTS * 4; i++)
+    {
+        drained[i] = cl_mem_alloc(pool, TEST_POOL_BLOCK_SIZE);
+        all_valid &= drained[i] != null && atomic_exchange(drained[i], 1) == 0;
+    }
+    for (u32 i = 0; i < TEST_CPOOL_SLOTS * 4; i++)
+        all_valid &= drained[i] == null || concurrent_pool_release(pool, drained[i]);
+
+    CL_ASSERT(all_valid);
+    cl_allocator_destroy(pool);
+}
+
+CL_TEST(test_proxy_allocator_alloc_and_realloc)
+{
+    cl_allocator_t *allocator = cl_allocator_new(CL_ALLOCATOR_TYPE_PROXY, .config.proxy = {.allocator = null});
+    CL_ASSERT_NOT_NULL(allocator);
+
+    // Sizes spanning every size class plus the large path, each checked for overlap through its contents
+    static unsigned char *blocks[64];
+    static u64 sizes[64];
+    for (int i = 0; i < 64; i++)
+    {
+        sizes[i] = (u64)i * i * 11 + 1;
+        blocks[i] = cl_mem_alloc(allocator, sizes[i]);
+        CL_ASSERT_NOT_NULL(blocks[i]);
+        CL_ASSERT_EQUAL((uintptr_t)blocks[i] % 16, 0);
+        memset(blocks[i], i, sizes[i]);
+    }
+    bool intact = true;
+    for (int i = 0; i < 64; i++)
+    {
+        for (u64 j = 0; j < sizes[i]; j++)
+            intact &= blocks[i][j] == (unsigned char)i;
+        cl_mem_free(allocator, blocks[i]);
+    }
+    CL_ASSERT(intact);
+
+    // Growing within a size class stays in place, crossing classes keeps the contents
+    unsigned char *ptr = cl_mem_alloc(allocator, 20);
+    memset(ptr, 0x5A, 20);
+    CL_ASSERT(cl_mem_realloc(allocator, ptr, 32) == ptr);
+    ptr = cl_mem_realloc(allocator, ptr, 100 * 1024);
+    CL_ASSERT_NOT_NULL(ptr);
+    CL_ASSERT(ptr[0] == 0x5A && ptr[19] == 0x5A);
+    ptr = cl_mem_realloc(allocator, ptr, 200 * 1024);
+    CL_ASSERT_NOT_NULL(ptr);
+    CL_ASSERT(ptr[0] == 0x5A && ptr[19] == 0x5A);
+    ptr = cl_mem_realloc(allocator, ptr, 8);
+    CL_ASSERT(ptr[0] == 0x5A && ptr[7] == 0x5A);
+    cl_mem_free(allocator, ptr);
+
+    // A freed block is handed straight back by the thread cache
+    void *first = cl_mem_alloc(allocator, TEST_ALLOC_SIZE);
+    cl_mem_free(allocator, first);
+    CL_ASSERT(cl_mem_alloc(allocator, TEST_ALLOC_SIZE) == first);
+    cl_mem_free(allocator, first);
+
+    CL_ASSERT(cl_proxy_flush_thread_cache(allocator));
+    CL_ASSERT(!cl_proxy_flush_thread_cache(test_allocator));
+    cl_allocator_destroy(allocator);
+}
+
+CL_TEST(test_proxy_allocator_over_pool)
+{
+    cl_allocator_t *pool = cl_allocator_new(CL_ALLOCATOR_TYPE_POOL, .flags = CL_ALLOCATOR_FLAG_GROWABLE,
+                                            .config.pool = {.block_size = 64 + 16, .block_count = 64});
+    cl_allocator_t *allocator =
+        cl_allocator_new(CL_ALLOCATOR_TYPE_PROXY, .config.proxy = {.allocator = pool, .cache_size = 8});
+    CL_ASSERT_NOT_NULL(allocator);
+
+    // Enough frees to overflow the magazine and flush half of it back to the pool
+    void *blocks[32];
+    for (int i = 0; i < 32; i++)
+    {
+        blocks[i] = cl_mem_alloc(allocator, 64);
+        CL_ASSERT_NOT_NULL(blocks[i]);
+    }
+    for (int i = 0; i < 32; i++)
+        cl_mem_free(allocator, blocks[i]);
+
+    cl_allocator_destroy(allocator);
+    cl_allocator_destroy(pool);
+}
+
+typedef struct proxy_thread_context
+{
+    const cl_allocator_t *allocator;
+    u32 seed;
+    u32 operations;
+    bool valid;
+} proxy_thread_context_t;
+
+static void *proxy_thread_churn(void *arg)
+{
+    proxy_thread_context_t *context = arg;
+    unsigned char *live[TEST_PROXY_LIVE_BLOCKS] = {0};
+    u32 state = context->seed;
+    context->valid = true;
+
+    for (u32 i = 0; i < context->operations; i++)
+    {
+        state = state * 1664525u + 1013904223u;
+        const u32 slot = (state >> 8) % TEST_PROXY_LIVE_BLOCKS;
+        if (live[slot])
+        {
+            // The first byte records who wrote the block, so a block handed to two owners is caught
+            context->valid &= live[slot][0] == (unsigned char)slot;
+            cl_mem_free(context->allocator, live[slot]);
+        }
+        live[slot] = cl_mem_alloc(context->allocator, 16 + (state >> 24) % 240);
+        context->valid &= live[slot] != null;
+        if (live[slot])
+            live[slot][0] = (unsigned char)slot;
+    }
+    for (u32 i = 0; i < TEST_PROXY_LIVE_BLOCKS; i++)
+        cl_mem_free(context->allocator, live[i]);
+    return null;
+}
+
+static void run_proxy_threads(const cl_allocator_t *allocator, u32 thread_count, bool *all_valid)
+{
+    cl_thread_t *threads[TEST_PROXY_THREADS];
+    proxy_thread_context_t contexts[TEST_PROXY_THREADS];
+
+    for (u32 i = 0; i < thread_count; i++)
+    {
+        contexts[i] = (proxy_thread_context_t){.allocator = allocator,
+                                               .seed = i * 2654435761u + 1,
+                                               .operations = TEST_PROXY_THREAD_ITERATIONS};
+        threads[i] = cl_thread_create(proxy_thread_churn, &contexts[i], CL_THREAD_FLAG_NONE);
+    }
+    for (u32 i = 0; i < thread_count; i++)
+    {
+        cl_thread_join(threads[i], null);
+        cl_thread_destroy(threads[i]);
+        *all_valid &= contexts[i].valid;
+    }
+}
+
+CL_TEST(test_proxy_allocator_threads)
+{
+    cl_allocator_t *freelist =
+        cl_allocator_new(CL_ALLOCATOR_TYPE_FREE_LIST, .config.free_list = {.size = 16 * 1024 * 1024});
+    cl_allocator_t *allocator = cl_allocator_new(CL_ALLOCATOR_TYPE_PROXY, .config.proxy = {.allocator = freelist});
+    CL_ASSERT_NOT_NULL(allocator);
+
+    // The free list is not thread safe on its own, so this also exercises the proxy's backing lock
+    bool all_valid = true;
+    run_proxy_threads(allocator, TEST_PROXY_THREADS, &all_valid);
+    CL_ASSERT(all_valid);
+
+    cl_allocator_destroy(allocator);
+
+    cl_freelist_stats_t stats;
+    CL_ASSERT(cl_freelist_get_stats(freelist, &stats));
+    CL_ASSERT_EQUAL(stats.allocation_count, 0);
+    cl_allocator_destroy(freelist);
+}
+
+CL_TEST(test_tracking_allocator_stats)
+{
+    cl_allocator_t *allocator = cl_allocator_new(
+        CL_ALLOCATOR_TYPE_PROXY, .config.proxy = {.allocator = test_allocator, .mode = CL_PROXY_MODE_TRACKING});
+    CL_ASSERT_NOT_NULL(allocator);
+
+    void *small = cl_mem_alloc(allocator, 16);
+    void *large = cl_mem_alloc(allocator, 1000);
+    CL_ASSERT_NOT_NULL(small);
+    CL_ASSERT_NOT_NULL(large);
+
+    cl_mem_stats_t stats;
+    CL_ASSERT(cl_tracking_get_stats(allocator, &stats));
+    CL_ASSERT_EQUAL(stats.live_bytes, 1016);
+    CL_ASSERT_EQUAL(stats.live_count, 2);
+    CL_ASSERT_EQUAL(stats.histogram[4], 1);
+    CL_ASSERT_EQUAL(stats.histogram[10], 1);
+
+    large = cl_mem_realloc(allocator, large, 4000);
+    cl_mem_free(allocator, small);
+    CL_ASSERT(cl_tracking_get_stats(allocator, &stats));
+    CL_ASSERT_EQUAL(stats.live_bytes, 4000);
+    CL_ASSERT_EQUAL(stats.peak_bytes, 4016);
+    CL_ASSERT_EQUAL(stats.total_allocations, 2);
+    CL_ASSERT_EQUAL(stats.total_reallocations, 1);
+    CL_ASSERT_EQUAL(stats.total_frees, 1);
+
+    cl_mem_free(allocator, large);
+    CL_ASSERT(cl_tracking_get_stats(allocator, &stats));
+    CL_ASSERT_EQUAL(stats.live_bytes, 0);
+    CL_ASSERT_EQUAL(stats.live_count, 0);
+
+    // Only tracking proxies have statistics
+    CL_ASSERT(!cl_tracking_get_stats(test_allocator, &stats));
+    cl_allocator_destroy(allocator);
+}
+
+CL_TEST(test_tracking_allocator_call_sites)
+{
+    cl_allocator_t *allocator =
+        cl_allocator_new(CL_ALLOCATOR_TYPE_PROXY, .config.proxy = {.mode = CL_PROXY_MODE_TRACKING});
+    CL_ASSERT_NOT_NULL(allocator);
+
+    // One hot site in a loop, one cold site, and one allocation without a site
+    void *hot[10];
+    for (int i = 0; i < 10; i++)
+        hot[i] = cl_mem_alloc_at(allocator, 32, __FILE__, __LINE__);
+    const i32 cold_line = __LINE__ + 1;
+    void *cold = cl_mem_alloc_at(allocator, 500, __FILE__, cold_line);
+    void *anonymous = cl_mem_alloc(allocator, 8);
+
+    cl_mem_site_stats_t sites[8];
+    const u64 count = cl_tracking_get_sites(allocator, sites, 8);
+    CL_ASSERT_EQUAL(count, 3);
+    CL_ASSERT_EQUAL(sites[0].allocations, 10);
+    CL_ASSERT_EQUAL(sites[0].live_bytes, 320);
+    CL_ASSERT(strcmp(sites[0].file, __FILE__) == 0);
+    CL_ASSERT_EQUAL(sites[1].line, cold_line);
+    CL_ASSERT_null(sites[2].file);
+
+    // Frees are charged back to the site that allocated, wherever they happen
+    for (int i = 0; i < 10; i++)
+        cl_mem_free(allocator, hot[i]);
+    CL_ASSERT_EQUAL(cl_tracking_get_sites(allocator, sites, 1), 1);
+    CL_ASSERT_EQUAL(sites[0].live_count, 0);
+    CL_ASSERT_EQUAL(sites[0].total_bytes, 320);
+
+    cl_tracking_dump(allocator, 4);
+    cl_mem_free(allocator, cold);
+    cl_mem_free(allocator, anonymous);
+    cl_allocator_destroy(allocator);
+}
+
+CL_TEST(test_aligned_alloc_every_allocator)
+{
+    cl_allocator_t *allocators[] = {
+        cl_allocator_new(CL_ALLOCATOR_TYPE_PLATFORM),
+        cl_allocator_new(CL_ALLOCATOR_TYPE_ARENA, .config.arena = {.size = 1024}),
+        cl_allocator_new(CL_ALLOCATOR_TYPE_ARENA, .config.arena = {.reserve = 1024 * 1024}),
+        cl_allocator_new(CL_ALLOCATOR_TYPE_LINEAR, .config.linear = {.size = 64 * 1024}),
+        cl_allocator_new(CL_ALLOCATOR_TYPE_STACK, .config.stack = {.size = 64 * 1024}),
+        cl_allocator_new(CL_ALLOCATOR_TYPE_FREE_LIST, .config.free_list = {.size = 64 * 1024}),
+        cl_allocator_new(CL_ALLOCATOR_TYPE_PROXY, .config.proxy = {.allocator = null}),
+        cl_allocator_new(CL_ALLOCATOR_TYPE_PROXY, .config.proxy = {.mode = CL_PROXY_MODE_TRACKING}),
+    };
+    const u64 alignments[] = {8, 16, 64, 4096};
+
+    for (u64 i = 0; i < sizeof(allocators) / sizeof(allocators[0]); i++)
+    {
+        cl_allocator_t *allocator = allocators[i];
+        CL_ASSERT_NOT_NULL(allocator);
+        CL_ASSERT(allocator->aligned_alloc != null);
+
+        // Interleave plain and aligned allocations so padding is exercised from odd positions
+        void *ptrs[8];
+        bool all_aligned = true;
+        for (u64 j = 0; j < 4; j++)
+        {
+            ptrs[j * 2] = cl_mem_alloc(allocator, 24);
+            ptrs[j * 2 + 1] = cl_mem_aligned_alloc(allocator, alignments[j], 100);
+            all_aligned &= ptrs[j * 2 + 1] != null && is_aligned(ptrs[j * 2 + 1], alignments[j]);
+            if (ptrs[j * 2 + 1])
+                memset(ptrs[j * 2 + 1], 0x7F, 100);
+        }
+        CL_ASSERT(all_aligned);
+
+        // Native aligned allocations go back through the ordinary free; the stack wants them in reverse
+        for (int j = 7; j >= 0; j--)
+            cl_mem_free(allocator, ptrs[j]);
+    }
+
+    cl_freelist_stats_t stats;
+    CL_ASSERT(cl_freelist_get_stats(allocators[5], &stats));
+    CL_ASSERT_EQUAL(stats.allocation_count, 0);
+    CL_ASSERT_EQUAL(stats.free_block_count, 1);
+
+    cl_mem_stats_t tracking_stats;
+    CL_ASSERT(cl_tracking_get_stats(allocators[7], &tracking_stats));
+    CL_ASSERT_EQUAL(tracking_stats.live_count, 0);
+
+    for (u64 i = 0; i < sizeof(allocators) / sizeof(allocators[0]); i++)
+        cl_allocator_destroy(allocators[i]);
+
+    // Alignments must be powers of two
+    CL_ASSERT_null(cl_mem_aligned_alloc(test_allocator, 48, 100));
+}
+
+CL_TEST(test_aligned_alloc_pool)
+{
+    // Blocks share one alignment, so a pool can only satisfy requests up to it
+    cl_allocator_t *pool = cl_allocator_new(CL_ALLOCATOR_TYPE_POOL, .flags = CL_ALLOCATOR_FLAG_ALIGN, .alignment = 4096,
+                                            .config.pool = {.block_size = 100, .block_count = 4});
+    CL_ASSERT_NOT_NULL(pool);
+
+    bool all_aligned = true;
+    void *blocks[4];
+    for (int i = 0; i < 4; i++)
+    {
+        blocks[i] = cl_mem_alloc(pool, 100);
+        all_aligned &= blocks[i] != null && is_aligned(blocks[i], 4096);
+    }
+    CL_ASSERT(all_aligned);
+    for (int i = 0; i < 4; i++)
+        cl_mem_free(pool, blocks[i]);
+
+    void *page = cl_mem_aligned_alloc(pool, 4096, 100);
+    CL_ASSERT(page != null && is_aligned(page, 4096));
+    CL_ASSERT_null(cl_mem_aligned_alloc(pool, 8192, 100));
+    cl_mem_free(pool, page);
+    cl_allocator_destroy(pool);
+
+    // Power-of-two block sizes are naturally aligned up to a cache line
+    pool = cl_allocator_new(CL_ALLOCATOR_TYPE_POOL, .config.pool = {.block_size = 64, .block_count = 4});
+    void *line = cl_mem_aligned_alloc(pool, 64, 64);
+    CL_ASSERT(line != null && is_aligned(line, 64));
+    cl_mem_free(pool, line);
+    cl_allocator_destroy(pool);
+}
+
+CL_TEST(test_aligned_flag)
+{
+    // Cache-line aligned counters from an arena: every plain allocation honours the allocator's alignment
+    cl_allocator_t *arena = cl_allocator_new(CL_ALLOCATOR_TYPE_ARENA, .flags = CL_ALLOCATOR_FLAG_ALIGN);
+    cl_allocator_t *freelist = cl_allocator_new(CL_ALLOCATOR_TYPE_FREE_LIST, .flags = CL_ALLOCATOR_FLAG_ALIGN,
+                                                .alignment = 256, .config.free_list = {.size = 64 * 1024});
+    cl_allocator_t *platform = cl_allocator_new(CL_ALLOCATOR_TYPE_PLATFORM, .flags = CL_ALLOCATOR_FLAG_ALIGN,
+                                                .alignment = 4096);
+    CL_ASSERT_NOT_NULL(arena);
+    CL_ASSERT_NOT_NULL(freelist);
+    CL_ASSERT_NOT_NULL(platform);
+
+    bool all_aligned = true;
+    void *ptrs[16];
+    for (int i = 0; i < 16; i++)
+    {
+        all_aligned &= is_aligned(cl_mem_alloc(arena, sizeof(u64)), 64);
+        ptrs[i] = cl_mem_alloc(freelist, 40 + i);
+        all_aligned &= ptrs[i] != null && is_aligned(ptrs[i], 256);
+    }
+    CL_ASSERT(all_aligned);
+
+    // Moving reallocs keep the allocator-wide alignment
+    ptrs[0] = cl_mem_realloc(freelist, ptrs[0], 8192);
+    CL_ASSERT(ptrs[0] != null && is_aligned(ptrs[0], 256));
+    for (int i = 0; i < 16; i++)
+        cl_mem_free(freelist, ptrs[i]);
+
+    cl_freelist_stats_t stats;
+    CL_ASSERT(cl_freelist_get_stats(freelist, &stats));
+    CL_ASSERT_EQUAL(stats.free_block_count, 1);
+
+    unsigned char *page = cl_mem_alloc(platform, 100);
+    CL_ASSERT(page != null && is_aligned(page, 4096));
+    memset(page, 0x42, 100);
+    page = cl_mem_realloc(platform, page, 1024 * 1024);
+    CL_ASSERT(page != null && is_aligned(page, 4096) && page[99] == 0x42);
+    cl_mem_free(platform, page);
+
+    // Alignments that are not powers of two are rejected up front
+    CL_ASSERT_null(cl_allocator_new(CL_ALLOCATOR_TYPE_ARENA, .flags = CL_ALLOCATOR_FLAG_ALIGN, .alignment = 96));
+
+    cl_allocator_destroy(platform);
+    cl_allocator_destroy(freelist);
+    cl_allocator_destroy(arena);
+}
+
+// Allocations bigger than an arena block get a block of their own, which must still fit the alignment padding
+CL_TEST(test_aligned_alloc_arena_oversize)
+{
+    cl_allocator_t *arena = cl_allocator_new(CL_ALLOCATOR_TYPE_ARENA, .config.arena = {.size = 4096});
+    cl_allocator_t *aligned_arena =
+        cl_allocator_new(CL_ALLOCATOR_TYPE_ARENA, .flags = CL_ALLOCATOR_FLAG_ALIGN, .config.arena = {.size = 4096});
+    CL_ASSERT_NOT_NULL(arena);
+    CL_ASSERT_NOT_NULL(aligned_arena);
+
+    bool all_valid = true;
+    const u64 alignments[] = {16, 64, 256, 4096};
+    for (int round = 0; round < 2; round++)
+    {
+        for (u64 i = 0; i < sizeof(alignments) / sizeof(alignments[0]); i++)
+        {
+            unsigned char *ptr = cl_mem_aligned_alloc(arena, alignments[i], 8192);
+            all_valid &= ptr != null && is_aligned(ptr, alignments[i]);
+            if (ptr)
+                memset(ptr, 0x5A, 8192);
+        }
+        unsigned char *ptr = cl_mem_alloc(aligned_arena, 8192);
+        all_valid &= ptr != null && is_aligned(ptr, 64);
+        if (ptr)
+            memset(ptr, 0x5A, 8192);
+
+        // The second round reuses the retained blocks
+        all_valid &= cl_arena_reset(arena, 16) && cl_arena_reset(aligned_arena, 16);
+    }
+    CL_ASSERT(all_valid);
+
+    cl_allocator_destroy(aligned_arena);
+    cl_allocator_destroy(arena);
+}
+
+static void *test_custom_alloc(u64 size, void *user_data)
+{
+    (void)user_data;
+    return malloc(size);
+}
+
+static void test_custom_free(void *ptr, void *user_data)
+{
+    (void)user_data;
+    free(ptr);
+}
+
+CL_TEST(test_aligned_alloc_custom_allocator)
+{
+    // Hand-built allocators without an aligned_alloc still get aligned memory through cl_mem_aligned_free
+    const cl_allocator_t custom = {.alloc = test_custom_alloc, .free = test_custom_free};
+    void *ptr = cl_mem_aligned_alloc(&custom, 128, 1000);
+    CL_ASSERT(ptr != null && is_aligned(ptr, 128));
+    memset(ptr, 0, 1000);
+    cl_mem_aligned_free(&custom, ptr);
+
+    ptr = cl_mem_aligned_alloc(null, 4096, 1000);
+    CL_ASSERT(ptr != null && is_aligned(ptr, 4096));
+    cl_mem_aligned_free(null, ptr);
+}
+
+static bool check_mem_ops(u8 *a, u8 *b, u8 *expected, u64 size, u64 offset)
+{
+    bool valid = true;
+
+    cl_mem_set(a + offset, 0x5C, size);
+    memset(expected + offset, 0x5C, size);
+    valid &= memcmp(a, expected, size + offset + 64) == 0;
+
+    for (u64 i = 0; i < size + 64; i++)
+        b[i] = (u8)(i * 31 + size);
+    cl_mem_copy(a + offset, b, size);
+    memcpy(expected + offset, b, size);
+    valid &= memcmp(a, expected, size + offset + 64) == 0;
+
+    valid &= cl_mem_compare(a + offset, b, size) == 0;
+    if (size > 0)
+    {
+        // Flip one byte either way and check the sign, not just that a difference was found
+        const u64 at = (size * 7) / 11;
+        const u8 saved = b[at];
+        a[offset + at] = 0x10;
+        b[at] = 0x90;
+        valid &= cl_mem_compare(a + offset, b, size) < 0 && cl_mem_compare(b, a + offset, size) > 0;
+        a[offset + at] = b[at] = saved;
+    }
+
+    // Overlapping moves in both directions
+    for (u64 i = 0; i < size + 64; i++)
+        a[i] = expected[i] = (u8)(i * 13);
+    cl_mem_move(a + offset + 1, a + 1, size);
+    memmove(expected + offset + 1, expected + 1, size);
+    valid &= memcmp(a, expected, size + offset + 64) == 0;
+    cl_mem_move(a, a + offset + 3, size);
+    memmove(expected, expected + offset + 3, size);
+    valid &= memcmp(a, expected, size + offset + 64) == 0;
+    return valid;
+}
+
+CL_TEST(test_mem_ops_kernels)
+{
+    static const char *kernels[] = {"libc", "sse2", "avx2", "libc+avx2"};
+    u8 *a = malloc(TEST_MEM_OPS_LARGE_SIZE + 128);
+    u8 *b = malloc(TEST_MEM_OPS_LARGE_SIZE + 128);
+    u8 *expected = malloc(TEST_MEM_OPS_LARGE_SIZE + 128);
+    CL_ASSERT(a != null && b != null && expected != null);
+    memset(a, 0, TEST_MEM_OPS_LARGE_SIZE + 128);
+    memset(expected, 0, TEST_MEM_OPS_LARGE_SIZE + 128);
+
+    bool all_valid = true;
+    for (u64 k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+    {
+        // Kernels the CPU lacks are skipped, everything else must agree with libc byte for byte
+        if (!cl_mem_ops_select(kernels[k]))
+            continue;
+        CL_ASSERT(strcmp(cl_mem_ops_name(), kernels[k]) == 0);
+        for (u64 size = 0; size <= TEST_MEM_OPS_MAX_SIZE; size++)
+        {
+            for (u64 offset = 0; offset < 4; offset++)
+                all_valid &= check_mem_ops(a, b, expected, size, offset);
+        }
+        // Large enough for the non-temporal copy path
+        all_valid &= check_mem_ops(a, b, expected, TEST_MEM_OPS_LARGE_SIZE, 5);
+    }
+    CL_ASSERT(!cl_mem_ops_select("mmx"));
+    CL_ASSERT(cl_mem_ops_select("auto"));
+    CL_ASSERT(all_valid);
+
+    free(a);
+    free(b);
+    free(expected);
+}
+
+// Timing lives in clib_bench_memory; this checks the default kernels across the sizes it measures
+CL_TEST(test_mem_ops_sizes)
+{
+    u8 *src = malloc(TEST_MEM_OPS_SWEEP_MAX_SIZE);
+    u8 *dest = malloc(TEST_MEM_OPS_SWEEP_MAX_SIZE);
+    CL_ASSERT(src != null && dest != null);
+    memset(src, 0x11, TEST_MEM_OPS_SWEEP_MAX_SIZE);
+
+    int mismatches = 0;
+    for (u64 size = 1; size <= TEST_MEM_OPS_SWEEP_MAX_SIZE; size *= 4)
+    {
+        cl_mem_set(dest, 0x22, size);
+        mismatches += dest[0] != 0x22 || dest[size - 1] != 0x22;
+        cl_mem_copy(dest, src, size);
+        mismatches += cl_mem_compare(dest, src, size) != 0 || memcmp(dest, src, size) != 0;
+    }
+    CL_ASSERT_EQUAL(mismatches, 0);
+
+    free(src);
+    free(dest);
+}
+
+static bool guard_ends_on_page(const void *ptr, u64 size)
+{
+    return ((uintptr_t)ptr + size) % 4096 == 0;
+}
+
+CL_TEST(test_guard_allocator_sampling)
+{
+    cl_allocator_t *pool = cl_allocator_new(CL_ALLOCATOR_TYPE_POOL, .flags = CL_ALLOCATOR_FLAG_GROWABLE,
+                                            .config.pool = {.block_size = TEST_POOL_BLOCK_SIZE});
+    cl_allocator_t *guard =
+        cl_allocator_new(CL_ALLOCATOR_TYPE_GUARD,
+                         .config.guard = {.allocator = pool, .sample_rate = TEST_GUARD_SAMPLE_RATE});
+    CL_ASSERT_NOT_NULL(guard);
+
+    // One in four allocations lands right before a guard page, the rest come from the pool
+    unsigned char *blocks[64];
+    int guarded = 0;
+    bool all_valid = true;
+    for (int i = 0; i < 64; i++)
+    {
+        blocks[i] = cl_mem_alloc(guard, TEST_POOL_BLOCK_SIZE);
+        all_valid &= blocks[i] != null && is_aligned(blocks[i], 16);
+        if (cl_guard_contains(guard, blocks[i]))
+        {
+            all_valid &= guard_ends_on_page(blocks[i], TEST_POOL_BLOCK_SIZE);
+            guarded++;
+        }
+        memset(blocks[i], i, TEST_POOL_BLOCK_SIZE);
+    }
+    CL_ASSERT(all_valid);
+    CL_ASSERT_EQUAL(guarded, 64 / TEST_GUARD_SAMPLE_RATE);
+
+    // Guarded blocks stay guarded and keep their contents when they grow
+    unsigned char *grown = cl_mem_realloc(guard, blocks[0], 1024);
+    CL_ASSERT(cl_guard_contains(guard, grown) && guard_ends_on_page(grown, 1024));
+    CL_ASSERT_EQUAL(grown[TEST_POOL_BLOCK_SIZE - 1], 0);
+    CL_ASSERT(!cl_guard_contains(guard, blocks[0]));
+    blocks[0] = grown;
+
+    for (int i = 0; i < 64; i++)
+        cl_mem_free(guard, blocks[i]);
+    cl_allocator_destroy(guard);
+    cl_allocator_destroy(pool);
+}
+
+CL_TEST(test_guard_allocator_behind_arena)
+{
+    cl_allocator_t *arena = cl_allocator_new(CL_ALLOCATOR_TYPE_ARENA, .config.arena = {.size = 4096});
+    cl_allocator_t *guard =
+        cl_allocator_new(CL_ALLOCATOR_TYPE_GUARD, .flags = CL_ALLOCATOR_FLAG_ALIGN, .alignment = 64,
+                         .config.guard = {.allocator = arena, .sample_rate = 2});
+    CL_ASSERT_NOT_NULL(guard);
+
+    // Growing through the guard copies only what the old block held, whichever side it lives on
+    unsigned char *ptr = cl_mem_alloc(guard, 24);
+    CL_ASSERT(ptr != null && is_aligned(ptr, 64));
+    memset(ptr, 0x5A, 24);
+    for (u64 size = 48; size <= 3000; size *= 2)
+    {
+        ptr = cl_mem_realloc(guard, ptr, size);
+        CL_ASSERT(ptr != null && ptr[0] == 0x5A && ptr[23] == 0x5A);
+    }
+    cl_mem_free(guard, ptr);
+
+    void *aligned = cl_mem_aligned_alloc(guard, 256, 100);
+    CL_ASSERT(aligned != null && is_aligned(aligned, 256));
+    cl_mem_free(guard, aligned);
+
+    cl_allocator_destroy(guard);
+    cl_allocator_destroy(arena);
+}
+
+CL_TEST(test_guard_allocator_aligned_realloc)
+{
+    cl_allocator_t *guard = cl_allocator_new(CL_ALLOCATOR_TYPE_GUARD, .config.guard = {.sample_rate = 1});
+    CL_ASSERT_NOT_NULL(guard);
+
+    // A guarded block keeps the alignment it was asked for, not the allocator's default, each time it moves
+    unsigned char *ptr = cl_mem_aligned_alloc(guard, 256, 100);
+    CL_ASSERT(ptr != null && is_aligned(ptr, 256));
+    memset(ptr, 0x3C, 100);
+    bool all_valid = true;
+    u64 kept = 100;
+    for (u64 size = 37; size <= 5000; size = size * 3 + 1)
+    {
+        ptr = cl_mem_realloc(guard, ptr, size);
+        kept = size < kept ? size : kept;
+        all_valid &= ptr != null && cl_guard_contains(guard, ptr) && is_aligned(ptr, 256) && ptr[0] == 0x3C &&
+                     ptr[kept - 1] == 0x3C;
+        if (ptr == null)
+            break;
+    }
+    CL_ASSERT(all_valid);
+    cl_mem_free(guard, ptr);
+
+    cl_allocator_destroy(guard);
+}
+
+#ifndef CL_PLATFORM_WINDOWS
+// Runs the access in a child process and reports whether it died on it; sanitizer builds catch the fault and
+// exit with an error instead of dying on the signal
+static bool guard_access_faults(bool use_after_free)
+{
+    const pid_t pid = fork();
+    if (pid == 0)
+    {
+        cl_allocator_t *guard = cl_allocator_new(CL_ALLOCATOR_TYPE_GUARD, .config.guard = {.sample_rate = 1});
+        volatile unsigned char *ptr = cl_mem_alloc(guard, 64);
+        ptr[63] = 1;
+        if (use_after_free)
+        {
+            cl_mem_free(guard, (void *)ptr);
+            ptr[0] = 1;
+        }
+        else
+        {
+            ptr[64] = 1;
+        }
+        _exit(0);
+    }
+
+    int status = 0;
+    if (pid < 0 || waitpid(pid, &status, 0) != pid)
+        return false;
+    if (WIFSIGNALED(status))
+        return WTERMSIG(status) == SIGSEGV || WTERMSIG(status) == SIGBUS;
+    return WIFEXITED(status) && WEXITSTATUS(status) != 0;
+}
+#endif
+
+CL_TEST(test_guard_allocator_faults)
+{
+#ifndef CL_PLATFORM_WINDOWS
+    CL_ASSERT(guard_access_faults(false));
+    CL_ASSERT(guard_access_faults(true));
+#endif
+}
+
+// Every block is distinct, aligned to at least 8 (the arena minimum), writable on its own and can be freed one at a
+// time or as a batch
+static bool check_alloc_batch(const cl_allocator_t *allocator, u64 size, u64 count)
+{
+    void *blocks[TEST_BATCH_COUNT];
+    if (!cl_mem_alloc_batch(allocator, size, count, blocks))
+        return false;
+
+    bool valid = true;
+    for (u64 i = 0; i < count; i++)
+    {
+        valid &= blocks[i] != null && is_aligned(blocks[i], 8);
+        memset(blocks[i], (int)i, size);
+    }
+    for (u64 i = 0; i < count; i++)
+        valid &= ((unsigned char *)blocks[i])[0] == (unsigned char)i &&
+                 ((unsigned char *)blocks[i])[size - 1] == (unsigned char)i;
+
+    cl_mem_free(allocator, blocks[0]);
+    blocks[0] = null;
+    cl_mem_free_batch(allocator, blocks, count);
+    return valid;
+}
+
+CL_TEST(test_alloc_batch_every_allocator)
+{
+    cl_allocator_t *platform = cl_allocator_new(CL_ALLOCATOR_TYPE_PLATFORM);
+    cl_allocator_t *pool = cl_allocator_new(CL_ALLOCATOR_TYPE_POOL, .flags = CL_ALLOCATOR_FLAG_GROWABLE,
+                                            .config.pool = {.block_size = TEST_POOL_BLOCK_SIZE, .block_count = 16});
+    cl_allocator_t *cpool =
+        cl_allocator_new(CL_ALLOCATOR_TYPE_POOL, .flags = CL_ALLOCATOR_FLAG_CONCURRENT | CL_ALLOCATOR_FLAG_GROWABLE,
+                         .config.pool = {.block_size = TEST_POOL_BLOCK_SIZE, .block_count = 16});
+    cl_allocator_t *arena = cl_allocator_new(CL_ALLOCATOR_TYPE_ARENA, .config.arena = {.size = 1024});
+    cl_allocator_t *vm_arena =
+        cl_allocator_new(CL_ALLOCATOR_TYPE_ARENA, .config.arena = {.size = 4096, .reserve = 16 * 1024 * 1024});
+    cl_allocator_t *free_list =
+        cl_allocator_new(CL_ALLOCATOR_TYPE_FREE_LIST, .config.free_list = {.size = TEST_FREE_LIST_SIZE});
+    CL_ASSERT(platform && pool && cpool && arena && vm_arena && free_list);
+
+    const cl_allocator_t *allocators[] = {platform, pool, cpool, arena, vm_arena, free_list};
+    for (u32 i = 0; i < sizeof(allocators) / sizeof(allocators[0]); i++)
+    {
+        // Runs that spill past the first slab or arena block, repeated so freed blocks get reused
+        for (u32 round = 0; round < 3; round++)
+            CL_ASSERT(check_alloc_batch(allocators[i], TEST_POOL_BLOCK_SIZE, TEST_BATCH_COUNT));
+        CL_ASSERT(check_alloc_batch(allocators[i], 1, 1));
+    }
+
+    // An empty batch is trivially satisfied, null entries are skipped on free
+    CL_ASSERT(cl_mem_alloc_batch(pool, TEST_POOL_BLOCK_SIZE, 0, null));
+    cl_mem_free_batch(pool, (void *[]){null, null}, 2);
+
+    cl_allocator_destroy(platform);
+    cl_allocator_destroy(pool);
+    cl_allocator_destroy(cpool);
+    cl_allocator_destroy(arena);
+    cl_allocator_destroy(vm_arena);
+    cl_allocator_destroy(free_list);
+}
+
+CL_TEST(test_alloc_batch_all_or_nothing)
+{
+    cl_allocator_t *allocators[] = {
+        cl_allocator_new(CL_ALLOCATOR_TYPE_POOL,
+                         .config.pool = {.block_size = TEST_POOL_BLOCK_SIZE, .block_count = TEST_POOL_BLOCK_COUNT}),
+        cl_allocator_new(CL_ALLOCATOR_TYPE_POOL, .flags = CL_ALLOCATOR_FLAG_CONCURRENT,
+                         .config.pool = {.block_size = TEST_POOL_BLOCK_SIZE, .block_count = TEST_POOL_BLOCK_COUNT}),
+    };
+    for (u32 i = 0; i < 2; i++)
+    {
+        cl_allocator_t *pool = allocators[i];
+        CL_ASSERT_NOT_NULL(pool);
+
+        void *held[4];
+        CL_ASSERT(cl_mem_alloc_batch(pool, TEST_POOL_BLOCK_SIZE, 4, held));
+
+        // One block short: nothing is handed out and the out array is cleared
+        void *blocks[TEST_POOL_BLOCK_COUNT];
+        CL_ASSERT(!cl_mem_alloc_batch(pool, TEST_POOL_BLOCK_SIZE, TEST_POOL_BLOCK_COUNT - 3, blocks));
+        CL_ASSERT_null(blocks[0]);
+        CL_ASSERT(!cl_mem_alloc_batch(pool, TEST_POOL_BLOCK_SIZE + 1, 1, blocks));
+
+        // ...so the rest of the pool is still there to take
+        CL_ASSERT(cl_mem_alloc_batch(pool, TEST_POOL_BLOCK_SIZE, TEST_POOL_BLOCK_COUNT - 4, blocks));
+        CL_ASSERT_null(cl_mem_alloc(pool, 1));
+        cl_mem_free_batch(pool, held, 4);
+        cl_mem_free_batch(pool, blocks, TEST_POOL_BLOCK_COUNT - 4);
+        CL_ASSERT(cl_mem_alloc_batch(pool, TEST_POOL_BLOCK_SIZE, TEST_POOL_BLOCK_COUNT, blocks));
+        cl_allocator_destroy(pool);
+    }
+}
+
+CL_TEST(test_freelist_allocator_create_and_destroy)
+{
+    cl_allocator_t *allocator = cl_allocator_new(CL_ALLOCATOR_TYPE_FREE_LIST, .config.free_list = {.size = 0});
+    CL_ASSERT_NOT_NULL(allocator);
+    cl_allocator_destroy(allocator);
+
+    // Caller-provided regions do not need to be aligned
+    static char region[TEST_FREE_LIST_SIZE + 3];
+    allocator = cl_allocator_new(CL_ALLOCATOR_TYPE_FREE_LIST,
+                                 .config.free_list = {.size = TEST_FREE_LIST_SIZE, .start = region + 3});
+    CL_ASSERT_NOT_NULL(allocator);
+    void *ptr = cl_mem_alloc(allocator, TEST_ALLOC_SIZE);
+    CL_ASSERT(ptr > (void *)region && ptr < (void *)(region + sizeof(region)));
+    CL_ASSERT_EQUAL((uintptr_t)ptr % 16, 0);
+    cl_mem_free(allocator, ptr);
+    cl_allocator_destroy(allocator);
+}
+
+CL_TEST(test_freelist_allocator_coalescing)
+{
+    cl_allocator_t *allocator =
+        cl_allocator_new(CL_ALLOCATOR_TYPE_FREE_LIST, .config.free_list = {.size = TEST_FREE_LIST_SIZE});
+    CL_ASSERT_NOT_NULL(allocator);
+
+    cl_freelist_stats_t initial;
+    CL_ASSERT(cl_freelist_get_stats(allocator, &initial));
+    CL_ASSERT_EQUAL(initial.free_block_count, 1);
+    CL_ASSERT_EQUAL(initial.allocation_count, 0);
+
+    void *a = cl_mem_alloc(allocator, 100);
+    void *b = cl_mem_alloc(allocator, 200);
+    void *c = cl_mem_alloc(allocator, 300);
+    void *d = cl_mem_alloc(allocator, 400);
+    CL_ASSERT(a && b && c && d);
+
+    // Freeing every other block leaves holes that cannot merge yet
+    cl_mem_free(allocator, a);
+    cl_mem_free(allocator, c);
+    cl_freelist_stats_t stats;
+    cl_freelist_get_stats(allocator, &stats);
+    CL_ASSERT_EQUAL(stats.allocation_count, 2);
+    CL_ASSERT_EQUAL(stats.free_block_count, 3);
+    CL_ASSERT(stats.fragmentation > 0.0);
+    CL_ASSERT(stats.largest_free_block < initial.largest_free_block);
+
+    // Freeing the neighbours merges everything back into a single block
+    cl_mem_free(allocator, b);
+    cl_mem_free(allocator, d);
+    cl_freelist_get_stats(allocator, &stats);
+    CL_ASSERT_EQUAL(stats.free_block_count, 1);
+    CL_ASSERT_EQUAL(stats.largest_free_block, initial.largest_free_block);
+    CL_ASSERT_EQUAL(stats.used_size, 0);
+    CL_ASSERT_FLOAT_EQUAL(stats.fragmentation, 0.0, 0.0001);
+
+    cl_allocator_destroy(allocator);
+}
+
+CL_TEST(test_freelist_allocator_realloc)
+{
+    cl_allocator_t *allocator =
+        cl_allocator_new(CL_ALLOCATOR_TYPE_FREE_LIST, .config.free_list = {.size = TEST_FREE_LIST_SIZE});
+    CL_ASSERT_NOT_NULL(allocator);
+
+    unsigned char *ptr = cl_mem_alloc(allocator, TEST_ALLOC_SIZE);
+    CL_ASSERT_NOT_NULL(ptr);
+    memset(ptr, 0xCC, TEST_ALLOC_SIZE);
+
+    // The block after ptr is free, so growing happens in place
+    unsigned char *grown = cl_mem_realloc(allocator, ptr, TEST_ALLOC_SIZE * 4);
+    CL_ASSERT(grown == ptr);
+
+    // Pin the neighbour so the next growth has to move
+    void *blocker = cl_mem_alloc(allocator, TEST_ALLOC_SIZE);
+    CL_ASSERT_NOT_NULL(blocker);
+    unsigned char *moved = cl_mem_realloc(allocator, grown, TEST_ALLOC_SIZE * 16);
+    CL_ASSERT_NOT_NULL(moved);
+    CL_ASSERT(moved != grown);
+    bool all_valid = true;
+    for (int i = 0; i < TEST_ALLOC_SIZE; i++)
+    {
+        all_valid &= moved[i] == 0xCC;
+    }
+    CL_ASSERT(all_valid);
+
+    cl_mem_free(allocator, moved);
+    cl_mem_free(allocator, blocker);
+    cl_allocator_destroy(allocator);
+}
+
+CL_TEST(test_freelist_allocator_exhaustion_and_stress)
+{
+    cl_allocator_t *allocator =
+        cl_allocator_new(CL_ALLOCATOR_TYPE_FREE_LIST, .config.free_list = {.size = TEST_FREE_LIST_SIZE});
+    CL_ASSERT_NOT_NULL(allocator);
+
+    CL_ASSERT_null(cl_mem_alloc(allocator, TEST_FREE_LIST_SIZE));
+
+    // Random sizes with interleaved frees, each block tagged so overlaps would be caught
+    enum { SLOTS = 64 };
+    unsigned char *slots[SLOTS] = {0};
+    u64 sizes[SLOTS] = {0};
+    bool all_valid = true;
+    u32 seed = 12345;
+    for (int i = 0; i < 20000 && all_valid; i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        const int slot = (seed >> 16) % SLOTS;
+        if (slots[slot])
+        {
+            for (u64 j = 0; j < sizes[slot]; j++)
+                all_valid &= slots[slot][j] == (unsigned char)slot;
+            cl_mem_free(allocator, slots[slot]);
+            slots[slot] = null;
+        }
+        else
+        {
+            sizes[slot] = 1 + (seed >> 8) % 700;
+            slots[slot] = cl_mem_alloc(allocator, sizes[slot]);
+            if (slots[slot])
+                memset(slots[slot], slot, sizes[slot]);
+        }
+    }
+    CL_ASSERT(all_valid);
+
+    for (int i = 0; i < SLOTS; i++)
+        cl_mem_free(allocator, slots[i]);
+
+    cl_freelist_stats_t stats;
+    cl_freelist_get_stats(allocator, &stats);
+    CL_ASSERT_EQUAL(stats.free_block_count, 1);
+    CL_ASSERT_EQUAL(stats.allocation_count, 0);
+
+    cl_allocator_destroy(allocator);
+}
+
+CL_TEST(test_linear_allocator_alloc_and_rollback)
+{
+    cl_allocator_t *allocator =
+        cl_allocator_new(CL_ALLOCATOR_TYPE_LINEAR, .config.linear = {.size = TEST_SCRATCH_SIZE});
+    CL_ASSERT_NOT_NULL(allocator);
+
+    void *ptr1 = cl_mem_alloc(allocator, TEST_ALLOC_SIZE);
+    CL_ASSERT_NOT_NULL(ptr1);
+    CL_ASSERT_EQUAL((uintptr_t)ptr1 % 8, 0);
+
+    const cl_mem_marker_t marker = cl_mem_mark(allocator);
+    void *ptr2 = cl_mem_alloc(allocator, TEST_ALLOC_SIZE);
+    void *ptr3 = cl_mem_alloc(allocator, TEST_ALLOC_SIZE);
+    CL_ASSERT(ptr2 && ptr3 && ptr2 != ptr3);
+
+    // Rolling back hands the same memory out again
+    CL_ASSERT(cl_mem_rollback(allocator, marker));
+    CL_ASSERT(cl_mem_alloc(allocator, TEST_ALLOC_SIZE) == ptr2);
+
+    // The region is bounded
+    CL_ASSERT_null(cl_mem_alloc(allocator, TEST_SCRATCH_SIZE));
+
+    // A zeroed marker resets everything
+    CL_ASSERT(cl_mem_rollback(allocator, (cl_mem_marker_t){0}));
+    CL_ASSERT(cl_mem_alloc(allocator, TEST_ALLOC_SIZE) == ptr1);
+
+    cl_allocator_destroy(allocator);
+}
+
+CL_TEST(test_linear_allocator_realloc)
+{
+    static char region[TEST_SCRATCH_SIZE];
+    cl_allocator_t *allocator = cl_allocator_new(CL_ALLOCATOR_TYPE_LINEAR,
+                                                 .config.linear = {.start = region, .end = region + sizeof(region)});
+    CL_ASSERT_NOT_NULL(allocator);
+
+    unsigned char *ptr1 = cl_mem_alloc(allocator, TEST_ALLOC_SIZE);
+    CL_ASSERT(ptr1 == (unsigned char *)region);
+    memset(ptr1, 0xCC, TEST_ALLOC_SIZE);
+
+    // The most recent allocation grows in place
+    CL_ASSERT(cl_mem_realloc(allocator, ptr1, TEST_ALLOC_SIZE * 2) == ptr1);
+
+    // Older allocations move and keep their contents
+    void *ptr2 = cl_mem_alloc(allocator, TEST_ALLOC_SIZE);
+    CL_ASSERT_NOT_NULL(ptr2);
+    unsigned char *moved = cl_mem_realloc(allocator, ptr1, TEST_ALLOC_SIZE * 3);
+    CL_ASSERT_NOT_NULL(moved);
+    CL_ASSERT(moved != ptr1);
+    bool all_valid = true;
+    for (int i = 0; i < TEST_ALLOC_SIZE; i++)
+    {
+        all_valid &= moved[i] == 0xCC;
+    }
+    CL_ASSERT(all_valid);
+
+    cl_allocator_destroy(allocator);
+}
+
+CL_TEST(test_stack_allocator_lifo)
+{
+    cl_allocator_t *allocator = cl_allocator_new(CL_ALLOCATOR_TYPE_STACK, .config.stack = {.size = TEST_SCRATCH_SIZE});
+    CL_ASSERT_NOT_NULL(allocator);
+
+    void *ptr1 = cl_mem_alloc(allocator, TEST_ALLOC_SIZE);
+    void *ptr2 = cl_mem_alloc(allocator, TEST_ALLOC_SIZE);
+    CL_ASSERT(ptr1 && ptr2 && ptr1 != ptr2);
+
+    // Freeing out of order is ignored
+    cl_mem_free(allocator, ptr1);
+    void *ptr3 = cl_mem_alloc(allocator, TEST_ALLOC_SIZE);
+    CL_ASSERT(ptr3 != ptr1);
+
+    // Freeing from the top unwinds one allocation at a time
+    cl_mem_free(allocator, ptr3);
+    cl_mem_free(allocator, ptr2);
+    CL_ASSERT(cl_mem_alloc(allocator, TEST_ALLOC_SIZE) == ptr2);
+
+    // The top allocation can grow in place
+    CL_ASSERT(cl_mem_realloc(allocator, ptr2, TEST_ALLOC_SIZE * 4) == ptr2);
+
+    cl_allocator_destroy(allocator);
+}
+
+CL_TEST(test_stack_allocator_rollback)
+{
+    cl_allocator_t *allocator = cl_allocator_new(CL_ALLOCATOR_TYPE_STACK, .config.stack = {.size = TEST_SCRATCH_SIZE});
+    CL_ASSERT_NOT_NULL(allocator);
+
+    void *base = cl_mem_alloc(allocator, TEST_ALLOC_SIZE);
+    CL_ASSERT_NOT_NULL(base);
+
+    const cl_mem_marker_t marker = cl_mem_mark(allocator);
+    for (int i = 0; i < 10; i++)
+    {
+        CL_ASSERT_NOT_NULL(cl_mem_alloc(allocator, 64));
+    }
+    CL_ASSERT(cl_mem_rollback(allocator, marker));
+
+    // After the rollback the base allocation is on top again and can be popped
+    cl_mem_free(allocator, base);
+    CL_ASSERT(cl_mem_alloc(allocator, TEST_ALLOC_SIZE) == base);
+
+    // Markers are not supported by every allocator
+    CL_ASSERT(!cl_mem_rollback(test_allocator, marker));
+
+    cl_allocator_destroy(allocator);
+}
+
 CL_TEST_SUITE_BEGIN(PlatformMemoryTests)
 CL_TEST_SUITE_TEST(test_allocator_create_and_destroy)
 CL_TEST_SUITE_TEST(test_mem_alloc_and_free)
@@ -185,6 +1639,8 @@ CL_TEST_SUITE_TEST(test_mem_set)
 CL_TEST_SUITE_TEST(test_mem_copy)
 CL_TEST_SUITE_TEST(test_mem_move)
 CL_TEST_SUITE_TEST(test_mem_compare)
+CL_TEST_SUITE_TEST(test_mem_ops_kernels)
+CL_TEST_SUITE_TEST(test_mem_ops_sizes)
 CL_TEST_SUITE_END
 
 CL_TEST_SUITE_BEGIN(ArenaMemoryTests)
@@ -192,15 +1648,81 @@ CL_TEST_SUITE_TEST(test_arena_allocator_create_and_destroy)
 CL_TEST_SUITE_TEST(test_arena_allocator_alloc_and_free)
 CL_TEST_SUITE_TEST(test_arena_allocator_large_alloc)
 CL_TEST_SUITE_TEST(test_arena_allocator_realloc)
+CL_TEST_SUITE_TEST(test_arena_allocator_realloc_in_place)
+CL_TEST_SUITE_TEST(test_arena_allocator_reset)
+CL_TEST_SUITE_TEST(test_arena_allocator_reserved)
+CL_TEST_SUITE_TEST(test_arena_allocator_reserved_huge_pages)
+CL_TEST_SUITE_END
+
+CL_TEST_SUITE_BEGIN(PoolMemoryTests)
+CL_TEST_SUITE_TEST(test_pool_allocator_create_and_destroy)
+CL_TEST_SUITE_TEST(test_pool_allocator_alloc_and_reuse)
+CL_TEST_SUITE_TEST(test_pool_allocator_exhaustion)
+CL_TEST_SUITE_TEST(test_pool_allocator_growable)
+CL_TEST_SUITE_TEST(test_pool_allocator_churn)
+CL_TEST_SUITE_TEST(test_concurrent_pool_allocator_capacity)
+CL_TEST_SUITE_TEST(test_concurrent_pool_allocator_commit_failure)
+CL_TEST_SUITE_TEST(test_concurrent_pool_allocator_threads)
+CL_TEST_SUITE_END
+
+CL_TEST_SUITE_BEGIN(FreeListMemoryTests)
+CL_TEST_SUITE_TEST(test_freelist_allocator_create_and_destroy)
+CL_TEST_SUITE_TEST(test_freelist_allocator_coalescing)
+CL_TEST_SUITE_TEST(test_freelist_allocator_realloc)
+CL_TEST_SUITE_TEST(test_freelist_allocator_exhaustion_and_stress)
+CL_TEST_SUITE_END
+
+CL_TEST_SUITE_BEGIN(ProxyMemoryTests)
+CL_TEST_SUITE_TEST(test_proxy_allocator_alloc_and_realloc)
+CL_TEST_SUITE_TEST(test_proxy_allocator_over_pool)
+CL_TEST_SUITE_TEST(test_proxy_allocator_threads)
+CL_TEST_SUITE_TEST(test_tracking_allocator_stats)
+CL_TEST_SUITE_TEST(test_tracking_allocator_call_sites)
+CL_TEST_SUITE_END
+
+CL_TEST_SUITE_BEGIN(AlignedMemoryTests)
+CL_TEST_SUITE_TEST(test_aligned_alloc_every_allocator)
+CL_TEST_SUITE_TEST(test_aligned_alloc_pool)
+CL_TEST_SUITE_TEST(test_aligned_flag)
+CL_TEST_SUITE_TEST(test_aligned_alloc_arena_oversize)
+CL_TEST_SUITE_TEST(test_aligned_alloc_custom_allocator)
+CL_TEST_SUITE_END
+
+CL_TEST_SUITE_BEGIN(GuardMemoryTests)
+CL_TEST_SUITE_TEST(test_guard_allocator_sampling)
+CL_TEST_SUITE_TEST(test_guard_allocator_behind_arena)
+CL_TEST_SUITE_TEST(test_guard_allocator_aligned_realloc)
+CL_TEST_SUITE_TEST(test_guard_allocator_faults)
+CL_TEST_SUITE_END
+
+CL_TEST_SUITE_BEGIN(BatchMemoryTests)
+CL_TEST_SUITE_TEST(test_alloc_batch_every_allocator)
+CL_TEST_SUITE_TEST(test_alloc_batch_all_or_nothing)
+CL_TEST_SUITE_END
+
+CL_TEST_SUITE_BEGIN(ScratchMemoryTests)
+CL_TEST_SUITE_TEST(test_linear_allocator_alloc_and_rollback)
+CL_TEST_SUITE_TEST(test_linear_allocator_realloc)
+CL_TEST_SUITE_TEST(test_stack_allocator_lifo)
+CL_TEST_SUITE_TEST(test_stack_allocator_rollback)
 CL_TEST_SUITE_END
 
 
 int main()
 {
     test_allocator = cl_allocator_new(CL_ALLOCATOR_TYPE_PLATFORM, .flags = CL_ALLOCATOR_FLAG_NONE, .user_data = null);
+    arena_allocator = cl_allocator_new(CL_ALLOCATOR_TYPE_ARENA, .config.arena = {.size = 1024});
     CL_RUN_TEST_SUITE(PlatformMemoryTests);
     CL_RUN_TEST_SUITE(ArenaMemoryTests);
+    CL_RUN_TEST_SUITE(PoolMemoryTests);
+    CL_RUN_TEST_SUITE(FreeListMemoryTests);
+    CL_RUN_TEST_SUITE(ProxyMemoryTests);
+    CL_RUN_TEST_SUITE(ScratchMemoryTests);
+    CL_RUN_TEST_SUITE(AlignedMemoryTests);
+    CL_RUN_TEST_SUITE(GuardMemoryTests);
+    CL_RUN_TEST_SUITE(BatchMemoryTests);
     CL_RUN_ALL_TESTS();
+    cl_allocator_destroy(arena_allocator);
     cl_allocator_destroy(test_allocator);
     return 0;
 }
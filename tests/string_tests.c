@@ -148,6 +148,37 @@ CL_TEST(test_str_split)
     cl_allocator_destroy(allocator);
 }
 
+CL_TEST(test_str_split_many)
+{
+    cl_allocator_t *allocator = cl_allocator_new(CL_ALLOCATOR_TYPE_ARENA, .config.arena = {.size = 4096});
+    char buffer[1024];
+    u32 len = 0;
+
+    // More tokens than one allocation batch, with an empty one in the middle
+    for (u32 i = 0; i < 200; i++)
+        len += (u32)snprintf(buffer + len, sizeof(buffer) - len, i == 100 ? "," : "%u,", i % 10);
+    buffer[--len] = '\0';
+    str_view sv = str_view_create(buffer, len);
+    str *split = str_split(allocator, &sv, ',');
+    CL_ASSERT_NOT_NULL(split);
+    bool valid = true;
+    for (u32 i = 0; i < 200; i++)
+        valid &= i == 100 ? split[i].len == 0 && split[i].data[0] == '\0'
+                          : split[i].len == 1 && split[i].data[0] == (char)('0' + i % 10) && split[i].data[1] == '\0';
+    CL_ASSERT(valid);
+    CL_ASSERT_null(split[200].data);
+
+    // One long token among short ones is copied on its own rather than padding every token to its length
+    memset(buffer, 'x', 600);
+    memcpy(buffer + 600, ",a,b,c", 7);
+    sv = str_view_create(buffer, 606);
+    split = str_split(allocator, &sv, ',');
+    CL_ASSERT_EQUAL(split[0].len, 600);
+    CL_ASSERT_EQUAL(strcmp(split[3].data, "c"), 0);
+    CL_ASSERT_null(split[4].data);
+    cl_allocator_destroy(allocator);
+}
+
 CL_TEST(test_str_join)
 {
     cl_allocator_t *allocator =
@@ -222,6 +253,7 @@ CL_TEST_SUITE_TEST(test_str_lit)
 CL_TEST_SUITE_TEST(test_str_from_view)
 CL_TEST_SUITE_TEST(test_str_concat)
 CL_TEST_SUITE_TEST(test_str_split)
+CL_TEST_SUITE_TEST(test_str_split_many)
 CL_TEST_SUITE_TEST(test_str_join)
 CL_TEST_SUITE_TEST(test_str_as_view)
 CL_TEST_SUITE_TEST(test_str_clear)